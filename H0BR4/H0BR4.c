@@ -22,14 +22,345 @@
 #include "LSM6DS3.h"
 #include "LSM303AGR_ACC.h"
 #include "LSM303AGR_MAG.h"
+#include "H0BR4_dsp.h"
 
 #include <math.h>
 
 #define LSM303AGR_MAG_SENSITIVITY_FOR_FS_50G  1.5  /**< Sensitivity value for 16 gauss full scale [mgauss/LSB] */
 
-#define MIN_MEMS_PERIOD_MS				200
+#define LSM6DS3_IMU_OUT_LEN						14		// OUT_TEMP_L (0x20) to OUTZ_H_XL (0x2D)
+#define LSM6DS3_TIMESTAMP_LEN					3			// TIMESTAMP0_REG (0x40) to TIMESTAMP2_REG (0x42)
+
+/* Q16.16 conversion: scale constants are folded at compile time, no float at run time */
+#define Q24_SCALE(x)							((int32_t)((x) * 16777216.0 + 0.5))		// Engineering units per LSB in Q8.24
+#define LSM303AGR_MAG_SCALE_Q24		Q24_SCALE(LSM303AGR_MAG_SENSITIVITY_FOR_FS_50G / 1000)		// gauss/LSB
+#define CONV_BENCH_SAMPLES				16		// Conversions per benchmark run: stays within one SysTick period
+
+/* Sensor configuration words in EEPROM: table indices, bit 15 marks a stored configuration */
+#define MEMS_CONFIG_VALID					0x8000
+#define MEMS_CONFIG_FIELD(word, pos)		(((word) >> (pos)) & 0x0F)
+
+/* Module settings in spare bits of _EE_MEMS_GYRO_CONFIG, stored apart from its valid flag */
+#define MEMS_SETTING_I2C_SPEED_POS		8
+#define MEMS_SETTING_I2C_SPEED				(0x03 << MEMS_SETTING_I2C_SPEED_POS)		// memsI2CSpeedKHz index
+#define MEMS_SETTING_GYRO_BIAS_AUTO		(1U << 10)
+#define MEMS_SETTING_DUTY_CYCLED			(1U << 11)
+#define MEMS_SETTINGS									(MEMS_SETTING_I2C_SPEED | MEMS_SETTING_GYRO_BIAS_AUTO | MEMS_SETTING_DUTY_CYCLED)
+
+#define MIN_MEMS_PERIOD_MS				1
 #define MAX_MEMS_TIMEOUT_MS				0xFFFFFFFF
 
+/* Stream bandwidth estimation */
+#define UART_BITS_PER_BYTE				10		// 8N1 framing
+#define BOS_MSG_OVERHEAD					8			// Message header, addressing, code and CRC around the params
+#define I2C_BITS_PER_BYTE					9			// 8 data bits and ACK
+#define I2C_READ_OVERHEAD					3			// Device address (write), register address, device address (read)
+#define TEXT_SAMPLE_BYTES					50		// CLI text line of a sample with its sample time
+// Outputs, then the timestamp in a second read whose addressing is counted here
+#define LSM6DS3_SAMPLE_I2C_BYTES	(LSM6DS3_IMU_OUT_LEN + I2C_READ_OVERHEAD + LSM6DS3_TIMESTAMP_LEN)
+
+/* Stream job task stack in words. Deepest job: a statistics stream to another module, about 650 bytes 
+	 by gcc -fstack-usage (host build, an upper bound of the Thumb frames), plus the BOS message send. 
+	 The magnetometer calibration, its normal equations included, takes about 600 bytes */
+#define STREAM_JOB_STACK_WORDS		224
+
+/* Acquisition task notification bits */
+#define MEMS_EVT_ACC							(1UL << 0)		// IMU_INT1: LSM6DS3 accelerometer data-ready
+#define MEMS_EVT_GYRO							(1UL << 1)		// IMU_INT2: LSM6DS3 gyroscope data-ready
+#define MEMS_EVT_MAG							(1UL << 2)		// MAG_INT: LSM303AGR magnetometer data-ready
+#define MEMS_EVT_FIFO							(1UL << 3)		// IMU_INT1: LSM6DS3 FIFO threshold reached
+#define MEMS_EVT_MOTION						(1UL << 4)		// IMU_INT1/2: LSM6DS3 embedded motion function
+#define MEMS_EVT_ALL							(MEMS_EVT_ACC | MEMS_EVT_GYRO | MEMS_EVT_MAG | MEMS_EVT_FIFO | MEMS_EVT_MOTION)
+
+#define MEMS_DRDY_WATCHDOG_MS			500		// Data-ready lines are latched until read: re-read if an edge was missed
+#define MEMS_LOCK_TIMEOUT_MS			2000	// Longest sensor ownership: a 512-sample spectrum capture at 416 Hz
+#define MEMS_HEAP_RESERVE					512		// FreeRTOS heap left to the kernel and BOS by module buffers
+#define MESSAGE_PARAMS_TIMEOUT_MS	100		// Wait for another task's message to another module
+
+/* LSM6DS3 embedded motion functions (datasheet register map) */
+#define LSM6DS3_INT1_CTRL_REG			0x0D
+#define LSM6DS3_CTRL10_C_REG			0x19
+#define LSM6DS3_WAKE_UP_SRC_REG		0x1B		// WAKE_UP_SRC, TAP_SRC, D6D_SRC
+#define LSM6DS3_FUNC_SRC_REG			0x53
+#define LSM6DS3_TAP_CFG_REG				0x58
+#define LSM6DS3_TAP_THS_6D_REG		0x59		// TAP_THS_6D, INT_DUR2, WAKE_UP_THS, WAKE_UP_DUR, FREE_FALL, MD1_CFG, MD2_CFG
+#define INT1_CTRL_SIGN_MOT				0x40
+#define CTRL10_FUNC_EN						0x04
+#define CTRL10_SIGN_MOTION_EN			0x01
+#define TAP_CFG_TIMER_EN					0x80
+#define TAP_CFG_PEDO_EN						0x40
+#define TAP_CFG_TILT_EN						0x20
+#define TAP_CFG_TAP_XYZ_EN				0x0E
+#define TAP_CFG_LIR								0x01
+#define TAP_CFG_MOTION_MASK				(TAP_CFG_TIMER_EN | TAP_CFG_PEDO_EN | TAP_CFG_TILT_EN | TAP_CFG_TAP_XYZ_EN | TAP_CFG_LIR)
+#define SIXD_THS_60_DEG						0x40
+#define INT_DUR2_SINGLE_TAP				0x06
+#define INT_DUR2_DOUBLE_TAP				0x7F
+#define WAKE_UP_THS_DOUBLE_TAP		0x80
+#define FREE_FALL_DUR							(6 << 3)	// Samples below the threshold
+#define MD_CFG_SINGLE_TAP					0x40
+#define MD_CFG_WU									0x20
+#define MD_CFG_FF									0x10
+#define MD_CFG_DOUBLE_TAP					0x08
+#define MD_CFG_6D									0x04
+#define MD_CFG_TILT								0x02
+#define WAKE_UP_SRC_FF_IA					0x20
+#define WAKE_UP_SRC_WU_IA					0x08
+#define TAP_SRC_SINGLE_TAP				0x20
+#define TAP_SRC_DOUBLE_TAP				0x10
+#define TAP_SRC_DIRECTION					0x0F		// Sign, X, Y, Z
+#define D6D_SRC_D6D_IA						0x40
+#define D6D_SRC_ORIENTATION				0x3F		// ZH, ZL, YH, YL, XH, XL
+#define FUNC_SRC_SIGN_MOTION_IA		0x40
+#define FUNC_SRC_TILT_IA					0x20
+#define FUNC_SRC_STEP_DETECTED		0x10
+
+/* LSM6DS3 pedometer */
+#define LSM6DS3_FUNC_CFG_ACCESS_REG	0x01
+#define FUNC_CFG_EN								0x80		// Embedded functions register bank
+#define LSM6DS3_PEDO_DEB_REG			0x14		// Embedded functions bank
+#define PEDO_DEB_TIME							(13 << 3)	// 1040 ms in 80 ms steps (reset value)
+#define PEDO_DEB_STEP_MAX					7
+#define LSM6DS3_STEP_COUNTER_REG	0x4B		// STEP_COUNTER_L, STEP_COUNTER_H
+#define CTRL10_PEDO_RST_STEP			0x02
+#define INT1_CTRL_STEP_DETECTOR		0x80
+
+/* LSM6DS3 timestamp */
+#define LSM6DS3_TIMESTAMP0_REG		0x40		// TIMESTAMP0 to TIMESTAMP2: 24-bit counter
+#define LSM6DS3_WAKE_UP_DUR_REG		0x5C
+#define WAKE_UP_DUR_TIMER_HR			0x10		// 25 us per LSB instead of 6.4 ms
+#define IMU_TIMESTAMP_US					25
+#define IMU_TIMESTAMP_MASK				0xFFFFFFUL
+#define IMU_TIMESTAMP_REORDER			0x10000UL		// Counts a read may trail the last one (1.6 s)
+#define MEMS_SAMPLE_TIME_SLOTS		8				// Tasks tracked for the time of their last sample
+#define MEMS_TIMESTAMP_BYTES			sizeof(uint32_t)		// Sample time leading each port record
+
+/* Duty-cycled power mode: sensors of a sample and their wake-up time */
+#define MEMS_SENSOR_GYRO					(1U << 0)
+#define MEMS_SENSOR_ACC						(1U << 1)
+#define MEMS_SENSOR_MAG						(1U << 2)
+#define GYRO_TURN_ON_MS						80		// LSM6DS3 gyroscope turn-on time from power-down
+#define ACC_SETTLE_SAMPLES				2			// First accelerometer output after power-down is discarded
+
+/* LSM6DS3 FIFO */
+#define FIFO_MAX_WORDS						(H0BR4_FIFO_MAX_SAMPLES * 3)		// 16-bit words drained in one burst
+#define FIFO_MAX_PATTERN					48			// Data sets in one FIFO pattern (worst case 35 for decimations 3 and 32)
+#define FIFO_SET_GYRO							0
+#define FIFO_SET_ACC							1
+
+/* On-device filters */
+#define FILTER_FIR_TAPS						(H0BR4_FILTER_MAX_LEN - 1)		// Odd: linear phase around the center tap
+#define FILTER_MAX_CUTOFF(hz)			((hz) * 0.45f)			// Cutoffs are clamped below Nyquist
+#define FILTER_TWO_PI							6.2831853f
+
+/* Vibration spectrum */
+#define FFT_MIN_SIZE							64
+#define FFT_SETTLE_SAMPLES				4				// Outputs discarded after the accelerometer ODR switch
+#define FFT_RECORD_MAX_BYTES			(MEMS_TIMESTAMP_BYTES + 1 + 2 + 2 * H0BR4_FFT_BINS_PER_RECORD)
+
+/* Orientation fusion (Mahony filter). Unit vectors and quaternion components are Q2.29 */
+#define Q29_ONE										(1L << 29)
+#define Q29_HALF									(1L << 28)
+#define Q29(x)										((int32_t)((x) * 536870912.0 + 0.5))
+#define DEG_TO_RAD_Q29						Q29(0.0174532925199433)
+#define FUSION_TWO_KP							Q29(2 * 0.5)		// Proportional gain on the accelerometer and magnetometer error
+#define FUSION_TWO_KI							Q29(2 * 0.01)		// Integral gain: removes the slow gyro bias
+#define FUSION_DEFAULT_RATE_HZ		50
+#define FUSION_MAX_RATE_HZ				200
+
+/* Compass heading */
+#define CORDIC_ITERATIONS					16
+#define CORDIC_INPUT_MAX					(1L << 29)		// Leaves headroom for the CORDIC gain (1.65)
+#define MAX_DECLINATION_DECIDEG		1800
+
+/* Magnetometer calibration: ellipsoid fit on samples scaled to about 0.5 (Earth field is about 350 LSB) */
+#define MAG_CAL_SCALE							1024.0f
+#define MAG_CAL_PARAMS						9				// x2, y2, z2, 2xy, 2xz, 2yz, 2x, 2y, 2z
+#define MAG_CAL_MIN_SAMPLES				100
+#define MAG_CAL_SAMPLE_PERIOD_MS	20			// 50 Hz magnetometer ODR while collecting
+#define MAG_CAL_MAX_AXIS_RATIO		3.0f		// Longest to shortest ellipsoid axis: beyond, rotation coverage was too poor
+#define MAG_CAL_Q14_MAX						(2.0f - 1.0f / 16384)
+#define MAG_CAL_PACKED						(MAG_CAL_PARAMS * (MAG_CAL_PARAMS + 1) / 2)
+#define MAG_CAL_IDX(i, j)					((i) * ((i) + 1) / 2 + (j))		// Row i >= column j of the packed lower triangle
+#define NEWTON_ITERATIONS					4
+#define JACOBI_SWEEPS							10
+
+/* Gyroscope bias estimation at rest, one bias per temperature bin */
+#define GYRO_BIAS_PERIOD_MS				40			// 25 samples per second while learning
+#define GYRO_BIAS_WINDOW					50			// Samples per stationarity decision, compared half against half
+#define GYRO_BIAS_TRACK_MS				1000		// Temperature follow-up between learning windows
+#define GYRO_BIAS_LEARN_INTERVAL_MS	10000	// Start of one learning window to the next
+#define GYRO_BIAS_BINS						16
+#define GYRO_BIAS_TEMP_MIN				-10			// Celsius, lower edge of the first bin
+#define GYRO_BIAS_TEMP_STEP				5				// Celsius per bin
+#define GYRO_BIAS_NO_BIN					0xFF
+#define GYRO_STILL_STD_MDPS				250.0f	// Gyro noise is about 20 mdps rms at rest
+#define ACC_STILL_STD_MG					10.0f
+#define GYRO_STILL_DRIFT_MDPS			100.0f	// Half-window mean change: a changing rate is not a bias
+#define ACC_STILL_DRIFT_MG				3.0f		// Half-window mean change: gravity moves 17 mg/s per dps about a horizontal axis
+#define GYRO_BIAS_MAX_MDPS				10000		// Larger offsets are a slow rotation, not a bias
+#define GYRO_BIAS_STEP_MDPS				500			// Largest change of a learned bin per window: slow yaw passes the acc gate
+#define GYRO_BIAS_SAVE_MDPS				50			// Minimum change worth an EEPROM write
+#define GYRO_BIAS_SAVE_INTERVAL_MS	60000	// Limits EEPROM wear
+
+
+/* Sensor configuration tables */
+typedef struct
+{
+	uint16_t hz;
+	uint8_t reg;
+} MemsOdr_t;
+
+/* Sensors whose ODR streams raise. A stream holds the raised ODR, the configured ODR comes back when 
+		the last holder ends */
+typedef enum
+{
+	MEMS_ODR_GYRO = 0,
+	MEMS_ODR_ACC,
+	MEMS_ODR_ACC2,
+	MEMS_ODR_MAG,
+	MEMS_ODR_SENSORS
+} MemsOdrSensor_t;
+
+typedef struct
+{
+	const MemsOdr_t *table;
+	uint8_t size;
+	uint8_t *idx;
+	Module_Status (*apply)(void);
+} MemsOdrSource_t;
+
+/* Per-sample cost of a stream */
+typedef struct
+{
+	uint8_t portBytes;				// Payload sent to a port per sample
+	uint8_t i2cBytes;					// Bytes read per sample in polling mode, and the addressing of reads after the first
+	uint16_t maxOdrHz;				// Fastest sensor output data rate
+	uint8_t sensors;					// MEMS_SENSOR_* woken per sample in duty-cycled mode
+} MemsStreamInfo_t;
+
+static const MemsStreamInfo_t gyroStreamInfo = { 3 * sizeof(float), LSM6DS3_SAMPLE_I2C_BYTES, 1660, MEMS_SENSOR_GYRO };
+static const MemsStreamInfo_t accStreamInfo = { 3 * sizeof(float), LSM6DS3_SAMPLE_I2C_BYTES, 6660, MEMS_SENSOR_ACC };
+static const MemsStreamInfo_t acc2StreamInfo = { 3 * sizeof(float), 6, 400, 0 };
+static const MemsStreamInfo_t magStreamInfo = { 3 * sizeof(float), 6, 100, MEMS_SENSOR_MAG };
+static const MemsStreamInfo_t tempStreamInfo = { sizeof(float), LSM6DS3_SAMPLE_I2C_BYTES, 52, MEMS_SENSOR_ACC };
+// Orientation is read from the fusion task: no sensor access per sample
+static const MemsStreamInfo_t quatStreamInfo = { 4 * sizeof(float), 0, FUSION_MAX_RATE_HZ, 0 };
+static const MemsStreamInfo_t eulerStreamInfo = { 3 * sizeof(float), 0, FUSION_MAX_RATE_HZ, 0 };
+static const MemsStreamInfo_t headingStreamInfo = { sizeof(float), LSM6DS3_SAMPLE_I2C_BYTES + I2C_READ_OVERHEAD + 6, 100, MEMS_SENSOR_ACC | MEMS_SENSOR_MAG };
+// The pedometer runs on the accelerometer at 26 Hz
+static const MemsStreamInfo_t stepsStreamInfo = { sizeof(uint32_t), 2, 26, MEMS_SENSOR_ACC };
+
+/* atan(2^-i) in Q16.16 degrees */
+static const int32_t cordicAtanTable[CORDIC_ITERATIONS] =
+{
+	2949120, 1740967, 919879, 466945, 234379, 117304, 58666, 29335,
+	14668, 7334, 3667, 1833, 917, 458, 229, 115
+};
+
+typedef struct
+{
+	uint16_t range;
+	uint8_t reg;
+	float sensitivity;				// mdps/LSB or mg/LSB
+	int32_t scaleQ24;					// dps/LSB or g/LSB in Q8.24
+} MemsFullScale_t;
+
+static const MemsOdr_t gyroOdrTable[] =
+{
+	{ 13, LSM6DS3_ACC_GYRO_ODR_G_13Hz }, { 26, LSM6DS3_ACC_GYRO_ODR_G_26Hz }, 
+	{ 52, LSM6DS3_ACC_GYRO_ODR_G_52Hz }, { 104, LSM6DS3_ACC_GYRO_ODR_G_104Hz }, 
+	{ 208, LSM6DS3_ACC_GYRO_ODR_G_208Hz }, { 416, LSM6DS3_ACC_GYRO_ODR_G_416Hz }, 
+	{ 833, LSM6DS3_ACC_GYRO_ODR_G_833Hz }, { 1660, LSM6DS3_ACC_GYRO_ODR_G_1660Hz },
+};
+
+// 125 dps is selected by the separate FS_125 bit
+static const MemsFullScale_t gyroFsTable[] =
+{
+	{ 125, LSM6DS3_ACC_GYRO_FS_G_245dps, 4.375, Q24_SCALE(0.004375) }, 
+	{ 245, LSM6DS3_ACC_GYRO_FS_G_245dps, 8.75, Q24_SCALE(0.00875) }, 
+	{ 500, LSM6DS3_ACC_GYRO_FS_G_500dps, 17.5, Q24_SCALE(0.0175) }, 
+	{ 1000, LSM6DS3_ACC_GYRO_FS_G_1000dps, 35.0, Q24_SCALE(0.035) }, 
+	{ 2000, LSM6DS3_ACC_GYRO_FS_G_2000dps, 70.0, Q24_SCALE(0.070) },
+};
+
+static const MemsOdr_t accOdrTable[] =
+{
+	{ 13, LSM6DS3_ACC_GYRO_ODR_XL_13Hz }, { 26, LSM6DS3_ACC_GYRO_ODR_XL_26Hz }, 
+	{ 52, LSM6DS3_ACC_GYRO_ODR_XL_52Hz }, { 104, LSM6DS3_ACC_GYRO_ODR_XL_104Hz }, 
+	{ 208, LSM6DS3_ACC_GYRO_ODR_XL_208Hz }, { 416, LSM6DS3_ACC_GYRO_ODR_XL_416Hz }, 
+	{ 833, LSM6DS3_ACC_GYRO_ODR_XL_833Hz }, { 1660, LSM6DS3_ACC_GYRO_ODR_XL_1660Hz }, 
+	{ 3330, LSM6DS3_ACC_GYRO_ODR_XL_3330Hz }, { 6660, LSM6DS3_ACC_GYRO_ODR_XL_6660Hz },
+};
+
+static const MemsFullScale_t accFsTable[] =
+{
+	{ 2, LSM6DS3_ACC_GYRO_FS_XL_2g, 0.061, Q24_SCALE(0.000061) }, 
+	{ 4, LSM6DS3_ACC_GYRO_FS_XL_4g, 0.122, Q24_SCALE(0.000122) }, 
+	{ 8, LSM6DS3_ACC_GYRO_FS_XL_8g, 0.244, Q24_SCALE(0.000244) }, 
+	{ 16, LSM6DS3_ACC_GYRO_FS_XL_16g, 0.488, Q24_SCALE(0.000488) },
+};
+
+// Anti-aliasing filter bandwidth
+static const MemsOdr_t accBwTable[] =
+{
+	{ 50, LSM6DS3_ACC_GYRO_BW_XL_50Hz }, { 100, LSM6DS3_ACC_GYRO_BW_XL_100Hz }, 
+	{ 200, LSM6DS3_ACC_GYRO_BW_XL_200Hz }, { 400, LSM6DS3_ACC_GYRO_BW_XL_400Hz },
+};
+
+// FIFO ODR code of each sensor ODR (labelled 10 Hz to 6.6 kHz)
+static const MemsOdr_t fifoOdrTable[] =
+{
+	{ 13, LSM6DS3_ACC_GYRO_ODR_FIFO_10Hz }, { 26, LSM6DS3_ACC_GYRO_ODR_FIFO_25Hz }, 
+	{ 52, LSM6DS3_ACC_GYRO_ODR_FIFO_50Hz }, { 104, LSM6DS3_ACC_GYRO_ODR_FIFO_100Hz }, 
+	{ 208, LSM6DS3_ACC_GYRO_ODR_FIFO_200Hz }, { 416, LSM6DS3_ACC_GYRO_ODR_FIFO_400Hz }, 
+	{ 833, LSM6DS3_ACC_GYRO_ODR_FIFO_800Hz }, { 1660, LSM6DS3_ACC_GYRO_ODR_FIFO_1600Hz }, 
+	{ 3330, LSM6DS3_ACC_GYRO_ODR_FIFO_3300Hz }, { 6660, LSM6DS3_ACC_GYRO_ODR_FIFO_6600Hz },
+};
+
+#if H0BR4_ENABLE_FFT
+// Vibration spectrum capture rates
+static const MemsOdr_t fftOdrTable[] =
+{
+	{ 416, LSM6DS3_ACC_GYRO_ODR_XL_416Hz }, { 833, LSM6DS3_ACC_GYRO_ODR_XL_833Hz }, 
+	{ 1660, LSM6DS3_ACC_GYRO_ODR_XL_1660Hz }, { 3330, LSM6DS3_ACC_GYRO_ODR_XL_3330Hz }, 
+	{ 6660, LSM6DS3_ACC_GYRO_ODR_XL_6660Hz },
+};
+#endif
+
+static const MemsOdr_t magOdrTable[] =
+{
+	{ 10, LSM303AGR_MAG_ODR_10Hz }, { 20, LSM303AGR_MAG_ODR_20Hz }, 
+	{ 50, LSM303AGR_MAG_ODR_50Hz }, { 100, LSM303AGR_MAG_ODR_100Hz },
+};
+
+static const MemsOdr_t acc2OdrTable[] =
+{
+	{ 1, LSM303AGR_ACC_ODR_DO_1Hz }, { 10, LSM303AGR_ACC_ODR_DO_10Hz }, 
+	{ 25, LSM303AGR_ACC_ODR_DO_25Hz }, { 50, LSM303AGR_ACC_ODR_DO_50Hz }, 
+	{ 100, LSM303AGR_ACC_ODR_DO_100Hz }, { 200, LSM303AGR_ACC_ODR_DO_200Hz }, 
+	{ 400, LSM303AGR_ACC_ODR_DO_400Hz },
+};
+
+// High resolution sensitivity. Normal mode LSB is 4 times larger, low-power mode LSB 16 times
+static const MemsFullScale_t acc2FsTable[] =
+{
+	{ 2, LSM303AGR_ACC_FS_2G, 0.98, Q24_SCALE(0.00098) }, 
+	{ 4, LSM303AGR_ACC_FS_4G, 1.95, Q24_SCALE(0.00195) }, 
+	{ 8, LSM303AGR_ACC_FS_8G, 3.9, Q24_SCALE(0.0039) }, 
+	{ 16, LSM303AGR_ACC_FS_16G, 11.72, Q24_SCALE(0.01172) },
+};
+
+// Left-justified output shift per operating mode
+static const uint8_t acc2ModeShift[] = { 0, 8, 6, 4 };
+
+// Free-fall thresholds selected by FF_THS
+static const uint16_t freeFallThsMG[] = { 156, 219, 250, 312, 344, 406, 469, 500 };
+
+// MEMS I2C bus speeds in kHz. Index 0 is the default, so an erased setting selects Standard mode
+static const uint16_t memsI2CSpeedKHz[] = { MEMS_I2C_DEFAULT_KHZ, 400, 1000 };
+
+#define TABLE_SIZE(table)					(sizeof(table) / sizeof(table[0]))
 
 /* Define UART variables */
 UART_HandleTypeDef huart1;
@@ -50,6 +381,8 @@ int H0BR4_magX=0.0f;
 int H0BR4_magY=0.0f;
 int H0BR4_magZ=0.0f;
 float H0BR4_temp=0.0f;
+uint32_t H0BR4_steps=0;
+uint32_t H0BR4_time=0;
 
 module_param_t modParam[NUM_MODULE_PARAMS] = {{.paramPtr=&H0BR4_gyroX, .paramFormat=FMT_FLOAT, .paramName="gyroX"},
 {.paramPtr=&H0BR4_gyroY, .paramFormat=FMT_FLOAT, .paramName="gyroY"},
@@ -61,20 +394,279 @@ module_param_t modParam[NUM_MODULE_PARAMS] = {{.paramPtr=&H0BR4_gyroX, .paramFor
 {.paramPtr=&H0BR4_magY, .paramFormat=FMT_INT32, .paramName="magY"},
 {.paramPtr=&H0BR4_magZ, .paramFormat=FMT_INT32, .paramName="magZ"},
 {.paramPtr=&H0BR4_temp, .paramFormat=FMT_FLOAT, .paramName="temp"},
+{.paramPtr=&H0BR4_steps, .paramFormat=FMT_UINT32, .paramName="steps"},
+{.paramPtr=&H0BR4_time, .paramFormat=FMT_UINT32, .paramName="time"},
 };
 
 typedef Module_Status (*SampleMemsToPort)(uint8_t, uint8_t);
 typedef Module_Status (*SampleMemsToString)(char *, size_t);
 typedef Module_Status (*SampleMemsToBuffer)(float *buffer);
 
+/* Latest samples read by the acquisition task: unfiltered, or the filter outputs */
+typedef struct
+{
+	int16_t temp;
+	int16_t gyro[3];
+	int16_t acc[3];
+	int16_t mag[3];
+	uint32_t gyroCount;
+	uint32_t accCount;
+	uint32_t magCount;
+	uint32_t imuTime;					// Sensor time in us of the gyro, acc and temp samples
+	uint32_t magTime;
+} MemsSampleCache_t;
+
+/* On-device filter state of one axis */
+typedef struct
+{
+	int16_t hist[H0BR4_FILTER_MAX_LEN];		// Last inputs: moving average and FIR
+	int16_t x[2];													// Last two inputs: biquad
+	int32_t y[2];													// Last two outputs: biquad in Q8, IIR1 low-pass in Q16
+	int32_t sum;													// Moving average
+} MemsFilterAxis_t;
+
+/* Filter settings, written by the APIs and picked up by the acquisition task */
+typedef struct
+{
+	MemsFilterType_t type;
+	uint16_t param;							// Cutoff in Hz or moving average length
+	uint8_t decimation;
+} MemsFilterConfig_t;
+
+/* Filter of a 3-axis channel, run by the acquisition task */
+typedef struct
+{
+	MemsFilterConfig_t config;
+	bool redesign;							// Set by the APIs when config changes
+	bool primed;								// State initialized from the first input
+	uint16_t designHz;					// Input rate of the coefficients
+	uint8_t pos;								// Position of the newest input in hist
+	uint8_t phase;							// Inputs since the last output
+	int32_t coef[5];						// Biquad b0 b1 b2 a1 a2 in Q30, IIR1 alpha in Q16
+	int16_t taps[FILTER_FIR_TAPS];	// Q15
+	MemsFilterAxis_t axis[3];
+} MemsFilter_t;
+
+/* Float sample of a stream sensor and its output forms: the one description behind the ToString APIs, 
+		change-reported streams and stream slots */
+typedef struct
+{
+	SampleMemsToBuffer sample;
+	uint8_t count;
+	bool counter;													// values[0] holds the bits of a uint32_t count
+	float q16Scale;												// Q16.16 units per sample unit, 0: no Q16 form
+	const char *format;										// CLI text of a sample
+	const MemsStreamInfo_t *info;					// NULL: the selected acc channel
+} MemsSensorSource_t;
+
+/* Change-triggered reporting state of a running stream */
+typedef struct
+{
+	const MemsSensorSource_t *source;			// NULL: every sample is sent
+	MemsReportConfig_t config;
+	float last[3];												// Last reported values
+	TickType_t lastTick;
+	bool started;
+	bool changing;												// Last sample moved: the deadband is reduced by the hysteresis
+} MemsReportStream_t;
+
+/* Stream slot request and run state. The flags are shared with the APIs under a critical section, 
+		the run state belongs to the stream scheduler task */
+typedef struct
+{
+	MemsStreamSlot_t config;
+	bool reserved;												// Start queued to the scheduler
+	bool active;
+	Module_Status status;									// What ended the slot
+	uint8_t odrHeld;											// Sensor ODRs raised for the slot, given back when it ends
+	TickType_t start;
+	TickType_t next;											// Next deadline
+	MemsReportStream_t report;
+} MemsSlotState_t;
+
+/* Window statistics, spectrum stream or magnetometer calibration, queued to the stream job task */
+typedef enum
+{
+	MEMS_JOB_STATS = 0,
+	MEMS_JOB_SPECTRUM,
+	MEMS_JOB_MAG_CAL,
+} MemsJobKind_t;
+
+typedef struct
+{
+	MemsJobKind_t kind;
+	uint8_t port;
+	uint8_t module;
+	uint8_t channel;											// Stats channel or spectrum axis
+	uint16_t samples;											// Stats window samples or spectrum size
+	uint16_t sampleHz;										// Spectrum only
+	MemsFftWindow_t window;
+	uint32_t period;											// Stats window ms, spectrum period or calibration time
+	uint32_t timeout;
+} MemsStreamJob_t;
+
+/* Magnetometer calibration normal equations, accumulated one sample at a time on the caller's stack */
+typedef struct
+{
+	float ata[MAG_CAL_PACKED];						// Symmetric matrix: lower triangle, row by row
+	float atb[MAG_CAL_PARAMS];
+	uint32_t samples;
+} MagCalState_t;
+
+/* Window accumulators of a 3-axis channel in its integer API units (mdps, mg or mGauss). Sums are 
+		taken around the first sample to keep them small, and are exact: no rounding builds up. */
+typedef struct
+{
+	uint32_t count;
+	int32_t ref[3];
+	int32_t min[3];
+	int32_t max[3];
+	int64_t sum[3];						// Of x - ref
+	uint64_t sumSq[3];				// Of (x - ref)^2
+} MemsStatsAcc_t;
+
+/* Time of the last sample read by a task */
+typedef struct
+{
+	TaskHandle_t task;
+	uint32_t timeUs;
+} MemsSampleTime_t;
+
 /* Private variables ---------------------------------------------------------*/
 static bool stopStream = false;
+static uint32_t streamMaxRateHz = 0;			// Highest sustainable rate of the last rejected stream request
+
+static MemsAcqMode_t acqMode = MEMS_ACQ_POLLING;
+static MemsPowerMode_t powerMode = MEMS_POWER_CONTINUOUS;
+static uint8_t dutyGyroUsers = 0;						// Samplers holding the gyro powered up in duty-cycled mode
+static uint8_t dutyAccUsers = 0;
+static TickType_t dutyGyroReady = 0;				// Tick of the first valid output after the power-up
+static TickType_t dutyAccReady = 0;
+static TaskHandle_t MemsAcqTaskHandle = NULL;
+static SemaphoreHandle_t MemsLockHandle = NULL;				// Sensor ownership, see MemsLock
+static TaskHandle_t memsLockOwner = NULL;
+static uint8_t memsLockDepth = 0;
+static SemaphoreHandle_t MessageParamsMutexHandle = NULL;		// BOS messages go out of the global messageParams
+static MemsSampleCache_t memsCache;						// Unfiltered: fusion, gyro bias and calibration
+static MemsSampleCache_t memsOutput;					// Filter outputs: Sample, Stream and report APIs
+
+static uint16_t fifoWatermark = 32;						// Data sets (3 words each)
+static uint8_t fifoGyroDecimation = 8;				// Gyro at 13 Hz against the 104 Hz accelerometer
+static uint8_t fifoAccDecimation = 1;
+static uint8_t fifoPattern[FIFO_MAX_PATTERN];	// Sensor of each data set in the FIFO pattern
+static uint8_t fifoPatternLen = 0;
+static uint8_t fifoRaw[FIFO_MAX_WORDS * 2];
+static MemsFifoBatch_t fifoBatch;
+
+static MemsFilterConfig_t filterConfig[3] = { { MEMS_FILTER_NONE, 0, 1 }, { MEMS_FILTER_NONE, 0, 1 }, { MEMS_FILTER_NONE, 0, 1 } };
+static MemsFilter_t memsFilters[3];
+
+static MemsReportConfig_t reportConfig[MEMS_REPORT_NONE];
+static bool reportEnabled[MEMS_REPORT_NONE];
+// Deadband units in EEPROM and messages per stream unit: mdps, mg, mGauss and milli-Celsius
+static const uint16_t reportDeadbandScale[MEMS_REPORT_NONE] = { 1000, 1000, 1, 1000 };
+
+#if H0BR4_ENABLE_SLOTS
+static MemsSlotState_t streamSlots[H0BR4_STREAM_SLOTS];
+#endif
+
+/* Timing counters: one per slot, then the tasks calling the stream APIs and the stream job task */
+typedef struct
+{
+	uint32_t samples;
+	uint32_t missed;
+	int32_t jitterMinUs;
+	int32_t jitterMaxUs;
+	int64_t jitterSumUs;
+} MemsStreamTimingAcc_t;
+
+static MemsStreamTimingAcc_t streamTiming[H0BR4_STREAM_TIMING_JOB + 1];
+static TaskHandle_t streamTimingTask[H0BR4_STREAM_TIMING_CALLERS];		// Owner of each API entry
+static TickType_t streamTimingClaimed[H0BR4_STREAM_TIMING_CALLERS];
+
+/* Sensor configuration: indices into the configuration tables. Defaults match the former fixed setup */
+static uint8_t gyroOdrIdx = 0;				// 13 Hz
+static uint8_t gyroFsIdx = 4;					// 2000 dps
+static uint8_t accOdrIdx = 3;					// 104 Hz
+static uint8_t accFsIdx = 3;					// 16 g
+static uint8_t accBwIdx = 0;					// 50 Hz
+static uint8_t magOdrIdx = 0;					// 10 Hz
+static float gyroSensitivity = 70.0;	// mdps/LSB
+static float accSensitivity = 0.488;	// mg/LSB
+static int32_t gyroScaleQ24 = Q24_SCALE(0.070);			// dps/LSB
+static int32_t accScaleQ24 = Q24_SCALE(0.000488);		// g/LSB
+static Lsm303AccMode_t acc2Mode = LSM303_ACC_POWER_DOWN;
+static uint8_t acc2OdrIdx = 1;				// 10 Hz
+static uint8_t acc2FsIdx = 0;					// 2 g
+static float acc2Sensitivity = 3.9;		// mg/LSB
+static int32_t acc2ScaleQ24 = Q24_SCALE(0.0039);		// g/LSB
+static MemsAccChannel_t accChannel = MEMS_ACC_LSM6DS3;
+static uint8_t odrHolds[MEMS_ODR_SENSORS];			// Streams running on a raised ODR
+static uint8_t odrBaseIdx[MEMS_ODR_SENSORS];		// Configured ODR while held
+static uint16_t accCrossCheckMG = 0;									// Largest allowed difference between the two accelerometers, 0: off
+static uint32_t accMismatches = 0;
+
+/* LSM6DS3 embedded motion events */
+static uint8_t motionEvents = 0;							// MEMS_MOTION_* enabled
+static uint8_t motionLine = 1;								// IMU_INT line of the events
+static uint16_t motionWakeUpMG = 125;
+static uint16_t motionFreeFallMG = 312;
+static uint16_t motionTapMG = 750;
+static uint8_t motionModule = 0;							// Destination of event reports, 0: none
+static uint8_t motionPort = 0;
+static uint32_t motionEventCount = 0;
+static uint8_t lastMotionEvents = 0;
+
+/* LSM6DS3 pedometer */
+static bool pedoEnabled = false;
+static uint8_t pedoDebounceSteps = 6;				// Steps before counting starts (reset value)
+static uint32_t stepCount = 0;							// STEP_COUNTER extended past 16 bits
+static uint16_t lastStepCounter = 0;
+
+/* Sensor timeline: the LSM6DS3 timestamp counter extended to 64 bits, in us since MCU reset */
+static uint64_t memsTimeUs = 0;
+static uint32_t memsTimeRaw = 0;						// Counter at memsTimeUs
+static uint32_t memsTimeTick = 0;						// HAL_GetTick() at memsTimeUs
+static bool memsTimeSynced = false;
+static MemsSampleTime_t sampleTimes[MEMS_SAMPLE_TIME_SLOTS];
+static uint8_t sampleTimeEvict = 0;
+static uint32_t fusionTime = 0;							// Sensor time of the IMU sample last fused
+static int16_t magDeclination = 0;										// Tenths of a degree, east positive
+static MagCalibration_t magCal;
+static bool magCalValid = false;
+static volatile Module_Status magCalStatus = H0BR4_OK;	// Last calibration result, H0BR4_ERR_BUSY while collecting
+
+/* Gyroscope bias table in mdps, indexed by temperature bin */
+static TaskHandle_t GyroBiasTaskHandle = NULL;
+static bool gyroBiasAuto = false;
+static int16_t gyroBiasTable[GYRO_BIAS_BINS][3];
+static uint16_t gyroBiasFilled = 0;					// One bit per bin holding a bias
+static uint16_t gyroBiasUnsaved = 0;				// One bit per bin learned but not yet in EEPROM
+static uint8_t gyroBiasBin = GYRO_BIAS_NO_BIN;		// Bin of the current temperature
+static int16_t gyroBiasRaw[3];								// Bias applied to the samples, LSB at the current full scale
+
+/* Orientation fusion state */
+static TaskHandle_t FusionTaskHandle = NULL;
+#if H0BR4_ENABLE_SLOTS
+static TaskHandle_t StreamSlotTaskHandle = NULL;
+static QueueHandle_t slotRequestQueue = NULL;
+#endif
+static TaskHandle_t StreamJobTaskHandle = NULL;
+static QueueHandle_t streamJobQueue = NULL;
+static volatile bool streamJobActive = false;
+static volatile bool fusionRunning = false;
+static uint8_t fusionOdrHeld = 0;
+static uint32_t fusionPeriodMs = 1000 / FUSION_DEFAULT_RATE_HZ;
+static int32_t fusionQ[4] = { Q29_ONE, 0, 0, 0 };		// w, x, y, z in Q2.29
+static int32_t fusionIntegral[3];										// Integral feedback in Q2.29 rad/s
 
 
 /* Private function prototypes -----------------------------------------------*/
 static Module_Status LSM6DS3Init(void);
-//static Module_Status LSM303AccInit(void);
+static Module_Status LSM303AccInit(void);
 static Module_Status LSM303MagInit(void);
+static Module_Status LSM303MagEnable(void);
+static Module_Status LSM303MagDisable(void);
 
 static Module_Status LSM6DS3SampleGyroMDPS(int *gyroX, int *gyroY, int *gyroZ);
 static Module_Status LSM6DS3SampleGyroRaw(int16_t *gyroX, int16_t *gyroY, int16_t *gyroZ);
@@ -82,38 +674,124 @@ static Module_Status LSM6DS3SampleGyroRaw(int16_t *gyroX, int16_t *gyroY, int16_
 static Module_Status LSM6DS3SampleAccMG(int *accX, int *accY, int *accZ);
 static Module_Status LSM6DS3SampleAccRaw(int16_t *accX, int16_t *accY, int16_t *accZ);
 
+static Module_Status LSM6DS3SampleImuDuty(ImuRawSample_t *sample, uint8_t sensors);
 static Module_Status LSM6DS3SampleTempCelsius(float *temp);
 static Module_Status LSM6DS3SampleTempFahrenheit(float *temp);
 
 static Module_Status LSM303SampleMagMGauss(int *magX, int *magY, int *magZ);
 static Module_Status LSM303SampleMagRaw(int16_t *magX, int16_t *magY, int16_t *magZ);
-
-static Module_Status StreamMemsToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout, SampleMemsToPort function);
-static Module_Status StreamMemsToCLI(uint32_t period, uint32_t timeout, SampleMemsToString function);
-static Module_Status StreamMemsToBuf(float *buffer, uint32_t numDatapoints, uint32_t period, uint32_t timeout, 
-																																						SampleMemsToBuffer function);
+static Module_Status LSM303SampleMagUnfiltered(int16_t *magX, int16_t *magY, int16_t *magZ);
+static void LSM303RemoveMagIron(int16_t *magX, int16_t *magY, int16_t *magZ);
+static Module_Status LSM303SampleMagCal(int16_t *magX, int16_t *magY, int16_t *magZ);
+
+static Module_Status LSM303SampleAccRaw(int16_t *accX, int16_t *accY, int16_t *accZ);
+static Module_Status SampleAccChannelRaw(int16_t *raw, float *sensitivity, int32_t *scaleQ24);
+
+static void MemsAcqTask(void *argument);
+static void MemsAcqProcess(uint32_t events);
+static bool MemsLock(TickType_t wait);
+static void MemsUnlock(void);
+static void *MemsAlloc(size_t bytes);
+static bool MessageParamsLock(void);
+static void MessageParamsUnlock(void);
+static void FusionTask(void *argument);
+static void GyroBiasTask(void *argument);
+#if H0BR4_ENABLE_SLOTS
+static void StreamSlotTask(void *argument);
+static void ReleaseSlotOdr(MemsSlotState_t *s);
+#endif
+static void StreamJobTask(void *argument);
+static Module_Status StartMessageStream(MemsStreamSensor_t sensor, uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+static Module_Status StartStreamJob(const MemsStreamJob_t *job);
+static void SelectGyroBias(uint8_t bin);
+
+static void LoadMemsConfig(void);
+static Module_Status SaveMemsConfig(void);
+static uint16_t LoadMemsSettings(void);
+static Module_Status SaveMemsSettings(uint16_t mask, uint16_t bits);
+static Module_Status MatchOdrToPeriod(MemsOdrSensor_t sensor, uint32_t period, uint8_t *held);
+static void ReleaseOdr(uint8_t held);
+static uint8_t ConfiguredOdrIdx(MemsOdrSensor_t sensor);
+static Module_Status LSM6DS3ApplyGyroConfig(void);
+static Module_Status LSM6DS3ApplyAccConfig(void);
+static Module_Status LSM303ApplyMagConfig(void);
+static Module_Status LSM303ApplyAccConfig(void);
+static Module_Status LSM6DS3ApplyMotionConfig(void);
+static Module_Status LSM6DS3RestartFifo(void);
+static Module_Status SaveMotionConfig(void);
+static Module_Status LSM6DS3WriteEmbeddedReg(uint8_t reg, uint8_t value);
+static void SetSampleTime(uint64_t timeUs);
+static bool MemsFilterInput(MemsFilterChannel_t channel, int16_t *sample);
+static bool MemsFilterValid(MemsFilterType_t type, uint16_t param, uint8_t decimation);
+static bool MemsReportValid(MemsReportChannel_t channel, const MemsReportConfig_t *config);
+static const MemsStreamInfo_t *AccChannelStreamInfo(void);
+
+static Module_Status StreamMemsToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout, SampleMemsToPort function, 
+																			const MemsStreamInfo_t *info, MemsReportChannel_t report);
+static Module_Status StreamMemsToCLI(uint32_t period, uint32_t timeout, SampleMemsToString function, const MemsStreamInfo_t *info, 
+																		 MemsReportChannel_t report);
+static Module_Status StreamMemsToBuf(float *buffer, MemsSampleRing_t *ring, uint32_t numDatapoints, uint32_t period, 
+																		 uint32_t timeout, SampleMemsToBuffer function, const MemsStreamInfo_t *info, 
+																		 MemsReportChannel_t report);
 
 
 
 /* Create CLI commands --------------------------------------------------------*/
 static portBASE_TYPE SampleSensorCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 static portBASE_TYPE StreamSensorCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+#if H0BR4_ENABLE_STATS
+static portBASE_TYPE StreamStatsCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+#endif
+#if H0BR4_ENABLE_FFT
+static portBASE_TYPE StreamSpectrumCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+#endif
 static portBASE_TYPE StopStreamCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE AcquisitionCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE I2CSpeedCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE MemsConfigCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+#if H0BR4_ENABLE_CONVBENCH
+static portBASE_TYPE ConvBenchCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+#endif
+static portBASE_TYPE FusionCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE MagCalCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE GyroBiasCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE MotionCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE PedometerCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE FilterCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE ReportCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+#if H0BR4_ENABLE_SLOTS
+static portBASE_TYPE SlotCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+#endif
 
 const CLI_Command_Definition_t SampleCommandDefinition = {
 	(const int8_t *) "sample",
-	(const int8_t *) "sample:\r\n Syntax: sample [gyro]/[acc]/[mag]/[temp]\r\n \
+	(const int8_t *) "sample:\r\n Syntax: sample [gyro]/[acc]/[mag]/[temp]/[imu]/[quat]/[euler]/[heading]/[steps]\r\n \
 \tGet filtered and calibrated Gyro, Acc, Mag or Temp values in \
-dps, g, mguass or celsius units respectively.\r\n\r\n",
+dps, g, mguass or celsius units respectively. imu reads Gyro, Acc and Temp from the same sample. \
+quat and euler read the fused orientation as a quaternion or roll, pitch and yaw in degrees. \
+heading reads the tilt-compensated compass heading in degrees from true north. \
+steps reads the pedometer step count.\r\n\r\n",
 	SampleSensorCommand,
 	1
 };
 
 const CLI_Command_Definition_t StreamCommandDefinition = {
 	(const int8_t *) "stream",
-	(const int8_t *) "stream:\r\n Syntax: stream [gyro]/[acc]/[mag]/[temp] (period in ms) (time in ms) [port]/[buffer] [module]\r\n \
+	(const int8_t *) "stream:\r\n Syntax: stream [gyro]/[acc]/[mag]/[temp]/[quat]/[euler]/[heading]/[steps] (period in ms) (time in ms) [port]/[buffer] [module]\r\n \
 \tGet stream of  filtered and calibrated Gyro, Acc, Mag or Temp values in \
-dps, g, mguass or celsius units respectively. Press ENTER to stop the stream.\r\n\r\n",
+dps, g, mguass or celsius units respectively. Periods down to 1 ms are accepted when the sensor ODR, \
+I2C bus and port baud rate can sustain them. Press ENTER to stop the stream.\r\n"
+#if H0BR4_ENABLE_STATS
+" Syntax: stream [gyro]/[acc]/[mag] stats (window samples) (window ms) (time in ms) [port] [module]\r\n \
+\tSample at the sensor output rate and send min, max, mean, RMS, variance and peak-to-peak of each \
+axis per window of samples or ms, whichever ends first (0 disables either).\r\n"
+#endif
+#if H0BR4_ENABLE_FFT
+" Syntax: stream accfft [x]/[y]/[z] (size) (sample Hz) [rect]/[hann] (period in ms) (time in ms) [port] [module]\r\n \
+\tCapture 64 to 512 accelerometer samples at 416, 833, 1660, 3330 or 6660 Hz and send the spectrum \
+bins, peaks and band energies. The CLI shows the peaks and bands.\r\n"
+#endif
+"\r\n",
 	StreamSensorCommand,
 	-1
 };
@@ -121,11 +799,138 @@ dps, g, mguass or celsius units respectively. Press ENTER to stop the stream.\r\
 const CLI_Command_Definition_t StopCommandDefinition = {
 	(const int8_t *) "stop",
 	(const int8_t *) "stop:\r\n Syntax: stop\r\n \
-\tStop the current streaming of MEMS values. r\n\r\n",
+\tStop the current streaming of MEMS values and all stream slots.\r\n\r\n",
 	StopStreamCommand,
 	0
 };
 
+const CLI_Command_Definition_t AcquisitionCommandDefinition = {
+	(const int8_t *) "acquisition",
+	(const int8_t *) "acquisition:\r\n Syntax: acquisition [polling]/[duty]/[drdy]/[fifo] (watermark) (gyro decimation) (acc decimation)\r\n \
+\tRead MEMS sensors on demand (polling), on demand with the sensors powered down between samples (duty), \
+once per sample on each sensor data-ready interrupt (drdy) or in bursts from the IMU FIFO on its threshold interrupt (fifo). The duty power mode is saved in EEPROM.\r\n\r\n",
+	AcquisitionCommand,
+	-1
+};
+
+const CLI_Command_Definition_t I2CSpeedCommandDefinition = {
+	(const int8_t *) "i2cspeed",
+	(const int8_t *) "i2cspeed:\r\n Syntax: i2cspeed (100)/(400)/(1000)/[bench]\r\n \
+\tSet the MEMS I2C bus speed in kHz or display it if no speed is given. Falls back to the previous \
+speed if the sensors do not answer. The speed is saved in EEPROM. bench displays the CPU time of a 14-byte IMU read with blocking and \
+interrupt-driven transfers.\r\n\r\n",
+	I2CSpeedCommand,
+	-1
+};
+
+const CLI_Command_Definition_t MemsConfigCommandDefinition = {
+	(const int8_t *) "memsconfig",
+	(const int8_t *) "memsconfig:\r\n Syntax: memsconfig [gyro] (odr in Hz) (full scale in dps)\r\n \
+memsconfig [acc] (odr in Hz) (full scale in g) (bandwidth in Hz)\r\n memsconfig [mag] (odr in Hz)\r\n \
+memsconfig [declination] (degrees, east positive)\r\n \
+memsconfig [acc2] [off]/[lp]/[normal]/[hr] (odr in Hz) (full scale in g)\r\n \
+memsconfig [accchannel] [lsm6ds3]/[lsm303] (cross-check tolerance in mg, 0: off)\r\n \
+\tSet sensor output data rate, full scale, anti-aliasing bandwidth and compass declination. acc2 is the low-power \
+LSM303AGR accelerometer and accchannel selects the one read by the acc commands. Settings are saved in EEPROM. \
+Without arguments, display the current configuration.\r\n\r\n",
+	MemsConfigCommand,
+	-1
+};
+
+#if H0BR4_ENABLE_CONVBENCH
+const CLI_Command_Definition_t ConvBenchCommandDefinition = {
+	(const int8_t *) "convbench",
+	(const int8_t *) "convbench:\r\n Syntax: convbench\r\n \
+\tDisplay CPU cycles of one 3-axis raw to DPS conversion with float and Q16.16 arithmetic.\r\n\r\n",
+	ConvBenchCommand,
+	0
+};
+#endif
+
+const CLI_Command_Definition_t FusionCommandDefinition = {
+	(const int8_t *) "fusion",
+	(const int8_t *) "fusion:\r\n Syntax: fusion [start] (rate in Hz)/[stop]\r\n \
+\tRun the orientation filter on Gyro, Acc and Mag samples at the given rate (default 50 Hz, up to 200 Hz). \
+Without arguments, display the fusion state.\r\n\r\n",
+	FusionCommand,
+	-1
+};
+
+const CLI_Command_Definition_t MagCalCommandDefinition = {
+	(const int8_t *) "magcal",
+	(const int8_t *) "magcal:\r\n Syntax: magcal [start] (time in s)/[clear]\r\n \
+\tCalibrate the magnetometer against nearby iron: rotate the module in all directions until done \
+(default 30 s). Samples are collected in the background and the result is saved in EEPROM. Without \
+arguments, display the current calibration, or the progress or failure of the last one.\r\n\r\n",
+	MagCalCommand,
+	-1
+};
+
+const CLI_Command_Definition_t GyroBiasCommandDefinition = {
+	(const int8_t *) "gyrobias",
+	(const int8_t *) "gyrobias:\r\n Syntax: gyrobias [on]/[off]/[clear]\r\n \
+\tEnable or disable learning the gyro bias while the module is at rest (off by default, saved in EEPROM), \
+or clear the learned biases. Biases are kept per temperature in EEPROM. Without arguments, display the \
+bias currently removed.\r\n\r\n",
+	GyroBiasCommand,
+	-1
+};
+
+const CLI_Command_Definition_t MotionCommandDefinition = {
+	(const int8_t *) "motion",
+	(const int8_t *) "motion:\r\n Syntax: motion [on]/[off] [wakeup]/[freefall]/[tap]/[doubletap]/[6d]/[tilt]/[sigmotion]/[step]\r\n \
+motion [line] (1/2)\r\n motion [thresholds] (wake-up in mg) (free-fall in mg) (tap in mg)\r\n motion [report] (module) (port)\r\n \
+\tEnable LSM6DS3 hardware motion detection. Events are routed to IMU_INT1 or IMU_INT2 and reported to a module, \
+or to a port of this module when module is its own ID. Module 0 only counts them. Settings are saved in EEPROM. \
+Without arguments, display the configuration and the number of events.\r\n\r\n",
+	MotionCommand,
+	-1
+};
+
+const CLI_Command_Definition_t PedometerCommandDefinition = {
+	(const int8_t *) "pedometer",
+	(const int8_t *) "pedometer:\r\n Syntax: pedometer [on]/[off] (debounce steps)\r\n pedometer [reset]\r\n \
+\tEnable the LSM6DS3 hardware step counter or reset the count. Counting starts after the debounce number of \
+steps (0 to 7, default 6). Settings are saved in EEPROM. Without arguments, display the configuration and the count.\r\n\r\n",
+	PedometerCommand,
+	-1
+};
+
+const CLI_Command_Definition_t FilterCommandDefinition = {
+	(const int8_t *) "filter",
+	(const int8_t *) "filter:\r\n Syntax: filter [gyro]/[acc]/[mag] [none]/[avg]/[lp1]/[hp1]/[lp2]/[hp2]/[fir] (cutoff in Hz or length) (decimation)\r\n \
+\tFilter a sensor at its output data rate and keep one sample every decimation (1 to 64): moving average, first or \
+second order low-pass or high-pass, or 15-tap FIR low-pass. Filters run in drdy and fifo acquisition only: select one \
+first. Settings are saved in EEPROM and pause while polling. Without arguments, display the filters.\r\n\r\n",
+	FilterCommand,
+	-1
+};
+
+const CLI_Command_Definition_t ReportCommandDefinition = {
+	(const int8_t *) "report",
+	(const int8_t *) "report:\r\n Syntax: report [gyro]/[acc]/[mag]/[temp] [off]/(deadband or X,Y,Z) (hysteresis %) (min ms) (max ms)\r\n \
+\tSend streams only when an axis moved by its deadband (dps, g, mGauss or Celsius; 0 ignores an axis), no sooner than \
+the min interval and at least every max interval (0: never). Hysteresis lowers the deadband while the value keeps \
+changing. Settings are saved in EEPROM. Without arguments, display the settings.\r\n\r\n",
+	ReportCommand,
+	-1
+};
+
+#if H0BR4_ENABLE_SLOTS
+const CLI_Command_Definition_t SlotCommandDefinition = {
+	(const int8_t *) "slot",
+	(const int8_t *) "slot:\r\n Syntax: slot [gyro]/[acc]/[mag]/[temp]/[quat]/[euler]/[heading]/[steps] (period in ms) (time in ms) [port] [module] [float]/[q16]/[text]\r\n \
+slot [stop] (slot)/[all]\r\n \
+slot [timing]\r\n \
+\tRun up to 4 streams at once, each with its own sensor, period and destination (the CLI without a port). \
+Slots due together share their sensor reads. Without arguments, display the slots. timing displays the samples, \
+missed deadlines and earliest to latest jitter of the last stream of each slot, of the stream APIs and CLI \
+streams of each calling task, and of the statistics and spectrum streams to a port.\r\n\r\n",
+	SlotCommand,
+	-1
+};
+#endif
+
 
 
 /* -----------------------------------------------------------------------
@@ -137,6 +942,9 @@ const CLI_Command_Definition_t StopCommandDefinition = {
 */
 void Module_Init(void)
 {
+	uint16_t settings = 0;
+	uint8_t speedIdx = 0;
+	
 	/* Peripheral clock enable */
 
 	/* Array ports */
@@ -150,11 +958,52 @@ void Module_Init(void)
 	// TODO: Initialize I2C
 	MX_I2C_Init();
 	
+	// Stored ODR, full scale and bandwidth settings
+	LoadMemsConfig();
+	
 	LSM6DS3Init();
 	LSM303MagInit();
 	
-	// Disabling Accelerometer of LSM303AGR
-	// LSM303AccInit();
+	// Accelerometer of LSM303AGR stays powered down unless its mode is set
+	LSM303AccInit();
+	
+	// Stored bus speed once the sensors can answer WHO_AM_I. An unusable speed falls back to Standard mode
+	settings = LoadMemsSettings();
+	speedIdx = (settings & MEMS_SETTING_I2C_SPEED) >> MEMS_SETTING_I2C_SPEED_POS;
+	if (speedIdx != 0 && speedIdx < TABLE_SIZE(memsI2CSpeedKHz))
+		SetMemsI2CSpeed(memsI2CSpeedKHz[speedIdx]);
+	
+	// Stored power mode. Duty cycling is refused if stored motion events or the pedometer need the sensors running
+	if (settings & MEMS_SETTING_DUTY_CYCLED)
+		SetMemsPowerMode(MEMS_POWER_DUTY_CYCLED);
+	
+	MemsLockHandle = xSemaphoreCreateMutex();
+	MessageParamsMutexHandle = xSemaphoreCreateMutex();
+	
+	/* Create the MEMS acquisition task. It sleeps until data-ready acquisition is selected */
+	xTaskCreate(MemsAcqTask, (const char *) "MemsAcqTask", (2*configMINIMAL_STACK_SIZE), NULL, osPriorityAboveNormal-osPriorityIdle, &MemsAcqTaskHandle);
+	
+	// Release a motion event line latched before the task existed
+	if (motionEvents)
+		xTaskNotify(MemsAcqTaskHandle, MEMS_EVT_MOTION, eSetBits);
+	
+	/* Create the orientation fusion task. It sleeps until fusion is started */
+	xTaskCreate(FusionTask, (const char *) "FusionTask", (2*configMINIMAL_STACK_SIZE), NULL, osPriorityNormal-osPriorityIdle, &FusionTaskHandle);
+	
+	/* Create the gyro bias estimation task */
+	xTaskCreate(GyroBiasTask, (const char *) "GyroBiasTask", (2*configMINIMAL_STACK_SIZE), NULL, osPriorityBelowNormal-osPriorityIdle, &GyroBiasTaskHandle);
+	
+#if H0BR4_ENABLE_SLOTS
+	/* Create the stream scheduler task. It sleeps until a stream slot is started. Text slots need 
+		 the stack of float formatting */
+	slotRequestQueue = xQueueCreate(H0BR4_STREAM_SLOTS, sizeof(uint8_t));
+	xTaskCreate(StreamSlotTask, (const char *) "StreamSlotTask", (4*configMINIMAL_STACK_SIZE), NULL, osPriorityNormal-osPriorityIdle, &StreamSlotTaskHandle);
+#endif
+	
+	/* Create the stream job task. Runs one statistics or spectrum stream at a time for the messaging 
+		 and CLI tasks */
+	streamJobQueue = xQueueCreate(1, sizeof(MemsStreamJob_t));
+	xTaskCreate(StreamJobTask, (const char *) "StreamJobTask", STREAM_JOB_STACK_WORDS, NULL, osPriorityNormal-osPriorityIdle, &StreamJobTaskHandle);
 
 }
 
@@ -172,18 +1021,21 @@ Module_Status Module_MessagingTask(uint16_t code, uint8_t port, uint8_t src, uin
 		case CODE_H0BR4_GET_GYRO:
 		{
 			SampleGyroDPS(&H0BR4_gyroX, &H0BR4_gyroY, &H0BR4_gyroZ);
+			H0BR4_time = GetMemsSampleTime();
 			
 			break;
 		}
 		case CODE_H0BR4_GET_ACC:
 		{
 			SampleAccG(&H0BR4_accX, &H0BR4_accY, &H0BR4_accZ);
+			H0BR4_time = GetMemsSampleTime();
 			
 			break;
 		}
 		case CODE_H0BR4_GET_MAG:
 		{
 			SampleMagMGauss(&H0BR4_magX, &H0BR4_magY, &H0BR4_magZ);
+			H0BR4_time = GetMemsSampleTime();
 
 			
 			break;
@@ -191,6 +1043,43 @@ Module_Status Module_MessagingTask(uint16_t code, uint8_t port, uint8_t src, uin
 		case CODE_H0BR4_GET_TEMP:
 		{
 			SampleTempCelsius(&H0BR4_temp);
+			H0BR4_time = GetMemsSampleTime();
+			
+			break;
+		}
+		case CODE_H0BR4_SET_GYRO_CONFIG:
+		{
+			result = SetGyroConfig(((uint16_t)cMessage[port-1][shift] << 8) + cMessage[port-1][1+shift], 
+														 ((uint16_t)cMessage[port-1][2+shift] << 8) + cMessage[port-1][3+shift]);
+			break;
+		}
+		case CODE_H0BR4_SET_ACC_CONFIG:
+		{
+			result = SetAccConfig(((uint16_t)cMessage[port-1][shift] << 8) + cMessage[port-1][1+shift], cMessage[port-1][2+shift], 
+														((uint16_t)cMessage[port-1][3+shift] << 8) + cMessage[port-1][4+shift]);
+			break;
+		}
+		case CODE_H0BR4_SET_MAG_CONFIG:
+		{
+			result = SetMagConfig(cMessage[port-1][shift]);
+			break;
+		}
+		case CODE_H0BR4_GET_IMU:
+		{
+			ImuSample_t sample;
+			
+			// Gyro, acc and temp params from the same output cycle
+			if ((result = SampleImu(&sample)) != H0BR4_OK)
+				break;
+			
+			H0BR4_gyroX = sample.gyro[0];
+			H0BR4_gyroY = sample.gyro[1];
+			H0BR4_gyroZ = sample.gyro[2];
+			H0BR4_accX = sample.acc[0];
+			H0BR4_accY = sample.acc[1];
+			H0BR4_accZ = sample.acc[2];
+			H0BR4_temp = sample.temp;
+			H0BR4_time = sample.timestamp;
 			
 			break;
 		}
@@ -199,7 +1088,7 @@ Module_Status Module_MessagingTask(uint16_t code, uint8_t port, uint8_t src, uin
 		{
 			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
 			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
-			if ((result = StreamGyroDPSToPort(port, dst, period, timeout)) != H0BR4_OK)
+			if ((result = StartMessageStream(MEMS_STREAM_GYRO, port, dst, period, timeout)) != H0BR4_OK)
 				break;
 			
 			break;
@@ -209,7 +1098,7 @@ Module_Status Module_MessagingTask(uint16_t code, uint8_t port, uint8_t src, uin
 		{
 			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
 			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
-			if ((result = StreamAccGToPort(port, dst, period, timeout)) != H0BR4_OK)
+			if ((result = StartMessageStream(MEMS_STREAM_ACC, port, dst, period, timeout)) != H0BR4_OK)
 				break;
 			
 			break;
@@ -218,7 +1107,7 @@ Module_Status Module_MessagingTask(uint16_t code, uint8_t port, uint8_t src, uin
 		{
 			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
 			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
-			if ((result = StreamMagMGaussToPort(port, dst, period, timeout)) != H0BR4_OK)
+			if ((result = StartMessageStream(MEMS_STREAM_MAG, port, dst, period, timeout)) != H0BR4_OK)
 				break;
 			
 			break;
@@ -227,11 +1116,197 @@ Module_Status Module_MessagingTask(uint16_t code, uint8_t port, uint8_t src, uin
 		{
 			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
 			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
-			if ((result = StreamTempCToPort(port, dst, period, timeout)) != H0BR4_OK)
+			if ((result = StartMessageStream(MEMS_STREAM_TEMP, port, dst, period, timeout)) != H0BR4_OK)
 				break;
 			
 			break;
 		}	
+		case CODE_H0BR4_STREAM_QUATERNION:
+		{
+			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
+			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
+			result = StartMessageStream(MEMS_STREAM_QUAT, port, dst, period, timeout);
+			break;
+		}
+		case CODE_H0BR4_STREAM_EULER:
+		{
+			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
+			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
+			result = StartMessageStream(MEMS_STREAM_EULER, port, dst, period, timeout);
+			break;
+		}
+		case CODE_H0BR4_SET_FUSION:
+		{
+			uint16_t rateHz = ((uint16_t)cMessage[port-1][shift] << 8) + cMessage[port-1][1+shift];
+			
+			// Rate 0 stops the fusion
+			if (rateHz == 0)
+				StopFusion();
+			else
+				result = StartFusion(rateHz);
+			break;
+		}
+		case CODE_H0BR4_STREAM_HEADING:
+		{
+			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
+			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
+			result = StartMessageStream(MEMS_STREAM_HEADING, port, dst, period, timeout);
+			break;
+		}
+		case CODE_H0BR4_SET_DECLINATION:
+		{
+			// Tenths of a degree, east positive
+			int16_t deciDegrees = (int16_t)(((uint16_t)cMessage[port-1][shift] << 8) + cMessage[port-1][1+shift]);
+			
+			result = SetMagDeclination((float)deciDegrees / 10);
+			break;
+		}
+		case CODE_H0BR4_CALIBRATE_MAG:
+		{
+			// Collection time in ms. Runs on the stream job task: the messaging task keeps serving its port
+			MemsStreamJob_t job = { .kind = MEMS_JOB_MAG_CAL, .port = port, .module = dst };
+			
+			job.period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
+			result = StartStreamJob(&job);
+			break;
+		}
+		case CODE_H0BR4_SET_GYRO_BIAS_AUTO:
+		{
+			result = SetGyroBiasAuto(cMessage[port-1][shift] != 0);
+			break;
+		}
+		case CODE_H0BR4_SET_ACC2_CONFIG:
+		{
+			result = SetLsm303AccConfig((Lsm303AccMode_t)cMessage[port-1][shift], 
+																	((uint16_t)cMessage[port-1][1+shift] << 8) + cMessage[port-1][2+shift], cMessage[port-1][3+shift]);
+			break;
+		}
+		case CODE_H0BR4_SET_ACC_CHANNEL:
+		{
+			// Channel, then cross-check tolerance in mg (0: off)
+			if ((result = SetAccChannel((MemsAccChannel_t)cMessage[port-1][shift])) != H0BR4_OK)
+				break;
+			result = SetAccCrossCheck(((uint16_t)cMessage[port-1][1+shift] << 8) + cMessage[port-1][2+shift]);
+			break;
+		}
+		case CODE_H0BR4_SET_POWER_MODE:
+		{
+			result = SetMemsPowerMode((MemsPowerMode_t)cMessage[port-1][shift]);
+			break;
+		}
+		case CODE_H0BR4_SET_MOTION_EVENTS:
+		{
+			// Event mask, line, then report destination module and port
+			if ((result = SetMotionEvents(cMessage[port-1][shift], cMessage[port-1][1+shift])) != H0BR4_OK)
+				break;
+			result = SetMotionEventReport(cMessage[port-1][2+shift], cMessage[port-1][3+shift]);
+			break;
+		}
+		case CODE_H0BR4_SET_MOTION_THRESHOLDS:
+		{
+			result = SetMotionThresholds(((uint16_t)cMessage[port-1][shift] << 8) + cMessage[port-1][1+shift], 
+																	 ((uint16_t)cMessage[port-1][2+shift] << 8) + cMessage[port-1][3+shift], 
+																	 ((uint16_t)cMessage[port-1][4+shift] << 8) + cMessage[port-1][5+shift]);
+			break;
+		}
+		case CODE_H0BR4_GET_STEPS:
+		{
+			// Updates the steps module param
+			if ((result = SampleStepCount(&H0BR4_steps)) == H0BR4_OK)
+				H0BR4_time = GetMemsSampleTime();
+			break;
+		}
+		case CODE_H0BR4_STREAM_STEPS:
+		{
+			period = ( (uint32_t) cMessage[port-1][shift] << 24 ) + ( (uint32_t) cMessage[port-1][1+shift] << 16 ) + ( (uint32_t) cMessage[port-1][2+shift] << 8 ) + cMessage[port-1][3+shift];
+			timeout = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
+			result = StartMessageStream(MEMS_STREAM_STEPS, port, dst, period, timeout);
+			break;
+		}
+#if H0BR4_ENABLE_STATS
+		case CODE_H0BR4_STREAM_STATS:
+		{
+			MemsStreamJob_t job = { .kind = MEMS_JOB_STATS, .port = port, .module = dst, .channel = cMessage[port-1][shift], 
+															.samples = ((uint16_t)cMessage[port-1][1+shift] << 8) + cMessage[port-1][2+shift] };
+			
+			job.period = ( (uint32_t) cMessage[port-1][3+shift] << 24 ) + ( (uint32_t) cMessage[port-1][4+shift] << 16 ) + ( (uint32_t) cMessage[port-1][5+shift] << 8 ) + cMessage[port-1][6+shift];
+			job.timeout = ( (uint32_t) cMessage[port-1][7+shift] << 24 ) + ( (uint32_t) cMessage[port-1][8+shift] << 16 ) + ( (uint32_t) cMessage[port-1][9+shift] << 8 ) + cMessage[port-1][10+shift];
+			result = StartStreamJob(&job);
+			break;
+		}
+#endif
+#if H0BR4_ENABLE_FFT
+		case CODE_H0BR4_STREAM_ACC_FFT:
+		{
+			MemsStreamJob_t job = { .kind = MEMS_JOB_SPECTRUM, .port = port, .module = dst, .channel = cMessage[port-1][shift], 
+															.samples = ((uint16_t)cMessage[port-1][1+shift] << 8) + cMessage[port-1][2+shift], 
+															.sampleHz = ((uint16_t)cMessage[port-1][3+shift] << 8) + cMessage[port-1][4+shift], 
+															.window = (MemsFftWindow_t)cMessage[port-1][5+shift] };
+			
+			job.period = ( (uint32_t) cMessage[port-1][6+shift] << 24 ) + ( (uint32_t) cMessage[port-1][7+shift] << 16 ) + ( (uint32_t) cMessage[port-1][8+shift] << 8 ) + cMessage[port-1][9+shift];
+			job.timeout = ( (uint32_t) cMessage[port-1][10+shift] << 24 ) + ( (uint32_t) cMessage[port-1][11+shift] << 16 ) + ( (uint32_t) cMessage[port-1][12+shift] << 8 ) + cMessage[port-1][13+shift];
+			result = StartStreamJob(&job);
+			break;
+		}
+#endif
+		case CODE_H0BR4_SET_PEDOMETER:
+		{
+			result = SetPedometer(cMessage[port-1][shift] != 0, cMessage[port-1][1+shift]);
+			break;
+		}
+		case CODE_H0BR4_RESET_STEPS:
+		{
+			result = ResetStepCount();
+			break;
+		}
+		case CODE_H0BR4_SET_REPORT:
+		{
+			// Deadbands in mdps, mg, mGauss or milli-Celsius
+			MemsReportChannel_t channel = (MemsReportChannel_t)cMessage[port-1][shift];
+			MemsReportConfig_t config;
+			uint8_t axis = 0;
+			
+			if (channel >= MEMS_REPORT_NONE) {
+				result = H0BR4_ERR_WrongParams;
+				break;
+			}
+			for (axis = 0; axis < 3; axis++)
+				config.deadband[axis] = (float)(((uint16_t)cMessage[port-1][2+2*axis+shift] << 8) + cMessage[port-1][3+2*axis+shift]) / 
+																reportDeadbandScale[channel];
+			config.hysteresis = cMessage[port-1][8+shift];
+			config.minIntervalMs = ((uint16_t)cMessage[port-1][9+shift] << 8) + cMessage[port-1][10+shift];
+			config.maxIntervalMs = ((uint16_t)cMessage[port-1][11+shift] << 8) + cMessage[port-1][12+shift];
+			
+			result = SetMemsReport(channel, cMessage[port-1][1+shift] ? &config : NULL);
+			break;
+		}
+		case CODE_H0BR4_SET_FILTER:
+		{
+			result = SetMemsFilter((MemsFilterChannel_t)cMessage[port-1][shift], (MemsFilterType_t)cMessage[port-1][1+shift], 
+														 ((uint16_t)cMessage[port-1][2+shift] << 8) + cMessage[port-1][3+shift], cMessage[port-1][4+shift]);
+			break;
+		}
+#if H0BR4_ENABLE_SLOTS
+		case CODE_H0BR4_START_SLOT:
+		{
+			MemsStreamSlot_t slot;
+			
+			slot.sensor = (MemsStreamSensor_t)cMessage[port-1][shift];
+			slot.format = (MemsStreamFormat_t)cMessage[port-1][1+shift];
+			slot.port = cMessage[port-1][2+shift];
+			slot.module = cMessage[port-1][3+shift];
+			slot.period = ( (uint32_t) cMessage[port-1][4+shift] << 24 ) + ( (uint32_t) cMessage[port-1][5+shift] << 16 ) + ( (uint32_t) cMessage[port-1][6+shift] << 8 ) + cMessage[port-1][7+shift];
+			slot.timeout = ( (uint32_t) cMessage[port-1][8+shift] << 24 ) + ( (uint32_t) cMessage[port-1][9+shift] << 16 ) + ( (uint32_t) cMessage[port-1][10+shift] << 8 ) + cMessage[port-1][11+shift];
+			slot.ring = NULL;
+			result = StartMemsStreamSlot(&slot, NULL);
+			break;
+		}
+		case CODE_H0BR4_STOP_SLOT:
+		{
+			result = StopMemsStreamSlot(cMessage[port-1][shift]);
+			break;
+		}
+#endif
 		case CODE_H0BR4_STREAM_STOP:
 		{
 			stopStreamMems();
@@ -256,6 +1331,22 @@ void RegisterModuleCLICommands(void)
 	FreeRTOS_CLIRegisterCommand(&SampleCommandDefinition);
 	FreeRTOS_CLIRegisterCommand(&StreamCommandDefinition);
 	FreeRTOS_CLIRegisterCommand(&StopCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&AcquisitionCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&I2CSpeedCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&MemsConfigCommandDefinition);
+#if H0BR4_ENABLE_CONVBENCH
+	FreeRTOS_CLIRegisterCommand(&ConvBenchCommandDefinition);
+#endif
+	FreeRTOS_CLIRegisterCommand(&FusionCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&MagCalCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&GyroBiasCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&MotionCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&PedometerCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&FilterCommandDefinition);
+	FreeRTOS_CLIRegisterCommand(&ReportCommandDefinition);
+#if H0BR4_ENABLE_SLOTS
+	FreeRTOS_CLIRegisterCommand(&SlotCommandDefinition);
+#endif
 }
 
 /*-----------------------------------------------------------*/
@@ -296,6 +1387,10 @@ static Module_Status LSM6D3Enable(void)
 	if (LSM6DS3_ACC_GYRO_W_IF_Addr_Incr(&hi2c2, LSM6DS3_ACC_GYRO_IF_INC_ENABLED) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
 	
+	// Block Data Update: output registers are not updated until both bytes of each are read
+	if (LSM6DS3_ACC_GYRO_W_BDU(&hi2c2, LSM6DS3_ACC_GYRO_BDU_BLOCK_UPDATE) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
 	// Bypass Mode
 	if (LSM6DS3_ACC_GYRO_W_FIFO_MODE(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_MODE_BYPASS) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
@@ -303,16 +1398,66 @@ static Module_Status LSM6D3Enable(void)
 	return H0BR4_OK;
 }
 
-static Module_Status LSM6D3SetupGyro(void)
+static Module_Status LSM6DS3ApplyGyroConfig(void)
 {
-	// Gyroscope ODR Init
-	if (LSM6DS3_ACC_GYRO_W_ODR_G(&hi2c2, LSM6DS3_ACC_GYRO_ODR_G_13Hz) != MEMS_SUCCESS)
-		return H0BR4_ERR_LSM303;
+	const MemsFullScale_t *fs = &gyroFsTable[gyroFsIdx];
+	
+	// Gyroscope ODR. In duty-cycled mode it stays powered down until a sample is read
+	if (LSM6DS3_ACC_GYRO_W_ODR_G(&hi2c2, (powerMode == MEMS_POWER_DUTY_CYCLED && dutyGyroUsers == 0) ? 
+																	LSM6DS3_ACC_GYRO_ODR_G_POWER_DOWN : gyroOdrTable[gyroOdrIdx].reg) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	// Gyroscope FS: 125 dps overrides FS_G
+	if (LSM6DS3_ACC_GYRO_W_FS_G(&hi2c2, fs->reg) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	if (LSM6DS3_ACC_GYRO_W_FS_125(&hi2c2, (fs->range == 125) ? LSM6DS3_ACC_GYRO_FS_125_ENABLED : 
+																															LSM6DS3_ACC_GYRO_FS_125_DISABLED) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	gyroSensitivity = fs->sensitivity;
+	gyroScaleQ24 = fs->scaleQ24;
+	
+	// The bias is kept in mdps: rescale the applied LSB offset
+	SelectGyroBias(gyroBiasBin);
+	return LSM6DS3RestartFifo();
+}
+
+static Module_Status LSM6DS3ApplyAccConfig(void)
+{
+	Module_Status status = H0BR4_OK;
+	
+	// Accelerometer ODR. In duty-cycled mode it stays powered down until a sample is read
+	if (LSM6DS3_ACC_GYRO_W_ODR_XL(&hi2c2, (powerMode == MEMS_POWER_DUTY_CYCLED && dutyAccUsers == 0) ? 
+																	 LSM6DS3_ACC_GYRO_ODR_XL_POWER_DOWN : accOdrTable[accOdrIdx].reg) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	// Bandwidth Selection
+	// Selection of bandwidth and ODR should be in accordance of Nyquist Sampling theorem!
+	if (LSM6DS3_ACC_GYRO_W_BW_XL(&hi2c2, accBwTable[accBwIdx].reg) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
 	
-	// Gyroscope FS Init
-	if (LSM6DS3_ACC_GYRO_W_FS_G(&hi2c2, LSM6DS3_ACC_GYRO_FS_G_2000dps) != MEMS_SUCCESS)
+	// Accelerometer FS
+	if (LSM6DS3_ACC_GYRO_W_FS_XL(&hi2c2, accFsTable[accFsIdx].reg) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
 	
+	accSensitivity = accFsTable[accFsIdx].sensitivity;
+	accScaleQ24 = accFsTable[accFsIdx].scaleQ24;
+	
+	// Motion thresholds are in LSB of the full scale
+	if ((motionEvents || pedoEnabled) && (status = LSM6DS3ApplyMotionConfig()) != H0BR4_OK)
+		return status;
+	return LSM6DS3RestartFifo();
+}
+
+static Module_Status LSM6D3SetupGyro(void)
+{
+	Module_Status status = H0BR4_OK;
+	
+	// Gyroscope ODR and FS Init
+	if ((status = LSM6DS3ApplyGyroConfig()) != H0BR4_OK)
+		return status;
+	
 	// Gyroscope Axes Status Init
 	if (LSM6DS3_ACC_GYRO_W_XEN_G(&hi2c2, LSM6DS3_ACC_GYRO_XEN_G_ENABLED) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
@@ -328,18 +1473,11 @@ static Module_Status LSM6D3SetupGyro(void)
 
 static Module_Status LSM6D3SetupAcc(void)
 {
-	// Accelerometer ODR Init
-	if (LSM6DS3_ACC_GYRO_W_ODR_XL(&hi2c2, LSM6DS3_ACC_GYRO_ODR_XL_104Hz) != MEMS_SUCCESS)
-		return H0BR4_ERR_LSM6DS3;
-	
-	// Bandwidth Selection
-	// Selection of bandwidth and ODR should be in accordance of Nyquist Sampling theorem!
-	if (LSM6DS3_ACC_GYRO_W_BW_XL(&hi2c2, LSM6DS3_ACC_GYRO_BW_XL_50Hz) != MEMS_SUCCESS)
-		return H0BR4_ERR_LSM6DS3;
+	Module_Status status = H0BR4_OK;
 	
-	// Accelerometer FS Init
-	if (LSM6DS3_ACC_GYRO_W_FS_XL(&hi2c2, LSM6DS3_ACC_GYRO_FS_XL_16g) != MEMS_SUCCESS)
-		return H0BR4_ERR_LSM6DS3;
+	// Accelerometer ODR, bandwidth and FS Init
+	if ((status = LSM6DS3ApplyAccConfig()) != H0BR4_OK)
+		return status;
 	
 	// Accelerometer Axes Status Init
 	if (LSM6DS3_ACC_GYRO_W_XEN_XL(&hi2c2, LSM6DS3_ACC_GYRO_XEN_XL_ENABLED) != MEMS_SUCCESS)
@@ -351,8 +1489,8 @@ static Module_Status LSM6D3SetupAcc(void)
 	if (LSM6DS3_ACC_GYRO_W_ZEN_XL(&hi2c2, LSM6DS3_ACC_GYRO_ZEN_XL_ENABLED) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
 	
-	// Enable Bandwidth Scaling
-	if (LSM6DS3_ACC_GYRO_W_BW_Fixed_By_ODR(&hi2c2, LSM6DS3_ACC_GYRO_BW_SCAL_ODR_ENABLED) != MEMS_ERROR)
+	// Enable Bandwidth Scaling: anti-aliasing bandwidth set by BW_XL instead of the ODR
+	if (LSM6DS3_ACC_GYRO_W_BW_Fixed_By_ODR(&hi2c2, LSM6DS3_ACC_GYRO_BW_SCAL_ODR_ENABLED) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
 	
 	return H0BR4_OK;
@@ -360,1036 +1498,7323 @@ static Module_Status LSM6D3SetupAcc(void)
 
 
 
-static Module_Status LSM6DS3SampleGyroRaw(int16_t *gyroX, int16_t *gyroY, int16_t *gyroZ)
+/* Read-modify-write of the LSM6DS3 register bits in mask
+*/
+static Module_Status LSM6DS3UpdateReg(uint8_t reg, uint8_t mask, uint8_t value)
 {
-	uint8_t temp[6];
-	if (LSM6DS3_ACC_GYRO_GetRawGyroData(&hi2c2, temp) != MEMS_SUCCESS)
+	uint8_t data = 0;
+	
+	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, reg, &data, 1) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
 	
-	*gyroX = concatBytes(temp[1], temp[0]);
-	*gyroY = concatBytes(temp[3], temp[2]);
-	*gyroZ = concatBytes(temp[5], temp[4]);
+	data = (data & ~mask) | (value & mask);
 	
-	return H0BR4_OK;
+	if (LSM6DS3_ACC_GYRO_WriteReg(&hi2c2, reg, &data, 1) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	return H0BR4_OK;
 }
 
-static Module_Status LSM6DS3SampleGyroMDPS(int *gyroX, int *gyroY, int *gyroZ)
+/* Write a register of the LSM6DS3 embedded functions bank
+*/
+static Module_Status LSM6DS3WriteEmbeddedReg(uint8_t reg, uint8_t value)
 {
-	int buff[3];
-	if (LSM6DS3_ACC_Get_AngularRate(&hi2c2, buff, 0) != MEMS_SUCCESS)
+	Module_Status status = H0BR4_OK;
+	uint8_t access = FUNC_CFG_EN;
+	
+	if (LSM6DS3_ACC_GYRO_WriteReg(&hi2c2, LSM6DS3_FUNC_CFG_ACCESS_REG, &access, 1) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
 	
-	*gyroX = buff[0];
-	*gyroY = buff[1];
-	*gyroZ = buff[2];
+	if (LSM6DS3_ACC_GYRO_WriteReg(&hi2c2, reg, &value, 1) != MEMS_SUCCESS)
+		status = H0BR4_ERR_LSM6DS3;
 	
-	return H0BR4_OK;
+	// Always return to the user bank
+	access = 0;
+	if (LSM6DS3_ACC_GYRO_WriteReg(&hi2c2, LSM6DS3_FUNC_CFG_ACCESS_REG, &access, 1) != MEMS_SUCCESS)
+		status = H0BR4_ERR_LSM6DS3;
+	
+	return status;
 }
 
-static Module_Status LSM6DS3SampleAccRaw(int16_t *accX, int16_t *accY, int16_t *accZ)
+/* Threshold in mg to register LSB of fullScaleG / steps, clamped to 1..maxCode
+*/
+static uint8_t MotionThresholdCode(uint16_t mg, uint8_t fullScaleG, uint8_t steps, uint8_t maxCode)
 {
-	uint8_t temp[6];
-	if (LSM6DS3_ACC_GYRO_GetRawAccData(&hi2c2, temp) != MEMS_SUCCESS)
-		return H0BR4_ERR_LSM6DS3;
-	
-	*accX = concatBytes(temp[1], temp[0]);
-	*accY = concatBytes(temp[3], temp[2]);
-	*accZ = concatBytes(temp[5], temp[4]);
+	uint32_t code = ((uint32_t)mg * steps + fullScaleG * 500) / (fullScaleG * 1000);
 	
-	return H0BR4_OK;
+	if (code < 1)
+		code = 1;
+	if (code > maxCode)
+		code = maxCode;
+	return (uint8_t)code;
 }
 
-static Module_Status LSM6DS3SampleAccMG(int *accX, int *accY, int *accZ)
+/* Configure the LSM6DS3 embedded motion functions and the pedometer, and route the enabled events 
+		to the selected line. Thresholds follow the accelerometer full scale.
+*/
+static Module_Status LSM6DS3ApplyMotionConfig(void)
 {
-	int buff[3];
-	if (LSM6DS3_ACC_Get_Acceleration(&hi2c2, buff, 0) != MEMS_SUCCESS)
+	Module_Status status = H0BR4_OK;
+	uint8_t fs = accFsTable[accFsIdx].range;
+	uint8_t regs[7], md = 0, tapCfg = 0, ff = 0;
+	bool tap = (motionEvents & (MEMS_MOTION_SINGLE_TAP | MEMS_MOTION_DOUBLE_TAP)) != 0;
+	bool pedo = pedoEnabled || (motionEvents & (MEMS_MOTION_SIGNIFICANT | MEMS_MOTION_STEP));
+	bool func = pedo || (motionEvents & MEMS_MOTION_TILT);
+	
+	if (motionEvents & MEMS_MOTION_WAKE_UP)
+		md |= MD_CFG_WU;
+	if (motionEvents & MEMS_MOTION_FREE_FALL)
+		md |= MD_CFG_FF;
+	if (motionEvents & MEMS_MOTION_SINGLE_TAP)
+		md |= MD_CFG_SINGLE_TAP;
+	if (motionEvents & MEMS_MOTION_DOUBLE_TAP)
+		md |= MD_CFG_DOUBLE_TAP;
+	if (motionEvents & MEMS_MOTION_6D)
+		md |= MD_CFG_6D;
+	if (motionEvents & MEMS_MOTION_TILT)
+		md |= MD_CFG_TILT;
+	
+	// The timer also runs the timestamp counter: always on
+	tapCfg = TAP_CFG_TIMER_EN;
+	
+	// Latched basic interrupts: the line stays high until the source registers are read
+	if (tap)
+		tapCfg |= TAP_CFG_TAP_XYZ_EN;
+	if (motionEvents & MEMS_MOTION_TILT)
+		tapCfg |= TAP_CFG_TILT_EN;
+	if (pedo)
+		tapCfg |= TAP_CFG_PEDO_EN;			// Significant motion and step detection are built on the pedometer
+	if (md & ~MD_CFG_TILT)
+		tapCfg |= TAP_CFG_LIR;
+	
+	for (ff = 0; ff < TABLE_SIZE(freeFallThsMG) - 1 && freeFallThsMG[ff] < motionFreeFallMG; ff++);
+	
+	// TAP_THS_6D to MD2_CFG in one burst: 6D at 60 degrees, tap timings from the ST application note
+	regs[0] = SIXD_THS_60_DEG | MotionThresholdCode(motionTapMG, fs, 32, 0x1F);
+	regs[1] = (motionEvents & MEMS_MOTION_DOUBLE_TAP) ? INT_DUR2_DOUBLE_TAP : INT_DUR2_SINGLE_TAP;
+	regs[2] = ((motionEvents & MEMS_MOTION_DOUBLE_TAP) ? WAKE_UP_THS_DOUBLE_TAP : 0) | MotionThresholdCode(motionWakeUpMG, fs, 64, 0x3F);
+	regs[3] = WAKE_UP_DUR_TIMER_HR;
+	regs[4] = FREE_FALL_DUR | ff;
+	regs[5] = (motionLine == 1) ? md : 0;
+	regs[6] = (motionLine == 2) ? md : 0;
+	
+	if (LSM6DS3_ACC_GYRO_WriteReg(&hi2c2, LSM6DS3_TAP_THS_6D_REG, regs, sizeof(regs)) != MEMS_SUCCESS)
 		return H0BR4_ERR_LSM6DS3;
 	
-	*accX = buff[0];
-	*accY = buff[1];
-	*accZ = buff[2];
+	if (pedo && (status = LSM6DS3WriteEmbeddedReg(LSM6DS3_PEDO_DEB_REG, PEDO_DEB_TIME | pedoDebounceSteps)) != H0BR4_OK)
+		return status;
 	
-	return H0BR4_OK;
+	if ((status = LSM6DS3UpdateReg(LSM6DS3_TAP_CFG_REG, TAP_CFG_MOTION_MASK, tapCfg)) != H0BR4_OK)
+		return status;
+	
+	if ((status = LSM6DS3UpdateReg(LSM6DS3_CTRL10_C_REG, CTRL10_FUNC_EN | CTRL10_SIGN_MOTION_EN, 
+																 (func ? CTRL10_FUNC_EN : 0) | 
+																 ((motionEvents & MEMS_MOTION_SIGNIFICANT) ? CTRL10_SIGN_MOTION_EN : 0))) != H0BR4_OK)
+		return status;
+	
+	// Significant motion and step detection can only be routed to IMU_INT1
+	return LSM6DS3UpdateReg(LSM6DS3_INT1_CTRL_REG, INT1_CTRL_SIGN_MOT | INT1_CTRL_STEP_DETECTOR, 
+													((motionEvents & MEMS_MOTION_SIGNIFICANT) ? INT1_CTRL_SIGN_MOT : 0) | 
+													((motionEvents & MEMS_MOTION_STEP) ? INT1_CTRL_STEP_DETECTOR : 0));
 }
 
-static Module_Status LSM6DS3SampleTempCelsius(float *temp)
+/* Lines carrying motion events, one bit per IMU_INT line
+*/
+static uint8_t MotionEventLines(void)
 {
-	uint8_t buff[2];
-	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_OUT_TEMP_L, buff, 2) != MEMS_SUCCESS)
-		return H0BR4_ERR_LSM6DS3;
-	
-	int16_t rawTemp = concatBytes(buff[0], buff[1]);
-	*temp = (((float)rawTemp)/16) + 25;
+	uint8_t lines = 0;
 	
-	return H0BR4_OK;
+	if (motionEvents & ~(MEMS_MOTION_SIGNIFICANT | MEMS_MOTION_STEP))
+		lines |= (1U << (motionLine - 1));
+	if (motionEvents & (MEMS_MOTION_SIGNIFICANT | MEMS_MOTION_STEP))
+		lines |= 1U;
+	return lines;
 }
 
-static Module_Status LSM6DS3SampleTempFahrenheit(float *temp)
+/* Read the event sources, which also releases the latched line, and report the enabled events: 
+		event mask, 6D orientation (ZH, ZL, YH, YL, XH, XL) and tap source (sign, X, Y, Z).
+*/
+static void LSM6DS3ReportMotionEvents(void)
 {
-	Module_Status status = H0BR4_OK;
-	float celsius = 0;
+	uint8_t src[3], func = 0, events = 0;
+	uint8_t payload[3];
 	
-	if ((status = LSM6DS3SampleTempCelsius(&celsius)) != H0BR4_OK)
-		return status;
+	// WAKE_UP_SRC, TAP_SRC and D6D_SRC are contiguous
+	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_WAKE_UP_SRC_REG, src, sizeof(src)) != MEMS_SUCCESS)
+		return;
+	if ((motionEvents & (MEMS_MOTION_TILT | MEMS_MOTION_SIGNIFICANT | MEMS_MOTION_STEP)) && 
+			LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_FUNC_SRC_REG, &func, 1) != MEMS_SUCCESS)
+		return;
 	
-	*temp = celsiusToFahrenheit(celsius);
-	return H0BR4_OK;
+	if (src[0] & WAKE_UP_SRC_WU_IA)
+		events |= MEMS_MOTION_WAKE_UP;
+	if (src[0] & WAKE_UP_SRC_FF_IA)
+		events |= MEMS_MOTION_FREE_FALL;
+	if (src[1] & TAP_SRC_SINGLE_TAP)
+		events |= MEMS_MOTION_SINGLE_TAP;
+	if (src[1] & TAP_SRC_DOUBLE_TAP)
+		events |= MEMS_MOTION_DOUBLE_TAP;
+	if (src[2] & D6D_SRC_D6D_IA)
+		events |= MEMS_MOTION_6D;
+	if (func & FUNC_SRC_TILT_IA)
+		events |= MEMS_MOTION_TILT;
+	if (func & FUNC_SRC_SIGN_MOTION_IA)
+		events |= MEMS_MOTION_SIGNIFICANT;
+	if (func & FUNC_SRC_STEP_DETECTED)
+		events |= MEMS_MOTION_STEP;
+	
+	if ((events &= motionEvents) == 0)
+		return;
+	
+	motionEventCount++;
+	lastMotionEvents = events;
+	
+	if (motionModule == 0)
+		return;
+	
+	payload[0] = events;
+	payload[1] = src[2] & D6D_SRC_ORIENTATION;
+	payload[2] = src[1] & TAP_SRC_DIRECTION;
+	
+	if (motionModule == myID) {
+		writePxITMutex(motionPort, (char *)payload, sizeof(payload), 10);
+	} else if (MessageParamsLock()) {
+		memcpy(messageParams, payload, sizeof(payload));
+		SendMessageToModule(motionModule, CODE_H0BR4_MOTION_EVENT, sizeof(payload));
+		MessageParamsUnlock();
+	}
 }
 
-static Module_Status LSM6DS3Init(void)
+/* Extend a 24-bit LSM6DS3 timestamp (25 us per LSB) on the sensor timeline. The elapsed HAL_GetTick() 
+		time counts the wraps (every 419 s) between reads far apart. A read that trails the last one, as 
+		when two tasks read concurrently, is placed before it without moving the timeline.
+*/
+static uint64_t LSM6DS3ExtendTimestamp(const uint8_t *ts)
 {
-	// Common Init
-	Module_Status status = H0BR4_OK;
-	if ((status = LSM6D3Enable()) != H0BR4_OK)
-		return status;
+	uint32_t raw = ((uint32_t)ts[2] << 16) | ((uint32_t)ts[1] << 8) | ts[0];
+	uint32_t tick = HAL_GetTick();
+	uint32_t back = 0;
+	uint64_t delta = 0, expected = 0, timeUs = 0;
 	
-	if ((status = LSM6D3SetupGyro()) != H0BR4_OK)
-		return status;
+	taskENTER_CRITICAL();
+	expected = (uint64_t)(tick - memsTimeTick) * (1000 / IMU_TIMESTAMP_US);
+	back = (memsTimeRaw - raw) & IMU_TIMESTAMP_MASK;
 	
-	if ((status = LSM6D3SetupAcc()) != H0BR4_OK)
-		return status;
+	if (!memsTimeSynced) {
+		// Continue from the MCU time: the counter starts at an arbitrary value
+		memsTimeUs += (uint64_t)(tick - memsTimeTick) * 1000;
+		memsTimeSynced = true;
+	} else if (back && back < IMU_TIMESTAMP_REORDER && expected < (IMU_TIMESTAMP_MASK >> 1)) {
+		timeUs = memsTimeUs - (uint64_t)back * IMU_TIMESTAMP_US;
+		taskEXIT_CRITICAL();
+		return timeUs;
+	} else {
+		delta = (raw - memsTimeRaw) & IMU_TIMESTAMP_MASK;
+		if (expected > delta + (IMU_TIMESTAMP_MASK >> 1))
+			delta += ((expected - delta + (IMU_TIMESTAMP_MASK >> 1)) >> 24) << 24;
+		memsTimeUs += delta * IMU_TIMESTAMP_US;
+	}
 	
-	// TODO: Configure Interrupt Lines
+	memsTimeRaw = raw;
+	memsTimeTick = tick;
+	timeUs = memsTimeUs;
+	taskEXIT_CRITICAL();
 	
-	return status;
+	return timeUs;
 }
 
-
-//static Module_Status LSM303AccInit(void)
-//{
-//	// Check WhoAmI
-//	uint8_t who_am_i;
-//	if (LSM303AGR_ACC_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//
-//	if (who_am_i != LSM303AGR_ACC_WHO_AM_I)
-//		return H0BR4_ERR_LSM303;
-//	
-//	// Enable Block Data update
-//	if (LSM303AGR_ACC_W_BlockDataUpdate(&hi2c2, LSM303AGR_ACC_BDU_ENABLED) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	// FIFO Mode: ByPass
-//	if (LSM303AGR_ACC_W_FifoMode(&hi2c2, LSM303AGR_ACC_FM_BYPASS) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	// ODR: Power Down
-//	if (LSM303AGR_ACC_W_ODR(&hi2c2, LSM303AGR_ACC_ODR_DO_PWR_DOWN) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	// Operating mode Selection: High Resolution
-//	if (LSM303AGR_ACC_W_HiRes(&hi2c2, LSM303AGR_ACC_HR_ENABLED) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	// Operating mode Selection: Low Power Disable
-//	if (LSM303AGR_ACC_W_LOWPWR_EN(&hi2c2, LSM303AGR_ACC_LPEN_DISABLED) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	// Full Scale Selection
-//	if (LSM303AGR_ACC_W_FullScale(&hi2c2, LSM303AGR_ACC_FS_8G) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	// Enable Axes: X, Y, Z
-//	if (LSM303AGR_ACC_W_XEN(&hi2c2, LSM303AGR_ACC_XEN_ENABLED) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	if (LSM303AGR_ACC_W_YEN(&hi2c2, LSM303AGR_ACC_YEN_ENABLED) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	if (LSM303AGR_ACC_W_ZEN(&hi2c2, LSM303AGR_ACC_ZEN_ENABLED) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	return H0BR4_OK;
-//}
-
-//static Module_Status LSM303AccDeInit(void)
-//{
-//	// Check WhoAmI
-//	uint8_t who_am_i;
-//	if ( LSM303AGR_ACC_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//  
-//	if (who_am_i != LSM303AGR_ACC_WHO_AM_I)
-//		return H0BR4_ERR_LSM303;
-//	
-//	// ODR: Power Down
-//	if (LSM303AGR_ACC_W_ODR(&hi2c2, LSM303AGR_ACC_ODR_DO_PWR_DOWN) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	return H0BR4_OK;
-//}
-
-//static Module_Status LSM303AccGetAxis(int *accX, int *accY, int *accZ)
-//{
-//	int data[3];
-//  /* Read data from LSM303AGR. */
-//  if (LSM303AGR_ACC_Get_Acceleration(&hi2c2, data) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//  /* Calculate the data. */
-//  *accX = data[0];
-//  *accX = data[1];
-//  *accZ = data[2];
-//
-//  return H0BR4_OK;
-//}
-
-//static Module_Status LSM303AccGetAxesRaw(int16_t *accX, int16_t *accY, int16_t *accZ)
-//{
-//  Type3Axis16bit_U raw_data_tmp;
-//  uint8_t shift = 0;
-//  LSM303AGR_ACC_LPEN_t lp;
-//  LSM303AGR_ACC_HR_t hr;
-//
-//  /* Determine which operational mode the acc is set */
-//  if (LSM303AGR_ACC_R_HiRes(&hi2c2, &hr) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//
-//  if (LSM303AGR_ACC_R_LOWPWR_EN(&hi2c2, &lp) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//
-//  if ((lp == LSM303AGR_ACC_LPEN_ENABLED) && (hr == LSM303AGR_ACC_HR_DISABLED)) {
-//    /* op mode is LP 8-bit */
-//    shift = 8;
-//  } else if ((lp == LSM303AGR_ACC_LPEN_DISABLED) && (hr == LSM303AGR_ACC_HR_DISABLED)) {
-//    /* op mode is Normal 10-bit */
-//    shift = 6;
-//  } else if ((lp == LSM303AGR_ACC_LPEN_DISABLED) && (hr == LSM303AGR_ACC_HR_ENABLED)) {
-//    /* op mode is HR 12-bit */
-//    shift = 4;
-//  } else {
-//    return H0BR4_ERR_LSM303;
-//  }
-//
-//  /* Read output registers from LSM303AGR_ACC_GYRO_OUTX_L_XL to LSM303AGR_ACC_GYRO_OUTZ_H_XL. */
-//  if (LSM303AGR_ACC_Get_Raw_Acceleration(&hi2c2, raw_data_tmp.u8bit) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//
-//  /* Format the data. */
-//  *accX = (raw_data_tmp.i16bit[0] >> shift);
-//  *accY = (raw_data_tmp.i16bit[1] >> shift);
-//  *accZ = (raw_data_tmp.i16bit[2] >> shift);
-//
-//  return H0BR4_OK;
-//}
-
-//static Module_Status LSM303AccGetDRDYStatus(bool *status)
-//{
-//  LSM303AGR_ACC_XDA_t status_raw;
-//  if (LSM303AGR_ACC_R_XDataAvail(&hi2c2, &status_raw ) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//  
-//  switch (status_raw) {
-//    case LSM303AGR_ACC_XDA_AVAILABLE:
-//      *status = true;
-//      break;
-//    case LSM303AGR_ACC_XDA_NOT_AVAILABLE:
-//      *status = false;
-//      break;
-//    default:
-//      return H0BR4_ERR_LSM303;
-//  }
-//  return H0BR4_OK;
-//}
-
-//static Module_Status LSM303AccClearDRDY(void)
-//{
-//  uint8_t regValue[6];
-//	
-//	if (LSM303AGR_ACC_ReadReg(&hi2c2, LSM303AGR_ACC_OUT_X_L, regValue, 2) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//  
-//	
-//	if (LSM303AGR_ACC_ReadReg(&hi2c2, LSM303AGR_ACC_OUT_Y_L, regValue, 2) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	if (LSM303AGR_ACC_ReadReg(&hi2c2, LSM303AGR_ACC_OUT_Z_L, regValue, 2) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//  return H0BR4_OK;
-//}
-
-static Module_Status LSM303MagEnable(void)
+/* Read the LSM6DS3 timestamp on the sensor timeline. Sensors powered down between samples 
+		use the MCU time mapped on the timeline instead.
+*/
+static Module_Status LSM6DS3SampleTime(uint64_t *timeUs)
 {
-	if (LSM303AGR_MAG_W_MD(&hi2c2, LSM303AGR_MAG_MD_CONTINUOS_MODE) != MEMS_SUCCESS)
-    return H0BR4_ERR_LSM303;
+	uint8_t ts[3];
+	
+	if (powerMode == MEMS_POWER_DUTY_CYCLED) {
+		*timeUs = MemsTickToTimeUs(HAL_GetTick());
+		return H0BR4_OK;
+	}
+	
+	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_TIMESTAMP0_REG, ts, sizeof(ts)) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
 	
+	*timeUs = LSM6DS3ExtendTimestamp(ts);
 	return H0BR4_OK;
 }
 
-//static Module_Status LSM303MagDisable(void)
-//{
-//	if (LSM303AGR_MAG_W_MD(&hi2c2, LSM303AGR_MAG_MD_IDLE1_MODE) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//	return H0BR4_OK;
-//}
-
-static Module_Status LSM303MagInit(void)
+/* Record the time of the sample just read by the calling task for its output path. One slot per 
+		task, so background tasks sampling concurrently do not overwrite the time of a streamed sample.
+*/
+static void SetSampleTime(uint64_t timeUs)
 {
-	// Check the Sensor
-	uint8_t who_am_i = 0x00;
-  if (LSM303AGR_MAG_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
-    return H0BR4_ERR_LSM303;
-  
-  if (who_am_i != LSM303AGR_MAG_WHO_AM_I)
-    return H0BR4_ERR_LSM303;
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+	uint8_t i = 0;
 	
-	// Operating Mode: Power Down
-	if (LSM303AGR_MAG_W_MD(&hi2c2, LSM303AGR_MAG_MD_IDLE1_MODE) != MEMS_SUCCESS)
-    return H0BR4_ERR_LSM303;
+	taskENTER_CRITICAL();
+	// Slots fill in order and are never freed: the first empty one ends the search
+	for (i = 0; i < MEMS_SAMPLE_TIME_SLOTS && sampleTimes[i].task != task && sampleTimes[i].task != NULL; i++);
+	if (i == MEMS_SAMPLE_TIME_SLOTS) {
+		i = sampleTimeEvict;
+		sampleTimeEvict = (sampleTimeEvict + 1) % MEMS_SAMPLE_TIME_SLOTS;
+	}
+	sampleTimes[i].task = task;
+	sampleTimes[i].timeUs = (uint32_t)timeUs;
+	taskEXIT_CRITICAL();
+}
+
+/* Run the timestamp counter at 25 us per LSB. TAP_CFG and WAKE_UP_DUR are shared with the motion functions
+*/
+static Module_Status LSM6DS3EnableTimestamp(void)
+{
+	Module_Status status = H0BR4_OK;
 	
-	// Enable Block Data Update
-  if (LSM303AGR_MAG_W_BDU(&hi2c2, LSM303AGR_MAG_BDU_ENABLED ) != MEMS_SUCCESS)
-    return H0BR4_ERR_LSM303;
+	if ((status = LSM6DS3UpdateReg(LSM6DS3_WAKE_UP_DUR_REG, WAKE_UP_DUR_TIMER_HR, WAKE_UP_DUR_TIMER_HR)) != H0BR4_OK)
+		return status;
 	
-	// TODO: Change the default ODR
-	if (LSM303AGR_MAG_W_ODR(&hi2c2, LSM303AGR_MAG_ODR_10Hz) != MEMS_SUCCESS)
-    return H0BR4_ERR_LSM303;
-
-	// Self Test Disabled
-	if (LSM303AGR_MAG_W_ST(&hi2c2, LSM303AGR_MAG_ST_DISABLED) != MEMS_SUCCESS)
-    return H0BR4_ERR_LSM303;
-
-  return LSM303MagEnable();
+	return LSM6DS3UpdateReg(LSM6DS3_TAP_CFG_REG, TAP_CFG_TIMER_EN, TAP_CFG_TIMER_EN);
 }
 
-//static Module_Status LSM303MagDeInit(void)
-//{
-//	// Check the Sensor
-//	uint8_t who_am_i = 0x00;
-//  if (LSM303AGR_MAG_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//	
-//  if (who_am_i != LSM303AGR_MAG_WHO_AM_I)
-//    return H0BR4_ERR_LSM303;
-//	
-//	return LSM303MagDisable();
-//}
+/* Copy three axes from the acquisition cache. The task updates it from a higher priority.
+*/
+static Module_Status ReadCachedAxes(const int16_t *axes, const uint32_t *count, const uint32_t *time, int16_t *x, int16_t *y, int16_t *z)
+{
+	Module_Status status = H0BR4_OK;
+	uint32_t timeUs = 0;
+	
+	taskENTER_CRITICAL();
+	*x = axes[0];
+	*y = axes[1];
+	*z = axes[2];
+	timeUs = *time;
+	if (*count == 0)
+		status = H0BR4_ERR_BUSY;		// No data-ready event yet
+	taskEXIT_CRITICAL();
+	
+	SetSampleTime(timeUs);
+	return status;
+}
 
-static Module_Status LSM303SampleMagRaw(int16_t *magX, int16_t *magY, int16_t *magZ)
+static Module_Status LSM6DS3RouteInterrupts(MemsAcqMode_t mode)
 {
-	int16_t *pData;
-	uint8_t data[6];
+	bool drdy = (mode == MEMS_ACQ_DRDY);
+	bool fifo = (mode == MEMS_ACQ_FIFO);
 	
-	memset(data, 0, sizeof(data));
+	// Accelerometer data-ready on IMU_INT1
+	if (LSM6DS3_ACC_GYRO_W_DRDY_XL_on_INT1(&hi2c2, drdy ? LSM6DS3_ACC_GYRO_INT1_DRDY_XL_ENABLED : 
+																											LSM6DS3_ACC_GYRO_INT1_DRDY_XL_DISABLED) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
 	
-	if (LSM303AGR_MAG_Get_Raw_Magnetic(&hi2c2, data) != MEMS_SUCCESS)
-		return H0BR4_ERR_LSM303;
+	// Gyroscope data-ready on IMU_INT2
+	if (LSM6DS3_ACC_GYRO_W_DRDY_G_on_INT2(&hi2c2, drdy ? LSM6DS3_ACC_GYRO_INT2_DRDY_G_ENABLED : 
+																										 LSM6DS3_ACC_GYRO_INT2_DRDY_G_DISABLED) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
 	
-	pData = (int16_t *)data;
-	*magX = pData[0];
-	*magY = pData[1];
-	*magZ = pData[2];
+	// FIFO threshold on IMU_INT1
+	if (LSM6DS3_ACC_GYRO_W_FTH_on_INT1(&hi2c2, fifo ? LSM6DS3_ACC_GYRO_INT1_FTH_ENABLED : 
+																							LSM6DS3_ACC_GYRO_INT1_FTH_DISABLED) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
 	
 	return H0BR4_OK;
 }
 
-static Module_Status LSM303SampleMagMGauss(int *magX, int *magY, int *magZ)
+/* Map a FIFO decimation factor to its DEC_FIFO field code (0 = sensor not in FIFO)
+*/
+static bool FifoDecimationCode(uint8_t decimation, uint8_t *code)
 {
-	Module_Status status = H0BR4_OK;
-  int16_t rawMagX, rawMagY, rawMagZ;
-
-  /* Read raw data from LSM303AGR output register. */
-  if ((status = LSM303SampleMagRaw(&rawMagX, &rawMagY, &rawMagZ)) != H0BR4_OK)
-    return status;
+	switch (decimation)
+	{
+		case 0: *code = 0; break;
+		case 1: *code = 1; break;
+		case 2: *code = 2; break;
+		case 3: *code = 3; break;
+		case 4: *code = 4; break;
+		case 8: *code = 5; break;
+		case 16: *code = 6; break;
+		case 32: *code = 7; break;
+		default: return false;
+	}
+	return true;
+}
 
-  /* Set the raw data. */
-  *magX = rawMagX * (float)LSM303AGR_MAG_SENSITIVITY_FOR_FS_50G;
-  *magY = rawMagY * (float)LSM303AGR_MAG_SENSITIVITY_FOR_FS_50G;
-  *magZ = rawMagZ * (float)LSM303AGR_MAG_SENSITIVITY_FOR_FS_50G;
-  return status;
+/* Build the order of data sets in one FIFO pattern. On each FIFO ODR tick the gyro set 
+		is stored first, then the accelerometer set, each only on ticks matching its decimation.
+*/
+static void BuildFifoPattern(uint8_t gyroDecimation, uint8_t accDecimation)
+{
+	uint8_t ticks = 1, tick = 0;
+	
+	// Pattern repeats every lcm(gyroDecimation, accDecimation) ticks
+	while ((gyroDecimation && (ticks % gyroDecimation)) || (accDecimation && (ticks % accDecimation)))
+		ticks++;
+	
+	fifoPatternLen = 0;
+	for (tick = 0; tick < ticks; tick++)
+	{
+		if (gyroDecimation && (tick % gyroDecimation) == 0)
+			fifoPattern[fifoPatternLen++] = FIFO_SET_GYRO;
+		if (accDecimation && (tick % accDecimation) == 0)
+			fifoPattern[fifoPatternLen++] = FIFO_SET_ACC;
+	}
 }
 
-//static Module_Status LSM303MagGetDRDYStatus(bool *status)
-//{
-//  LSM303AGR_MAG_ZYXDA_t status_raw;
-//
-//  if (LSM303AGR_MAG_R_ZYXDA(&hi2c2, &status_raw ) != MEMS_SUCCESS)
-//    return H0BR4_ERR_LSM303;
-//
-//  switch (status_raw) {
-//    case LSM303AGR_MAG_ZYXDA_EV_ON:
-//      *status = true;
-//      break;
-//    case LSM303AGR_MAG_ZYXDA_EV_OFF:
-//      *status = false;
-//      break;
-//    default:
-//      return H0BR4_ERR_LSM303;
-//  }
-//  return H0BR4_OK;
-//}
+/* FIFO ODR: the configured ODR of the fastest sensor stored in the FIFO. A faster FIFO would store 
+		repeated outputs, a slower one would drop them. Decimations are relative to it.
+*/
+static uint16_t FifoOdrHz(void)
+{
+	uint16_t hz = 0;
+	
+	if (fifoGyroDecimation)
+		hz = gyroOdrTable[gyroOdrIdx].hz;
+	if (fifoAccDecimation && accOdrTable[accOdrIdx].hz > hz)
+		hz = accOdrTable[accOdrIdx].hz;
+	return hz;
+}
 
-static Module_Status PollingSleepCLISafe(uint32_t period)
+/* FIFO ODR code running at the sensor ODR hz
+*/
+static bool FifoOdrCode(uint16_t hz, uint8_t *code)
 {
-	const unsigned DELTA_SLEEP_MS = 100; // milliseconds
-	long numDeltaDelay =  period / DELTA_SLEEP_MS;
-	unsigned lastDelayMS = period % DELTA_SLEEP_MS;
+	uint8_t i = 0;
 	
-	while (numDeltaDelay-- > 0) {
-		vTaskDelay(pdMS_TO_TICKS(DELTA_SLEEP_MS));
-		
-		// Look for ENTER key to stop the stream
-		for (uint8_t chr=0 ; chr<MSG_RX_BUF_SIZE ; chr++)
-		{
-			if (UARTRxBuf[PcPort-1][chr] == '\r') {
-				UARTRxBuf[PcPort-1][chr] = 0;
-				return H0BR4_ERR_TERMINATED;
-			}
+	for (i = 0; i < TABLE_SIZE(fifoOdrTable); i++) {
+		if (fifoOdrTable[i].hz == hz) {
+			*code = fifoOdrTable[i].reg;
+			return true;
 		}
-		
-		if (stopStream)
-			return H0BR4_ERR_TERMINATED;
 	}
-	
-	vTaskDelay(pdMS_TO_TICKS(lastDelayMS));
-	return H0BR4_OK;
+	return false;
 }
 
-
-static Module_Status StreamMemsToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout, SampleMemsToPort function)
+static Module_Status LSM6DS3SetupFifo(bool enable)
 {
-	Module_Status status = H0BR4_OK;
+	uint8_t gyroCode = 0, accCode = 0, odrCode = 0, reg = 0;
 	
-	if (period < MIN_MEMS_PERIOD_MS)
-		return H0BR4_ERR_WrongParams;
-	if (port == 0)
+	// Going through bypass empties the FIFO
+	if (LSM6DS3_ACC_GYRO_W_FIFO_MODE(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_MODE_BYPASS) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	if (!enable)
+		return H0BR4_OK;
+	
+	if (!FifoOdrCode(FifoOdrHz(), &odrCode))
 		return H0BR4_ERR_WrongParams;
-	if (port == PcPort) // Check if CLI is not enabled at that port!
-		return H0BR4_ERR_BUSY;
 	
-	if (period > timeout)
-		timeout = period;
+	FifoDecimationCode(fifoGyroDecimation, &gyroCode);
+	FifoDecimationCode(fifoAccDecimation, &accCode);
+	BuildFifoPattern(fifoGyroDecimation, fifoAccDecimation);
 	
-	long numTimes = timeout / period;
-	stopStream = false;
+	// Threshold in 16-bit words
+	if (LSM6DS3_ACC_GYRO_W_FIFO_Watermark(&hi2c2, fifoWatermark * 3) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
 	
-	while ((numTimes-- > 0) || (timeout >= MAX_MEMS_TIMEOUT_MS)) {
-		if ((status = function(port, module)) != H0BR4_OK)
-			break;
-		
-		vTaskDelay(pdMS_TO_TICKS(period));
-		if (stopStream) {
-			status = H0BR4_ERR_TERMINATED;
-			break;
-		}
-	}
-	return status;
+	// FIFO_CTRL3: DEC_FIFO_GYRO[5:3] and DEC_FIFO_XL[2:0]
+	reg = (gyroCode << 3) | accCode;
+	if (LSM6DS3_ACC_GYRO_WriteReg(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_CTRL3, &reg, 1) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	if (LSM6DS3_ACC_GYRO_W_ODR_FIFO(&hi2c2, odrCode) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	// Continuous mode: oldest data is overwritten if the FIFO is not drained in time
+	if (LSM6DS3_ACC_GYRO_W_FIFO_MODE(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_MODE_DYN_STREAM_2) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	return H0BR4_OK;
 }
 
-static Module_Status StreamMemsToCLI(uint32_t period, uint32_t timeout, SampleMemsToString function)
+/* The FIFO ODR follows the sensor ODRs: restart a running FIFO after a change
+*/
+static Module_Status LSM6DS3RestartFifo(void)
 {
 	Module_Status status = H0BR4_OK;
-	int8_t *pcOutputString = NULL;
-	
-	if (period < MIN_MEMS_PERIOD_MS)
-		return H0BR4_ERR_WrongParams;
-
-	// TODO: Check if CLI is enable or not
 	
-	if (period > timeout)
-		timeout = period;
+	if (acqMode != MEMS_ACQ_FIFO)
+		return H0BR4_OK;
 	
-	long numTimes = timeout / period;
-	stopStream = false;
+	// Keep the acquisition task from draining with the old pattern
+	if (!MemsLock(pdMS_TO_TICKS(MEMS_LOCK_TIMEOUT_MS)))
+		return H0BR4_ERR_BUSY;
+	status = LSM6DS3SetupFifo(true);
+	MemsUnlock();
 	
-	while ((numTimes-- > 0) || (timeout >= MAX_MEMS_TIMEOUT_MS)) {
-		pcOutputString = FreeRTOS_CLIGetOutputBuffer();
-		if ((status = function((char *)pcOutputString, 100)) != H0BR4_OK)
-			break;
-		
-		writePxMutex(PcPort, (char *)pcOutputString, strlen((char *)pcOutputString), cmd500ms, HAL_MAX_DELAY);
-		if (PollingSleepCLISafe(period) != H0BR4_OK)
-			break;
-	}
-
-	memset((char *) pcOutputString, 0, configCOMMAND_INT_MAX_OUTPUT_SIZE);
-  sprintf((char *)pcOutputString, "\r\n");
 	return status;
 }
 
-static Module_Status StreamMemsToBuf( float *buffer, uint32_t numDatapoints, uint32_t period, uint32_t timeout, 
-																																						SampleMemsToBuffer function)
+/* Drain the FIFO in a single multi-byte read and demultiplex the pattern into per-sensor arrays.
+		Sets *more if the FIFO still holds a full threshold afterwards.
+*/
+static Module_Status LSM6DS3DrainFifo(bool *more)
 {
-	Module_Status status = H0BR4_OK;
+	uint8_t status[4];
+	uint16_t words = 0, pending = 0, patternIdx = 0, skip = 0, set = 0, i = 0;
+	int16_t *dst = NULL;
+	int16_t filtered[3];
+	uint64_t timeUs = 0;
 	
-	if (period < MIN_MEMS_PERIOD_MS)
+	*more = false;
+	if (fifoPatternLen == 0)
 		return H0BR4_ERR_WrongParams;
-
-	// TODO: Check if CLI is enable or not
 	
-	if (period > timeout)
-		timeout = period;
+	// FIFO_STATUS1..4: unread words and the position of the next word in the pattern
+	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_STATUS1, status, 4) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
 	
-	long numTimes = timeout / period;
-	stopStream = false;
+	pending = ((uint16_t)(status[1] & 0x0F) << 8) | status[0];
+	patternIdx = ((uint16_t)(status[3] & 0x03) << 8) | status[2];
 	
-	while ((numTimes-- > 0) || (timeout >= MAX_MEMS_TIMEOUT_MS)) {
-		if ((status = function(buffer)) != H0BR4_OK)
-			break;
+	// Realign on a data set boundary if a previous read stopped mid-set
+	skip = (3 - (patternIdx % 3)) % 3;
+	if (pending < skip + 3)
+		return H0BR4_OK;
+	
+	words = pending;
+	if (words > FIFO_MAX_WORDS)
+		words = FIFO_MAX_WORDS;
+	words = skip + ((words - skip) / 3) * 3;
+	
+	// Output address rolls back from FIFO_DATA_OUT_H to FIFO_DATA_OUT_L so one burst drains all words
+	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L, fifoRaw, words * 2) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	// The last set drained was written within one FIFO period of now
+	if (LSM6DS3SampleTime(&timeUs) != H0BR4_OK)
+		return H0BR4_ERR_LSM6DS3;
+	
+	set = ((patternIdx + skip) / 3) % fifoPatternLen;
+	
+	vTaskSuspendAll();
+	fifoBatch.numGyro = 0;
+	fifoBatch.numAcc = 0;
+	for (i = skip; i < words; i += 3)
+	{
+		if (fifoPattern[set] == FIFO_SET_GYRO)
+			dst = fifoBatch.gyro[fifoBatch.numGyro++];
+		else
+			dst = fifoBatch.acc[fifoBatch.numAcc++];
 		
-		buffer += numDatapoints;
+		dst[0] = concatBytes(fifoRaw[2*i + 1], fifoRaw[2*i]);
+		dst[1] = concatBytes(fifoRaw[2*i + 3], fifoRaw[2*i + 2]);
+		dst[2] = concatBytes(fifoRaw[2*i + 5], fifoRaw[2*i + 4]);
 		
-		vTaskDelay(pdMS_TO_TICKS(period));
-		if (stopStream) {
-			status = H0BR4_ERR_TERMINATED;
-			break;
+		set = (set + 1) % fifoPatternLen;
+	}
+	fifoBatch.sequence++;
+	fifoBatch.timestamp = (uint32_t)timeUs;
+	memsCache.imuTime = memsOutput.imuTime = fifoBatch.timestamp;
+	
+	// Keep the latest raw sample of each sensor, then filter every sample in order and keep the latest 
+	// output for the Sample APIs. The batch itself stays raw
+	if (fifoBatch.numGyro > 0) {
+		memcpy(memsCache.gyro, fifoBatch.gyro[fifoBatch.numGyro - 1], sizeof(memsCache.gyro));
+		memsCache.gyroCount++;
+	}
+	if (fifoBatch.numAcc > 0) {
+		memcpy(memsCache.acc, fifoBatch.acc[fifoBatch.numAcc - 1], sizeof(memsCache.acc));
+		memsCache.accCount++;
+	}
+	for (i = 0; i < fifoBatch.numGyro; i++) {
+		memcpy(filtered, fifoBatch.gyro[i], sizeof(filtered));
+		if (MemsFilterInput(MEMS_FILTER_GYRO, filtered)) {
+			memcpy(memsOutput.gyro, filtered, sizeof(memsOutput.gyro));
+			memsOutput.gyroCount++;
 		}
 	}
-	return status;
+	for (i = 0; i < fifoBatch.numAcc; i++) {
+		memcpy(filtered, fifoBatch.acc[i], sizeof(filtered));
+		if (MemsFilterInput(MEMS_FILTER_ACC, filtered)) {
+			memcpy(memsOutput.acc, filtered, sizeof(memsOutput.acc));
+			memsOutput.accCount++;
+		}
+	}
+	xTaskResumeAll();
+	
+	*more = ((pending - words) >= fifoWatermark * 3);
+	return H0BR4_OK;
 }
 
-
-
-
-/* -----------------------------------------------------------------------
-	|																APIs	 																 	|
-   ----------------------------------------------------------------------- 
+/* IMU sample from the acquisition task's unfiltered or output cache
 */
-
-Module_Status SampleGyroMDPS(int *gyroX, int *gyroY, int *gyroZ)
+static Module_Status ReadCachedImu(const MemsSampleCache_t *cache, ImuRawSample_t *sample)
 {
-	return LSM6DS3SampleGyroMDPS(gyroX, gyroY, gyroZ);
+	if (cache->gyroCount == 0 && cache->accCount == 0)
+		return H0BR4_ERR_BUSY;
+	
+	taskENTER_CRITICAL();
+	sample->temp = cache->temp;
+	memcpy(sample->gyro, cache->gyro, sizeof(sample->gyro));
+	memcpy(sample->acc, cache->acc, sizeof(sample->acc));
+	sample->timestamp = cache->imuTime;
+	taskEXIT_CRITICAL();
+	
+	SetSampleTime(sample->timestamp);
+	return H0BR4_OK;
 }
 
-Module_Status SampleGyroRaw(int16_t *gyroX, int16_t *gyroY, int16_t *gyroZ)
+/* Read temperature, gyro and accelerometer outputs from the same output cycle. Always unfiltered
+*/
+static Module_Status LSM6DS3SampleImuRaw(ImuRawSample_t *sample)
 {
-	return LSM6DS3SampleGyroRaw(gyroX, gyroY, gyroZ);
+	uint8_t buff[LSM6DS3_IMU_OUT_LEN];
+	uint64_t timeUs = 0;
+	
+	if (acqMode != MEMS_ACQ_POLLING)
+		return ReadCachedImu(&memsCache, sample);
+	
+	// A spectrum capture reprograms the accelerometer: wait for it to restore the configuration
+	if (!MemsLock(pdMS_TO_TICKS(MEMS_LOCK_TIMEOUT_MS)))
+		return H0BR4_ERR_BUSY;
+	
+	// OUT_TEMP_L to OUTZ_H_XL in one auto-increment burst, BDU keeps them from the same cycle. The 
+	// timestamp follows in a short read of its own
+	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_OUT_TEMP_L, buff, LSM6DS3_IMU_OUT_LEN) != MEMS_SUCCESS || 
+			LSM6DS3SampleTime(&timeUs) != H0BR4_OK) {
+		MemsUnlock();
+		return H0BR4_ERR_LSM6DS3;
+	}
+	MemsUnlock();
+	
+	sample->timestamp = (uint32_t)timeUs;
+	SetSampleTime(timeUs);
+	
+	sample->temp = concatBytes(buff[1], buff[0]);
+	sample->gyro[0] = concatBytes(buff[3], buff[2]);
+	sample->gyro[1] = concatBytes(buff[5], buff[4]);
+	sample->gyro[2] = concatBytes(buff[7], buff[6]);
+	sample->acc[0] = concatBytes(buff[9], buff[8]);
+	sample->acc[1] = concatBytes(buff[11], buff[10]);
+	sample->acc[2] = concatBytes(buff[13], buff[12]);
+	
+	return H0BR4_OK;
 }
 
+/* Time from wake-up to the first valid output of the given sensors in duty-cycled mode
+*/
+static uint32_t MemsDutySettleMs(uint8_t sensors)
+{
+	uint32_t settleMs = 0, ms = 0;
+	
+	if (sensors & MEMS_SENSOR_GYRO) {
+		ms = GYRO_TURN_ON_MS + 1000 / gyroOdrTable[gyroOdrIdx].hz + 1;
+		settleMs = (ms > settleMs) ? ms : settleMs;
+	}
+	if (sensors & MEMS_SENSOR_ACC) {
+		ms = (ACC_SETTLE_SAMPLES * 1000) / accOdrTable[accOdrIdx].hz + 1;
+		settleMs = (ms > settleMs) ? ms : settleMs;
+	}
+	// A single magnetometer measurement completes within one ODR period
+	if (sensors & MEMS_SENSOR_MAG) {
+		ms = 1000 / magOdrTable[magOdrIdx].hz + 1;
+		settleMs = (ms > settleMs) ? ms : settleMs;
+	}
+	
+	return settleMs;
+}
 
-Module_Status SampleGyroDPSToPort(uint8_t port, uint8_t module)
+/* Take a duty-cycled power-up of the given LSM6DS3 sensors. The first user powers a sensor up, later 
+		ones share it. *ready is the tick of the first valid output of all of them. Every call but a 
+		H0BR4_ERR_BUSY one must be matched by LSM6DS3DutyPowerDown, even after a failed write.
+*/
+static Module_Status LSM6DS3DutyPowerUp(uint8_t sensors, TickType_t *ready)
 {
-	float buffer[3]; // Three Samples X, Y, Z
-	static uint8_t temp[12];
 	Module_Status status = H0BR4_OK;
+	TickType_t now = 0;
 	
-	if ((status = SampleGyroDPSToBuf(buffer)) != H0BR4_OK)
-		return status;
-	
-	/*memcpy(messageParams, buffer, sizeof(buffer));
-	if (SendMessageFromPort(port, myID, module, CODE_H0BR4_RESULT_GYRO, sizeof(buffer)) != BOS_OK)
-		status = H0BR4_ERR_IO;*/
+	if (!MemsLock(pdMS_TO_TICKS(MEMS_LOCK_TIMEOUT_MS)))
+		return H0BR4_ERR_BUSY;
 	
-	if (module==myID){
-						temp[0] = *((__IO uint8_t *)(&buffer[0])+3);  temp[1] = *((__IO uint8_t *)(&buffer[0])+2);
-						temp[2] = *((__IO uint8_t *)(&buffer[0])+1);  temp[3] = *((__IO uint8_t *)(&buffer[0])+0);
-		
-		        temp[4] = *((__IO uint8_t *)(&buffer[1])+3);  temp[5] = *((__IO uint8_t *)(&buffer[1])+2);
-						temp[6] = *((__IO uint8_t *)(&buffer[1])+1);  temp[7] = *((__IO uint8_t *)(&buffer[1])+0);
-
-		        temp[8] = *((__IO uint8_t *)(&buffer[2])+3);  temp[9] = *((__IO uint8_t *)(&buffer[2])+2);
-						temp[10] = *((__IO uint8_t *)(&buffer[2])+1); temp[11] = *((__IO uint8_t *)(&buffer[2])+0);
-
-						writePxITMutex(port, (char *)&temp[0], 12*sizeof(uint8_t), 10);
-						//memset(temp,0,12*sizeof(uint8_t));
-				}
-			else{
-						messageParams[0]=port;
-					  messageParams[1] = *((__IO uint8_t *)(&buffer[0])+3);  messageParams[2] = *((__IO uint8_t *)(&buffer[0])+2);
-						messageParams[3] = *((__IO uint8_t *)(&buffer[0])+1);  messageParams[4] = *((__IO uint8_t *)(&buffer[0])+0);
-				
-					  messageParams[5] = *((__IO uint8_t *)(&buffer[1])+3);  messageParams[6] = *((__IO uint8_t *)(&buffer[1])+2);
-						messageParams[7] = *((__IO uint8_t *)(&buffer[1])+1);  messageParams[8] = *((__IO uint8_t *)(&buffer[1])+0);
-				
-					  messageParams[9] = *((__IO uint8_t *)(&buffer[2])+3);  messageParams[10] = *((__IO uint8_t *)(&buffer[2])+2);
-						messageParams[11] = *((__IO uint8_t *)(&buffer[2])+1); messageParams[12] = *((__IO uint8_t *)(&buffer[2])+0);
-						SendMessageToModule(module, CODE_PORT_FORWARD, (sizeof(float)*3)+1);
-					}
+	now = *ready = xTaskGetTickCount();
+	if (sensors & MEMS_SENSOR_GYRO) {
+		if (dutyGyroUsers++ == 0) {
+			dutyGyroReady = now + pdMS_TO_TICKS(MemsDutySettleMs(MEMS_SENSOR_GYRO));
+			if (LSM6DS3_ACC_GYRO_W_ODR_G(&hi2c2, gyroOdrTable[gyroOdrIdx].reg) != MEMS_SUCCESS)
+				status = H0BR4_ERR_LSM6DS3;
+		}
+		if ((int32_t)(dutyGyroReady - *ready) > 0)
+			*ready = dutyGyroReady;
+	}
+	if (sensors & MEMS_SENSOR_ACC) {
+		if (dutyAccUsers++ == 0) {
+			dutyAccReady = now + pdMS_TO_TICKS(MemsDutySettleMs(MEMS_SENSOR_ACC));
+			if (LSM6DS3_ACC_GYRO_W_ODR_XL(&hi2c2, accOdrTable[accOdrIdx].reg) != MEMS_SUCCESS)
+				status = H0BR4_ERR_LSM6DS3;
+		}
+		if ((int32_t)(dutyAccReady - *ready) > 0)
+			*ready = dutyAccReady;
+	}
+	MemsUnlock();
 	
 	return status;
 }
 
-Module_Status SampleGyroDPSToString(char *cstring, size_t maxLen)
+/* Give back a duty-cycled power-up. The last user powers the sensor down, unless the mode was 
+		switched to continuous meanwhile. Waits for the lock: the counts must stay balanced
+*/
+static Module_Status LSM6DS3DutyPowerDown(uint8_t sensors)
 {
 	Module_Status status = H0BR4_OK;
-	float x = 0, y = 0, z = 0;
+	bool duty = false;
 	
-	if ((status = SampleGyroDPS(&x, &y, &z)) != H0BR4_OK)
-		return status;
+	MemsLock(portMAX_DELAY);
+	duty = (powerMode == MEMS_POWER_DUTY_CYCLED);
+	
+	if ((sensors & MEMS_SENSOR_GYRO) && dutyGyroUsers > 0 && --dutyGyroUsers == 0 && duty && 
+			LSM6DS3_ACC_GYRO_W_ODR_G(&hi2c2, LSM6DS3_ACC_GYRO_ODR_G_POWER_DOWN) != MEMS_SUCCESS)
+		status = H0BR4_ERR_LSM6DS3;
+	if ((sensors & MEMS_SENSOR_ACC) && dutyAccUsers > 0 && --dutyAccUsers == 0 && duty && 
+			LSM6DS3_ACC_GYRO_W_ODR_XL(&hi2c2, LSM6DS3_ACC_GYRO_ODR_XL_POWER_DOWN) != MEMS_SUCCESS)
+		status = H0BR4_ERR_LSM6DS3;
+	MemsUnlock();
 	
-	snprintf(cstring, maxLen, "Gyro(DPS) | X: %.2f, Y: %.2f, Z: %.2f\r\n", x, y, z);
 	return status;
 }
 
-Module_Status SampleGyroDPS(float *x, float *y, float *z)
+/* LSM6DS3 sample of the Sample APIs. In duty-cycled mode: power up the requested sensors, wait for 
+		their first valid output, read and power them down again. Concurrent samplers share the power-up. 
+		Polling reads the running sensors directly, and the interrupt modes return the filter outputs.
+*/
+static Module_Status LSM6DS3SampleImuDuty(ImuRawSample_t *sample, uint8_t sensors)
 {
 	Module_Status status = H0BR4_OK;
-	int xInMDPS = 0, yInMDPS = 0, zInMDPS = 0;
+	TickType_t ready = 0, now = 0;
 	
-	if ((status = LSM6DS3SampleGyroMDPS(&xInMDPS, &yInMDPS, &zInMDPS)) != H0BR4_OK)
+	if (acqMode != MEMS_ACQ_POLLING)
+		return ReadCachedImu(&memsOutput, sample);
+	if (powerMode != MEMS_POWER_DUTY_CYCLED)
+		return LSM6DS3SampleImuRaw(sample);
+	
+	if ((status = LSM6DS3DutyPowerUp(sensors, &ready)) == H0BR4_ERR_BUSY)
 		return status;
 	
-	*x = ((float)xInMDPS) / 1000;
-	*y = ((float)yInMDPS) / 1000;
-	*z = ((float)zInMDPS) / 1000;
+	if (status == H0BR4_OK) {
+		now = xTaskGetTickCount();
+		if ((int32_t)(ready - now) > 0)
+			vTaskDelay(ready - now);
+		status = LSM6DS3SampleImuRaw(sample);
+	}
+	
+	// Power down even after a failed read
+	if (LSM6DS3DutyPowerDown(sensors) != H0BR4_OK)
+		status = H0BR4_ERR_LSM6DS3;
 	
 	return status;
 }
 
-Module_Status SampleGyroDPSToBuf(float *buffer)
+static Module_Status LSM6DS3SampleGyroRaw(int16_t *gyroX, int16_t *gyroY, int16_t *gyroZ)
 {
-	return SampleGyroDPS(buffer, buffer + 1, buffer + 2);
+	Module_Status status = H0BR4_OK;
+	ImuRawSample_t sample;
+	
+	if (acqMode != MEMS_ACQ_POLLING)
+		return ReadCachedAxes(memsOutput.gyro, &memsOutput.gyroCount, &memsOutput.imuTime, gyroX, gyroY, gyroZ);
+	
+	if ((status = LSM6DS3SampleImuDuty(&sample, MEMS_SENSOR_GYRO)) != H0BR4_OK)
+		return status;
+	
+	*gyroX = sample.gyro[0];
+	*gyroY = sample.gyro[1];
+	*gyroZ = sample.gyro[2];
+	
+	return H0BR4_OK;
 }
 
-Module_Status SampleAccMG(int *accX, int *accY, int *accZ)
+/* Subtract the current gyro bias from raw LSB, saturating
+*/
+static void LSM6DS3RemoveGyroBias(int16_t *gyro)
 {
-	return LSM6DS3SampleAccMG(accX, accY, accZ);
+	int32_t value = 0;
+	uint8_t i = 0;
+	
+	for (i = 0; i < 3; i++) {
+		value = (int32_t)gyro[i] - gyroBiasRaw[i];
+		gyro[i] = (value > INT16_MAX) ? INT16_MAX : (value < INT16_MIN) ? INT16_MIN : value;
+	}
 }
 
-Module_Status SampleAccRaw(int16_t *accX, int16_t *accY, int16_t *accZ)
+/* Raw gyro sample with the bias removed, in LSB
+*/
+static Module_Status LSM6DS3SampleGyroCal(int16_t *gyroX, int16_t *gyroY, int16_t *gyroZ)
 {
-	return LSM6DS3SampleAccRaw(accX, accY, accZ);
+	Module_Status status = H0BR4_OK;
+	int16_t raw[3];
+	
+	if ((status = LSM6DS3SampleGyroRaw(&raw[0], &raw[1], &raw[2])) != H0BR4_OK)
+		return status;
+	
+	LSM6DS3RemoveGyroBias(raw);
+	*gyroX = raw[0];
+	*gyroY = raw[1];
+	*gyroZ = raw[2];
+	
+	return H0BR4_OK;
 }
 
-Module_Status SampleAccGToPort(uint8_t port, uint8_t module)
+static Module_Status LSM6DS3SampleGyroMDPS(int *gyroX, int *gyroY, int *gyroZ)
 {
-	float buffer[3]; // Three Samples X, Y, Z
-	static uint8_t temp[12];
 	Module_Status status = H0BR4_OK;
+	int16_t raw[3];
 	
-	if ((status = SampleAccGToBuf(buffer)) != H0BR4_OK)
+	if ((status = LSM6DS3SampleGyroCal(&raw[0], &raw[1], &raw[2])) != H0BR4_OK)
 		return status;
 	
-	/*memcpy(messageParams, buffer, sizeof(buffer));
-	if (SendMessageFromPort(port, myID, module, CODE_H0BR4_RESULT_ACC, sizeof(buffer)) != BOS_OK)
-		status = H0BR4_ERR_IO;*/
+	*gyroX = raw[0] * gyroSensitivity;
+	*gyroY = raw[1] * gyroSensitivity;
+	*gyroZ = raw[2] * gyroSensitivity;
 	
-	if (module==myID){
-						temp[0] = *((__IO uint8_t *)(&buffer[0])+3);  temp[1] = *((__IO uint8_t *)(&buffer[0])+2);
-						temp[2] = *((__IO uint8_t *)(&buffer[0])+1);  temp[3] = *((__IO uint8_t *)(&buffer[0])+0);
-		
-		        temp[4] = *((__IO uint8_t *)(&buffer[1])+3);  temp[5] = *((__IO uint8_t *)(&buffer[1])+2);
-						temp[6] = *((__IO uint8_t *)(&buffer[1])+1);  temp[7] = *((__IO uint8_t *)(&buffer[1])+0);
-
-		        temp[8] = *((__IO uint8_t *)(&buffer[2])+3);  temp[9] = *((__IO uint8_t *)(&buffer[2])+2);
-						temp[10] = *((__IO uint8_t *)(&buffer[2])+1); temp[11] = *((__IO uint8_t *)(&buffer[2])+0);
-		
-						writePxITMutex(port, (char *)&temp[0], 12*sizeof(uint8_t), 10);
-						//memset(temp,0,12*sizeof(uint8_t));
-				}
-			else{
-						messageParams[0]=port;
-					  messageParams[1] = *((__IO uint8_t *)(&buffer[0])+3);  messageParams[2] = *((__IO uint8_t *)(&buffer[0])+2);
-						messageParams[3] = *((__IO uint8_t *)(&buffer[0])+1);  messageParams[4] = *((__IO uint8_t *)(&buffer[0])+0);
-				
-					  messageParams[5] = *((__IO uint8_t *)(&buffer[1])+3);  messageParams[6] = *((__IO uint8_t *)(&buffer[1])+2);
-						messageParams[7] = *((__IO uint8_t *)(&buffer[1])+1);  messageParams[8] = *((__IO uint8_t *)(&buffer[1])+0);
-				
-					  messageParams[9] = *((__IO uint8_t *)(&buffer[2])+3);  messageParams[10] = *((__IO uint8_t *)(&buffer[2])+2);
-						messageParams[11] = *((__IO uint8_t *)(&buffer[2])+1); messageParams[12] = *((__IO uint8_t *)(&buffer[2])+0);
-						SendMessageToModule(module, CODE_PORT_FORWARD, (sizeof(float)*3)+1);
-					}
-	return status;
+	return H0BR4_OK;
 }
 
-Module_Status SampleAccGToString(char *cstring, size_t maxLen)
+static Module_Status LSM6DS3SampleAccRaw(int16_t *accX, int16_t *accY, int16_t *accZ)
 {
 	Module_Status status = H0BR4_OK;
-	float x = 0, y = 0, z = 0;
+	ImuRawSample_t sample;
+	
+	if (acqMode != MEMS_ACQ_POLLING)
+		return ReadCachedAxes(memsOutput.acc, &memsOutput.accCount, &memsOutput.imuTime, accX, accY, accZ);
 	
-	if ((status = SampleAccG(&x, &y, &z)) != H0BR4_OK)
+	if ((status = LSM6DS3SampleImuDuty(&sample, MEMS_SENSOR_ACC)) != H0BR4_OK)
 		return status;
 	
-	snprintf(cstring, maxLen, "Acc(G) | X: %.2f, Y: %.2f, Z: %.2f\r\n", x, y, z);
-	return status;
+	*accX = sample.acc[0];
+	*accY = sample.acc[1];
+	*accZ = sample.acc[2];
+	
+	return H0BR4_OK;
 }
 
-Module_Status SampleAccG(float *x, float *y, float *z)
+static Module_Status LSM6DS3SampleAccMG(int *accX, int *accY, int *accZ)
 {
 	Module_Status status = H0BR4_OK;
-	int xInMG = 0, yInMG = 0, zInMG = 0;
+	int16_t raw[3];
 	
-	if ((status = LSM6DS3SampleAccMG(&xInMG, &yInMG, &zInMG)) != H0BR4_OK)
+	if ((status = LSM6DS3SampleAccRaw(&raw[0], &raw[1], &raw[2])) != H0BR4_OK)
 		return status;
 	
-	*x = ((float)xInMG) / 1000;
-	*y = ((float)yInMG) / 1000;
-	*z = ((float)zInMG) / 1000;
+	*accX = raw[0] * accSensitivity;
+	*accY = raw[1] * accSensitivity;
+	*accZ = raw[2] * accSensitivity;
 	
-	return status;
+	return H0BR4_OK;
 }
 
-Module_Status SampleAccGToBuf(float *buffer)
+static Module_Status LSM6DS3SampleTempCelsius(float *temp)
 {
-	return SampleAccG(buffer, buffer + 1, buffer + 2);
-}
-
-Module_Status SampleMagMGauss(int *magX, int *magY, int *magZ)
-{
-	return LSM303SampleMagMGauss(magX, magY, magZ);
-}
-
-Module_Status SampleMagRaw(int16_t *magX, int16_t *magY, int16_t *magZ)
-{
-	return LSM303SampleMagRaw(magX, magY, magZ);
+	Module_Status status = H0BR4_OK;
+	ImuRawSample_t sample;
+	
+	// The temperature sensor runs while the gyro or the accelerometer is on
+	if ((status = LSM6DS3SampleImuDuty(&sample, MEMS_SENSOR_ACC)) != H0BR4_OK)
+		return status;
+	
+	*temp = (((float)sample.temp)/16) + 25;
+	
+	return H0BR4_OK;
 }
 
-Module_Status SampleMagMGaussToPort(uint8_t port, uint8_t module)
+static Module_Status LSM6DS3SampleTempFahrenheit(float *temp)
 {
-	float buffer[3]; // Three Samples X, Y, Z
-	static uint8_t temp[12];
 	Module_Status status = H0BR4_OK;
+	float celsius = 0;
 	
-	if ((status = SampleMagMGaussToBuf(buffer)) != H0BR4_OK)
+	if ((status = LSM6DS3SampleTempCelsius(&celsius)) != H0BR4_OK)
 		return status;
 	
-	/*memcpy(messageParams, buffer, sizeof(buffer));
-	if (SendMessageFromPort(port, myID, module, CODE_H0BR4_RESULT_MAG, sizeof(buffer)) != BOS_OK)
-		status = H0BR4_ERR_TIMEOUT;*/
-	
-	if (module==myID){
-						temp[0] = *((__IO uint8_t *)(&buffer[0])+3);  temp[1] = *((__IO uint8_t *)(&buffer[0])+2);
-						temp[2] = *((__IO uint8_t *)(&buffer[0])+1);  temp[3] = *((__IO uint8_t *)(&buffer[0])+0);
-		
-		        temp[4] = *((__IO uint8_t *)(&buffer[1])+3);  temp[5] = *((__IO uint8_t *)(&buffer[1])+2);
-						temp[6] = *((__IO uint8_t *)(&buffer[1])+1);  temp[7] = *((__IO uint8_t *)(&buffer[1])+0);
-
-		        temp[8] = *((__IO uint8_t *)(&buffer[2])+3);  temp[9] = *((__IO uint8_t *)(&buffer[2])+2);
-						temp[10] = *((__IO uint8_t *)(&buffer[2])+1); temp[11] = *((__IO uint8_t *)(&buffer[2])+0);
-
-						writePxITMutex(port, (char *)&temp[0], 12*sizeof(uint8_t), 10);
-						//memset(temp,0,12*sizeof(uint8_t));
-				}
-			else{
-						messageParams[0]=port;
-					  messageParams[1] = *((__IO uint8_t *)(&buffer[0])+3);  messageParams[2] = *((__IO uint8_t *)(&buffer[0])+2);
-						messageParams[3] = *((__IO uint8_t *)(&buffer[0])+1);  messageParams[4] = *((__IO uint8_t *)(&buffer[0])+0);
-				
-					  messageParams[5] = *((__IO uint8_t *)(&buffer[1])+3);  messageParams[6] = *((__IO uint8_t *)(&buffer[1])+2);
-						messageParams[7] = *((__IO uint8_t *)(&buffer[1])+1);  messageParams[8] = *((__IO uint8_t *)(&buffer[1])+0);
-				
-					  messageParams[9] = *((__IO uint8_t *)(&buffer[2])+3);  messageParams[10] = *((__IO uint8_t *)(&buffer[2])+2);
-						messageParams[11] = *((__IO uint8_t *)(&buffer[2])+1); messageParams[12] = *((__IO uint8_t *)(&buffer[2])+0);
-						SendMessageToModule(module, CODE_PORT_FORWARD, (sizeof(float)*3)+1);
-					}
-	return status;
+	*temp = celsiusToFahrenheit(celsius);
+	return H0BR4_OK;
 }
 
-Module_Status SampleMagMGaussToString(char *cstring, size_t maxLen)
+static Module_Status LSM6DS3Init(void)
 {
+	// Common Init
 	Module_Status status = H0BR4_OK;
-	int x = 0, y = 0, z = 0;
+	if ((status = LSM6D3Enable()) != H0BR4_OK)
+		return status;
+	
+	if ((status = LSM6D3SetupGyro()) != H0BR4_OK)
+		return status;
+	
+	if ((status = LSM6D3SetupAcc()) != H0BR4_OK)
+		return status;
 	
-	if ((status = LSM303SampleMagMGauss(&x, &y, &z)) != H0BR4_OK)
+	if ((status = LSM6DS3EnableTimestamp()) != H0BR4_OK)
 		return status;
 	
-	snprintf(cstring, maxLen, "Mag(mGauss) | X: %d, Y: %d, Z: %d\r\n", x, y, z);
+	// Interrupt lines stay unrouted until data-ready acquisition is selected
+	
 	return status;
 }
 
-Module_Status SampleMagMGaussToBuf(float *buffer)
+
+static Module_Status LSM303ApplyAccConfig(void)
 {
-	int iMagMGauss[3];
-	Module_Status status = LSM303SampleMagMGauss(iMagMGauss, iMagMGauss + 1, iMagMGauss + 2);
+	const MemsFullScale_t *fs = &acc2FsTable[acc2FsIdx];
+	uint8_t shift = acc2ModeShift[acc2Mode];
 	
-	buffer[0] = iMagMGauss[0];
-	buffer[1] = iMagMGauss[1];
-	buffer[2] = iMagMGauss[2];
+	// Operating mode: LPen (CTRL_REG1) for low power, HR (CTRL_REG4) for high resolution, neither for 
+	// normal. Entering low power, HR is cleared before LPen is set; leaving it, HR is written before 
+	// LPen is cleared
+	if (acc2Mode == LSM303_ACC_LOW_POWER) {
+		if (LSM303AGR_ACC_W_HiRes(&hi2c2, LSM303AGR_ACC_HR_DISABLED) != MEMS_SUCCESS)
+			return H0BR4_ERR_LSM303;
+		if (LSM303AGR_ACC_W_LOWPWR_EN(&hi2c2, LSM303AGR_ACC_LPEN_ENABLED) != MEMS_SUCCESS)
+			return H0BR4_ERR_LSM303;
+	} else {
+		if (LSM303AGR_ACC_W_HiRes(&hi2c2, (acc2Mode == LSM303_ACC_HIGH_RES) ? LSM303AGR_ACC_HR_ENABLED : 
+															LSM303AGR_ACC_HR_DISABLED) != MEMS_SUCCESS)
+			return H0BR4_ERR_LSM303;
+		if (LSM303AGR_ACC_W_LOWPWR_EN(&hi2c2, LSM303AGR_ACC_LPEN_DISABLED) != MEMS_SUCCESS)
+			return H0BR4_ERR_LSM303;
+	}
 	
-	return status;
+	if (LSM303AGR_ACC_W_FullScale(&hi2c2, fs->reg) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	if (LSM303AGR_ACC_W_ODR(&hi2c2, (acc2Mode == LSM303_ACC_POWER_DOWN) ? LSM303AGR_ACC_ODR_DO_PWR_DOWN : 
+												 acc2OdrTable[acc2OdrIdx].reg) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	// Coarser modes give fewer bits of the same full scale
+	if (shift) {
+		acc2Sensitivity = fs->sensitivity * (1 << (shift - 4));
+		acc2ScaleQ24 = fs->scaleQ24 << (shift - 4);
+	}
+	
+	return H0BR4_OK;
 }
 
-Module_Status SampleTempCelsius(float *temp)
+static Module_Status LSM303AccInit(void)
 {
-	return LSM6DS3SampleTempCelsius(temp);
+	// Check WhoAmI
+	uint8_t who_am_i;
+	if (LSM303AGR_ACC_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+
+	if (who_am_i != LSM303AGR_ACC_WHO_AM_I)
+		return H0BR4_ERR_LSM303;
+	
+	// Enable Block Data update
+	if (LSM303AGR_ACC_W_BlockDataUpdate(&hi2c2, LSM303AGR_ACC_BDU_ENABLED) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	// FIFO Mode: ByPass
+	if (LSM303AGR_ACC_W_FifoMode(&hi2c2, LSM303AGR_ACC_FM_BYPASS) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	// Enable Axes: X, Y, Z
+	if (LSM303AGR_ACC_W_XEN(&hi2c2, LSM303AGR_ACC_XEN_ENABLED) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	if (LSM303AGR_ACC_W_YEN(&hi2c2, LSM303AGR_ACC_YEN_ENABLED) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	if (LSM303AGR_ACC_W_ZEN(&hi2c2, LSM303AGR_ACC_ZEN_ENABLED) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	// Operating mode, full scale and ODR (power down by default)
+	return LSM303ApplyAccConfig();
 }
 
-Module_Status SampleTempFahrenheit(float *temp)
+//static Module_Status LSM303AccDeInit(void)
+//{
+//	// Check WhoAmI
+//	uint8_t who_am_i;
+//	if ( LSM303AGR_ACC_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//  
+//	if (who_am_i != LSM303AGR_ACC_WHO_AM_I)
+//		return H0BR4_ERR_LSM303;
+//	
+//	// ODR: Power Down
+//	if (LSM303AGR_ACC_W_ODR(&hi2c2, LSM303AGR_ACC_ODR_DO_PWR_DOWN) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//	
+//	return H0BR4_OK;
+//}
+
+//static Module_Status LSM303AccGetAxis(int *accX, int *accY, int *accZ)
+//{
+//	int data[3];
+//  /* Read data from LSM303AGR. */
+//  if (LSM303AGR_ACC_Get_Acceleration(&hi2c2, data) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//	
+//  /* Calculate the data. */
+//  *accX = data[0];
+//  *accX = data[1];
+//  *accZ = data[2];
+//
+//  return H0BR4_OK;
+//}
+
+/* The operating mode is cached by LSM303ApplyAccConfig, so a sample is a single 6-byte read
+*/
+static Module_Status LSM303SampleAccRaw(int16_t *accX, int16_t *accY, int16_t *accZ)
 {
-	return LSM6DS3SampleTempFahrenheit(temp);
+  Type3Axis16bit_U raw_data_tmp;
+  uint8_t shift = acc2ModeShift[acc2Mode];
+
+  if (acc2Mode == LSM303_ACC_POWER_DOWN)
+    return H0BR4_ERR_ACC;
+
+  /* Read output registers from LSM303AGR_ACC_OUT_X_L to LSM303AGR_ACC_OUT_Z_H. */
+  if (LSM303AGR_ACC_Get_Raw_Acceleration(&hi2c2, raw_data_tmp.u8bit) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+  
+  SetSampleTime(MemsTickToTimeUs(HAL_GetTick()));
+
+  /* Format the data. */
+  *accX = (raw_data_tmp.i16bit[0] >> shift);
+  *accY = (raw_data_tmp.i16bit[1] >> shift);
+  *accZ = (raw_data_tmp.i16bit[2] >> shift);
+
+  return H0BR4_OK;
 }
 
-Module_Status SampleTempCToPort(uint8_t port, uint8_t module)
+/* Fresh unfiltered LSM6DS3 accelerometer sample for the cross-check. Polling reads the running sensor, 
+		or powers it up in duty-cycled mode; the interrupt modes accept a cached sample at most two 
+		output periods old. False if none
+*/
+static bool LSM6DS3SampleAccFresh(int16_t *acc)
 {
-	float temp;
-	static uint8_t tempD[4];
-	Module_Status status = H0BR4_OK;
-	
-	if ((status = LSM6DS3SampleTempCelsius(&temp)) != H0BR4_OK)
-		return status;
+	ImuRawSample_t sample;
+	int32_t maxAgeUs = 2 * (1000000L / accOdrTable[accOdrIdx].hz) + 1000;		// HAL tick resolution
 	
-	/*memcpy(messageParams, &temp, sizeof(temp));
-	if (SendMessageFromPort(port, myID, module, CODE_H0BR4_RESULT_TEMP, sizeof(temp)) != BOS_OK)
-		status = H0BR4_ERR_TERMINATED;*/
+	if (acqMode == MEMS_ACQ_POLLING) {
+		if (LSM6DS3SampleImuDuty(&sample, MEMS_SENSOR_ACC) != H0BR4_OK)
+			return false;
+	} else {
+		if (LSM6DS3SampleImuRaw(&sample) != H0BR4_OK || 
+				(int32_t)((uint32_t)MemsTickToTimeUs(HAL_GetTick()) - sample.timestamp) > maxAgeUs)
+			return false;
+	}
 	
-if (module==myID){
-						tempD[0] = *((__IO uint8_t *)(&temp)+3);
-						tempD[1] = *((__IO uint8_t *)(&temp)+2);
-						tempD[2] = *((__IO uint8_t *)(&temp)+1);
-						tempD[3] = *((__IO uint8_t *)(&temp)+0);
-						writePxMutex(port, (char *)&tempD[0], 4*sizeof(uint8_t), 10, 10);
-						//writePxITMutex(port, (char *)&tempD[0], 4*sizeof(uint8_t), 10);
-						//memset(tempD,0,4*sizeof(uint8_t));
-				}
-			else{
-						messageParams[0]=port;
-					  messageParams[1] = *((__IO uint8_t *)(&temp)+3);
-						messageParams[2] = *((__IO uint8_t *)(&temp)+2);
-						messageParams[3] = *((__IO uint8_t *)(&temp)+1);
-						messageParams[4] = *((__IO uint8_t *)(&temp)+0);
-						SendMessageToModule(module, CODE_PORT_FORWARD, sizeof(float)+1);
-					}
-	return status;
+	memcpy(acc, sample.acc, sizeof(sample.acc));
+	return true;
 }
 
-Module_Status SampleTempCToString(char *cstring, size_t maxLen)
+/* Raw sample of the accelerometer selected by SetAccChannel and its scale. With the cross-check on, 
+		the other accelerometer is read too and a difference beyond the tolerance is counted
+*/
+static Module_Status SampleAccChannelRaw(int16_t *raw, float *sensitivity, int32_t *scaleQ24)
 {
 	Module_Status status = H0BR4_OK;
-	float temp;
+	int16_t other[3];
+	float otherSensitivity = 0;
+	bool check = false;
+	uint8_t i = 0;
 	
-	if ((status = LSM6DS3SampleTempCelsius(&temp)) != H0BR4_OK)
+	// The other sensor first: the sample time left for the caller is the selected one's. Nothing to 
+	// compare against while it is powered down or has no fresh output
+	if (accCrossCheckMG != 0) {
+		if (accChannel == MEMS_ACC_LSM303AGR) {
+			check = LSM6DS3SampleAccFresh(other);
+			otherSensitivity = accSensitivity;
+		} else {
+			check = (LSM303SampleAccRaw(&other[0], &other[1], &other[2]) == H0BR4_OK);
+			otherSensitivity = acc2Sensitivity;
+		}
+	}
+	
+	if (accChannel == MEMS_ACC_LSM303AGR) {
+		status = LSM303SampleAccRaw(&raw[0], &raw[1], &raw[2]);
+		*sensitivity = acc2Sensitivity;
+		*scaleQ24 = acc2ScaleQ24;
+	} else {
+		status = LSM6DS3SampleAccRaw(&raw[0], &raw[1], &raw[2]);
+		*sensitivity = accSensitivity;
+		*scaleQ24 = accScaleQ24;
+	}
+	
+	if (status != H0BR4_OK || !check)
 		return status;
 	
-	snprintf(cstring, maxLen, "Temp(Celsius) | %0.2f\r\n", temp);
+	for (i = 0; i < 3; i++) {
+		if (fabsf(raw[i] * *sensitivity - other[i] * otherSensitivity) > accCrossCheckMG) {
+			accMismatches++;
+			break;
+		}
+	}
+	
 	return status;
 }
 
-Module_Status StreamGyroDPSToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
-{
-	return StreamMemsToPort(port, module, period, timeout, SampleGyroDPSToPort);
-}
+//static Module_Status LSM303AccGetDRDYStatus(bool *status)
+//{
+//  LSM303AGR_ACC_XDA_t status_raw;
+//  if (LSM303AGR_ACC_R_XDataAvail(&hi2c2, &status_raw ) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//  
+//  switch (status_raw) {
+//    case LSM303AGR_ACC_XDA_AVAILABLE:
+//      *status = true;
+//      break;
+//    case LSM303AGR_ACC_XDA_NOT_AVAILABLE:
+//      *status = false;
+//      break;
+//    default:
+//      return H0BR4_ERR_LSM303;
+//  }
+//  return H0BR4_OK;
+//}
 
-Module_Status StreamGyroDPSToCLI(uint32_t period, uint32_t timeout)
+//static Module_Status LSM303AccClearDRDY(void)
+//{
+//  uint8_t regValue[6];
+//	
+//	if (LSM303AGR_ACC_ReadReg(&hi2c2, LSM303AGR_ACC_OUT_X_L, regValue, 2) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//  
+//	
+//	if (LSM303AGR_ACC_ReadReg(&hi2c2, LSM303AGR_ACC_OUT_Y_L, regValue, 2) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//	
+//	if (LSM303AGR_ACC_ReadReg(&hi2c2, LSM303AGR_ACC_OUT_Z_L, regValue, 2) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//	
+//  return H0BR4_OK;
+//}
+
+static Module_Status LSM303MagRouteDRDY(bool enable)
 {
-	return StreamMemsToCLI(period, timeout, SampleGyroDPSToString);
+	// Magnetometer data-ready on MAG_INT
+	if (LSM303AGR_MAG_W_INT_MAG(&hi2c2, enable ? LSM303AGR_MAG_INT_MAG_ENABLED : LSM303AGR_MAG_INT_MAG_DISABLED) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM303;
+	
+	return H0BR4_OK;
 }
 
-Module_Status StreamGyroDPSToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+static Module_Status LSM303ApplyMagConfig(void)
 {
-	return StreamMemsToBuf(buffer, sizeof(*buffer) * 3, period, timeout, SampleGyroDPSToBuf);
+	if (LSM303AGR_MAG_W_ODR(&hi2c2, magOdrTable[magOdrIdx].reg) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	return H0BR4_OK;
 }
 
-Module_Status StreamAccGToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+static Module_Status LSM303MagEnable(void)
 {
-	return StreamMemsToPort(port, module, period, timeout, SampleAccGToPort);
+	if (LSM303AGR_MAG_W_MD(&hi2c2, LSM303AGR_MAG_MD_CONTINUOS_MODE) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	return H0BR4_OK;
 }
 
-Module_Status StreamAccGToCLI(uint32_t period, uint32_t timeout)
+static Module_Status LSM303MagDisable(void)
 {
-	return StreamMemsToCLI(period, timeout, SampleAccGToString);
+	if (LSM303AGR_MAG_W_MD(&hi2c2, LSM303AGR_MAG_MD_IDLE1_MODE) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	return H0BR4_OK;
 }
 
-Module_Status StreamAccGToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+static Module_Status LSM303MagInit(void)
 {
-	return StreamMemsToBuf(buffer, sizeof(*buffer) * 3, period, timeout, SampleAccGToBuf);
+	// Check the Sensor
+	uint8_t who_am_i = 0x00;
+  if (LSM303AGR_MAG_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+  
+  if (who_am_i != LSM303AGR_MAG_WHO_AM_I)
+    return H0BR4_ERR_LSM303;
+	
+	// Operating Mode: Power Down
+	if (LSM303AGR_MAG_W_MD(&hi2c2, LSM303AGR_MAG_MD_IDLE1_MODE) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	// Enable Block Data Update
+  if (LSM303AGR_MAG_W_BDU(&hi2c2, LSM303AGR_MAG_BDU_ENABLED ) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+	
+	// Magnetometer ODR
+	if (LSM303ApplyMagConfig() != H0BR4_OK)
+    return H0BR4_ERR_LSM303;
+
+	// Self Test Disabled
+	if (LSM303AGR_MAG_W_ST(&hi2c2, LSM303AGR_MAG_ST_DISABLED) != MEMS_SUCCESS)
+    return H0BR4_ERR_LSM303;
+
+  return LSM303MagEnable();
 }
 
-Module_Status StreamMagMGaussToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+/* Check that both sensors answer on the bus at its current speed
+*/
+static Module_Status MemsCheckWhoAmI(void)
 {
-	return StreamMemsToPort(port, module, period, timeout, SampleMagMGaussToPort);
+	uint8_t who_am_i = 0;
+	
+	if (LSM6DS3_ACC_GYRO_R_WHO_AM_I(&hi2c2, &who_am_i) != MEMS_SUCCESS || who_am_i != LSM6DS3_ACC_GYRO_WHO_AM_I)
+		return H0BR4_ERR_LSM6DS3;
+	
+	if (LSM303AGR_MAG_R_WHO_AM_I(&hi2c2, &who_am_i) != MEMS_SUCCESS || who_am_i != LSM303AGR_MAG_WHO_AM_I)
+		return H0BR4_ERR_LSM303;
+	
+	return H0BR4_OK;
 }
 
-Module_Status StreamMagMGaussToCLI(uint32_t period, uint32_t timeout)
+//static Module_Status LSM303MagDeInit(void)
+//{
+//	// Check the Sensor
+//	uint8_t who_am_i = 0x00;
+//  if (LSM303AGR_MAG_R_WHO_AM_I(&hi2c2, &who_am_i ) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//	
+//  if (who_am_i != LSM303AGR_MAG_WHO_AM_I)
+//    return H0BR4_ERR_LSM303;
+//	
+//	return LSM303MagDisable();
+//}
+
+/* Unfiltered magnetometer sample in LSB, for fusion and calibration
+*/
+static Module_Status LSM303SampleMagUnfiltered(int16_t *magX, int16_t *magY, int16_t *magZ)
 {
-	return StreamMemsToCLI(period, timeout, SampleMagMGaussToString);
+	int16_t *pData;
+	uint8_t data[6];
+	
+	if (acqMode != MEMS_ACQ_POLLING)
+		return ReadCachedAxes(memsCache.mag, &memsCache.magCount, &memsCache.magTime, magX, magY, magZ);
+	
+	// Duty-cycled mode: one measurement, then the magnetometer returns to idle by itself
+	if (powerMode == MEMS_POWER_DUTY_CYCLED) {
+		if (LSM303AGR_MAG_W_MD(&hi2c2, LSM303AGR_MAG_MD_SINGLE_MODE) != MEMS_SUCCESS)
+			return H0BR4_ERR_LSM303;
+		vTaskDelay(pdMS_TO_TICKS(MemsDutySettleMs(MEMS_SENSOR_MAG)));
+	}
+	
+	memset(data, 0, sizeof(data));
+	
+	if (LSM303AGR_MAG_Get_Raw_Magnetic(&hi2c2, data) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM303;
+	
+	SetSampleTime(MemsTickToTimeUs(HAL_GetTick()));
+	
+	pData = (int16_t *)data;
+	*magX = pData[0];
+	*magY = pData[1];
+	*magZ = pData[2];
+	
+	return H0BR4_OK;
+}
+
+/* Magnetometer sample of the Sample APIs: the filter output in the interrupt modes
+*/
+static Module_Status LSM303SampleMagRaw(int16_t *magX, int16_t *magY, int16_t *magZ)
+{
+	if (acqMode != MEMS_ACQ_POLLING)
+		return ReadCachedAxes(memsOutput.mag, &memsOutput.magCount, &memsOutput.magTime, magX, magY, magZ);
+	
+	return LSM303SampleMagUnfiltered(magX, magY, magZ);
+}
+
+/* Apply the hard and soft-iron calibration to a sample in LSB. Integer only: 9 multiplies per sample.
+*/
+static void LSM303RemoveMagIron(int16_t *magX, int16_t *magY, int16_t *magZ)
+{
+	int32_t v[3], out[3];
+	const int16_t *w = magCal.softIron;
+	uint8_t i = 0;
+	
+	if (!magCalValid)
+		return;
+	
+	v[0] = *magX - magCal.offset[0];
+	v[1] = *magY - magCal.offset[1];
+	v[2] = *magZ - magCal.offset[2];
+	
+	out[0] = (w[0] * v[0] + w[3] * v[1] + w[4] * v[2]) >> 14;
+	out[1] = (w[3] * v[0] + w[1] * v[1] + w[5] * v[2]) >> 14;
+	out[2] = (w[4] * v[0] + w[5] * v[1] + w[2] * v[2]) >> 14;
+	
+	for (i = 0; i < 3; i++) {
+		if (out[i] > INT16_MAX)
+			out[i] = INT16_MAX;
+		else if (out[i] < INT16_MIN)
+			out[i] = INT16_MIN;
+	}
+	
+	*magX = out[0];
+	*magY = out[1];
+	*magZ = out[2];
+}
+
+/* Sample of the Sample APIs with the hard and soft-iron calibration applied, in LSB
+*/
+static Module_Status LSM303SampleMagCal(int16_t *magX, int16_t *magY, int16_t *magZ)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = LSM303SampleMagRaw(magX, magY, magZ)) == H0BR4_OK)
+		LSM303RemoveMagIron(magX, magY, magZ);
+	return status;
+}
+
+static Module_Status LSM303SampleMagMGauss(int *magX, int *magY, int *magZ)
+{
+	Module_Status status = H0BR4_OK;
+  int16_t rawMagX, rawMagY, rawMagZ;
+
+  /* Read calibrated data from LSM303AGR output register. */
+  if ((status = LSM303SampleMagCal(&rawMagX, &rawMagY, &rawMagZ)) != H0BR4_OK)
+    return status;
+
+  /* Set the raw data: 1.5 mgauss/LSB in integer arithmetic */
+  *magX = (rawMagX * 3) / 2;
+  *magY = (rawMagY * 3) / 2;
+  *magZ = (rawMagZ * 3) / 2;
+  return status;
+}
+
+//static Module_Status LSM303MagGetDRDYStatus(bool *status)
+//{
+//  LSM303AGR_MAG_ZYXDA_t status_raw;
+//
+//  if (LSM303AGR_MAG_R_ZYXDA(&hi2c2, &status_raw ) != MEMS_SUCCESS)
+//    return H0BR4_ERR_LSM303;
+//
+//  switch (status_raw) {
+//    case LSM303AGR_MAG_ZYXDA_EV_ON:
+//      *status = true;
+//      break;
+//    case LSM303AGR_MAG_ZYXDA_EV_OFF:
+//      *status = false;
+//      break;
+//    default:
+//      return H0BR4_ERR_LSM303;
+//  }
+//  return H0BR4_OK;
+//}
+
+/* Raw LSB to Q16.16 engineering units, (raw * scaleQ24) >> 8 in two 32-bit products: no 64-bit 
+		multiply on the Cortex-M0. Exact for scales below 1 unit/LSB.
+*/
+static inline q16_16_t RawToQ16(int16_t raw, int32_t scaleQ24)
+{
+	return (q16_16_t)(raw * (scaleQ24 >> 8) + ((raw * (scaleQ24 & 0xFF)) >> 8));
+}
+
+/* Raw temperature (16 LSB/degC, 0 at 25 degC) to Q16.16 Celsius
+*/
+static inline q16_16_t RawTempToQ16(int16_t raw)
+{
+	return ((q16_16_t)raw << 12) + (25 << 16);
+}
+
+/* Write a 32-bit value MSB first and return the next byte
+*/
+static uint8_t *PackUint32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t)(value >> 24);
+	dst[1] = (uint8_t)(value >> 16);
+	dst[2] = (uint8_t)(value >> 8);
+	dst[3] = (uint8_t)value;
+	return dst + 4;
+}
+
+/* Send one record to port of module. Blocking, and records are built on the stack of the sending 
+		task, so streams of several tasks or slots can send back to back. A record to another module is 
+		dropped with H0BR4_ERR_BUSY when messageParams stays taken
+*/
+static Module_Status SendRecordToPort(uint8_t port, uint8_t module, const uint8_t *record, uint8_t len)
+{
+	if (module == myID) {
+		writePxMutex(port, (char *)record, len, 10, 10);
+		return H0BR4_OK;
+	}
+	
+	if (!MessageParamsLock())
+		return H0BR4_ERR_BUSY;
+	messageParams[0] = port;
+	memcpy(&messageParams[1], record, len);
+	SendMessageToModule(module, CODE_PORT_FORWARD, len+1);
+	MessageParamsUnlock();
+	
+	return H0BR4_OK;
+}
+
+/* Send a sample record: the sample time in us, then up to four 32-bit words (float, Q16.16 or count), 
+		all MSB first. The one serializer of the ToPort APIs and slots
+*/
+static Module_Status SendWordsToPort(uint8_t port, uint8_t module, const void *words, uint8_t count)
+{
+	uint8_t temp[MEMS_TIMESTAMP_BYTES + 16];
+	uint8_t *dst = PackUint32(temp, GetMemsSampleTime());
+	uint32_t word = 0;
+	uint8_t i = 0;
+	
+	for (i = 0; i < count; i++) {
+		memcpy(&word, (const uint8_t *)words + 4*i, sizeof(word));
+		dst = PackUint32(dst, word);
+	}
+	
+	return SendRecordToPort(port, module, temp, MEMS_TIMESTAMP_BYTES + 4*count);
+}
+
+/* Sample three Q16.16 axes and send them
+*/
+static Module_Status SampleAxesQ16ToPort(uint8_t port, uint8_t module, Module_Status (*sample)(q16_16_t *, q16_16_t *, q16_16_t *))
+{
+	Module_Status status = H0BR4_OK;
+	q16_16_t axes[3];
+	
+	if ((status = sample(&axes[0], &axes[1], &axes[2])) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, axes, 3);
+}
+
+/* Restore sensor configuration from EEPROM. Out-of-range indices keep the defaults
+*/
+static void LoadMemsConfig(void)
+{
+	MemsReportConfig_t report;
+	uint16_t word = 0, param = 0, words[5];
+	uint8_t i = 0, j = 0;
+	
+	if (EE_ReadVariable(_EE_MEMS_GYRO_CONFIG, &word) == 0 && (word & MEMS_CONFIG_VALID)) {
+		if (MEMS_CONFIG_FIELD(word, 0) < TABLE_SIZE(gyroOdrTable) && MEMS_CONFIG_FIELD(word, 4) < TABLE_SIZE(gyroFsTable)) {
+			gyroOdrIdx = MEMS_CONFIG_FIELD(word, 0);
+			gyroFsIdx = MEMS_CONFIG_FIELD(word, 4);
+		}
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_ACC_CONFIG, &word) == 0 && (word & MEMS_CONFIG_VALID)) {
+		if (MEMS_CONFIG_FIELD(word, 0) < TABLE_SIZE(accOdrTable) && MEMS_CONFIG_FIELD(word, 4) < TABLE_SIZE(accFsTable) && 
+				MEMS_CONFIG_FIELD(word, 8) < TABLE_SIZE(accBwTable)) {
+			accOdrIdx = MEMS_CONFIG_FIELD(word, 0);
+			accFsIdx = MEMS_CONFIG_FIELD(word, 4);
+			accBwIdx = MEMS_CONFIG_FIELD(word, 8);
+		}
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_MAG_CONFIG, &word) == 0 && (word & MEMS_CONFIG_VALID)) {
+		if (MEMS_CONFIG_FIELD(word, 0) < TABLE_SIZE(magOdrTable))
+			magOdrIdx = MEMS_CONFIG_FIELD(word, 0);
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_ACC2_CONFIG, &word) == 0 && (word & MEMS_CONFIG_VALID)) {
+		if (MEMS_CONFIG_FIELD(word, 0) < TABLE_SIZE(acc2OdrTable) && MEMS_CONFIG_FIELD(word, 4) < TABLE_SIZE(acc2FsTable) && 
+				MEMS_CONFIG_FIELD(word, 8) <= LSM303_ACC_HIGH_RES && MEMS_CONFIG_FIELD(word, 12) <= MEMS_ACC_LSM303AGR) {
+			acc2OdrIdx = MEMS_CONFIG_FIELD(word, 0);
+			acc2FsIdx = MEMS_CONFIG_FIELD(word, 4);
+			acc2Mode = (Lsm303AccMode_t)MEMS_CONFIG_FIELD(word, 8);
+			accChannel = (MemsAccChannel_t)MEMS_CONFIG_FIELD(word, 12);
+		}
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_ACC_CROSS_CHECK, &word) == 0)
+		accCrossCheckMG = word;
+	
+	if (EE_ReadVariable(_EE_MEMS_MOTION_CONFIG, &word) == 0 && (word & MEMS_CONFIG_VALID)) {
+		if ((word & 0xFF & ~MEMS_MOTION_ALL) == 0 && MEMS_CONFIG_FIELD(word, 8) >= 1 && MEMS_CONFIG_FIELD(word, 8) <= 2) {
+			motionEvents = word & 0xFF;
+			motionLine = MEMS_CONFIG_FIELD(word, 8);
+		}
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_MOTION_THRESHOLDS, &word) == 0 && word)
+		motionWakeUpMG = word;
+	if (EE_ReadVariable(_EE_MEMS_MOTION_THRESHOLDS + 1, &word) == 0 && word)
+		motionFreeFallMG = word;
+	if (EE_ReadVariable(_EE_MEMS_MOTION_THRESHOLDS + 2, &word) == 0 && word)
+		motionTapMG = word;
+	
+	if (EE_ReadVariable(_EE_MEMS_MOTION_REPORT, &word) == 0) {
+		motionModule = word >> 8;
+		motionPort = word & 0xFF;
+	}
+	
+	for (i = 0; i < 3; i++) {
+		if (EE_ReadVariable(_EE_MEMS_FILTER + 2*i, &word) == 0 && (word & MEMS_CONFIG_VALID) && 
+				EE_ReadVariable(_EE_MEMS_FILTER + 2*i + 1, &param) == 0 && 
+				MemsFilterValid((MemsFilterType_t)MEMS_CONFIG_FIELD(word, 8), param, word & 0xFF)) {
+			filterConfig[i].type = (MemsFilterType_t)MEMS_CONFIG_FIELD(word, 8);
+			filterConfig[i].param = param;
+			filterConfig[i].decimation = word & 0xFF;
+			memsFilters[i].redesign = true;
+		}
+	}
+	
+	for (i = 0; i < MEMS_REPORT_NONE; i++) {
+		if (EE_ReadVariable(_EE_MEMS_REPORT + 6*i, &word) != 0 || !(word & MEMS_CONFIG_VALID))
+			continue;
+		for (j = 0; j < 5; j++) {
+			if (EE_ReadVariable(_EE_MEMS_REPORT + 6*i + 1 + j, &words[j]) != 0)
+				break;
+		}
+		if (j < 5)
+			continue;
+		
+		for (j = 0; j < 3; j++)
+			report.deadband[j] = (float)words[j] / reportDeadbandScale[i];
+		report.hysteresis = word & 0xFF;
+		report.minIntervalMs = words[3];
+		report.maxIntervalMs = words[4];
+		if (MemsReportValid((MemsReportChannel_t)i, &report)) {
+			reportConfig[i] = report;
+			reportEnabled[i] = (word & 0x100) != 0;
+		}
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_PEDOMETER, &word) == 0 && (word & MEMS_CONFIG_VALID)) {
+		if (MEMS_CONFIG_FIELD(word, 0) <= PEDO_DEB_STEP_MAX) {
+			pedoDebounceSteps = MEMS_CONFIG_FIELD(word, 0);
+			pedoEnabled = MEMS_CONFIG_FIELD(word, 4) != 0;
+		}
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_MAG_DECLINATION, &word) == 0) {
+		if ((int16_t)word >= -MAX_DECLINATION_DECIDEG && (int16_t)word <= MAX_DECLINATION_DECIDEG)
+			magDeclination = (int16_t)word;
+	}
+	
+	if (EE_ReadVariable(_EE_MEMS_MAG_CAL_VALID, &word) == 0 && word == MEMS_CONFIG_VALID) {
+		uint8_t i = 0;
+		
+		magCalValid = true;
+		for (i = 0; i < 3; i++)
+			magCalValid &= (EE_ReadVariable(_EE_MEMS_MAG_CAL_OFFSET + i, (uint16_t *)&magCal.offset[i]) == 0);
+		for (i = 0; i < 6; i++)
+			magCalValid &= (EE_ReadVariable(_EE_MEMS_MAG_CAL_SOFT_IRON + i, (uint16_t *)&magCal.softIron[i]) == 0);
+	}
+	
+	gyroBiasAuto = (LoadMemsSettings() & MEMS_SETTING_GYRO_BIAS_AUTO) != 0;
+	
+	// A bin holds a bias once its three axes are stored. INT16_MIN marks a cleared bin
+	for (i = 0; i < GYRO_BIAS_BINS; i++) {
+		bool filled = true;
+		
+		for (j = 0; j < 3; j++) {
+			filled &= (EE_ReadVariable(_EE_MEMS_GYRO_BIAS_TABLE + 3*i + j, (uint16_t *)&gyroBiasTable[i][j]) == 0);
+			filled &= (gyroBiasTable[i][j] != INT16_MIN);
+		}
+		if (filled)
+			gyroBiasFilled |= (1U << i);
+	}
+}
+
+/* Store sensor configuration in EEPROM. Unchanged words are not rewritten
+*/
+static Module_Status SaveMemsConfig(void)
+{
+	uint16_t words[5], stored = 0;
+	const uint16_t addresses[5] = { _EE_MEMS_GYRO_CONFIG, _EE_MEMS_ACC_CONFIG, _EE_MEMS_MAG_CONFIG, _EE_MEMS_ACC2_CONFIG, 
+																	_EE_MEMS_ACC_CROSS_CHECK };
+	uint8_t i = 0;
+	
+	words[0] = MEMS_CONFIG_VALID | ConfiguredOdrIdx(MEMS_ODR_GYRO) | (gyroFsIdx << 4) | LoadMemsSettings();
+	words[1] = MEMS_CONFIG_VALID | ConfiguredOdrIdx(MEMS_ODR_ACC) | (accFsIdx << 4) | (accBwIdx << 8);
+	words[2] = MEMS_CONFIG_VALID | ConfiguredOdrIdx(MEMS_ODR_MAG);
+	words[3] = MEMS_CONFIG_VALID | ConfiguredOdrIdx(MEMS_ODR_ACC2) | (acc2FsIdx << 4) | (acc2Mode << 8) | (accChannel << 12);
+	words[4] = accCrossCheckMG;
+	
+	for (i = 0; i < 5; i++) {
+		if (EE_ReadVariable(addresses[i], &stored) == 0 && stored == words[i])
+			continue;
+		if (EE_WriteVariable(addresses[i], words[i]) != 0)
+			return H0BR4_ERR_IO;
+	}
+	
+	return H0BR4_OK;
+}
+
+/* Module settings stored in spare bits of _EE_MEMS_GYRO_CONFIG. None set while nothing is stored
+*/
+static uint16_t LoadMemsSettings(void)
+{
+	uint16_t word = 0;
+	
+	if (EE_ReadVariable(_EE_MEMS_GYRO_CONFIG, &word) != 0)
+		return 0;
+	return word & MEMS_SETTINGS;
+}
+
+/* Store the settings bits in mask. The gyro configuration sharing the word is kept as stored, valid 
+		or not, and an unchanged word is not rewritten
+*/
+static Module_Status SaveMemsSettings(uint16_t mask, uint16_t bits)
+{
+	uint16_t stored = 0, word = 0;
+	
+	if (EE_ReadVariable(_EE_MEMS_GYRO_CONFIG, &stored) != 0)
+		stored = 0;
+	word = (stored & ~mask) | (bits & mask);
+	if (word == stored)
+		return H0BR4_OK;
+	return (EE_WriteVariable(_EE_MEMS_GYRO_CONFIG, word) == 0) ? H0BR4_OK : H0BR4_ERR_IO;
+}
+
+/* Store the motion event configuration in EEPROM. Unchanged words are not rewritten
+*/
+static Module_Status SaveMotionConfig(void)
+{
+	uint16_t words[5], stored = 0;
+	uint8_t i = 0;
+	
+	words[0] = MEMS_CONFIG_VALID | motionEvents | (motionLine << 8);
+	words[1] = motionWakeUpMG;
+	words[2] = motionFreeFallMG;
+	words[3] = motionTapMG;
+	words[4] = ((uint16_t)motionModule << 8) | motionPort;
+	
+	// Configuration, three thresholds and report destination are contiguous
+	for (i = 0; i < 5; i++) {
+		if (EE_ReadVariable(_EE_MEMS_MOTION_CONFIG + i, &stored) == 0 && stored == words[i])
+			continue;
+		if (EE_WriteVariable(_EE_MEMS_MOTION_CONFIG + i, words[i]) != 0)
+			return H0BR4_ERR_IO;
+	}
+	
+	return H0BR4_OK;
+}
+
+/* Find the index of value in a configuration table
+*/
+static bool FindOdr(const MemsOdr_t *table, uint8_t size, uint16_t hz, uint8_t *idx)
+{
+	uint8_t i = 0;
+	
+	for (i = 0; i < size; i++) {
+		if (table[i].hz == hz) {
+			*idx = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool FindFullScale(const MemsFullScale_t *table, uint8_t size, uint16_t range, uint8_t *idx)
+{
+	uint8_t i = 0;
+	
+	for (i = 0; i < size; i++) {
+		if (table[i].range == range) {
+			*idx = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static const MemsOdrSource_t odrSources[MEMS_ODR_SENSORS] =
+{
+	{ gyroOdrTable, TABLE_SIZE(gyroOdrTable), &gyroOdrIdx, LSM6DS3ApplyGyroConfig },
+	{ accOdrTable, TABLE_SIZE(accOdrTable), &accOdrIdx, LSM6DS3ApplyAccConfig },
+	{ acc2OdrTable, TABLE_SIZE(acc2OdrTable), &acc2OdrIdx, LSM303ApplyAccConfig },
+	{ magOdrTable, TABLE_SIZE(magOdrTable), &magOdrIdx, LSM303ApplyMagConfig },
+};
+
+/* Raise the sensor ODR to the slowest rate that still gives a new sample every period ms and hold it: 
+		the sensor bit is set in held, which the caller gives back to ReleaseOdr when its stream ends. 
+		The ODR is never lowered while held and the stored configuration is not changed. A rate the 
+		sensor rejects is undone.
+*/
+static Module_Status MatchOdrToPeriod(MemsOdrSensor_t sensor, uint32_t period, uint8_t *held)
+{
+	const MemsOdrSource_t *source = &odrSources[sensor];
+	Module_Status status = H0BR4_OK;
+	uint32_t requiredHz = 0;
+	uint8_t i = 0, previous = 0;
+	
+	if (period == 0)
+		return H0BR4_ERR_WrongParams;
+	
+	requiredHz = (1000 + period - 1) / period;
+	
+	if (!MemsLock(pdMS_TO_TICKS(MEMS_LOCK_TIMEOUT_MS)))
+		return H0BR4_ERR_BUSY;
+	
+	previous = *source->idx;
+	for (i = previous; i < source->size - 1 && source->table[i].hz < requiredHz; i++);
+	
+	if (odrHolds[sensor] == 0)
+		odrBaseIdx[sensor] = previous;
+	
+	if (i != previous) {
+		*source->idx = i;
+		if ((status = source->apply()) != H0BR4_OK) {
+			*source->idx = previous;
+			source->apply();
+		}
+	}
+	
+	if (status == H0BR4_OK) {
+		odrHolds[sensor]++;
+		*held |= 1U << sensor;
+	}
+	
+	MemsUnlock();
+	return status;
+}
+
+/* Give back the ODRs held by an ended stream. The last holder of a sensor restores its configured ODR
+*/
+static void ReleaseOdr(uint8_t held)
+{
+	const MemsOdrSource_t *source = NULL;
+	uint8_t sensor = 0;
+	
+	if (held == 0)
+		return;
+	
+	MemsLock(portMAX_DELAY);
+	for (sensor = 0; sensor < MEMS_ODR_SENSORS; sensor++) {
+		if (!(held & (1U << sensor)) || odrHolds[sensor] == 0 || --odrHolds[sensor] > 0)
+			continue;
+		
+		source = &odrSources[sensor];
+		if (*source->idx != odrBaseIdx[sensor]) {
+			*source->idx = odrBaseIdx[sensor];
+			source->apply();
+		}
+	}
+	MemsUnlock();
+}
+
+/* ODR index to store: the configured one while streams hold a raised ODR
+*/
+static uint8_t ConfiguredOdrIdx(MemsOdrSensor_t sensor)
+{
+	return odrHolds[sensor] ? odrBaseIdx[sensor] : *odrSources[sensor].idx;
+}
+
+/* Rate at which a channel feeds its filter: the sensor ODR, or its FIFO rate in FIFO acquisition
+*/
+static uint16_t MemsFilterInputHz(MemsFilterChannel_t channel)
+{
+	if (channel == MEMS_FILTER_GYRO)
+		return (acqMode == MEMS_ACQ_FIFO && fifoGyroDecimation) ? FifoOdrHz() / fifoGyroDecimation : gyroOdrTable[gyroOdrIdx].hz;
+	if (channel == MEMS_FILTER_ACC)
+		return (acqMode == MEMS_ACQ_FIFO && fifoAccDecimation) ? FifoOdrHz() / fifoAccDecimation : accOdrTable[accOdrIdx].hz;
+	return magOdrTable[magOdrIdx].hz;
+}
+
+/* Stream period at which a channel must be sampled to give one filter output per period
+*/
+static uint32_t MemsFilterPeriod(MemsFilterChannel_t channel, uint32_t period)
+{
+	uint8_t decimation = filterConfig[channel].decimation;
+	
+	// Filters only run on samples read by the acquisition task
+	if (acqMode == MEMS_ACQ_POLLING || decimation <= 1)
+		return period;
+	
+	return (period > decimation) ? period / decimation : 1;
+}
+
+/* Hold the ODR of the sensor behind a channel for one output every period ms
+*/
+static Module_Status MatchFilterChannelOdr(MemsFilterChannel_t channel, uint32_t period, uint8_t *held)
+{
+	if (channel == MEMS_FILTER_ACC && accChannel == MEMS_ACC_LSM303AGR)
+		return MatchOdrToPeriod(MEMS_ODR_ACC2, period, held);
+	
+	return MatchOdrToPeriod((channel == MEMS_FILTER_GYRO) ? MEMS_ODR_GYRO : (channel == MEMS_FILTER_ACC) ? MEMS_ODR_ACC : MEMS_ODR_MAG, 
+													MemsFilterPeriod(channel, period), held);
+}
+
+/* True when a channel filters or decimates
+*/
+static bool MemsFiltersSet(void)
+{
+	uint8_t i = 0;
+	
+	for (i = 0; i < TABLE_SIZE(filterConfig); i++) {
+		if (filterConfig[i].type != MEMS_FILTER_NONE || filterConfig[i].decimation > 1)
+			return true;
+	}
+	return false;
+}
+
+static bool MemsFilterValid(MemsFilterType_t type, uint16_t param, uint8_t decimation)
+{
+	if (type > MEMS_FILTER_FIR_LOWPASS || decimation == 0 || decimation > H0BR4_FILTER_MAX_DECIMATION)
+		return false;
+	if (type == MEMS_FILTER_MOVING_AVG)
+		return (param >= 2 && param <= H0BR4_FILTER_MAX_LEN);
+	if (type != MEMS_FILTER_NONE)
+		return (param > 0);
+	
+	return true;
+}
+
+/* Copy the settings of a filter, compute its fixed-point coefficients for inputHz and restart it.
+		Float is only used here, on configuration or input rate changes.
+*/
+static void MemsFilterDesign(MemsFilter_t *f, const MemsFilterConfig_t *config, uint16_t inputHz)
+{
+	float fc = 0, w0 = 0, cw = 0, alpha = 0, a0 = 0, sum = 0, n = 0;
+	float h[FILTER_FIR_TAPS];
+	int32_t total = 0;
+	uint8_t i = 0;
+	
+	taskENTER_CRITICAL();
+	f->config = *config;
+	f->redesign = false;
+	taskEXIT_CRITICAL();
+	
+	f->designHz = inputHz;
+	f->primed = false;
+	f->pos = 0;
+	f->phase = 0;
+	
+	fc = f->config.param;
+	if (fc > FILTER_MAX_CUTOFF(inputHz))
+		fc = FILTER_MAX_CUTOFF(inputHz);
+	w0 = FILTER_TWO_PI * fc / inputHz;
+	
+	switch (f->config.type)
+	{
+		case MEMS_FILTER_IIR1_LOWPASS:
+		case MEMS_FILTER_IIR1_HIGHPASS:
+			// Exponential smoothing: y += alpha * (x - y), high-pass is x minus the low-pass
+			f->coef[0] = (int32_t)((1 - expf(-w0)) * 65536 + 0.5f);
+			break;
+	
+		case MEMS_FILTER_IIR2_LOWPASS:
+		case MEMS_FILTER_IIR2_HIGHPASS:
+			// Butterworth biquad (Q = 1/sqrt(2)), bilinear transform
+			cw = cosf(w0);
+			alpha = sinf(w0) * 0.70710678f;
+			a0 = 1 + alpha;
+			if (f->config.type == MEMS_FILTER_IIR2_LOWPASS) {
+				f->coef[0] = (int32_t)((1 - cw) / 2 / a0 * (1L << 30));
+				f->coef[1] = (int32_t)((1 - cw) / a0 * (1L << 30));
+			} else {
+				f->coef[0] = (int32_t)((1 + cw) / 2 / a0 * (1L << 30));
+				f->coef[1] = -(int32_t)((1 + cw) / a0 * (1L << 30));
+			}
+			f->coef[2] = f->coef[0];
+			f->coef[3] = (int32_t)(-2 * cw / a0 * (1L << 30));
+			f->coef[4] = (int32_t)((1 - alpha) / a0 * (1L << 30));
+			break;
+	
+		case MEMS_FILTER_FIR_LOWPASS:
+			// Hamming-windowed sinc, normalized to unity gain at DC
+			for (i = 0; i < FILTER_FIR_TAPS; i++) {
+				n = (float)i - (FILTER_FIR_TAPS - 1) / 2;
+				h[i] = (n == 0) ? w0 : sinf(w0 * n) / n;
+				h[i] *= 0.54f - 0.46f * cosf(FILTER_TWO_PI * i / (FILTER_FIR_TAPS - 1));
+				sum += h[i];
+			}
+			for (i = 0; i < FILTER_FIR_TAPS; i++) {
+				f->taps[i] = (int16_t)(h[i] / sum * 32768 + ((h[i] >= 0) ? 0.5f : -0.5f));
+				total += f->taps[i];
+			}
+			// Rounding error goes to the center tap
+			f->taps[FILTER_FIR_TAPS / 2] += 32768 - total;
+			break;
+	
+		default:
+			break;
+	}
+}
+
+/* Start a filter at its steady state for input x: no settling transient from zero
+*/
+static void MemsFilterPrime(const MemsFilter_t *f, MemsFilterAxis_t *a, int16_t x)
+{
+	uint8_t i = 0;
+	
+	for (i = 0; i < H0BR4_FILTER_MAX_LEN; i++)
+		a->hist[i] = x;
+	a->sum = (int32_t)x * f->config.param;
+	a->x[0] = a->x[1] = x;
+	
+	// Low-pass states start at the input, high-pass outputs at zero
+	if (f->config.type == MEMS_FILTER_IIR1_LOWPASS || f->config.type == MEMS_FILTER_IIR1_HIGHPASS)
+		a->y[0] = (int32_t)x << 16;
+	else if (f->config.type == MEMS_FILTER_IIR2_LOWPASS)
+		a->y[0] = a->y[1] = (int32_t)x << 8;
+	else
+		a->y[0] = a->y[1] = 0;
+}
+
+/* One input of one axis. Integer only
+*/
+static int16_t MemsFilterStep(const MemsFilter_t *f, MemsFilterAxis_t *a, int16_t x)
+{
+	int64_t acc64 = 0;
+	int32_t acc = 0, out = x;
+	uint8_t i = 0, idx = 0;
+	
+	switch (f->config.type)
+	{
+		case MEMS_FILTER_MOVING_AVG:
+			// hist[pos] holds the input from param samples ago
+			a->sum += x - a->hist[f->pos];
+			a->hist[f->pos] = x;
+			out = (a->sum + ((a->sum >= 0) ? 1 : -1) * (int32_t)(f->config.param / 2)) / (int32_t)f->config.param;
+			break;
+	
+		case MEMS_FILTER_IIR1_LOWPASS:
+		case MEMS_FILTER_IIR1_HIGHPASS:
+			a->y[0] += (int32_t)(((((int64_t)x << 16) - a->y[0]) * f->coef[0]) >> 16);
+			out = (a->y[0] + 0x8000) >> 16;
+			if (f->config.type == MEMS_FILTER_IIR1_HIGHPASS)
+				out = x - out;
+			break;
+	
+		case MEMS_FILTER_IIR2_LOWPASS:
+		case MEMS_FILTER_IIR2_HIGHPASS:
+			// Direct form I in Q38: Q30 coefficients, outputs kept in Q8
+			acc64 = ((int64_t)f->coef[0] * x + (int64_t)f->coef[1] * a->x[0] + (int64_t)f->coef[2] * a->x[1]) << 8;
+			acc64 -= (int64_t)f->coef[3] * a->y[0] + (int64_t)f->coef[4] * a->y[1];
+			a->x[1] = a->x[0];
+			a->x[0] = x;
+			a->y[1] = a->y[0];
+			a->y[0] = (int32_t)(acc64 >> 30);
+			out = (a->y[0] + 0x80) >> 8;
+			break;
+	
+		case MEMS_FILTER_FIR_LOWPASS:
+			// The sum of |taps| stays below 2 in Q15, so a 32-bit accumulator cannot overflow
+			a->hist[f->pos] = x;
+			for (i = 0, idx = f->pos; i < FILTER_FIR_TAPS; i++) {
+				acc += (int32_t)f->taps[i] * a->hist[idx];
+				idx = idx ? idx - 1 : FILTER_FIR_TAPS - 1;
+			}
+			out = (acc + 0x4000) >> 15;
+			break;
+	
+		default:
+			break;
+	}
+	
+	return (out > INT16_MAX) ? INT16_MAX : (out < INT16_MIN) ? INT16_MIN : out;
+}
+
+/* Filter one 3-axis sample of a channel in place, at the input rate. Returns true on the samples
+		kept by the decimation.
+*/
+static bool MemsFilterInput(MemsFilterChannel_t channel, int16_t *sample)
+{
+	MemsFilter_t *f = &memsFilters[channel];
+	uint16_t inputHz = MemsFilterInputHz(channel);
+	uint8_t len = 1, i = 0;
+	
+	if (f->redesign || f->designHz != inputHz)
+		MemsFilterDesign(f, &filterConfig[channel], inputHz);
+	
+	if (f->config.type != MEMS_FILTER_NONE) {
+		if (!f->primed) {
+			for (i = 0; i < 3; i++)
+				MemsFilterPrime(f, &f->axis[i], sample[i]);
+			f->primed = true;
+		}
+	
+		for (i = 0; i < 3; i++)
+			sample[i] = MemsFilterStep(f, &f->axis[i], sample[i]);
+	
+		if (f->config.type == MEMS_FILTER_MOVING_AVG)
+			len = f->config.param;
+		else if (f->config.type == MEMS_FILTER_FIR_LOWPASS)
+			len = FILTER_FIR_TAPS;
+		f->pos = (f->pos + 1) % len;
+	}
+	
+	if (++f->phase < f->config.decimation)
+		return false;
+	
+	f->phase = 0;
+	return true;
+}
+
+/* Store the filter settings of all channels: configuration word and parameter for each
+*/
+static Module_Status SaveMemsFilterConfig(void)
+{
+	uint16_t words[2], stored = 0;
+	uint8_t i = 0, j = 0;
+	
+	for (i = 0; i < 3; i++) {
+		words[0] = MEMS_CONFIG_VALID | ((uint16_t)filterConfig[i].type << 8) | filterConfig[i].decimation;
+		words[1] = filterConfig[i].param;
+	
+		for (j = 0; j < 2; j++) {
+			if (EE_ReadVariable(_EE_MEMS_FILTER + 2*i + j, &stored) == 0 && stored == words[j])
+				continue;
+			if (EE_WriteVariable(_EE_MEMS_FILTER + 2*i + j, words[j]) != 0)
+				return H0BR4_ERR_IO;
+		}
+	}
+	
+	return H0BR4_OK;
+}
+
+/* Take the sensor ownership lock. The bus mutex covers one transfer; this lock covers a sequence of 
+		them that must not interleave with the acquisition task, such as an acquisition mode switch. 
+		Nested calls from the owner only count. Before the scheduler runs there is nothing to exclude.
+*/
+static bool MemsLock(TickType_t wait)
+{
+	TaskHandle_t task = NULL;
+	
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || MemsLockHandle == NULL)
+		return true;
+	
+	task = xTaskGetCurrentTaskHandle();
+	if (memsLockOwner == task) {
+		memsLockDepth++;
+		return true;
+	}
+	
+	if (xSemaphoreTake(MemsLockHandle, wait) != pdTRUE)
+		return false;
+	
+	memsLockOwner = task;
+	memsLockDepth = 1;
+	return true;
+}
+
+static void MemsUnlock(void)
+{
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || MemsLockHandle == NULL)
+		return;
+	
+	if (--memsLockDepth == 0) {
+		memsLockOwner = NULL;
+		xSemaphoreGive(MemsLockHandle);
+	}
+}
+
+/* Buffer from the FreeRTOS heap for one call or one stream, given back with vPortFree. NULL when the 
+		heap cannot spare it: a failed pvPortMalloc would stop the module in the malloc-failed hook
+*/
+static void *MemsAlloc(size_t bytes)
+{
+	if (xPortGetFreeHeapSize() < bytes + MEMS_HEAP_RESERVE)
+		return NULL;
+	
+	return pvPortMalloc(bytes);
+}
+
+/* Take messageParams from filling to sending: streams of several tasks and motion events send messages 
+		to other modules through the same buffer
+*/
+static bool MessageParamsLock(void)
+{
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || MessageParamsMutexHandle == NULL)
+		return true;
+	
+	return (xSemaphoreTake(MessageParamsMutexHandle, pdMS_TO_TICKS(MESSAGE_PARAMS_TIMEOUT_MS)) == pdTRUE);
+}
+
+static void MessageParamsUnlock(void)
+{
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || MessageParamsMutexHandle == NULL)
+		return;
+	
+	xSemaphoreGive(MessageParamsMutexHandle);
+}
+
+/* --- MEMS acquisition task. Reads each sensor exactly once per data-ready interrupt 
+				and keeps the latest sample for the Sample and Stream APIs.
+*/
+static void MemsAcqTask(void *argument)
+{
+	uint32_t events = 0;
+	TickType_t wait;
+	
+	for(;;)
+	{
+		wait = (acqMode != MEMS_ACQ_POLLING || motionEvents) ? pdMS_TO_TICKS(MEMS_DRDY_WATCHDOG_MS) : portMAX_DELAY;
+		
+		if (xTaskNotifyWait(0, MEMS_EVT_ALL, &events, wait) != pdTRUE)
+			events = MEMS_EVT_ALL;		// Missed an edge: reading the outputs releases the latched lines
+		
+		// A mode switch in progress holds the sensors until the lines are routed again
+		MemsLock(portMAX_DELAY);
+		MemsAcqProcess(events);
+		MemsUnlock();
+	}
+}
+
+/* Serve the events of one acquisition task wake-up
+*/
+static void MemsAcqProcess(uint32_t events)
+{
+	uint8_t data[LSM6DS3_IMU_OUT_LEN];
+	uint64_t sampleUs = 0;
+	
+	// Motion events share the lines with data-ready and are reported in every acquisition mode
+	if ((events & MEMS_EVT_MOTION) && motionEvents)
+		LSM6DS3ReportMotionEvents();
+	
+	if (acqMode == MEMS_ACQ_POLLING)
+		return;
+	
+	// Gyro and accelerometer come either from their data-ready lines or from the FIFO
+	if (acqMode == MEMS_ACQ_FIFO)
+		events &= (MEMS_EVT_FIFO | MEMS_EVT_MAG);
+	else
+		events &= ~MEMS_EVT_FIFO;
+	
+	if (events & MEMS_EVT_FIFO) {
+		bool more = false;
+		
+		if (LSM6DS3DrainFifo(&more) == H0BR4_OK) {
+			// Temperature is not stored in the FIFO
+			if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_OUT_TEMP_L, data, 2) == MEMS_SUCCESS)
+				memsCache.temp = memsOutput.temp = concatBytes(data[1], data[0]);
+		}
+		
+		// The threshold line stays high while above the watermark: no new edge will come
+		if (more)
+			xTaskNotify(MemsAcqTaskHandle, MEMS_EVT_FIFO, eSetBits);
+	}
+	
+	if (events & (MEMS_EVT_GYRO | MEMS_EVT_ACC)) {
+		// OUT_TEMP_L to OUTZ_H_XL are contiguous: one burst serves both data-ready lines, then the timestamp
+		if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_OUT_TEMP_L, data, LSM6DS3_IMU_OUT_LEN) == MEMS_SUCCESS && 
+				LSM6DS3SampleTime(&sampleUs) == H0BR4_OK) {
+			uint32_t timeUs = (uint32_t)sampleUs;
+			int16_t gyro[3], acc[3], gyroOut[3], accOut[3];
+			bool gyroReady = false, accReady = false;
+			
+			gyro[0] = concatBytes(data[3], data[2]);
+			gyro[1] = concatBytes(data[5], data[4]);
+			gyro[2] = concatBytes(data[7], data[6]);
+			acc[0] = concatBytes(data[9], data[8]);
+			acc[1] = concatBytes(data[11], data[10]);
+			acc[2] = concatBytes(data[13], data[12]);
+			
+			// Each sensor feeds its filter once per own data-ready, and its output is cached on decimated outputs
+			memcpy(gyroOut, gyro, sizeof(gyroOut));
+			memcpy(accOut, acc, sizeof(accOut));
+			gyroReady = (events & MEMS_EVT_GYRO) && MemsFilterInput(MEMS_FILTER_GYRO, gyroOut);
+			accReady = (events & MEMS_EVT_ACC) && MemsFilterInput(MEMS_FILTER_ACC, accOut);
+			
+			taskENTER_CRITICAL();
+			memsCache.imuTime = memsOutput.imuTime = timeUs;
+			memsCache.temp = memsOutput.temp = concatBytes(data[1], data[0]);
+			if (events & MEMS_EVT_GYRO) {
+				memcpy(memsCache.gyro, gyro, sizeof(memsCache.gyro));
+				memsCache.gyroCount++;
+			}
+			if (events & MEMS_EVT_ACC) {
+				memcpy(memsCache.acc, acc, sizeof(memsCache.acc));
+				memsCache.accCount++;
+			}
+			if (gyroReady) {
+				memcpy(memsOutput.gyro, gyroOut, sizeof(memsOutput.gyro));
+				memsOutput.gyroCount++;
+			}
+			if (accReady) {
+				memcpy(memsOutput.acc, accOut, sizeof(memsOutput.acc));
+				memsOutput.accCount++;
+			}
+			taskEXIT_CRITICAL();
+		}
+	}
+	
+	if (events & MEMS_EVT_MAG) {
+		if (LSM303AGR_MAG_Get_Raw_Magnetic(&hi2c2, data) == MEMS_SUCCESS) {
+			// The magnetometer has no timestamp: place it on the timeline from the MCU time
+			uint32_t timeUs = (uint32_t)MemsTickToTimeUs(HAL_GetTick());
+			int16_t mag[3], magOut[3];
+			bool magReady = false;
+			
+			mag[0] = concatBytes(data[1], data[0]);
+			mag[1] = concatBytes(data[3], data[2]);
+			mag[2] = concatBytes(data[5], data[4]);
+			memcpy(magOut, mag, sizeof(magOut));
+			magReady = MemsFilterInput(MEMS_FILTER_MAG, magOut);
+			
+			taskENTER_CRITICAL();
+			memsCache.magTime = timeUs;
+			memcpy(memsCache.mag, mag, sizeof(memsCache.mag));
+			memsCache.magCount++;
+			if (magReady) {
+				memsOutput.magTime = timeUs;
+				memcpy(memsOutput.mag, magOut, sizeof(memsOutput.mag));
+				memsOutput.magCount++;
+			}
+			taskEXIT_CRITICAL();
+		}
+	}
+}
+
+/*-----------------------------------------------------------*/
+
+static inline int32_t MulQ29(int32_t a, int32_t b)
+{
+	return (int32_t)(((int64_t)a * b) >> 29);
+}
+
+/* Scale a vector to unit length in Q2.29. Returns false for a null vector
+*/
+static bool NormalizeQ29(int32_t *v, uint8_t n)
+{
+	uint64_t sum = 0;
+	uint32_t norm = 0;
+	uint8_t i = 0;
+	
+	for (i = 0; i < n; i++)
+		sum += (int64_t)v[i] * v[i];
+	
+	if ((norm = ISqrt64(sum)) == 0)
+		return false;
+	
+	for (i = 0; i < n; i++)
+		v[i] = (int32_t)(((int64_t)v[i] * Q29_ONE) / norm);
+	
+	return true;
+}
+
+/* One Mahony filter step (Mahony et al., after Madgwick's reference implementation) in fixed point. 
+		Accelerometer and magnetometer only give directions, so their raw LSB are normalized directly. 
+		The magnetometer is skipped when its vector is null. Both sensors are assumed to share the 
+		board axes. dtQ29 is the step period in seconds.
+*/
+static void FusionUpdate(const int16_t *gyro, const int16_t *acc, const int16_t *mag, int32_t dtQ29)
+{
+	int32_t q0 = fusionQ[0], q1 = fusionQ[1], q2 = fusionQ[2], q3 = fusionQ[3];
+	int32_t q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+	int32_t a[3], m[3], q[4];
+	int32_t hx, hy, bx, bz, halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+	int32_t halfe[3] = { 0, 0, 0 };
+	q16_16_t g[3];
+	int32_t gyroRadScaleQ24 = MulQ29(gyroScaleQ24, DEG_TO_RAD_Q29);		// rad/s per LSB
+	uint8_t i = 0;
+	
+	for (i = 0; i < 3; i++) {
+		g[i] = RawToQ16(gyro[i], gyroRadScaleQ24);
+		a[i] = acc[i];
+		m[i] = mag[i];
+	}
+	
+	// No feedback in free fall: integrate the gyro only
+	if (NormalizeQ29(a, 3)) {
+		q0q0 = MulQ29(q0, q0);
+		q0q1 = MulQ29(q0, q1);
+		q0q2 = MulQ29(q0, q2);
+		q0q3 = MulQ29(q0, q3);
+		q1q1 = MulQ29(q1, q1);
+		q1q2 = MulQ29(q1, q2);
+		q1q3 = MulQ29(q1, q3);
+		q2q2 = MulQ29(q2, q2);
+		q2q3 = MulQ29(q2, q3);
+		q3q3 = MulQ29(q3, q3);
+		
+		// Estimated direction of gravity, halved
+		halfvx = q1q3 - q0q2;
+		halfvy = q0q1 + q2q3;
+		halfvz = q0q0 - Q29_HALF + q3q3;
+		
+		// Error is the cross product between measured and estimated directions
+		halfe[0] = MulQ29(a[1], halfvz) - MulQ29(a[2], halfvy);
+		halfe[1] = MulQ29(a[2], halfvx) - MulQ29(a[0], halfvz);
+		halfe[2] = MulQ29(a[0], halfvy) - MulQ29(a[1], halfvx);
+		
+		if (NormalizeQ29(m, 3)) {
+			// Reference direction of Earth's magnetic field: horizontal (bx) and vertical (bz) parts
+			hx = 2 * (MulQ29(m[0], Q29_HALF - q2q2 - q3q3) + MulQ29(m[1], q1q2 - q0q3) + MulQ29(m[2], q1q3 + q0q2));
+			hy = 2 * (MulQ29(m[0], q1q2 + q0q3) + MulQ29(m[1], Q29_HALF - q1q1 - q3q3) + MulQ29(m[2], q2q3 - q0q1));
+			bx = (int32_t)ISqrt64((int64_t)hx * hx + (int64_t)hy * hy);
+			bz = 2 * (MulQ29(m[0], q1q3 - q0q2) + MulQ29(m[1], q2q3 + q0q1) + MulQ29(m[2], Q29_HALF - q1q1 - q2q2));
+			
+			// Estimated direction of the magnetic field, halved
+			halfwx = MulQ29(bx, Q29_HALF - q2q2 - q3q3) + MulQ29(bz, q1q3 - q0q2);
+			halfwy = MulQ29(bx, q1q2 - q0q3) + MulQ29(bz, q0q1 + q2q3);
+			halfwz = MulQ29(bx, q0q2 + q1q3) + MulQ29(bz, Q29_HALF - q1q1 - q2q2);
+			
+			halfe[0] += MulQ29(m[1], halfwz) - MulQ29(m[2], halfwy);
+			halfe[1] += MulQ29(m[2], halfwx) - MulQ29(m[0], halfwz);
+			halfe[2] += MulQ29(m[0], halfwy) - MulQ29(m[1], halfwx);
+		}
+		
+		// Proportional and integral feedback, Q2.29 to Q16.16 rad/s. The integral keeps Q2.29: 
+		// its per-step increment is below the Q16.16 resolution
+		for (i = 0; i < 3; i++) {
+			fusionIntegral[i] += MulQ29(MulQ29(FUSION_TWO_KI, halfe[i]), dtQ29);
+			g[i] += (fusionIntegral[i] + MulQ29(FUSION_TWO_KP, halfe[i])) >> 13;
+		}
+	}
+	
+	// Rotation over half a step in Q2.29 radians
+	for (i = 0; i < 3; i++)
+		g[i] = (int32_t)(((int64_t)g[i] * (dtQ29 / 2)) >> 16);
+	
+	q[0] = q0 - MulQ29(q1, g[0]) - MulQ29(q2, g[1]) - MulQ29(q3, g[2]);
+	q[1] = q1 + MulQ29(q0, g[0]) + MulQ29(q2, g[2]) - MulQ29(q3, g[1]);
+	q[2] = q2 + MulQ29(q0, g[1]) - MulQ29(q1, g[2]) + MulQ29(q3, g[0]);
+	q[3] = q3 + MulQ29(q0, g[2]) + MulQ29(q1, g[1]) - MulQ29(q2, g[0]);
+	
+	if (!NormalizeQ29(q, 4))
+		return;
+	
+	taskENTER_CRITICAL();
+	memcpy(fusionQ, q, sizeof(fusionQ));
+	taskEXIT_CRITICAL();
+}
+
+/* --- Orientation fusion task. Runs the filter every fusion period on the latest IMU and 
+				magnetometer samples, read the same way as the Sample APIs.
+*/
+static void FusionTask(void *argument)
+{
+	ImuRawSample_t imu;
+	int16_t mag[3] = { 0, 0, 0 };
+	TickType_t lastWakeTime;
+	
+	for(;;)
+	{
+		// Sleep until the fusion is started
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		lastWakeTime = xTaskGetTickCount();
+		
+		while (fusionRunning) {
+			// The magnetometer is much slower than the IMU: keep its last sample when none is ready
+			if (LSM6DS3SampleImuRaw(&imu) == H0BR4_OK) {
+				LSM6DS3RemoveGyroBias(imu.gyro);
+				if (LSM303SampleMagUnfiltered(&mag[0], &mag[1], &mag[2]) == H0BR4_OK)
+					LSM303RemoveMagIron(&mag[0], &mag[1], &mag[2]);
+				FusionUpdate(imu.gyro, imu.acc, mag, (int32_t)(((int64_t)Q29_ONE * fusionPeriodMs) / 1000));
+				fusionTime = imu.timestamp;
+			}
+			
+			vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(fusionPeriodMs));
+		}
+	}
+}
+
+/* Latest fused quaternion as float
+*/
+static Module_Status ReadFusionQuaternion(float *q)
+{
+	int32_t fixed[4];
+	uint8_t i = 0;
+	
+	if (!fusionRunning)
+		return H0BR4_ERR_FUSION;
+	
+	taskENTER_CRITICAL();
+	memcpy(fixed, fusionQ, sizeof(fixed));
+	taskEXIT_CRITICAL();
+	
+	SetSampleTime(fusionTime);
+	
+	for (i = 0; i < 4; i++)
+		q[i] = (float)fixed[i] / Q29_ONE;
+	
+	return H0BR4_OK;
+}
+
+/* atan2 in Q16.16 degrees, (-180, 180], by CORDIC vectoring: shifts and adds only. 
+		|x| and |y| must stay below CORDIC_INPUT_MAX.
+*/
+static q16_16_t Atan2Q16(int32_t y, int32_t x)
+{
+	q16_16_t angle = 0;
+	int32_t xNew = 0;
+	uint8_t i = 0;
+	
+	if (x == 0 && y == 0)
+		return 0;
+	
+	// Rotate by 180 degrees into the right half plane
+	if (x < 0) {
+		angle = (y >= 0) ? (180L << 16) : -(180L << 16);
+		x = -x;
+		y = -y;
+	}
+	
+	// Rotate towards the x axis, accumulating the rotation
+	for (i = 0; i < CORDIC_ITERATIONS; i++) {
+		if (y > 0) {
+			xNew = x + (y >> i);
+			y -= x >> i;
+			angle += cordicAtanTable[i];
+		} else {
+			xNew = x - (y >> i);
+			y += x >> i;
+			angle -= cordicAtanTable[i];
+		}
+		x = xNew;
+	}
+	return angle;
+}
+
+/* Tilt-compensated heading of the board x axis in Q16.16 degrees, [0, 360), clockwise from magnetic 
+		north. East is the cross product of down (opposite to the accelerometer reading) and the magnetic 
+		field, north is east crossed with down, so no pitch or roll angle is needed. Both sensors are 
+		assumed to share the board axes. Returns false when the field is parallel to gravity.
+*/
+static bool ComputeHeadingQ16(const int16_t *acc, const int16_t *mag, q16_16_t *heading)
+{
+	int64_t east[3], north, y, x, larger;
+	uint32_t down = 0;
+	
+	down = ISqrt64((int64_t)acc[0] * acc[0] + (int64_t)acc[1] * acc[1] + (int64_t)acc[2] * acc[2]);
+	
+	east[0] = (int64_t)mag[1] * acc[2] - (int64_t)mag[2] * acc[1];
+	east[1] = (int64_t)mag[2] * acc[0] - (int64_t)mag[0] * acc[2];
+	east[2] = (int64_t)mag[0] * acc[1] - (int64_t)mag[1] * acc[0];
+	north = (int64_t)acc[1] * east[2] - (int64_t)acc[2] * east[1];
+	
+	// Bring the x axis components to the same scale: |north| is |east| times |down|
+	y = east[0] * down;
+	x = north;
+	
+	if (y == 0 && x == 0)
+		return false;
+	
+	// Scale both into [CORDIC_INPUT_MAX / 2, CORDIC_INPUT_MAX) for full CORDIC resolution
+	larger = (y < 0 ? -y : y) > (x < 0 ? -x : x) ? (y < 0 ? -y : y) : (x < 0 ? -x : x);
+	while (larger >= CORDIC_INPUT_MAX) {
+		y >>= 1;
+		x >>= 1;
+		larger >>= 1;
+	}
+	while (larger < CORDIC_INPUT_MAX / 2) {
+		y *= 2;
+		x *= 2;
+		larger *= 2;
+	}
+	
+	*heading = Atan2Q16((int32_t)y, (int32_t)x);
+	if (*heading < 0)
+		*heading += 360L << 16;
+	
+	return true;
+}
+
+/* Round to the nearest integer, halves away from zero */
+static int32_t RoundToInt(float x)
+{
+	return (int32_t)((x < 0) ? x - 0.5f : x + 0.5f);
+}
+
+/* Square root by Newton iterations from an exponent-halved first guess: keeps libm out of the 
+		calibration. 0 for x <= 0.
+*/
+static float SqrtF(float x)
+{
+	union { float f; uint32_t u; } y = { x };
+	uint8_t i = 0;
+	
+	if (x <= 0)
+		return 0;
+	
+	y.u = (y.u >> 1) + 0x1FC00000;
+	for (i = 0; i < NEWTON_ITERATIONS; i++)
+		y.f = 0.5f * (y.f + x / y.f);
+	return y.f;
+}
+
+/* Cube root of x > 0, as SqrtF */
+static float CbrtF(float x)
+{
+	union { float f; uint32_t u; } y = { x };
+	uint8_t i = 0;
+	
+	if (x <= 0)
+		return 0;
+	
+	y.u = y.u / 3 + 0x2A555555;
+	for (i = 0; i < NEWTON_ITERATIONS; i++)
+		y.f = (2 * y.f + x / (y.f * y.f)) / 3;
+	return y.f;
+}
+
+/* Add one magnetometer sample to the ellipsoid fit normal equations. The fit solves 
+		v'Av + 2b'v = 1 for the symmetric A and the vector b.
+*/
+static void MagCalAccumulate(MagCalState_t *state, const int16_t *raw)
+{
+	float x = raw[0] / MAG_CAL_SCALE, y = raw[1] / MAG_CAL_SCALE, z = raw[2] / MAG_CAL_SCALE;
+	const float row[MAG_CAL_PARAMS] = { x*x, y*y, z*z, 2*x*y, 2*x*z, 2*y*z, 2*x, 2*y, 2*z };
+	float *ata = state->ata;
+	uint8_t i = 0, j = 0;
+	
+	// Lower triangle only, packed: the matrix is symmetric
+	for (i = 0; i < MAG_CAL_PARAMS; i++) {
+		for (j = 0; j <= i; j++)
+			*ata++ += row[i] * row[j];
+		state->atb[i] += row[i];
+	}
+	state->samples++;
+}
+
+/* Solve the normal equations by Cholesky decomposition, L overwriting the packed matrix. Returns 
+		false if not positive definite
+*/
+static bool MagCalSolve(MagCalState_t *state, float *params)
+{
+	float *a = state->ata;
+	float sum = 0;
+	int8_t i = 0, j = 0, k = 0;
+	
+	// A = LL': each element of A is read once, before L takes its place
+	for (i = 0; i < MAG_CAL_PARAMS; i++) {
+		for (j = 0; j <= i; j++) {
+			sum = a[MAG_CAL_IDX(i, j)];
+			for (k = 0; k < j; k++)
+				sum -= a[MAG_CAL_IDX(i, k)] * a[MAG_CAL_IDX(j, k)];
+			
+			if (i == j) {
+				if (sum <= 0)
+					return false;
+				a[MAG_CAL_IDX(i, i)] = SqrtF(sum);
+			} else {
+				a[MAG_CAL_IDX(i, j)] = sum / a[MAG_CAL_IDX(j, j)];
+			}
+		}
+	}
+	
+	// Forward then back substitution
+	for (i = 0; i < MAG_CAL_PARAMS; i++) {
+		sum = state->atb[i];
+		for (k = 0; k < i; k++)
+			sum -= a[MAG_CAL_IDX(i, k)] * params[k];
+		params[i] = sum / a[MAG_CAL_IDX(i, i)];
+	}
+	for (i = MAG_CAL_PARAMS - 1; i >= 0; i--) {
+		sum = params[i];
+		for (k = i + 1; k < MAG_CAL_PARAMS; k++)
+			sum -= a[MAG_CAL_IDX(k, i)] * params[k];
+		params[i] = sum / a[MAG_CAL_IDX(i, i)];
+	}
+	return true;
+}
+
+/* Eigenvalues (diagonal of a) and eigenvectors (columns of v) of a symmetric 3x3 matrix, Jacobi rotations
+*/
+static void Jacobi3(float a[3][3], float v[3][3])
+{
+	float theta = 0, t = 0, c = 0, sn = 0, x = 0, y = 0;
+	uint8_t sweep = 0, p = 0, q = 0, k = 0;
+	
+	memset(v, 0, 9 * sizeof(float));
+	v[0][0] = v[1][1] = v[2][2] = 1;
+	
+	for (sweep = 0; sweep < JACOBI_SWEEPS; sweep++) {
+		for (p = 0; p < 2; p++) {
+			for (q = p + 1; q < 3; q++) {
+				if (fabsf(a[p][q]) < 1e-12f)
+					continue;
+				
+				theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				t = ((theta < 0) ? -1 : 1) / (fabsf(theta) + SqrtF(theta * theta + 1));
+				c = 1 / SqrtF(t * t + 1);
+				sn = t * c;
+				
+				for (k = 0; k < 3; k++) {
+					x = a[k][p];
+					y = a[k][q];
+					a[k][p] = c * x - sn * y;
+					a[k][q] = sn * x + c * y;
+				}
+				for (k = 0; k < 3; k++) {
+					x = a[p][k];
+					y = a[q][k];
+					a[p][k] = c * x - sn * y;
+					a[q][k] = sn * x + c * y;
+				}
+				for (k = 0; k < 3; k++) {
+					x = v[k][p];
+					y = v[k][q];
+					v[k][p] = c * x - sn * y;
+					v[k][q] = sn * x + c * y;
+				}
+			}
+		}
+	}
+}
+
+/* Fit the hard-iron offset and soft-iron matrix from the accumulated samples. The ellipsoid 
+		(v-c)'M(v-c) = 1 is mapped to a sphere of the same volume by W = r.sqrt(M), so calibrated 
+		values keep their units and no rotation is added.
+*/
+static Module_Status MagCalFit(MagCalState_t *state, MagCalibration_t *cal)
+{
+	float p[MAG_CAL_PARAMS];
+	float m[3][3], v[3][3], center[3], scale[3], k = 0, det = 0, r = 0, w = 0;
+	float inv[3][3];
+	uint8_t i = 0, j = 0, n = 0;
+	
+	if (state->samples < MAG_CAL_MIN_SAMPLES || !MagCalSolve(state, p))
+		return H0BR4_ERR_MAG;
+	
+	m[0][0] = p[0];	m[1][1] = p[1];	m[2][2] = p[2];
+	m[0][1] = m[1][0] = p[3];
+	m[0][2] = m[2][0] = p[4];
+	m[1][2] = m[2][1] = p[5];
+	
+	// Center c = -inv(A).b, by the adjugate
+	inv[0][0] = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+	inv[0][1] = m[0][2]*m[2][1] - m[0][1]*m[2][2];
+	inv[0][2] = m[0][1]*m[1][2] - m[0][2]*m[1][1];
+	inv[1][1] = m[0][0]*m[2][2] - m[0][2]*m[2][0];
+	inv[1][2] = m[0][2]*m[1][0] - m[0][0]*m[1][2];
+	inv[2][2] = m[0][0]*m[1][1] - m[0][1]*m[1][0];
+	inv[1][0] = inv[0][1];
+	inv[2][0] = inv[0][2];
+	inv[2][1] = inv[1][2];
+	det = m[0][0]*inv[0][0] + m[0][1]*inv[1][0] + m[0][2]*inv[2][0];
+	if (det <= 0)
+		return H0BR4_ERR_MAG;
+	
+	for (i = 0; i < 3; i++)
+		center[i] = -(inv[i][0]*p[6] + inv[i][1]*p[7] + inv[i][2]*p[8]) / det;
+	
+	// M = A / (1 + c'Ac)
+	k = 1;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			k += center[i] * m[i][j] * center[j];
+	if (k <= 0)
+		return H0BR4_ERR_MAG;
+	
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			m[i][j] /= k;
+	
+	Jacobi3(m, v);
+	
+	// Eigenvalues are 1/axis^2: all positive for an ellipsoid, and not too eccentric
+	for (i = 0; i < 3; i++) {
+		if (m[i][i] <= 0)
+			return H0BR4_ERR_MAG;
+	}
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			if (m[i][i] > m[j][j] * MAG_CAL_MAX_AXIS_RATIO * MAG_CAL_MAX_AXIS_RATIO)
+				return H0BR4_ERR_MAG;
+		}
+	}
+	
+	// Sphere radius: geometric mean of the ellipsoid axes, r^2 = 1 / cbrt(product of the eigenvalues)
+	r = CbrtF(m[0][0] * m[1][1] * m[2][2]);
+	for (i = 0; i < 3; i++)
+		scale[i] = SqrtF(m[i][i] / r);
+	
+	// W = V.diag(scale).V', stored as xx, yy, zz, xy, xz, yz
+	for (n = 0; n < 6; n++) {
+		const uint8_t rows[6] = { 0, 1, 2, 0, 0, 1 }, cols[6] = { 0, 1, 2, 1, 2, 2 };
+		
+		w = 0;
+		for (i = 0; i < 3; i++)
+			w += v[rows[n]][i] * scale[i] * v[cols[n]][i];
+		if (fabsf(w) > MAG_CAL_Q14_MAX)
+			return H0BR4_ERR_MAG;
+		cal->softIron[n] = (int16_t)RoundToInt(w * 16384);
+	}
+	
+	for (i = 0; i < 3; i++) {
+		if (fabsf(center[i] * MAG_CAL_SCALE) > INT16_MAX)
+			return H0BR4_ERR_MAG;
+		cal->offset[i] = (int16_t)RoundToInt(center[i] * MAG_CAL_SCALE);
+	}
+	
+	return H0BR4_OK;
+}
+
+/* Temperature bin of a raw LSM6DS3 temperature (16 LSB/degC, 0 at 25 degC)
+*/
+static uint8_t GyroBiasBin(int16_t rawTemp)
+{
+	int32_t bin = ((int32_t)rawTemp / 16 + 25 - GYRO_BIAS_TEMP_MIN) / GYRO_BIAS_TEMP_STEP;
+	
+	if (bin < 0)
+		return 0;
+	if (bin >= GYRO_BIAS_BINS)
+		return GYRO_BIAS_BINS - 1;
+	return bin;
+}
+
+/* Apply the bias of the nearest filled bin. No bias is applied while the table is empty
+*/
+static void SelectGyroBias(uint8_t bin)
+{
+	int16_t raw[3] = { 0, 0, 0 };
+	uint8_t i = 0, d = 0, found = GYRO_BIAS_NO_BIN;
+	
+	if (bin >= GYRO_BIAS_BINS)
+		return;
+	
+	for (d = 0; d < GYRO_BIAS_BINS && found == GYRO_BIAS_NO_BIN; d++) {
+		if (bin >= d && (gyroBiasFilled & (1U << (bin - d))))
+			found = bin - d;
+		else if (bin + d < GYRO_BIAS_BINS && (gyroBiasFilled & (1U << (bin + d))))
+			found = bin + d;
+	}
+	
+	if (found != GYRO_BIAS_NO_BIN) {
+		for (i = 0; i < 3; i++)
+			raw[i] = RoundToInt(gyroBiasTable[found][i] / gyroSensitivity);
+	}
+	
+	taskENTER_CRITICAL();
+	memcpy(gyroBiasRaw, raw, sizeof(gyroBiasRaw));
+	gyroBiasBin = bin;
+	taskEXIT_CRITICAL();
+}
+
+/* Store the learned bins that moved enough since their last write. Writes are rate limited: bins 
+		stay pending until a later call, and after a failed write
+*/
+static void SaveGyroBias(void)
+{
+	static TickType_t lastSave = 0;
+	static bool saved = false;
+	uint16_t stored = 0;
+	bool changed = false, written = false;
+	uint8_t bin = 0, i = 0;
+	
+	if (gyroBiasUnsaved == 0 || (saved && (xTaskGetTickCount() - lastSave) < pdMS_TO_TICKS(GYRO_BIAS_SAVE_INTERVAL_MS)))
+		return;
+	
+	for (bin = 0; bin < GYRO_BIAS_BINS; bin++) {
+		if (!(gyroBiasUnsaved & (1U << bin)))
+			continue;
+		
+		changed = false;
+		for (i = 0; i < 3; i++) {
+			if (EE_ReadVariable(_EE_MEMS_GYRO_BIAS_TABLE + 3*bin + i, &stored) != 0 || 
+					abs((int16_t)stored - gyroBiasTable[bin][i]) >= GYRO_BIAS_SAVE_MDPS)
+				changed = true;
+		}
+		
+		written = true;
+		for (i = 0; i < 3 && changed; i++)
+			written &= (EE_WriteVariable(_EE_MEMS_GYRO_BIAS_TABLE + 3*bin + i, (uint16_t)gyroBiasTable[bin][i]) == 0);
+		if (written)
+			gyroBiasUnsaved &= ~(1U << bin);
+		
+		if (changed) {
+			lastSave = xTaskGetTickCount();
+			saved = true;
+		}
+	}
+}
+
+/* --- Gyroscope bias estimation task. Follows the die temperature once a second to pick the bias of 
+				its bin and, when enabled, learns the bias over one window every GYRO_BIAS_LEARN_INTERVAL_MS. 
+				The unfiltered gyro and accelerometer must both be still: low variance, and no drift between 
+				the two halves of the window, which rejects slow rotation. In duty-cycled mode the temperature 
+				is still followed, with one accelerometer power-up a second, but nothing is learned.
+*/
+static void GyroBiasTask(void *argument)
+{
+	ImuRawSample_t imu;
+	int32_t sum[2][6];							// Gyro X, Y, Z, acc X, Y, Z of each half window
+	int64_t sumSq[6];
+	int32_t sumTemp = 0;
+	float mean = 0, var = 0, maxVar = 0, drift = 0;
+	int32_t bias[3], step = 0;
+	uint8_t n = 0, i = 0, half = 0, bin = 0, fsIdx = 0;
+	bool still = false, duty = false;
+	TickType_t lastWakeTime = 0, lastLearn = 0;
+	
+	// The stored bias of the current temperature applies from the start
+	duty = (powerMode == MEMS_POWER_DUTY_CYCLED);
+	if ((duty ? LSM6DS3SampleImuDuty(&imu, MEMS_SENSOR_ACC) : LSM6DS3SampleImuRaw(&imu)) == H0BR4_OK)
+		SelectGyroBias(GyroBiasBin(imu.temp));
+	lastWakeTime = xTaskGetTickCount();
+	lastLearn = lastWakeTime - pdMS_TO_TICKS(GYRO_BIAS_LEARN_INTERVAL_MS);
+	
+	for(;;)
+	{
+		vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS((n > 0) ? GYRO_BIAS_PERIOD_MS : GYRO_BIAS_TRACK_MS));
+		
+		// Deferred and failed writes are retried until stored
+		SaveGyroBias();
+		
+		// Learning needs the sensors running: in duty-cycled mode only the temperature is sampled, with a 
+		// power-up of the accelerometer. Duty cycling or a missed sample restarts the window
+		duty = (powerMode == MEMS_POWER_DUTY_CYCLED);
+		if (duty)
+			n = 0;
+		if ((duty ? LSM6DS3SampleImuDuty(&imu, MEMS_SENSOR_ACC) : LSM6DS3SampleImuRaw(&imu)) != H0BR4_OK) {
+			n = 0;
+			continue;
+		}
+		
+		if (n == 0) {
+			// Between windows: follow the temperature. Applied from the first sample, no wait after a restart
+			bin = GyroBiasBin(imu.temp);
+			if (bin != gyroBiasBin)
+				SelectGyroBias(bin);
+			
+			if (duty || !gyroBiasAuto || (xTaskGetTickCount() - lastLearn) < pdMS_TO_TICKS(GYRO_BIAS_LEARN_INTERVAL_MS))
+				continue;
+			
+			lastLearn = xTaskGetTickCount();
+			memset(sum, 0, sizeof(sum));
+			memset(sumSq, 0, sizeof(sumSq));
+			sumTemp = 0;
+			fsIdx = (gyroFsIdx << 4) | accFsIdx;
+		}
+		
+		half = (n < GYRO_BIAS_WINDOW / 2) ? 0 : 1;
+		for (i = 0; i < 3; i++) {
+			sum[half][i] += imu.gyro[i];
+			sum[half][3 + i] += imu.acc[i];
+			sumSq[i] += (int32_t)imu.gyro[i] * imu.gyro[i];
+			sumSq[3 + i] += (int32_t)imu.acc[i] * imu.acc[i];
+		}
+		sumTemp += imu.temp;
+		
+		if (++n < GYRO_BIAS_WINDOW)
+			continue;
+		n = 0;
+		
+		bin = GyroBiasBin(sumTemp / GYRO_BIAS_WINDOW);
+		
+		// Learning turned off or a full scale change during the window mixes units: drop it
+		still = gyroBiasAuto && (fsIdx == ((gyroFsIdx << 4) | accFsIdx));
+		
+		for (i = 0; i < 6 && still; i++) {
+			mean = (float)(sum[0][i] + sum[1][i]) / GYRO_BIAS_WINDOW;
+			var = (float)sumSq[i] / GYRO_BIAS_WINDOW - mean * mean;
+			drift = (float)(sum[1][i] - sum[0][i]) / (GYRO_BIAS_WINDOW / 2);
+			if (i < 3) {
+				maxVar = GYRO_STILL_STD_MDPS / gyroSensitivity;
+				still = (fabsf(drift) <= GYRO_STILL_DRIFT_MDPS / gyroSensitivity);
+			} else {
+				maxVar = ACC_STILL_STD_MG / accSensitivity;
+				still = (fabsf(drift) <= ACC_STILL_DRIFT_MG / accSensitivity);
+			}
+			still = still && (var <= maxVar * maxVar);
+		}
+		
+		for (i = 0; i < 3 && still; i++) {
+			bias[i] = RoundToInt((float)(sum[0][i] + sum[1][i]) / GYRO_BIAS_WINDOW * gyroSensitivity);
+			still = (abs(bias[i]) <= GYRO_BIAS_MAX_MDPS);
+		}
+		
+		if (still) {
+			// First estimate of a bin is taken as is, then averaged over later rest periods in bounded steps
+			for (i = 0; i < 3; i++) {
+				if (gyroBiasFilled & (1U << bin)) {
+					step = (bias[i] - gyroBiasTable[bin][i]) / 4;
+					step = (step > GYRO_BIAS_STEP_MDPS) ? GYRO_BIAS_STEP_MDPS : (step < -GYRO_BIAS_STEP_MDPS) ? -GYRO_BIAS_STEP_MDPS : step;
+					gyroBiasTable[bin][i] += step;
+				} else {
+					gyroBiasTable[bin][i] = bias[i];
+				}
+			}
+			gyroBiasFilled |= (1U << bin);
+			gyroBiasUnsaved |= (1U << bin);
+			SaveGyroBias();
+		}
+		
+		if (still || bin != gyroBiasBin)
+			SelectGyroBias(bin);
+	}
+}
+
+/*-----------------------------------------------------------*/
+
+/* --- MEMS data-ready and motion event lines, dispatched from EXTI4_15_IRQHandler. Wake the acquisition task.
+*/
+void MEMS_EXTI_Callback(uint16_t GPIO_Pin)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	uint32_t event = 0;
+	
+	if (GPIO_Pin == IMU_INT1_PIN)
+		event = ((acqMode == MEMS_ACQ_FIFO) ? MEMS_EVT_FIFO : MEMS_EVT_ACC) | ((MotionEventLines() & 1U) ? MEMS_EVT_MOTION : 0);
+	else if (GPIO_Pin == IMU_INT2_PIN)
+		event = MEMS_EVT_GYRO | ((MotionEventLines() & 2U) ? MEMS_EVT_MOTION : 0);
+	else if (GPIO_Pin == MAG_INT_PIN)
+		event = MEMS_EVT_MAG;
+	
+	if (event == 0 || MemsAcqTaskHandle == NULL)
+		return;
+	
+	xTaskNotifyFromISR(MemsAcqTaskHandle, event, eSetBits, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/*-----------------------------------------------------------*/
+
+/* Time in us on the RTOS tick, refined by the SysTick count within the tick. Wraps with the tick 
+		count times 1000, so deadlines in ticks compare to it modulo 2^32.
+*/
+static uint32_t StreamTimeUs(void)
+{
+	uint32_t reload = (SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1;
+	uint32_t count = 0;
+	TickType_t tick = 0;
+	
+	taskENTER_CRITICAL();
+	tick = xTaskGetTickCount();
+	count = SysTick->VAL;
+	// Reload not yet counted by the tick interrupt: SysTick counts down from the new period
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+		tick++;
+		count = SysTick->VAL;
+	}
+	taskEXIT_CRITICAL();
+	
+	return tick * (1000 * portTICK_PERIOD_MS) + (reload - 1 - count) * (1000 * portTICK_PERIOD_MS) / reload;
+}
+
+/* Timing counters of the stream run by the calling task. A stream start claims an entry for its task: 
+		a free one, else the one claimed longest ago. NULL when the task lost its entry meanwhile
+*/
+static MemsStreamTimingAcc_t *StreamTimingOfTask(bool claim)
+{
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+	MemsStreamTimingAcc_t *timing = NULL;
+	uint8_t i = 0, oldest = 0;
+	
+	if (StreamJobTaskHandle != NULL && task == StreamJobTaskHandle)
+		return &streamTiming[H0BR4_STREAM_TIMING_JOB];
+	
+	taskENTER_CRITICAL();
+	for (i = 0; i < H0BR4_STREAM_TIMING_CALLERS && streamTimingTask[i] != task; i++) {
+		if (streamTimingTask[i] == NULL || (streamTimingTask[oldest] != NULL && 
+				(int32_t)(streamTimingClaimed[i] - streamTimingClaimed[oldest]) < 0))
+			oldest = i;
+	}
+	if (i == H0BR4_STREAM_TIMING_CALLERS && claim)
+		i = oldest;
+	if (i < H0BR4_STREAM_TIMING_CALLERS) {
+		if (claim) {
+			streamTimingTask[i] = task;
+			streamTimingClaimed[i] = xTaskGetTickCount();
+		}
+		timing = &streamTiming[H0BR4_STREAM_TIMING_API + i];
+	}
+	taskEXIT_CRITICAL();
+	
+	return timing;
+}
+
+/* Restart timing counters. Returns the first deadline of the stream: now
+*/
+static TickType_t StreamTimingStart(MemsStreamTimingAcc_t *timing)
+{
+	taskENTER_CRITICAL();
+	memset(timing, 0, sizeof(*timing));
+	taskEXIT_CRITICAL();
+	
+	return xTaskGetTickCount();
+}
+
+/* Account a sample taken for deadline. Early wakes are kept negative
+*/
+static void StreamTimingSample(MemsStreamTimingAcc_t *timing, TickType_t deadline)
+{
+	int32_t late = (int32_t)(StreamTimeUs() - deadline * (1000 * portTICK_PERIOD_MS));
+	
+	if (timing == NULL)
+		return;
+	
+	taskENTER_CRITICAL();
+	if (timing->samples == 0 || late < timing->jitterMinUs)
+		timing->jitterMinUs = late;
+	if (timing->samples == 0 || late > timing->jitterMaxUs)
+		timing->jitterMaxUs = late;
+	timing->samples++;
+	timing->jitterSumUs += late;
+	taskEXIT_CRITICAL();
+}
+
+/* Move *deadline past the deadlines after it missed by a full period, and count them. Later ones are 
+		kept: the sample is taken at once. The stream keeps its phase instead of catching up in a burst.
+*/
+static void StreamSkipMissed(MemsStreamTimingAcc_t *timing, TickType_t *deadline, TickType_t period)
+{
+	TickType_t late = xTaskGetTickCount() - (*deadline + period);
+	uint32_t missed = 0;
+	
+	if ((int32_t)late < (int32_t)period)
+		return;
+	
+	missed = late / period;
+	*deadline += missed * period;
+	
+	if (timing == NULL)
+		return;
+	taskENTER_CRITICAL();
+	timing->missed += missed;
+	taskEXIT_CRITICAL();
+}
+
+/* Fixed-rate wait of the stream loops: sleep until the deadline one period after *lastWakeTime, on 
+		absolute time so sampling and sending do not add to the period.
+*/
+static void StreamDelayUntil(TickType_t *lastWakeTime, uint32_t period)
+{
+	MemsStreamTimingAcc_t *timing = StreamTimingOfTask(false);
+	
+	StreamSkipMissed(timing, lastWakeTime, pdMS_TO_TICKS(period));
+	vTaskDelayUntil(lastWakeTime, pdMS_TO_TICKS(period));
+	StreamTimingSample(timing, *lastWakeTime);
+}
+
+/* StreamDelayUntil for CLI streams: also stops on ENTER or a stop request
+*/
+static Module_Status PollingSleepUntilCLISafe(TickType_t *lastWakeTime, uint32_t period)
+{
+	const unsigned DELTA_SLEEP_MS = 100; // milliseconds
+	MemsStreamTimingAcc_t *timing = StreamTimingOfTask(false);
+	TickType_t deadline = 0, slice = 0;
+	
+	StreamSkipMissed(timing, lastWakeTime, pdMS_TO_TICKS(period));
+	deadline = *lastWakeTime + pdMS_TO_TICKS(period);
+	
+	// Sleep in slices so ENTER is checked at least once per period, even for short periods
+	while (*lastWakeTime != deadline) {
+		slice = deadline - *lastWakeTime;
+		if (slice > pdMS_TO_TICKS(DELTA_SLEEP_MS))
+			slice = pdMS_TO_TICKS(DELTA_SLEEP_MS);
+		vTaskDelayUntil(lastWakeTime, slice);
+		
+		// Look for ENTER key to stop the stream
+		for (uint8_t chr=0 ; chr<MSG_RX_BUF_SIZE ; chr++)
+		{
+			if (UARTRxBuf[PcPort-1][chr] == '\r') {
+				UARTRxBuf[PcPort-1][chr] = 0;
+				return H0BR4_ERR_TERMINATED;
+			}
+		}
+		
+		if (stopStream)
+			return H0BR4_ERR_TERMINATED;
+	}
+	
+	StreamTimingSample(timing, deadline);
+	return H0BR4_OK;
+}
+
+/* Shortest sustainable stream period in microseconds: limited by the sensor ODR, the I2C read 
+		time when polling (none for streams read from a task), and the port baud rate for outBytes 
+		per sample (0 when not sent to a port).
+*/
+static uint32_t StreamMinPeriodUs(const MemsStreamInfo_t *info, uint8_t port, uint32_t outBytes)
+{
+	UART_HandleTypeDef *huart = NULL;
+	uint32_t minUs = 1000000UL / info->maxOdrHz;
+	uint32_t us = 0;
+	
+	if (acqMode == MEMS_ACQ_POLLING && info->i2cBytes) {
+		us = ((uint32_t)(info->i2cBytes + I2C_READ_OVERHEAD) * I2C_BITS_PER_BYTE * 1000) / GetMemsI2CSpeed();
+		
+		// Duty-cycled sensors wake up for each sample
+		if (powerMode == MEMS_POWER_DUTY_CYCLED)
+			us += MemsDutySettleMs(info->sensors) * 1000;
+		if (us > minUs)
+			minUs = us;
+	}
+	
+	if (outBytes && (huart = GetUart(port)) != NULL && huart->Init.BaudRate) {
+		us = (outBytes * UART_BITS_PER_BYTE * 1000000ULL) / huart->Init.BaudRate;
+		if (us > minUs)
+			minUs = us;
+	}
+	
+	return minUs;
+}
+
+/* Reject a period the stream cannot sustain and record the highest sustainable rate. Compared in 
+		ms: long periods would overflow in us.
+*/
+static Module_Status CheckStreamPeriod(uint32_t period, uint32_t minPeriodUs)
+{
+	if (period >= minPeriodUs / 1000 + (minPeriodUs % 1000 != 0))
+		return H0BR4_OK;
+	
+	streamMaxRateHz = 1000000UL / minPeriodUs;
+	return H0BR4_ERR_BANDWIDTH;
+}
+
+
+/* Prefix a sample text with the sample time in us
+*/
+static void PrependSampleTime(char *cstring, size_t maxLen)
+{
+	char stamp[20];
+	size_t len = snprintf(stamp, sizeof(stamp), "%lu us | ", (unsigned long)GetMemsSampleTime());
+	size_t textLen = strlen(cstring);
+	
+	if (len >= maxLen)
+		return;
+	if (len + textLen >= maxLen)
+		textLen = maxLen - len - 1;
+	
+	memmove(cstring + len, cstring, textLen);
+	memcpy(cstring, stamp, len);
+	cstring[len + textLen] = '\0';
+}
+
+static bool MemsReportValid(MemsReportChannel_t channel, const MemsReportConfig_t *config)
+{
+	uint8_t i = 0;
+	
+	if (channel >= MEMS_REPORT_NONE || config->hysteresis > H0BR4_REPORT_MAX_HYSTERESIS)
+		return false;
+	if (config->maxIntervalMs && config->maxIntervalMs < config->minIntervalMs)
+		return false;
+	
+	// Deadbands must fit their EEPROM word
+	for (i = 0; i < 3; i++) {
+		if (config->deadband[i] < 0 || config->deadband[i] * reportDeadbandScale[channel] > UINT16_MAX)
+			return false;
+	}
+	
+	return true;
+}
+
+/* Store the reporting settings of a channel: configuration word, deadbands, then intervals
+*/
+static Module_Status SaveMemsReportConfig(MemsReportChannel_t channel)
+{
+	uint16_t address = _EE_MEMS_REPORT + 6*channel;
+	uint16_t words[6], stored = 0;
+	uint8_t i = 0;
+	
+	words[0] = MEMS_CONFIG_VALID | (reportEnabled[channel] ? 0x100 : 0) | reportConfig[channel].hysteresis;
+	for (i = 0; i < 3; i++)
+		words[1 + i] = (uint16_t)(reportConfig[channel].deadband[i] * reportDeadbandScale[channel] + 0.5f);
+	words[4] = reportConfig[channel].minIntervalMs;
+	words[5] = reportConfig[channel].maxIntervalMs;
+	
+	for (i = 0; i < 6; i++) {
+		if (EE_ReadVariable(address + i, &stored) == 0 && stored == words[i])
+			continue;
+		if (EE_WriteVariable(address + i, words[i]) != 0)
+			return H0BR4_ERR_IO;
+	}
+	
+	return H0BR4_OK;
+}
+
+/* Step count of a stream sensor: the bits of the uint32_t count in buffer[0]
+*/
+static Module_Status SampleStepCountToBuf(float *buffer)
+{
+	Module_Status status = H0BR4_OK;
+	uint32_t steps = 0;
+	
+	if ((status = SampleStepCount(&steps)) == H0BR4_OK)
+		memcpy(buffer, &steps, sizeof(steps));
+	return status;
+}
+
+/* Stream sensors in MemsStreamSensor_t order. Report channels are the first ones, in the same order */
+static const MemsSensorSource_t sensorSources[] =
+{
+	{ SampleGyroDPSToBuf, 3, false, 1, "Gyro(DPS) | X: %.2f, Y: %.2f, Z: %.2f\r\n", &gyroStreamInfo }, 
+	{ SampleAccGToBuf, 3, false, 1, "Acc(G) | X: %.2f, Y: %.2f, Z: %.2f\r\n", NULL }, 
+	{ SampleMagMGaussToBuf, 3, false, 0.001f, "Mag(mGauss) | X: %.0f, Y: %.0f, Z: %.0f\r\n", &magStreamInfo }, 
+	{ SampleTempCelsius, 1, false, 1, "Temp(Celsius) | %0.2f\r\n", &tempStreamInfo }, 
+	{ SampleQuaternionToBuf, 4, false, 0, "Quaternion | W: %.4f, X: %.4f, Y: %.4f, Z: %.4f\r\n", &quatStreamInfo }, 
+	{ SampleEulerToBuf, 3, false, 1, "Euler(Deg) | Roll: %.2f, Pitch: %.2f, Yaw: %.2f\r\n", &eulerStreamInfo }, 
+	{ SampleHeading, 1, false, 1, "Heading(Deg) | %.1f\r\n", &headingStreamInfo }, 
+	{ SampleStepCountToBuf, 1, true, 0, "Steps | %lu\r\n", &stepsStreamInfo },
+};
+
+/* CLI text of one sample of a stream sensor
+*/
+static void FormatSensorSample(const MemsSensorSource_t *src, const float *values, char *text, size_t maxLen)
+{
+	float v[4] = { 0 };
+	uint32_t bits = 0;
+	
+	if (src->counter) {
+		memcpy(&bits, values, sizeof(bits));
+		snprintf(text, maxLen, src->format, (unsigned long)bits);
+		return;
+	}
+	
+	// Unused values are ignored by single-value formats
+	memcpy(v, values, src->count * sizeof(float));
+	snprintf(text, maxLen, src->format, v[0], v[1], v[2], v[3]);
+}
+
+/* Sample a stream sensor as CLI text
+*/
+static Module_Status SampleSensorToString(MemsStreamSensor_t sensor, char *cstring, size_t maxLen)
+{
+	Module_Status status = H0BR4_OK;
+	float values[4];
+	
+	if ((status = sensorSources[sensor].sample(values)) != H0BR4_OK)
+		return status;
+	
+	FormatSensorSample(&sensorSources[sensor], values, cstring, maxLen);
+	return status;
+}
+
+/* Start change-triggered reporting on a stream if it is enabled for its channel
+*/
+static void MemsReportStart(MemsReportStream_t *stream, MemsReportChannel_t channel)
+{
+	memset(stream, 0, sizeof(*stream));
+	if (channel >= MEMS_REPORT_NONE)
+		return;
+	
+	taskENTER_CRITICAL();
+	if (reportEnabled[channel]) {
+		stream->source = &sensorSources[channel];
+		stream->config = reportConfig[channel];
+	}
+	taskEXIT_CRITICAL();
+}
+
+/* Whether a sample of a change-reported stream is sent. False when it is held back: no axis moved by 
+		its deadband since the last report, or it is too soon after it, and no heartbeat is due.
+*/
+static bool MemsReportDue(MemsReportStream_t *stream, const float *values)
+{
+	TickType_t now = 0, elapsed = 0;
+	float deadband = 0;
+	bool changed = false;
+	uint8_t i = 0;
+	
+	now = xTaskGetTickCount();
+	elapsed = now - stream->lastTick;
+	
+	for (i = 0; i < stream->source->count; i++) {
+		deadband = stream->config.deadband[i];
+		if (stream->changing)
+			deadband -= deadband * stream->config.hysteresis / 100;
+		if (deadband > 0 && fabsf(values[i] - stream->last[i]) >= deadband)
+			changed = true;
+	}
+	stream->changing = changed;
+	
+	// The first sample is always reported
+	if (stream->started) {
+		if (elapsed < pdMS_TO_TICKS(stream->config.minIntervalMs))
+			return false;
+		if (!changed && !(stream->config.maxIntervalMs && elapsed >= pdMS_TO_TICKS(stream->config.maxIntervalMs)))
+			return false;
+	}
+	
+	stream->started = true;
+	stream->lastTick = now;
+	memcpy(stream->last, values, stream->source->count * sizeof(float));
+	return true;
+}
+
+/* Sample a change-reported stream into values. *due is false when the sample is held back
+*/
+static Module_Status MemsReportSample(MemsReportStream_t *stream, float *values, bool *due)
+{
+	Module_Status status = H0BR4_OK;
+	
+	*due = false;
+	if ((status = stream->source->sample(values)) == H0BR4_OK)
+		*due = MemsReportDue(stream, values);
+	return status;
+}
+
+static Module_Status StreamMemsToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout, SampleMemsToPort function, 
+																			const MemsStreamInfo_t *info, MemsReportChannel_t report)
+{
+	Module_Status status = H0BR4_OK;
+	uint32_t outBytes = MEMS_TIMESTAMP_BYTES + info->portBytes;
+	MemsReportStream_t stream;
+	float values[3];
+	bool due = false;
+	TickType_t lastWakeTime;
+	
+	if (period < MIN_MEMS_PERIOD_MS)
+		return H0BR4_ERR_WrongParams;
+	if (port == 0)
+		return H0BR4_ERR_WrongParams;
+	if (port == PcPort) // Check if CLI is not enabled at that port!
+		return H0BR4_ERR_BUSY;
+	
+	// Samples for other modules are forwarded in a BOS message
+	if (module != myID)
+		outBytes += 1 + BOS_MSG_OVERHEAD;
+	
+	if ((status = CheckStreamPeriod(period, StreamMinPeriodUs(info, port, outBytes))) != H0BR4_OK)
+		return status;
+	
+	if (period > timeout)
+		timeout = period;
+	
+	long numTimes = timeout / period;
+	stopStream = false;
+	MemsReportStart(&stream, report);
+	lastWakeTime = StreamTimingStart(StreamTimingOfTask(true));
+	
+	while ((numTimes-- > 0) || (timeout >= MAX_MEMS_TIMEOUT_MS)) {
+		if (stream.source == NULL)
+			status = function(port, module);
+		else if ((status = MemsReportSample(&stream, values, &due)) == H0BR4_OK && due)
+			status = SendWordsToPort(port, module, values, stream.source->count);
+		if (status != H0BR4_OK)
+			break;
+		
+		// Fixed-rate wake-up: sampling time does not add to the period
+		StreamDelayUntil(&lastWakeTime, period);
+		if (stopStream) {
+			status = H0BR4_ERR_TERMINATED;
+			break;
+		}
+	}
+	return status;
+}
+
+static Module_Status StreamMemsToCLI(uint32_t period, uint32_t timeout, SampleMemsToString function, const MemsStreamInfo_t *info, 
+																		 MemsReportChannel_t report)
+{
+	Module_Status status = H0BR4_OK;
+	int8_t *pcOutputString = NULL;
+	MemsReportStream_t stream;
+	float values[3];
+	TickType_t lastWakeTime;
+	bool due = true;
+	
+	if (period < MIN_MEMS_PERIOD_MS)
+		return H0BR4_ERR_WrongParams;
+
+	// TODO: Check if CLI is enable or not
+	
+	// Checked at the usual line length before any sample is read or sent
+	if ((status = CheckStreamPeriod(period, StreamMinPeriodUs(info, PcPort, TEXT_SAMPLE_BYTES))) != H0BR4_OK)
+		return status;
+	
+	if (period > timeout)
+		timeout = period;
+	
+	long numTimes = timeout / period;
+	stopStream = false;
+	MemsReportStart(&stream, report);
+	lastWakeTime = StreamTimingStart(StreamTimingOfTask(true));
+	
+	while ((numTimes-- > 0) || (timeout >= MAX_MEMS_TIMEOUT_MS)) {
+		pcOutputString = FreeRTOS_CLIGetOutputBuffer();
+		if (stream.source == NULL) {
+			status = function((char *)pcOutputString, 100);
+		} else if ((status = MemsReportSample(&stream, values, &due)) == H0BR4_OK && due) {
+			FormatSensorSample(stream.source, values, (char *)pcOutputString, 100);
+		}
+		if (status != H0BR4_OK)
+			break;
+		if (!due) {
+			if (PollingSleepUntilCLISafe(&lastWakeTime, period) != H0BR4_OK)
+				break;
+			continue;
+		}
+		PrependSampleTime((char *)pcOutputString, 100);
+		
+		writePxMutex(PcPort, (char *)pcOutputString, strlen((char *)pcOutputString), cmd500ms, HAL_MAX_DELAY);
+		if (PollingSleepUntilCLISafe(&lastWakeTime, period) != H0BR4_OK)
+			break;
+	}
+
+	memset((char *) pcOutputString, 0, configCOMMAND_INT_MAX_OUTPUT_SIZE);
+  sprintf((char *)pcOutputString, "\r\n");
+	return status;
+}
+
+/* Buffer streams write records one after the other from buffer, ring streams (ring not NULL) store 
+		them in the ring. Change-reported streams only store the samples reported: held-back samples 
+		leave the rest of the buffer untouched.
+*/
+static Module_Status StreamMemsToBuf(float *buffer, MemsSampleRing_t *ring, uint32_t numDatapoints, uint32_t period, 
+																		 uint32_t timeout, SampleMemsToBuffer function, const MemsStreamInfo_t *info, 
+																		 MemsReportChannel_t report)
+{
+	Module_Status status = H0BR4_OK;
+	MemsReportStream_t stream;
+	float values[3];
+	float record[1 + 4];
+	TickType_t lastWakeTime;
+	uint32_t stamp = 0;
+	bool due = true;
+	
+	if (period < MIN_MEMS_PERIOD_MS)
+		return H0BR4_ERR_WrongParams;
+	if (ring != NULL && (ring->data == NULL || ring->values != numDatapoints))
+		return H0BR4_ERR_WrongParams;
+	if (ring != NULL)
+		buffer = record;
+
+	// TODO: Check if CLI is enable or not
+	
+	if ((status = CheckStreamPeriod(period, StreamMinPeriodUs(info, 0, 0))) != H0BR4_OK)
+		return status;
+	
+	if (period > timeout)
+		timeout = period;
+	
+	long numTimes = timeout / period;
+	stopStream = false;
+	MemsReportStart(&stream, report);
+	lastWakeTime = StreamTimingStart(StreamTimingOfTask(true));
+	
+	while ((numTimes-- > 0) || (timeout >= MAX_MEMS_TIMEOUT_MS)) {
+		if (stream.source == NULL)
+			status = function(buffer + 1);
+		else if ((status = MemsReportSample(&stream, values, &due)) == H0BR4_OK && due)
+			memcpy(buffer + 1, values, numDatapoints * sizeof(float));
+		if (status != H0BR4_OK)
+			break;
+		
+		// Record: sample time in the first word, then the values
+		if (due) {
+			stamp = GetMemsSampleTime();
+			memcpy(buffer, &stamp, sizeof(stamp));
+			if (ring != NULL)
+				MemsRingPush(ring, stamp, record + 1);
+			else
+				buffer += 1 + numDatapoints;
+		}
+		
+		StreamDelayUntil(&lastWakeTime, period);
+		if (stopStream) {
+			status = H0BR4_ERR_TERMINATED;
+			break;
+		}
+	}
+	return status;
+}
+
+#if H0BR4_ENABLE_STATS
+/* Add one sample to window accumulators
+*/
+static void MemsStatsInput(MemsStatsAcc_t *acc, const int32_t *sample)
+{
+	int64_t d = 0;
+	uint8_t i = 0;
+	
+	for (i = 0; i < 3; i++) {
+		if (acc->count == 0) {
+			acc->ref[i] = acc->min[i] = acc->max[i] = sample[i];
+			acc->sum[i] = 0;
+			acc->sumSq[i] = 0;
+		}
+		if (sample[i] < acc->min[i])
+			acc->min[i] = sample[i];
+		if (sample[i] > acc->max[i])
+			acc->max[i] = sample[i];
+		
+		d = (int64_t)sample[i] - acc->ref[i];
+		acc->sum[i] += d;
+		acc->sumSq[i] += (uint64_t)(d * d);
+	}
+	acc->count++;
+}
+
+/* Statistics of one axis in stream units: API units times scale. The sums are re-centred on their 
+		integer mean exactly in 64 bits, so only the remainders below one API unit go through float
+*/
+static void MemsStatsAxis(const MemsStatsAcc_t *acc, uint8_t axis, float scale, MemsAxisStats_t *stats)
+{
+	int64_t mean = acc->sum[axis] / (int64_t)acc->count;
+	int64_t rest = acc->sum[axis] - mean * acc->count;			// |rest| < count
+	int64_t centred = 0;																		// Sum of (x - ref - mean)^2
+	float meanF = 0, variance = 0;
+	
+	// No overflow: |x - ref| < 2^22 (4000 dps in mdps) and count < 2^16 keep every term below 2^62
+	centred = (int64_t)acc->sumSq[axis] - 2 * mean * acc->sum[axis] + mean * mean * (int64_t)acc->count;
+	variance = ((float)centred - (float)rest * (float)rest / acc->count) / acc->count;
+	
+	// Float rounding can leave a tiny negative variance on a constant input
+	if (variance < 0)
+		variance = 0;
+	meanF = (float)(acc->ref[axis] + mean) + (float)rest / acc->count;
+	
+	stats->min = acc->min[axis] * scale;
+	stats->max = acc->max[axis] * scale;
+	stats->mean = meanF * scale;
+	stats->variance = variance * scale * scale;
+	stats->rms = sqrtf(variance + meanF * meanF) * scale;
+	stats->peakToPeak = (float)(acc->max[axis] - acc->min[axis]) * scale;
+}
+
+/* Send the statistics of one axis: the sample time in us, the axis, then min, max, mean, RMS, 
+		variance and peak-to-peak as floats, all MSB first
+*/
+static Module_Status SendStatsToPort(uint8_t port, uint8_t module, uint8_t axis, const MemsAxisStats_t *stats)
+{
+	uint8_t temp[MEMS_TIMESTAMP_BYTES + 1 + sizeof(MemsAxisStats_t)];
+	const float *values = &stats->min;
+	uint8_t *dst = PackUint32(temp, GetMemsSampleTime());
+	uint32_t bits = 0;
+	uint8_t i = 0;
+	
+	*dst++ = axis;
+	for (i = 0; i < sizeof(MemsAxisStats_t) / sizeof(float); i++) {
+		memcpy(&bits, &values[i], sizeof(bits));
+		dst = PackUint32(dst, bits);
+	}
+	
+	return SendRecordToPort(port, module, temp, sizeof(temp));
+}
+
+/* Calibrated sample of a channel in its integer API units. *fresh is false when the acquisition task 
+		has no new output since the last call
+*/
+static Module_Status MemsStatsSample(MemsFilterChannel_t channel, int32_t *sample, uint32_t *lastCount, bool *fresh)
+{
+	Module_Status status = H0BR4_OK;
+	uint32_t count = 0;
+	int xyz[3];
+	
+	// Outputs of the acquisition task are counted: the same one must not be accumulated twice
+	if (acqMode != MEMS_ACQ_POLLING && !(channel == MEMS_FILTER_ACC && accChannel == MEMS_ACC_LSM303AGR)) {
+		count = (channel == MEMS_FILTER_GYRO) ? memsOutput.gyroCount : 
+						(channel == MEMS_FILTER_ACC) ? memsOutput.accCount : memsOutput.magCount;
+		*fresh = (count != *lastCount);
+		*lastCount = count;
+		if (!*fresh)
+			return H0BR4_OK;
+	}
+	*fresh = true;
+	
+	if (channel == MEMS_FILTER_GYRO)
+		status = SampleGyroMDPS(&xyz[0], &xyz[1], &xyz[2]);
+	else if (channel == MEMS_FILTER_ACC)
+		status = SampleAccMG(&xyz[0], &xyz[1], &xyz[2]);
+	else
+		status = SampleMagMGauss(&xyz[0], &xyz[1], &xyz[2]);
+	
+	sample[0] = xyz[0];
+	sample[1] = xyz[1];
+	sample[2] = xyz[2];
+	return status;
+}
+
+/* Parameters and port bandwidth of a statistics stream, and its sample period in ms. No side effect 
+		other than the highest sustainable rate: also the check of a job before it is queued. 
+		Statistics are sampled on the RTOS tick, not from FIFO or DRDY: the period is one channel output, 
+		clamped to 1 ms and to the bus time of a sample. Above 1 kHz a window holds every n-th output.
+*/
+static Module_Status StatsStreamCheck(MemsFilterChannel_t channel, uint16_t windowSamples, uint32_t windowMs, bool toCLI, 
+																			uint8_t port, uint8_t module, uint32_t *sampleMs)
+{
+	const MemsStreamInfo_t *info = NULL;
+	uint32_t windowPeriod = 0, outBytes = 0;
+	uint16_t hz = 0;
+	
+	if (channel > MEMS_FILTER_MAG || (windowSamples == 0 && windowMs == 0))
+		return H0BR4_ERR_WrongParams;
+	if (!toCLI && port == 0)
+		return H0BR4_ERR_WrongParams;
+	if (!toCLI && port == PcPort) // Check if CLI is not enabled at that port!
+		return H0BR4_ERR_BUSY;
+	
+	// Sample at the channel output rate: the sensor ODR, after decimation when filtered
+	info = (channel == MEMS_FILTER_GYRO) ? &gyroStreamInfo : (channel == MEMS_FILTER_ACC) ? AccChannelStreamInfo() : &magStreamInfo;
+	if (channel == MEMS_FILTER_ACC && accChannel == MEMS_ACC_LSM303AGR)
+		hz = acc2OdrTable[acc2OdrIdx].hz;
+	else
+		hz = MemsFilterInputHz(channel) / ((acqMode == MEMS_ACQ_POLLING) ? 1 : filterConfig[channel].decimation);
+	*sampleMs = hz ? (1000 + hz - 1) / hz : 1000;
+	if ((StreamMinPeriodUs(info, 0, 0) + 999) / 1000 > *sampleMs)
+		*sampleMs = (StreamMinPeriodUs(info, 0, 0) + 999) / 1000;
+	
+	// Three records per window must fit the port bandwidth
+	windowPeriod = windowSamples ? windowSamples * *sampleMs : windowMs;
+	if (windowMs && windowMs < windowPeriod)
+		windowPeriod = windowMs;
+	if (toCLI)
+		return H0BR4_OK;
+	
+	outBytes = 3 * (MEMS_TIMESTAMP_BYTES + 1 + sizeof(MemsAxisStats_t) + ((module != myID) ? 1 + BOS_MSG_OVERHEAD : 0));
+	return CheckStreamPeriod(windowPeriod, StreamMinPeriodUs(info, port, outBytes));
+}
+
+/* Sample a channel at its output rate and send min, max, mean, RMS, variance and peak-to-peak of each 
+		axis every windowSamples samples or windowMs, whichever comes first (0 disables either). To the 
+		CLI when toCLI, else to port of module. The sensor ODR is held at the sample rate or above until 
+		the stream ends, so another stream giving its raised ODR back cannot slow the window down.
+*/
+static Module_Status StreamMemsStats(MemsFilterChannel_t channel, uint16_t windowSamples, uint32_t windowMs, uint32_t timeout, 
+																		 bool toCLI, uint8_t port, uint8_t module)
+{
+	const char *const labels[] = { "Gyro(DPS)", "Acc(G)", "Mag(mGauss)" };
+	const char *const axes = "XYZ";
+	const float scales[] = { 0.001f, 0.001f, 1.0f };
+	
+	Module_Status status = H0BR4_OK;
+	MemsStatsAcc_t acc;
+	MemsAxisStats_t stats;
+	TickType_t start = 0, windowStart = 0, lastWakeTime = 0;
+	uint32_t sampleMs = 0, lastCount = 0;
+	int32_t sample[3];
+	int8_t *pcOutputString = NULL;
+	bool fresh = false;
+	uint8_t i = 0, held = 0;
+	
+	if ((status = StatsStreamCheck(channel, windowSamples, windowMs, toCLI, port, module, &sampleMs)) != H0BR4_OK)
+		return status;
+	if ((status = MatchFilterChannelOdr(channel, sampleMs, &held)) != H0BR4_OK)
+		return status;
+	
+	stopStream = false;
+	acc.count = 0;
+	start = windowStart = lastWakeTime = StreamTimingStart(StreamTimingOfTask(true));
+	
+	while (timeout >= MAX_MEMS_TIMEOUT_MS || (xTaskGetTickCount() - start) < pdMS_TO_TICKS(timeout)) {
+		if ((status = MemsStatsSample(channel, sample, &lastCount, &fresh)) == H0BR4_OK && fresh)
+			MemsStatsInput(&acc, sample);
+		else if (status != H0BR4_OK && status != H0BR4_ERR_BUSY)		// No output yet from the acquisition task
+			break;
+		status = H0BR4_OK;
+		
+		if (acc.count && ((windowSamples && acc.count >= windowSamples) || acc.count >= H0BR4_STATS_MAX_SAMPLES || 
+				(windowMs && (xTaskGetTickCount() - windowStart) >= pdMS_TO_TICKS(windowMs)))) {
+			for (i = 0; i < 3; i++) {
+				MemsStatsAxis(&acc, i, scales[channel], &stats);
+				if (!toCLI) {
+					SendStatsToPort(port, module, i, &stats);
+					continue;
+				}
+				
+				pcOutputString = FreeRTOS_CLIGetOutputBuffer();
+				snprintf((char *)pcOutputString, configCOMMAND_INT_MAX_OUTPUT_SIZE, 
+								 "%s %c | min %.3f, max %.3f, mean %.3f, rms %.3f, var %.5f, p2p %.3f, n %lu\r\n", labels[channel], axes[i], 
+								 stats.min, stats.max, stats.mean, stats.rms, stats.variance, stats.peakToPeak, (unsigned long)acc.count);
+				PrependSampleTime((char *)pcOutputString, configCOMMAND_INT_MAX_OUTPUT_SIZE);
+				writePxMutex(PcPort, (char *)pcOutputString, strlen((char *)pcOutputString), cmd500ms, HAL_MAX_DELAY);
+			}
+			acc.count = 0;
+			windowStart = xTaskGetTickCount();
+		}
+		
+		if (toCLI) {
+			if ((status = PollingSleepUntilCLISafe(&lastWakeTime, sampleMs)) != H0BR4_OK)
+				break;
+		} else {
+			StreamDelayUntil(&lastWakeTime, sampleMs);
+			if (stopStream) {
+				status = H0BR4_ERR_TERMINATED;
+				break;
+			}
+		}
+	}
+	
+	if (toCLI) {
+		pcOutputString = FreeRTOS_CLIGetOutputBuffer();
+		memset((char *) pcOutputString, 0, configCOMMAND_INT_MAX_OUTPUT_SIZE);
+		sprintf((char *)pcOutputString, "\r\n");
+	}
+	ReleaseOdr(held);
+	return status;
+}
+#endif
+
+
+#if H0BR4_ENABLE_FFT
+/* Capture size samples of one LSM6DS3 accelerometer axis at fftOdrTable[odr]. The FIFO collects them 
+		at the sensor rate, independent of the I2C speed, and stops when full. The capture holds the sensor 
+		lock: the acquisition task and the polling reads of the fusion, gyro bias and slot tasks wait for 
+		it. The acquisition mode and accelerometer settings are restored afterwards.
+*/
+static Module_Status LSM6DS3CaptureAcc(uint8_t axis, uint16_t size, uint8_t odr, int16_t *samples)
+{
+	MemsAcqMode_t mode = acqMode;
+	Module_Status status = H0BR4_OK, restore = H0BR4_OK;
+	uint16_t total = size + FFT_SETTLE_SAMPLES, pending = 0, words = 0, got = 0, i = 0;
+	uint32_t captureMs = ((uint32_t)total * 1000 + fftOdrTable[odr].hz - 1) / fftOdrTable[odr].hz;
+	uint64_t timeUs = 0;
+	uint8_t fifoStatus[2], code = 0, odrCode = 0, bw = 0;
+	TickType_t start = 0;
+	
+	if (!MemsLock(pdMS_TO_TICKS(MEMS_LOCK_TIMEOUT_MS)))
+		return H0BR4_ERR_BUSY;
+	
+	// The acquisition task must stay off the FIFO during the capture
+	if (mode != MEMS_ACQ_POLLING && (status = SetMemsAcquisitionMode(MEMS_ACQ_POLLING)) != H0BR4_OK) {
+		MemsUnlock();
+		return status;
+	}
+	
+	// Anti-aliasing bandwidth of the capture: the widest one up to Nyquist, whatever BW_XL is configured
+	for (bw = TABLE_SIZE(accBwTable) - 1; bw > 0 && accBwTable[bw].hz > fftOdrTable[odr].hz / 2; bw--);
+	
+	// Accelerometer alone in the FIFO, undecimated, at the capture rate. FIFO mode stops when full
+	FifoDecimationCode(1, &code);
+	FifoOdrCode(fftOdrTable[odr].hz, &odrCode);
+	if (LSM6DS3_ACC_GYRO_W_ODR_XL(&hi2c2, fftOdrTable[odr].reg) != MEMS_SUCCESS || 
+			LSM6DS3_ACC_GYRO_W_BW_Fixed_By_ODR(&hi2c2, LSM6DS3_ACC_GYRO_BW_SCAL_ODR_ENABLED) != MEMS_SUCCESS || 
+			LSM6DS3_ACC_GYRO_W_BW_XL(&hi2c2, accBwTable[bw].reg) != MEMS_SUCCESS || 
+			LSM6DS3_ACC_GYRO_WriteReg(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_CTRL3, &code, 1) != MEMS_SUCCESS || 
+			LSM6DS3_ACC_GYRO_W_ODR_FIFO(&hi2c2, odrCode) != MEMS_SUCCESS || 
+			LSM6DS3SampleTime(&timeUs) != H0BR4_OK || 
+			LSM6DS3_ACC_GYRO_W_FIFO_MODE(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_MODE_FIFO) != MEMS_SUCCESS)
+		status = H0BR4_ERR_LSM6DS3;
+	
+	// Sleep through the capture, then wait for the last samples for up to as long again
+	if (status == H0BR4_OK)
+		vTaskDelay(pdMS_TO_TICKS(captureMs));
+	start = xTaskGetTickCount();
+	while (status == H0BR4_OK) {
+		if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_STATUS1, fifoStatus, 2) != MEMS_SUCCESS)
+			status = H0BR4_ERR_LSM6DS3;
+		pending = ((uint16_t)(fifoStatus[1] & 0x0F) << 8) | fifoStatus[0];
+		if (status != H0BR4_OK || pending >= total * 3)
+			break;
+		if ((xTaskGetTickCount() - start) > pdMS_TO_TICKS(captureMs + 10))
+			status = H0BR4_ERR_LSM6DS3;
+		vTaskDelay(1);
+	}
+	
+	// Drain in bursts of whole samples, the first ones settle after the ODR switch
+	while (status == H0BR4_OK && got < total) {
+		words = (total - got) * 3;
+		if (words > FIFO_MAX_WORDS)
+			words = FIFO_MAX_WORDS;
+		if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L, fifoRaw, words * 2) != MEMS_SUCCESS) {
+			status = H0BR4_ERR_LSM6DS3;
+			break;
+		}
+		for (i = 0; i < words / 3; i++, got++) {
+			if (got >= FFT_SETTLE_SAMPLES)
+				samples[got - FFT_SETTLE_SAMPLES] = concatBytes(fifoRaw[6*i + 2*axis + 1], fifoRaw[6*i + 2*axis]);
+		}
+	}
+	
+	// Time of the last sample captured
+	if (status == H0BR4_OK)
+		SetSampleTime(timeUs + (uint64_t)total * 1000000UL / fftOdrTable[odr].hz);
+	
+	// Going through bypass empties the FIFO. Bandwidth scaling stays enabled as at init, and the 
+	// configuration puts ODR_XL and BW_XL back
+	if (LSM6DS3_ACC_GYRO_W_FIFO_MODE(&hi2c2, LSM6DS3_ACC_GYRO_FIFO_MODE_BYPASS) != MEMS_SUCCESS)
+		restore = H0BR4_ERR_LSM6DS3;
+	if (restore == H0BR4_OK)
+		restore = LSM6DS3ApplyAccConfig();
+	if (restore == H0BR4_OK && mode != MEMS_ACQ_POLLING)
+		restore = SetMemsAcquisitionMode(mode);
+	MemsUnlock();
+	
+	return (status != H0BR4_OK) ? status : restore;
+}
+
+/* Top peaks of the bins, largest first, located between bins by a parabola through the three 
+		bins around each local maximum
+*/
+static void FftFindPeaks(MemsSpectrum_t *spectrum)
+{
+	const uint16_t *bins = spectrum->bins;
+	uint16_t idx[H0BR4_FFT_PEAKS];
+	uint16_t k = 0;
+	uint8_t i = 0;
+	float a = 0, b = 0, c = 0, den = 0, d = 0;
+	
+	memset(idx, 0, sizeof(idx));
+	for (k = 1; k + 1 < spectrum->size / 2; k++) {
+		if (bins[k] == 0 || bins[k] <= bins[k - 1] || bins[k] < bins[k + 1])
+			continue;
+		
+		// Insertion in the sorted list, the smallest drops out
+		for (i = H0BR4_FFT_PEAKS - 1; i > 0 && (idx[i - 1] == 0 || bins[idx[i - 1]] < bins[k]); i--)
+			idx[i] = idx[i - 1];
+		if (idx[i] == 0 || bins[idx[i]] < bins[k])
+			idx[i] = k;
+	}
+	
+	memset(spectrum->peaks, 0, sizeof(spectrum->peaks));
+	for (i = 0; i < H0BR4_FFT_PEAKS && idx[i]; i++) {
+		a = bins[idx[i] - 1];
+		b = bins[idx[i]];
+		c = bins[idx[i] + 1];
+		den = a - 2 * b + c;
+		d = (den != 0) ? 0.5f * (a - c) / den : 0;
+		spectrum->peaks[i].hz = (idx[i] + d) * spectrum->binHz;
+		spectrum->peaks[i].amplitude = (b - 0.25f * (a - c) * d) * spectrum->binScale;
+	}
+}
+
+/* Amplitude spectrum of size samples, computed in place: mean removed, window applied, then a 
+		size / 2 point complex FFT of the real samples. Float is only used for the scaling of the 
+		results, peaks and bands.
+*/
+static void FftAccSpectrum(int16_t *x, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, MemsSpectrum_t *spectrum)
+{
+	uint16_t m = size / 2, k = 0;
+	int32_t sum = 0, mean = 0, v = 0, w = FFT_Q15_ONE;
+	uint32_t sumW = 0, mag = 0, peak = 0;
+	uint64_t sumW2 = 0;
+	uint8_t exponent = 0, shift = 0;
+	int16_t s = 0, c = 0;
+	float ampScale = 0, enbw = 0, a = 0;
+	
+	for (k = 0; k < size; k++)
+		sum += x[k];
+	mean = sum / size;
+	
+	for (k = 0; k < size; k++) {
+		v = x[k] - mean;
+		v = (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v;
+		if (window == MEMS_FFT_WINDOW_HANN) {
+			FftSinCos(k * (FFT_TABLE_SIZE / size), &s, &c);
+			w = (FFT_Q15_ONE - c) / 2;
+		}
+		x[k] = (v * w + 0x4000) >> 15;
+		sumW += w;
+		sumW2 += (uint64_t)w * w;
+	}
+	
+	exponent = FftComplexQ15(x, m);
+	
+	// Bins are scaled down to 16 bits by the largest one
+	for (k = 0; k < m; k++) {
+		if ((mag = FftRealBin(x, m, k)) > peak)
+			peak = mag;
+	}
+	while ((peak >> shift) > UINT16_MAX)
+		shift++;
+	
+	// Peak amplitude of a sine: 2 |X| over the window sum. Bins hold 2 |X| / 2^exponent in Q15
+	ampScale = ldexpf((float)FFT_Q15_ONE / sumW * accSensitivity, exponent);
+	enbw = (float)size * sumW2 / ((float)sumW * sumW);
+	
+	spectrum->size = size;
+	spectrum->sampleHz = sampleHz;
+	spectrum->binHz = (float)sampleHz / size;
+	spectrum->binScale = ldexpf(ampScale, shift);
+	memset(spectrum->bins, 0, sizeof(spectrum->bins));
+	memset(spectrum->bandEnergy, 0, sizeof(spectrum->bandEnergy));
+	
+	for (k = 0; k < m; k++) {
+		mag = FftRealBin(x, m, k);
+		spectrum->bins[k] = mag >> shift;
+		
+		// Mean square of the signal in the bin, corrected for the window noise bandwidth
+		a = mag * ampScale;
+		spectrum->bandEnergy[(uint32_t)k * H0BR4_FFT_BANDS / m] += a * a / 2 / enbw;
+	}
+	
+	FftFindPeaks(spectrum);
+}
+
+static bool FftParamsValid(uint8_t axis, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, uint8_t *odr)
+{
+	if (axis > 2 || window > MEMS_FFT_WINDOW_HANN || !FindOdr(fftOdrTable, TABLE_SIZE(fftOdrTable), sampleHz, odr))
+		return false;
+	
+	return (size >= FFT_MIN_SIZE && size <= H0BR4_FFT_MAX_SIZE && (size & (size - 1)) == 0);
+}
+
+/* Edge in Hz between bands i - 1 and i: the bands split the bins up to Nyquist evenly
+*/
+static float FftBandEdgeHz(const MemsSpectrum_t *spectrum, uint8_t i)
+{
+	return (float)spectrum->sampleHz / 2 * i / H0BR4_FFT_BANDS;
+}
+
+/* Send one spectrum record: the sample time in us, the record kind, then its payload
+*/
+static void SendSpectrumRecord(uint8_t port, uint8_t module, uint8_t kind, const uint8_t *payload, uint8_t len)
+{
+	uint8_t temp[FFT_RECORD_MAX_BYTES];
+	uint8_t *dst = PackUint32(temp, GetMemsSampleTime());
+	
+	*dst++ = kind;
+	memcpy(dst, payload, len);
+	len += MEMS_TIMESTAMP_BYTES + 1;
+	SendRecordToPort(port, module, temp, len);
+}
+
+/* Send a spectrum as records, all MSB first: its info, the bins, the peaks, then the bands
+*/
+static void SendSpectrumToPort(uint8_t port, uint8_t module, const MemsSpectrum_t *spectrum)
+{
+	uint8_t payload[FFT_RECORD_MAX_BYTES];
+	uint8_t *dst = NULL;
+	uint32_t bits = 0;
+	uint16_t k = 0, j = 0;
+	float lowHz = 0, highHz = 0;
+	uint8_t i = 0;
+	
+	dst = payload;
+	*dst++ = (uint8_t)(spectrum->size >> 8);
+	*dst++ = (uint8_t)spectrum->size;
+	*dst++ = (uint8_t)(spectrum->sampleHz >> 8);
+	*dst++ = (uint8_t)spectrum->sampleHz;
+	memcpy(&bits, &spectrum->binHz, sizeof(bits));
+	dst = PackUint32(dst, bits);
+	memcpy(&bits, &spectrum->binScale, sizeof(bits));
+	dst = PackUint32(dst, bits);
+	SendSpectrumRecord(port, module, H0BR4_FFT_RECORD_INFO, payload, dst - payload);
+	
+	for (k = 0; k < spectrum->size / 2; k += H0BR4_FFT_BINS_PER_RECORD) {
+		dst = payload;
+		*dst++ = (uint8_t)(k >> 8);
+		*dst++ = (uint8_t)k;
+		for (j = k; j < k + H0BR4_FFT_BINS_PER_RECORD && j < spectrum->size / 2; j++) {
+			*dst++ = (uint8_t)(spectrum->bins[j] >> 8);
+			*dst++ = (uint8_t)spectrum->bins[j];
+		}
+		SendSpectrumRecord(port, module, H0BR4_FFT_RECORD_BINS, payload, dst - payload);
+	}
+	
+	for (i = 0; i < H0BR4_FFT_PEAKS && spectrum->peaks[i].hz != 0; i++) {
+		dst = payload;
+		*dst++ = i;
+		memcpy(&bits, &spectrum->peaks[i].hz, sizeof(bits));
+		dst = PackUint32(dst, bits);
+		memcpy(&bits, &spectrum->peaks[i].amplitude, sizeof(bits));
+		dst = PackUint32(dst, bits);
+		SendSpectrumRecord(port, module, H0BR4_FFT_RECORD_PEAK, payload, dst - payload);
+	}
+	
+	for (i = 0; i < H0BR4_FFT_BANDS; i++) {
+		lowHz = FftBandEdgeHz(spectrum, i);
+		highHz = FftBandEdgeHz(spectrum, i + 1);
+		dst = payload;
+		*dst++ = i;
+		memcpy(&bits, &lowHz, sizeof(bits));
+		dst = PackUint32(dst, bits);
+		memcpy(&bits, &highHz, sizeof(bits));
+		dst = PackUint32(dst, bits);
+		memcpy(&bits, &spectrum->bandEnergy[i], sizeof(bits));
+		dst = PackUint32(dst, bits);
+		SendSpectrumRecord(port, module, H0BR4_FFT_RECORD_BAND, payload, dst - payload);
+	}
+}
+
+/* Parameters, capture time and port bandwidth of a spectrum stream. No side effect other than the 
+		highest sustainable rate: also the check of a job before it is queued
+*/
+static Module_Status SpectrumStreamCheck(uint8_t axis, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, uint32_t period, 
+																				 bool toCLI, uint8_t port, uint8_t module)
+{
+	uint32_t minUs = 0, outBytes = 0, records = 0;
+	uint8_t odr = 0;
+	
+	if (!FftParamsValid(axis, size, sampleHz, window, &odr))
+		return H0BR4_ERR_WrongParams;
+	if (!toCLI && port == 0)
+		return H0BR4_ERR_WrongParams;
+	if (!toCLI && port == PcPort) // Check if CLI is not enabled at that port!
+		return H0BR4_ERR_BUSY;
+	
+	// A capture lasts size samples, and the records of a spectrum must fit the port bandwidth
+	minUs = (uint32_t)(size + FFT_SETTLE_SAMPLES) * 1000000UL / sampleHz;
+	if (!toCLI) {
+		records = 1 + (size / 2 + H0BR4_FFT_BINS_PER_RECORD - 1) / H0BR4_FFT_BINS_PER_RECORD + H0BR4_FFT_PEAKS + H0BR4_FFT_BANDS;
+		outBytes = records * (FFT_RECORD_MAX_BYTES + ((module != myID) ? 1 + BOS_MSG_OVERHEAD : 0));
+		if (StreamMinPeriodUs(&accStreamInfo, port, outBytes) > minUs)
+			minUs = StreamMinPeriodUs(&accStreamInfo, port, outBytes);
+	}
+	return CheckStreamPeriod(period, minUs);
+}
+
+/* Capture and transform one spectrum every period: to the CLI as a summary of its peaks and bands 
+		when toCLI, else to port of module as records
+*/
+static Module_Status StreamAccSpectrum(uint8_t axis, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, uint32_t period, 
+																			 uint32_t timeout, bool toCLI, uint8_t port, uint8_t module)
+{
+	const char *const axes = "XYZ";
+	
+	Module_Status status = H0BR4_OK;
+	MemsSpectrum_t *spectrum = NULL;
+	TickType_t start = 0, lastWakeTime = 0;
+	int8_t *pcOutputString = NULL;
+	uint8_t i = 0;
+	
+	if ((status = SpectrumStreamCheck(axis, size, sampleHz, window, period, toCLI, port, module)) != H0BR4_OK)
+		return status;
+	
+	// The spectrum is only kept while the stream runs
+	if ((spectrum = MemsAlloc(sizeof(MemsSpectrum_t))) == NULL)
+		return H0BR4_ERR_BUSY;
+	
+	stopStream = false;
+	start = lastWakeTime = StreamTimingStart(StreamTimingOfTask(true));
+	
+	while (timeout >= MAX_MEMS_TIMEOUT_MS || (xTaskGetTickCount() - start) < pdMS_TO_TICKS(timeout)) {
+		if ((status = SampleAccSpectrum(axis, size, sampleHz, window, spectrum)) != H0BR4_OK)
+			break;
+		
+		if (!toCLI) {
+			SendSpectrumToPort(port, module, spectrum);
+			StreamDelayUntil(&lastWakeTime, period);
+			if (stopStream) {
+				status = H0BR4_ERR_TERMINATED;
+				break;
+			}
+			continue;
+		}
+		
+		pcOutputString = FreeRTOS_CLIGetOutputBuffer();
+		snprintf((char *)pcOutputString, configCOMMAND_INT_MAX_OUTPUT_SIZE, "Acc %c spectrum | %u points at %u Hz, %.2f Hz per bin\r\n", 
+						 axes[axis], spectrum->size, spectrum->sampleHz, spectrum->binHz);
+		PrependSampleTime((char *)pcOutputString, configCOMMAND_INT_MAX_OUTPUT_SIZE);
+		writePxMutex(PcPort, (char *)pcOutputString, strlen((char *)pcOutputString), cmd500ms, HAL_MAX_DELAY);
+		
+		for (i = 0; i < H0BR4_FFT_PEAKS && spectrum->peaks[i].hz != 0; i++) {
+			snprintf((char *)pcOutputString, configCOMMAND_INT_MAX_OUTPUT_SIZE, "  Peak %u: %.1f Hz, %.2f mg\r\n", 
+							 i + 1, spectrum->peaks[i].hz, spectrum->peaks[i].amplitude);
+			writePxMutex(PcPort, (char *)pcOutputString, strlen((char *)pcOutputString), cmd500ms, HAL_MAX_DELAY);
+		}
+		for (i = 0; i < H0BR4_FFT_BANDS; i++) {
+			snprintf((char *)pcOutputString, configCOMMAND_INT_MAX_OUTPUT_SIZE, "  Band %.0f-%.0f Hz: %.3f mg rms\r\n", 
+							 FftBandEdgeHz(spectrum, i), FftBandEdgeHz(spectrum, i + 1), sqrtf(spectrum->bandEnergy[i]));
+			writePxMutex(PcPort, (char *)pcOutputString, strlen((char *)pcOutputString), cmd500ms, HAL_MAX_DELAY);
+		}
+		
+		// The capture is part of the period
+		if ((status = PollingSleepUntilCLISafe(&lastWakeTime, period)) != H0BR4_OK)
+			break;
+	}
+	
+	if (toCLI) {
+		pcOutputString = FreeRTOS_CLIGetOutputBuffer();
+		memset((char *) pcOutputString, 0, configCOMMAND_INT_MAX_OUTPUT_SIZE);
+		sprintf((char *)pcOutputString, "\r\n");
+	}
+	vPortFree(spectrum);
+	return status;
+}
+#endif
+
+#if H0BR4_ENABLE_SLOTS
+/* Send one sample of a stream slot in its format, or store it in the ring of the slot. The ring is 
+		filled here, in the stream scheduler task: the reader only drains it
+*/
+static Module_Status SendSlotSample(const MemsStreamSlot_t *slot, const float *values)
+{
+	const MemsSensorSource_t *src = &sensorSources[slot->sensor];
+	char text[100];
+	q16_16_t q16[3];
+	uint32_t bits = 0;
+	uint8_t i = 0;
+	
+	if (slot->ring != NULL) {
+		MemsRingPush(slot->ring, GetMemsSampleTime(), values);
+		return H0BR4_OK;
+	}
+	
+	memcpy(&bits, values, sizeof(bits));
+	
+	if (slot->port == 0 || slot->format == MEMS_STREAM_FORMAT_TEXT) {
+		FormatSensorSample(src, values, text, sizeof(text));
+		PrependSampleTime(text, sizeof(text));
+		writePxMutex(slot->port ? slot->port : PcPort, text, strlen(text), cmd500ms, HAL_MAX_DELAY);
+		return H0BR4_OK;
+	}
+	
+	if (src->counter)
+		return SendWordsToPort(slot->port, slot->module, &bits, 1);
+	if (slot->format == MEMS_STREAM_FORMAT_FLOAT)
+		return SendWordsToPort(slot->port, slot->module, values, src->count);
+	
+	for (i = 0; i < src->count; i++)
+		q16[i] = (q16_16_t)(values[i] * src->q16Scale * 65536 + ((values[i] >= 0) ? 0.5f : -0.5f));
+	return SendWordsToPort(slot->port, slot->module, q16, src->count);
+}
+
+/* Give back the ODRs of a slot once it has ended, whoever ended it first
+*/
+static void ReleaseSlotOdr(MemsSlotState_t *s)
+{
+	uint8_t held = 0;
+	
+	taskENTER_CRITICAL();
+	if (!s->active && !s->reserved) {
+		held = s->odrHeld;
+		s->odrHeld = 0;
+	}
+	taskEXIT_CRITICAL();
+	
+	ReleaseOdr(held);
+}
+
+/* --- Stream scheduler task. Serves the stream slots in deadline order: each pass reads the sensor of 
+				every due slot once, whatever the number of slots due on it, then sends to each slot. Sleeps 
+				until the next deadline or a start request.
+*/
+static void StreamSlotTask(void *argument)
+{
+	MemsSlotState_t *s = NULL;
+	MemsStreamSlot_t config;
+	Module_Status status = H0BR4_OK;
+	Module_Status readStatus[TABLE_SIZE(sensorSources)];
+	float values[TABLE_SIZE(sensorSources)][4];
+	uint32_t times[TABLE_SIZE(sensorSources)];
+	uint16_t read = 0;
+	TickType_t now = 0, wait = 0, start = 0, next = 0;
+	bool active = false, due = false, pending = false;
+	uint8_t i = 0, request = 0;
+	
+	for (;;) {
+		// Start the requested slots: the run state is set up here, before the slot is seen as active
+		while (xQueueReceive(slotRequestQueue, &request, 0) == pdPASS) {
+			if (request >= H0BR4_STREAM_SLOTS)
+				continue;
+			s = &streamSlots[request];
+			
+			// Stale request of a slot stopped, or started and stopped again, since it was queued
+			taskENTER_CRITICAL();
+			pending = s->reserved;
+			taskEXIT_CRITICAL();
+			if (!pending)
+				continue;
+			
+			// Binary Q16 streams are never change-reported, as with the Q16 APIs. Rings take float records
+			MemsReportStart(&s->report, (s->config.sensor <= MEMS_STREAM_TEMP && (s->config.ring != NULL || 
+											s->config.format != MEMS_STREAM_FORMAT_Q16)) ? 
+											(MemsReportChannel_t)s->config.sensor : MEMS_REPORT_NONE);
+			
+			// Not if stopped meanwhile
+			taskENTER_CRITICAL();
+			if (s->reserved) {
+				s->status = H0BR4_OK;
+				s->start = s->next = StreamTimingStart(&streamTiming[request]);
+				s->reserved = false;
+				s->active = true;
+			}
+			taskEXIT_CRITICAL();
+		}
+		
+		now = xTaskGetTickCount();
+		wait = portMAX_DELAY;
+		read = 0;
+		
+		for (i = 0; i < H0BR4_STREAM_SLOTS; i++) {
+			s = &streamSlots[i];
+			
+			taskENTER_CRITICAL();
+			config = s->config;
+			start = s->start;
+			next = s->next;
+			// Timeouts count in ms from the start, so long ones cannot overflow the tick conversion
+			if (s->active && config.timeout < MAX_MEMS_TIMEOUT_MS && (now - start) * portTICK_PERIOD_MS >= config.timeout) {
+				s->active = false;
+				s->status = H0BR4_ERR_TERMINATED;
+			}
+			active = s->active;
+			taskEXIT_CRITICAL();
+			
+			if (!active) {
+				ReleaseSlotOdr(s);
+				continue;
+			}
+			if ((int32_t)(next - now) > 0) {
+				if (next - now < wait)
+					wait = next - now;
+				continue;
+			}
+			StreamTimingSample(&streamTiming[i], next);
+			
+			// One read per sensor and pass. Later slots send it with its own sample time
+			if (!(read & (1U << config.sensor))) {
+				readStatus[config.sensor] = sensorSources[config.sensor].sample(values[config.sensor]);
+				times[config.sensor] = GetMemsSampleTime();
+				read |= 1U << config.sensor;
+			} else {
+				SetSampleTime(times[config.sensor]);
+			}
+			
+			status = readStatus[config.sensor];
+			due = (s->report.source == NULL) || MemsReportDue(&s->report, values[config.sensor]);
+			if (status == H0BR4_OK && due)
+				status = SendSlotSample(&config, values[config.sensor]);
+			
+			// Fixed rate on absolute deadlines: a late pass skips the deadlines missed by a full period
+			StreamSkipMissed(&streamTiming[i], &next, pdMS_TO_TICKS(config.period));
+			next += pdMS_TO_TICKS(config.period);
+			
+			taskENTER_CRITICAL();
+			// No output yet from the acquisition task is not an error
+			if (s->active && status != H0BR4_OK && status != H0BR4_ERR_BUSY) {
+				s->active = false;
+				s->status = status;
+			}
+			if (s->active && s->start == start)
+				s->next = next;
+			taskEXIT_CRITICAL();
+			
+			// A late deadline is served on the next pass
+			now = xTaskGetTickCount();
+			if ((int32_t)(next - now) <= 0)
+				wait = 0;
+			else if (next - now < wait)
+				wait = next - now;
+		}
+		
+		// Wait for the next deadline or request. The request is received at the top
+		xQueuePeek(slotRequestQueue, &request, wait);
+	}
+}
+#endif
+
+/* --- Stream job task. Runs the statistics and spectrum streams and the magnetometer calibration 
+				handed off by the messaging and CLI tasks, one at a time, until they end or are stopped.
+*/
+static void StreamJobTask(void *argument)
+{
+	MemsStreamJob_t job;
+	
+	for (;;) {
+		if (xQueueReceive(streamJobQueue, &job, portMAX_DELAY) != pdPASS)
+			continue;
+		
+#if H0BR4_ENABLE_STATS
+		if (job.kind == MEMS_JOB_STATS)
+			StreamMemsStats((MemsFilterChannel_t)job.channel, job.samples, job.period, job.timeout, false, job.port, job.module);
+		else
+#endif
+#if H0BR4_ENABLE_FFT
+		if (job.kind == MEMS_JOB_SPECTRUM)
+			StreamAccSpectrum(job.channel, job.samples, job.sampleHz, job.window, job.period, job.timeout, false, job.port, job.module);
+		else
+#endif
+			magCalStatus = CalibrateMag(job.period);
+		
+		streamJobActive = false;
+	}
+}
+
+/* Streams requested by message run in a stream slot, so the messaging task keeps serving its port. 
+		Without stream slots they run in the calling task until they end, as the StreamXToPort APIs
+*/
+static Module_Status StartMessageStream(MemsStreamSensor_t sensor, uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+#if H0BR4_ENABLE_SLOTS
+	MemsStreamSlot_t slot = { sensor, MEMS_STREAM_FORMAT_FLOAT, port, module, period, timeout };
+	
+	return StartMemsStreamSlot(&slot, NULL);
+#else
+	switch (sensor)
+	{
+		case MEMS_STREAM_GYRO: return StreamGyroDPSToPort(port, module, period, timeout);
+		case MEMS_STREAM_ACC: return StreamAccGToPort(port, module, period, timeout);
+		case MEMS_STREAM_MAG: return StreamMagMGaussToPort(port, module, period, timeout);
+		case MEMS_STREAM_TEMP: return StreamTempCToPort(port, module, period, timeout);
+		case MEMS_STREAM_QUAT: return StreamQuaternionToPort(port, module, period, timeout);
+		case MEMS_STREAM_EULER: return StreamEulerToPort(port, module, period, timeout);
+		case MEMS_STREAM_HEADING: return StreamHeadingToPort(port, module, period, timeout);
+		case MEMS_STREAM_STEPS: return StreamStepCountToPort(port, module, period, timeout);
+		default: return H0BR4_ERR_WrongParams;
+	}
+#endif
+}
+
+/* Hand a statistics or spectrum stream or a magnetometer calibration to the stream job task. Parameters 
+		and bandwidth are checked here, before it is queued. H0BR4_ERR_BUSY while a job runs.
+*/
+static Module_Status StartStreamJob(const MemsStreamJob_t *job)
+{
+	Module_Status status = H0BR4_OK, lastMagCal = magCalStatus;
+#if H0BR4_ENABLE_STATS
+	uint32_t sampleMs = 0;
+#endif
+	bool busy = false;
+	
+#if H0BR4_ENABLE_STATS
+	if (job->kind == MEMS_JOB_STATS)
+		status = StatsStreamCheck((MemsFilterChannel_t)job->channel, job->samples, job->period, false, job->port, job->module, &sampleMs);
+	else
+#endif
+#if H0BR4_ENABLE_FFT
+	if (job->kind == MEMS_JOB_SPECTRUM)
+		status = SpectrumStreamCheck(job->channel, job->samples, job->sampleHz, job->window, job->period, false, job->port, job->module);
+	else
+#endif
+	if (job->kind != MEMS_JOB_MAG_CAL || job->period / MAG_CAL_SAMPLE_PERIOD_MS < MAG_CAL_MIN_SAMPLES)
+		status = H0BR4_ERR_WrongParams;
+	if (status != H0BR4_OK)
+		return status;
+	
+	taskENTER_CRITICAL();
+	busy = streamJobActive;
+	streamJobActive = true;
+	taskEXIT_CRITICAL();
+	if (busy)
+		return H0BR4_ERR_BUSY;
+	
+	// Collecting from here, so the magcal command never shows the previous result meanwhile
+	if (job->kind == MEMS_JOB_MAG_CAL)
+		magCalStatus = H0BR4_ERR_BUSY;
+	
+	// The queue is empty while no job is active
+	if (xQueueSend(streamJobQueue, job, 0) != pdPASS) {
+		magCalStatus = lastMagCal;
+		streamJobActive = false;
+		return H0BR4_ERR_BUSY;
+	}
+	return H0BR4_OK;
+}
+
+
+
+/* -----------------------------------------------------------------------
+	|																APIs	 																 	|
+   ----------------------------------------------------------------------- 
+*/
+
+Module_Status SampleGyroMDPS(int *gyroX, int *gyroY, int *gyroZ)
+{
+	return LSM6DS3SampleGyroMDPS(gyroX, gyroY, gyroZ);
+}
+
+Module_Status SampleGyroRaw(int16_t *gyroX, int16_t *gyroY, int16_t *gyroZ)
+{
+	return LSM6DS3SampleGyroRaw(gyroX, gyroY, gyroZ);
+}
+
+
+Module_Status SampleGyroDPSToPort(uint8_t port, uint8_t module)
+{
+	float buffer[3]; // Three Samples X, Y, Z
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = SampleGyroDPSToBuf(buffer)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, buffer, 3);
+}
+
+Module_Status SampleGyroDPSToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_GYRO, cstring, maxLen);
+}
+
+Module_Status SampleGyroDPS(float *x, float *y, float *z)
+{
+	Module_Status status = H0BR4_OK;
+	int xInMDPS = 0, yInMDPS = 0, zInMDPS = 0;
+	
+	if ((status = LSM6DS3SampleGyroMDPS(&xInMDPS, &yInMDPS, &zInMDPS)) != H0BR4_OK)
+		return status;
+	
+	*x = ((float)xInMDPS) / 1000;
+	*y = ((float)yInMDPS) / 1000;
+	*z = ((float)zInMDPS) / 1000;
+	
+	return status;
+}
+
+Module_Status SampleGyroDPSToBuf(float *buffer)
+{
+	return SampleGyroDPS(buffer, buffer + 1, buffer + 2);
+}
+
+/* --- The Acc APIs read the accelerometer selected by SetAccChannel. Raw samples are in LSB of 
+				its current mode and full scale.
+*/
+Module_Status SampleAccMG(int *accX, int *accY, int *accZ)
+{
+	Module_Status status = H0BR4_OK;
+	int16_t raw[3];
+	float sensitivity = 0;
+	int32_t scaleQ24 = 0;
+	
+	if ((status = SampleAccChannelRaw(raw, &sensitivity, &scaleQ24)) != H0BR4_OK)
+		return status;
+	
+	*accX = raw[0] * sensitivity;
+	*accY = raw[1] * sensitivity;
+	*accZ = raw[2] * sensitivity;
+	
+	return status;
+}
+
+Module_Status SampleAccRaw(int16_t *accX, int16_t *accY, int16_t *accZ)
+{
+	Module_Status status = H0BR4_OK;
+	int16_t raw[3];
+	float sensitivity = 0;
+	int32_t scaleQ24 = 0;
+	
+	if ((status = SampleAccChannelRaw(raw, &sensitivity, &scaleQ24)) != H0BR4_OK)
+		return status;
+	
+	*accX = raw[0];
+	*accY = raw[1];
+	*accZ = raw[2];
+	
+	return status;
+}
+
+Module_Status SampleAccGToPort(uint8_t port, uint8_t module)
+{
+	float buffer[3]; // Three Samples X, Y, Z
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = SampleAccGToBuf(buffer)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, buffer, 3);
+}
+
+Module_Status SampleAccGToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_ACC, cstring, maxLen);
+}
+
+Module_Status SampleAccG(float *x, float *y, float *z)
+{
+	Module_Status status = H0BR4_OK;
+	int xInMG = 0, yInMG = 0, zInMG = 0;
+	
+	if ((status = SampleAccMG(&xInMG, &yInMG, &zInMG)) != H0BR4_OK)
+		return status;
+	
+	*x = ((float)xInMG) / 1000;
+	*y = ((float)yInMG) / 1000;
+	*z = ((float)zInMG) / 1000;
+	
+	return status;
+}
+
+Module_Status SampleAccGToBuf(float *buffer)
+{
+	return SampleAccG(buffer, buffer + 1, buffer + 2);
+}
+
+Module_Status SampleMagMGauss(int *magX, int *magY, int *magZ)
+{
+	return LSM303SampleMagMGauss(magX, magY, magZ);
+}
+
+Module_Status SampleMagRaw(int16_t *magX, int16_t *magY, int16_t *magZ)
+{
+	return LSM303SampleMagRaw(magX, magY, magZ);
+}
+
+Module_Status SampleMagMGaussToPort(uint8_t port, uint8_t module)
+{
+	float buffer[3]; // Three Samples X, Y, Z
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = SampleMagMGaussToBuf(buffer)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, buffer, 3);
+}
+
+Module_Status SampleMagMGaussToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_MAG, cstring, maxLen);
+}
+
+Module_Status SampleMagMGaussToBuf(float *buffer)
+{
+	int iMagMGauss[3];
+	Module_Status status = LSM303SampleMagMGauss(iMagMGauss, iMagMGauss + 1, iMagMGauss + 2);
+	
+	buffer[0] = iMagMGauss[0];
+	buffer[1] = iMagMGauss[1];
+	buffer[2] = iMagMGauss[2];
+	
+	return status;
+}
+
+Module_Status SampleTempCelsius(float *temp)
+{
+	return LSM6DS3SampleTempCelsius(temp);
+}
+
+Module_Status SampleTempFahrenheit(float *temp)
+{
+	return LSM6DS3SampleTempFahrenheit(temp);
+}
+
+Module_Status SampleTempCToPort(uint8_t port, uint8_t module)
+{
+	float temp;
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = LSM6DS3SampleTempCelsius(&temp)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, &temp, 1);
+}
+
+Module_Status SampleTempCToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_TEMP, cstring, maxLen);
+}
+
+Module_Status SampleImuRaw(ImuRawSample_t *sample)
+{
+	if (sample == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	return LSM6DS3SampleImuDuty(sample, MEMS_SENSOR_GYRO | MEMS_SENSOR_ACC);
+}
+
+Module_Status SampleImu(ImuSample_t *sample)
+{
+	Module_Status status = H0BR4_OK;
+	ImuRawSample_t raw;
+	uint8_t i = 0;
+	
+	if (sample == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	if ((status = LSM6DS3SampleImuDuty(&raw, MEMS_SENSOR_GYRO | MEMS_SENSOR_ACC)) != H0BR4_OK)
+		return status;
+	
+	LSM6DS3RemoveGyroBias(raw.gyro);
+	for (i = 0; i < 3; i++) {
+		sample->gyro[i] = (raw.gyro[i] * gyroSensitivity) / 1000;
+		sample->acc[i] = (raw.acc[i] * accSensitivity) / 1000;
+	}
+	sample->temp = (((float)raw.temp)/16) + 25;
+	sample->timestamp = raw.timestamp;
+	
+	return status;
+}
+
+Module_Status SampleImuToString(char *cstring, size_t maxLen)
+{
+	Module_Status status = H0BR4_OK;
+	ImuSample_t sample;
+	
+	if ((status = SampleImu(&sample)) != H0BR4_OK)
+		return status;
+	
+	snprintf(cstring, maxLen, "Gyro(DPS) | X: %.2f, Y: %.2f, Z: %.2f\r\nAcc(G) | X: %.2f, Y: %.2f, Z: %.2f\r\nTemp(Celsius) | %0.2f\r\n", 
+					 sample.gyro[0], sample.gyro[1], sample.gyro[2], sample.acc[0], sample.acc[1], sample.acc[2], sample.temp);
+	return status;
+}
+
+Module_Status SampleGyroDPSQ16(q16_16_t *x, q16_16_t *y, q16_16_t *z)
+{
+	Module_Status status = H0BR4_OK;
+	int16_t raw[3];
+	
+	if ((status = LSM6DS3SampleGyroCal(&raw[0], &raw[1], &raw[2])) != H0BR4_OK)
+		return status;
+	
+	*x = RawToQ16(raw[0], gyroScaleQ24);
+	*y = RawToQ16(raw[1], gyroScaleQ24);
+	*z = RawToQ16(raw[2], gyroScaleQ24);
+	
+	return status;
+}
+
+Module_Status SampleAccGQ16(q16_16_t *x, q16_16_t *y, q16_16_t *z)
+{
+	Module_Status status = H0BR4_OK;
+	int16_t raw[3];
+	float sensitivity = 0;
+	int32_t scaleQ24 = 0;
+	
+	if ((status = SampleAccChannelRaw(raw, &sensitivity, &scaleQ24)) != H0BR4_OK)
+		return status;
+	
+	*x = RawToQ16(raw[0], scaleQ24);
+	*y = RawToQ16(raw[1], scaleQ24);
+	*z = RawToQ16(raw[2], scaleQ24);
+	
+	return status;
+}
+
+Module_Status SampleMagGaussQ16(q16_16_t *x, q16_16_t *y, q16_16_t *z)
+{
+	Module_Status status = H0BR4_OK;
+	int16_t raw[3];
+	
+	if ((status = LSM303SampleMagCal(&raw[0], &raw[1], &raw[2])) != H0BR4_OK)
+		return status;
+	
+	*x = RawToQ16(raw[0], LSM303AGR_MAG_SCALE_Q24);
+	*y = RawToQ16(raw[1], LSM303AGR_MAG_SCALE_Q24);
+	*z = RawToQ16(raw[2], LSM303AGR_MAG_SCALE_Q24);
+	
+	return status;
+}
+
+Module_Status SampleTempCQ16(q16_16_t *temp)
+{
+	Module_Status status = H0BR4_OK;
+	ImuRawSample_t sample;
+	
+	if ((status = LSM6DS3SampleImuDuty(&sample, MEMS_SENSOR_ACC)) != H0BR4_OK)
+		return status;
+	
+	*temp = RawTempToQ16(sample.temp);
+	
+	return status;
+}
+
+Module_Status SampleGyroDPSQ16ToPort(uint8_t port, uint8_t module)
+{
+	return SampleAxesQ16ToPort(port, module, SampleGyroDPSQ16);
+}
+
+Module_Status SampleAccGQ16ToPort(uint8_t port, uint8_t module)
+{
+	return SampleAxesQ16ToPort(port, module, SampleAccGQ16);
+}
+
+Module_Status SampleMagGaussQ16ToPort(uint8_t port, uint8_t module)
+{
+	return SampleAxesQ16ToPort(port, module, SampleMagGaussQ16);
+}
+
+Module_Status SampleTempCQ16ToPort(uint8_t port, uint8_t module)
+{
+	Module_Status status = H0BR4_OK;
+	q16_16_t temp = 0;
+	
+	if ((status = SampleTempCQ16(&temp)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, &temp, 1);
+}
+
+Module_Status SampleQuaternion(float *w, float *x, float *y, float *z)
+{
+	Module_Status status = H0BR4_OK;
+	float q[4];
+	
+	if ((status = ReadFusionQuaternion(q)) != H0BR4_OK)
+		return status;
+	
+	*w = q[0];
+	*x = q[1];
+	*y = q[2];
+	*z = q[3];
+	
+	return status;
+}
+
+Module_Status SampleQuaternionToBuf(float *buffer)
+{
+	return ReadFusionQuaternion(buffer);
+}
+
+Module_Status SampleQuaternionToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_QUAT, cstring, maxLen);
+}
+
+Module_Status SampleQuaternionToPort(uint8_t port, uint8_t module)
+{
+	Module_Status status = H0BR4_OK;
+	float q[4];
+	
+	if ((status = ReadFusionQuaternion(q)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, q, 4);
+}
+
+/* --- Fused orientation as roll, pitch and yaw in degrees (aerospace sequence). Trigonometry is 
+				only evaluated here, outside the filter loop.
+*/
+Module_Status SampleEuler(float *roll, float *pitch, float *yaw)
+{
+	Module_Status status = H0BR4_OK;
+	float q[4], sinPitch = 0;
+	
+	if ((status = ReadFusionQuaternion(q)) != H0BR4_OK)
+		return status;
+	
+	sinPitch = 2 * (q[0]*q[2] - q[1]*q[3]);
+	if (sinPitch > 1)
+		sinPitch = 1;
+	else if (sinPitch < -1)
+		sinPitch = -1;
+	
+	*roll = atan2f(2 * (q[0]*q[1] + q[2]*q[3]), 1 - 2 * (q[1]*q[1] + q[2]*q[2])) * 57.29578f;
+	*pitch = asinf(sinPitch) * 57.29578f;
+	*yaw = atan2f(2 * (q[0]*q[3] + q[1]*q[2]), 1 - 2 * (q[2]*q[2] + q[3]*q[3])) * 57.29578f;
+	
+	return status;
+}
+
+Module_Status SampleEulerToBuf(float *buffer)
+{
+	return SampleEuler(buffer, buffer + 1, buffer + 2);
+}
+
+Module_Status SampleEulerToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_EULER, cstring, maxLen);
+}
+
+Module_Status SampleEulerToPort(uint8_t port, uint8_t module)
+{
+	Module_Status status = H0BR4_OK;
+	float angles[3];
+	
+	if ((status = SampleEulerToBuf(angles)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, angles, 3);
+}
+
+/* --- Tilt-compensated compass heading in Q16.16 degrees, [0, 360), clockwise from true north 
+				(magnetic heading plus the declination). Fixed-point only.
+*/
+Module_Status SampleHeadingQ16(q16_16_t *heading)
+{
+	Module_Status status = H0BR4_OK;
+	int16_t acc[3], mag[3];
+	q16_16_t angle = 0;
+	
+	if ((status = LSM6DS3SampleAccRaw(&acc[0], &acc[1], &acc[2])) != H0BR4_OK)
+		return status;
+	if ((status = LSM303SampleMagCal(&mag[0], &mag[1], &mag[2])) != H0BR4_OK)
+		return status;
+	
+	if (!ComputeHeadingQ16(acc, mag, &angle))
+		return H0BR4_ERR_MAG;
+	
+	// Declination in tenths of a degree to Q16.16, wrapped into [0, 360)
+	angle += ((q16_16_t)magDeclination << 16) / 10;
+	if (angle < 0)
+		angle += 360L << 16;
+	else if (angle >= (360L << 16))
+		angle -= 360L << 16;
+	
+	*heading = angle;
+	return status;
+}
+
+Module_Status SampleHeading(float *heading)
+{
+	Module_Status status = H0BR4_OK;
+	q16_16_t angle = 0;
+	
+	if ((status = SampleHeadingQ16(&angle)) != H0BR4_OK)
+		return status;
+	
+	*heading = (float)angle / Q16_16_ONE;
+	return status;
+}
+
+Module_Status SampleHeadingToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_HEADING, cstring, maxLen);
+}
+
+Module_Status SampleHeadingToPort(uint8_t port, uint8_t module)
+{
+	Module_Status status = H0BR4_OK;
+	float heading = 0;
+	
+	if ((status = SampleHeading(&heading)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, &heading, 1);
+}
+
+/* --- Steps counted by the LSM6DS3 pedometer since the last reset. The 16-bit hardware counter is 
+				extended in software, so it must be read at least once every 65535 steps. Updates the steps 
+				module param. H0BR4_ERR_BUSY when the pedometer is off.
+*/
+Module_Status SampleStepCount(uint32_t *steps)
+{
+	uint8_t data[2];
+	uint16_t counter = 0;
+	
+	if (!pedoEnabled)
+		return H0BR4_ERR_BUSY;
+	
+	if (LSM6DS3_ACC_GYRO_ReadReg(&hi2c2, LSM6DS3_STEP_COUNTER_REG, data, 2) != MEMS_SUCCESS)
+		return H0BR4_ERR_LSM6DS3;
+	
+	counter = concatBytes(data[1], data[0]);
+	SetSampleTime(MemsTickToTimeUs(HAL_GetTick()));
+	
+	taskENTER_CRITICAL();
+	stepCount += (uint16_t)(counter - lastStepCounter);
+	lastStepCounter = counter;
+	*steps = stepCount;
+	taskEXIT_CRITICAL();
+	
+	H0BR4_steps = *steps;
+	return H0BR4_OK;
+}
+
+Module_Status SampleStepCountToString(char *cstring, size_t maxLen)
+{
+	return SampleSensorToString(MEMS_STREAM_STEPS, cstring, maxLen);
+}
+
+Module_Status SampleStepCountToPort(uint8_t port, uint8_t module)
+{
+	Module_Status status = H0BR4_OK;
+	uint32_t steps = 0;
+	
+	if ((status = SampleStepCount(&steps)) != H0BR4_OK)
+		return status;
+	
+	return SendWordsToPort(port, module, &steps, 1);
+}
+
+#if H0BR4_ENABLE_CONVBENCH
+/* --- Measure the CPU cycles of one 3-axis gyro conversion from raw LSB to DPS through the float 
+				path (SampleGyroDPS) and the Q16.16 path (SampleGyroDPSQ16). Uses SysTick, which counts 
+				core clock cycles, with interrupts masked.
+*/
+Module_Status BenchmarkMemsConversion(uint32_t *floatCycles, uint32_t *fixedCycles)
+{
+	static volatile int16_t raw[3] = { 12345, -321, 4567 };
+	volatile float resultF = 0;
+	volatile q16_16_t resultQ = 0;
+	uint32_t reload = (SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1;
+	uint32_t start = 0, end = 0;
+	uint8_t i = 0, axis = 0;
+	
+	if (floatCycles == NULL || fixedCycles == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	taskENTER_CRITICAL();
+	
+	// SysTick counts down: elapsed = start - end modulo the reload value
+	start = SysTick->VAL;
+	for (i = 0; i < CONV_BENCH_SAMPLES; i++) {
+		for (axis = 0; axis < 3; axis++) {
+			int mdps = raw[axis] * gyroSensitivity;
+			resultF = ((float)mdps) / 1000;
+		}
+	}
+	end = SysTick->VAL;
+	*floatCycles = ((start + reload - end) % reload) / CONV_BENCH_SAMPLES;
+	
+	start = SysTick->VAL;
+	for (i = 0; i < CONV_BENCH_SAMPLES; i++) {
+		for (axis = 0; axis < 3; axis++)
+			resultQ = RawToQ16(raw[axis], gyroScaleQ24);
+	}
+	end = SysTick->VAL;
+	*fixedCycles = ((start + reload - end) % reload) / CONV_BENCH_SAMPLES;
+	
+	taskEXIT_CRITICAL();
+	
+	(void)resultF;
+	(void)resultQ;
+	return H0BR4_OK;
+}
+#endif
+
+/* Stream requests raise the sensor ODR when it is too slow for the requested period, until they end */
+/* Filtered channels run the sensor decimation times faster than the stream */
+#define MATCH_GYRO_ODR(period, held)		MatchOdrToPeriod(MEMS_ODR_GYRO, MemsFilterPeriod(MEMS_FILTER_GYRO, period), held)
+#define MATCH_ACC_ODR(period, held)			MatchOdrToPeriod(MEMS_ODR_ACC, MemsFilterPeriod(MEMS_FILTER_ACC, period), held)
+#define MATCH_ACC2_ODR(period, held)		MatchOdrToPeriod(MEMS_ODR_ACC2, period, held)
+
+/* Acc streams follow the selected accelerometer channel */
+static Module_Status MatchAccChannelOdr(uint32_t period, uint8_t *held)
+{
+	return (accChannel == MEMS_ACC_LSM303AGR) ? MATCH_ACC2_ODR(period, held) : MATCH_ACC_ODR(period, held);
+}
+
+static const MemsStreamInfo_t *AccChannelStreamInfo(void)
+{
+	return (accChannel == MEMS_ACC_LSM303AGR) ? &acc2StreamInfo : &accStreamInfo;
+}
+#define MATCH_MAG_ODR(period, held)			MatchOdrToPeriod(MEMS_ODR_MAG, MemsFilterPeriod(MEMS_FILTER_MAG, period), held)
+
+Module_Status StreamGyroDPSToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_GYRO_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToPort(port, module, period, timeout, SampleGyroDPSToPort, &gyroStreamInfo, MEMS_REPORT_GYRO);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamGyroDPSToCLI(uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_GYRO_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToCLI(period, timeout, SampleGyroDPSToString, &gyroStreamInfo, MEMS_REPORT_GYRO);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamGyroDPSToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_GYRO_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToBuf(buffer, NULL, 3, period, timeout, SampleGyroDPSToBuf, &gyroStreamInfo, MEMS_REPORT_GYRO);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamGyroDPSToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_GYRO_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToBuf(NULL, ring, 3, period, timeout, SampleGyroDPSToBuf, &gyroStreamInfo, MEMS_REPORT_GYRO);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamAccGToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MatchAccChannelOdr(period, &held)) == H0BR4_OK)
+		status = StreamMemsToPort(port, module, period, timeout, SampleAccGToPort, AccChannelStreamInfo(), MEMS_REPORT_ACC);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamAccGToCLI(uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MatchAccChannelOdr(period, &held)) == H0BR4_OK)
+		status = StreamMemsToCLI(period, timeout, SampleAccGToString, AccChannelStreamInfo(), MEMS_REPORT_ACC);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamAccGToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MatchAccChannelOdr(period, &held)) == H0BR4_OK)
+		status = StreamMemsToBuf(buffer, NULL, 3, period, timeout, SampleAccGToBuf, AccChannelStreamInfo(), MEMS_REPORT_ACC);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamAccGToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MatchAccChannelOdr(period, &held)) == H0BR4_OK)
+		status = StreamMemsToBuf(NULL, ring, 3, period, timeout, SampleAccGToBuf, AccChannelStreamInfo(), MEMS_REPORT_ACC);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamMagMGaussToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_MAG_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToPort(port, module, period, timeout, SampleMagMGaussToPort, &magStreamInfo, MEMS_REPORT_MAG);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamMagMGaussToCLI(uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_MAG_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToCLI(period, timeout, SampleMagMGaussToString, &magStreamInfo, MEMS_REPORT_MAG);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamMagMGaussToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_MAG_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToBuf(buffer, NULL, 3, period, timeout, SampleMagMGaussToBuf, &magStreamInfo, MEMS_REPORT_MAG);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamMagMGaussToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_MAG_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToBuf(NULL, ring, 3, period, timeout, SampleMagMGaussToBuf, &magStreamInfo, MEMS_REPORT_MAG);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamTempCToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	return StreamMemsToPort(port, module, period, timeout, SampleTempCToPort, &tempStreamInfo, MEMS_REPORT_TEMP);
+}
+
+Module_Status StreamTempCToCLI(uint32_t period, uint32_t timeout)
+{
+	return StreamMemsToCLI(period, timeout, SampleTempCToString, &tempStreamInfo, MEMS_REPORT_TEMP);
+}
+
+Module_Status StreamGyroDPSQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_GYRO_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToPort(port, module, period, timeout, SampleGyroDPSQ16ToPort, &gyroStreamInfo, MEMS_REPORT_NONE);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamAccGQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MatchAccChannelOdr(period, &held)) == H0BR4_OK)
+		status = StreamMemsToPort(port, module, period, timeout, SampleAccGQ16ToPort, AccChannelStreamInfo(), MEMS_REPORT_NONE);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamMagGaussQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_MAG_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToPort(port, module, period, timeout, SampleMagGaussQ16ToPort, &magStreamInfo, MEMS_REPORT_NONE);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamTempCQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	return StreamMemsToPort(port, module, period, timeout, SampleTempCQ16ToPort, &tempStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamTempCToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+{
+	return StreamMemsToBuf(buffer, NULL, 1, period, timeout, SampleTempCelsius, &tempStreamInfo, MEMS_REPORT_TEMP);
+}
+
+Module_Status StreamTempCToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout)
+{
+	return StreamMemsToBuf(NULL, ring, 1, period, timeout, SampleTempCelsius, &tempStreamInfo, MEMS_REPORT_TEMP);
+}
+
+Module_Status StreamHeadingToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_ACC_ODR(period, &held)) == H0BR4_OK && (status = MATCH_MAG_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToPort(port, module, period, timeout, SampleHeadingToPort, &headingStreamInfo, MEMS_REPORT_NONE);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamHeadingToCLI(uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t held = 0;
+	
+	if ((status = MATCH_ACC_ODR(period, &held)) == H0BR4_OK && (status = MATCH_MAG_ODR(period, &held)) == H0BR4_OK)
+		status = StreamMemsToCLI(period, timeout, SampleHeadingToString, &headingStreamInfo, MEMS_REPORT_NONE);
+	ReleaseOdr(held);
+	return status;
+}
+
+Module_Status StreamStepCountToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	return StreamMemsToPort(port, module, period, timeout, SampleStepCountToPort, &stepsStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamStepCountToCLI(uint32_t period, uint32_t timeout)
+{
+	return StreamMemsToCLI(period, timeout, SampleStepCountToString, &stepsStreamInfo, MEMS_REPORT_NONE);
+}
+
+#if H0BR4_ENABLE_STATS
+/* --- Window statistics of the gyro, acc or mag channel (as in SetMemsFilter): the channel is sampled 
+				at its output rate and min, max, mean, RMS, variance and peak-to-peak of each axis are sent 
+				every windowSamples samples or windowMs, whichever comes first (0 disables either). In fifo 
+				acquisition only the latest sample of each FIFO batch is seen.
+*/
+Module_Status StreamMemsStatsToPort(MemsFilterChannel_t channel, uint8_t port, uint8_t module, uint16_t windowSamples, 
+																		uint32_t windowMs, uint32_t timeout)
+{
+	return StreamMemsStats(channel, windowSamples, windowMs, timeout, false, port, module);
+}
+
+Module_Status StreamMemsStatsToCLI(MemsFilterChannel_t channel, uint16_t windowSamples, uint32_t windowMs, uint32_t timeout)
+{
+	return StreamMemsStats(channel, windowSamples, windowMs, timeout, true, 0, 0);
+}
+#endif
+
+#if H0BR4_ENABLE_FFT
+/* --- Vibration spectrum of one LSM6DS3 accelerometer axis (0: X, 1: Y, 2: Z). size samples, a power 
+				of 2 from 64 to H0BR4_FFT_MAX_SIZE, are captured in the FIFO at sampleHz (416, 833, 1660, 3330 
+				or 6660) and transformed on the module by a fixed-point FFT after a rectangular or Hann window. 
+				Bins hold the amplitude up to Nyquist, peaks the strongest lines and bandEnergy the mean square 
+				of H0BR4_FFT_BANDS equal bands. The capture holds the sensors: interrupt-driven acquisition and 
+				the other LSM6DS3 readers wait until it ends. Its buffer, 2 bytes per sample, is taken from the 
+				FreeRTOS heap for the call only: H0BR4_ERR_BUSY when the heap cannot spare it.
+*/
+Module_Status SampleAccSpectrum(uint8_t axis, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, MemsSpectrum_t *spectrum)
+{
+	Module_Status status = H0BR4_OK;
+	int16_t *samples = NULL;
+	uint8_t odr = 0;
+	
+	if (spectrum == NULL || !FftParamsValid(axis, size, sampleHz, window, &odr))
+		return H0BR4_ERR_WrongParams;
+	
+	// Captured samples, then their FFT in place
+	if ((samples = MemsAlloc(size * sizeof(int16_t))) == NULL)
+		return H0BR4_ERR_BUSY;
+	
+	if ((status = LSM6DS3CaptureAcc(axis, size, odr, samples)) == H0BR4_OK)
+		FftAccSpectrum(samples, size, sampleHz, window, spectrum);
+	
+	vPortFree(samples);
+	return status;
+}
+
+/* --- Stream a spectrum every period (at least the capture time). Each one is sent as records, all MSB 
+				first after the sample time in us and the record kind: H0BR4_FFT_RECORD_INFO, then the bins 
+				H0BR4_FFT_BINS_PER_RECORD at a time, the peaks and the bands.
+*/
+Module_Status StreamAccSpectrumToPort(uint8_t port, uint8_t module, uint8_t axis, uint16_t size, uint16_t sampleHz, 
+																			MemsFftWindow_t window, uint32_t period, uint32_t timeout)
+{
+	return StreamAccSpectrum(axis, size, sampleHz, window, period, timeout, false, port, module);
+}
+
+Module_Status StreamAccSpectrumToCLI(uint8_t axis, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, uint32_t period, 
+																		 uint32_t timeout)
+{
+	return StreamAccSpectrum(axis, size, sampleHz, window, period, timeout, true, 0, 0);
+}
+#endif
+
+/* --- Magnetometer hard and soft-iron calibration. Collects samples for durationMs while the module 
+				is rotated in all directions, fits an ellipsoid and stores the result in EEPROM. The previous 
+				calibration is kept if the fit fails (H0BR4_ERR_MAG): rotate over more directions and retry. 
+				Blocks the caller for durationMs: the magcal command and CODE_H0BR4_CALIBRATE_MAG run it on 
+				the stream job task instead.
+*/
+Module_Status CalibrateMag(uint32_t durationMs)
+{
+	Module_Status status = H0BR4_OK;
+	MagCalState_t state;
+	MagCalibration_t cal;
+	int16_t raw[3];
+	long numTimes = durationMs / MAG_CAL_SAMPLE_PERIOD_MS;
+	TickType_t lastWakeTime;
+	uint8_t held = 0;
+	
+	if (numTimes < MAG_CAL_MIN_SAMPLES)
+		return H0BR4_ERR_WrongParams;
+	
+	if ((status = MATCH_MAG_ODR(MAG_CAL_SAMPLE_PERIOD_MS, &held)) != H0BR4_OK)
+		return status;
+	
+	memset(&state, 0, sizeof(state));
+	stopStream = false;
+	lastWakeTime = xTaskGetTickCount();
+	
+	while (numTimes-- > 0) {
+		// Uncalibrated samples
+		if (LSM303SampleMagUnfiltered(&raw[0], &raw[1], &raw[2]) == H0BR4_OK)
+			MagCalAccumulate(&state, raw);
+		
+		vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(MAG_CAL_SAMPLE_PERIOD_MS));
+		if (stopStream) {
+			status = H0BR4_ERR_TERMINATED;
+			break;
+		}
+	}
+	ReleaseOdr(held);
+	
+	if (status == H0BR4_OK && (status = MagCalFit(&state, &cal)) == H0BR4_OK)
+		status = SetMagCalibration(&cal);
+	return status;
+}
+
+/* --- Apply and store a magnetometer calibration: hard-iron offset in LSB and symmetric soft-iron 
+				matrix in Q2.14.
+*/
+Module_Status SetMagCalibration(const MagCalibration_t *cal)
+{
+	uint8_t i = 0;
+	
+	if (cal == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	taskENTER_CRITICAL();
+	magCal = *cal;
+	magCalValid = true;
+	taskEXIT_CRITICAL();
+	
+	// Values first, then the marker: a reset in between leaves the module uncalibrated
+	for (i = 0; i < 3; i++) {
+		if (EE_WriteVariable(_EE_MEMS_MAG_CAL_OFFSET + i, (uint16_t)cal->offset[i]) != 0)
+			return H0BR4_ERR_IO;
+	}
+	for (i = 0; i < 6; i++) {
+		if (EE_WriteVariable(_EE_MEMS_MAG_CAL_SOFT_IRON + i, (uint16_t)cal->softIron[i]) != 0)
+			return H0BR4_ERR_IO;
+	}
+	if (EE_WriteVariable(_EE_MEMS_MAG_CAL_VALID, MEMS_CONFIG_VALID) != 0)
+		return H0BR4_ERR_IO;
+	
+	return H0BR4_OK;
+}
+
+/* --- Current magnetometer calibration. Returns H0BR4_ERR_MAG if the module is not calibrated.
+*/
+Module_Status GetMagCalibration(MagCalibration_t *cal)
+{
+	if (cal == NULL)
+		return H0BR4_ERR_WrongParams;
+	if (!magCalValid)
+		return H0BR4_ERR_MAG;
+	
+	*cal = magCal;
+	return H0BR4_OK;
+}
+
+Module_Status ClearMagCalibration(void)
+{
+	magCalValid = false;
+	
+	if (EE_WriteVariable(_EE_MEMS_MAG_CAL_VALID, 0) != 0)
+		return H0BR4_ERR_IO;
+	
+	return H0BR4_OK;
+}
+
+/* --- Enable or disable learning the gyro bias at rest. The stored bias table stays applied. Off by 
+				default, stored in EEPROM.
+*/
+Module_Status SetGyroBiasAuto(bool enable)
+{
+	gyroBiasAuto = enable;
+	
+	return SaveMemsSettings(MEMS_SETTING_GYRO_BIAS_AUTO, enable ? MEMS_SETTING_GYRO_BIAS_AUTO : 0);
+}
+
+bool GetGyroBiasAuto(void)
+{
+	return gyroBiasAuto;
+}
+
+/* --- Gyro bias currently subtracted from the samples, in DPS.
+*/
+void GetGyroBias(float *x, float *y, float *z)
+{
+	*x = (gyroBiasRaw[0] * gyroSensitivity) / 1000;
+	*y = (gyroBiasRaw[1] * gyroSensitivity) / 1000;
+	*z = (gyroBiasRaw[2] * gyroSensitivity) / 1000;
+}
+
+/* --- Forget all learned gyro biases, in RAM and EEPROM.
+*/
+Module_Status ClearGyroBias(void)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t i = 0;
+	
+	gyroBiasFilled = 0;
+	gyroBiasUnsaved = 0;
+	SelectGyroBias(gyroBiasBin);
+	
+	// Emulated EEPROM variables cannot be deleted: mark the bins empty with an out-of-range bias
+	for (i = 0; i < 3 * GYRO_BIAS_BINS; i++) {
+		if (EE_WriteVariable(_EE_MEMS_GYRO_BIAS_TABLE + i, (uint16_t)INT16_MIN) != 0)
+			status = H0BR4_ERR_IO;
+	}
+	
+	return status;
+}
+
+/*-----------------------------------------------------------*/
+
+/* --- Enable LSM6DS3 hardware motion detection. events is a mask of MEMS_MOTION_* and line the 
+				IMU_INT line (1 or 2) the events are routed to. Significant motion always uses IMU_INT1. 
+				Detected events are reported as configured by SetMotionEventReport. The accelerometer must 
+				run at 26 Hz or more; taps need about 416 Hz. Stored in EEPROM.
+*/
+Module_Status SetMotionEvents(uint8_t events, uint8_t line)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((events & ~MEMS_MOTION_ALL) || line < 1 || line > 2)
+		return H0BR4_ERR_WrongParams;
+	// Events need the accelerometer running
+	if (events && powerMode == MEMS_POWER_DUTY_CYCLED)
+		return H0BR4_ERR_BUSY;
+	
+	motionEvents = events;
+	motionLine = line;
+	
+	if ((status = LSM6DS3ApplyMotionConfig()) != H0BR4_OK)
+		return status;
+	
+	// A line latched before routing would never give a new edge
+	if (events && MemsAcqTaskHandle != NULL)
+		xTaskNotify(MemsAcqTaskHandle, MEMS_EVT_MOTION, eSetBits);
+	
+	return SaveMotionConfig();
+}
+
+void GetMotionEvents(uint8_t *events, uint8_t *line)
+{
+	*events = motionEvents;
+	*line = motionLine;
+}
+
+/* --- Motion detection thresholds in mg. Wake-up and tap resolve to 1/64 and 1/32 of the 
+				accelerometer full scale, free-fall to the nearest of 156 to 500 mg. Stored in EEPROM.
+*/
+Module_Status SetMotionThresholds(uint16_t wakeUpMG, uint16_t freeFallMG, uint16_t tapMG)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if (wakeUpMG == 0 || freeFallMG == 0 || tapMG == 0)
+		return H0BR4_ERR_WrongParams;
+	
+	motionWakeUpMG = wakeUpMG;
+	motionFreeFallMG = freeFallMG;
+	motionTapMG = tapMG;
+	
+	if ((status = LSM6DS3ApplyMotionConfig()) != H0BR4_OK)
+		return status;
+	
+	return SaveMotionConfig();
+}
+
+void GetMotionThresholds(uint16_t *wakeUpMG, uint16_t *freeFallMG, uint16_t *tapMG)
+{
+	*wakeUpMG = motionWakeUpMG;
+	*freeFallMG = motionFreeFallMG;
+	*tapMG = motionTapMG;
+}
+
+/* --- Destination of motion events: three bytes (event mask, 6D orientation, tap source) written 
+				to port when module is this module, or sent to module in a CODE_H0BR4_MOTION_EVENT message. 
+				Module 0 only counts the events. Stored in EEPROM.
+*/
+Module_Status SetMotionEventReport(uint8_t module, uint8_t port)
+{
+	if (module == myID && (port == 0 || port > NumOfPorts))
+		return H0BR4_ERR_WrongParams;
+	
+	motionModule = module;
+	motionPort = port;
+	
+	return SaveMotionConfig();
+}
+
+/* --- Number of reported motion events and the mask of the last one
+*/
+uint32_t GetMotionEventCount(uint8_t *lastEvents)
+{
+	if (lastEvents != NULL)
+		*lastEvents = lastMotionEvents;
+	return motionEventCount;
+}
+
+/* --- Enable the LSM6DS3 pedometer. Counting starts after debounceSteps (0 to 7) consecutive steps, 
+				which rejects short bursts of movement. Needs the accelerometer running at 26 Hz or more. 
+				Stored in EEPROM.
+*/
+Module_Status SetPedometer(bool enable, uint8_t debounceSteps)
+{
+	Module_Status status = H0BR4_OK;
+	uint16_t word = 0, stored = 0;
+	
+	if (debounceSteps > PEDO_DEB_STEP_MAX)
+		return H0BR4_ERR_WrongParams;
+	if (enable && powerMode == MEMS_POWER_DUTY_CYCLED)
+		return H0BR4_ERR_BUSY;
+	
+	pedoEnabled = enable;
+	pedoDebounceSteps = debounceSteps;
+	
+	if ((status = LSM6DS3ApplyMotionConfig()) != H0BR4_OK)
+		return status;
+	
+	word = MEMS_CONFIG_VALID | (enable ? (1U << 4) : 0) | debounceSteps;
+	if (EE_ReadVariable(_EE_MEMS_PEDOMETER, &stored) == 0 && stored == word)
+		return status;
+	if (EE_WriteVariable(_EE_MEMS_PEDOMETER, word) != 0)
+		return H0BR4_ERR_IO;
+	
+	return status;
+}
+
+void GetPedometer(bool *enabled, uint8_t *debounceSteps)
+{
+	*enabled = pedoEnabled;
+	*debounceSteps = pedoDebounceSteps;
+}
+
+/* --- Clear the hardware step counter and the extended count
+*/
+Module_Status ResetStepCount(void)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = LSM6DS3UpdateReg(LSM6DS3_CTRL10_C_REG, CTRL10_PEDO_RST_STEP, CTRL10_PEDO_RST_STEP)) != H0BR4_OK)
+		return status;
+	if ((status = LSM6DS3UpdateReg(LSM6DS3_CTRL10_C_REG, CTRL10_PEDO_RST_STEP, 0)) != H0BR4_OK)
+		return status;
+	
+	taskENTER_CRITICAL();
+	stepCount = 0;
+	lastStepCounter = 0;
+	taskEXIT_CRITICAL();
+	
+	H0BR4_steps = 0;
+	return status;
+}
+
+/* --- Start the orientation fusion at rateHz (1 to 200 Hz), or change the rate of a running fusion. 
+				Sensor ODRs are raised to the fusion rate until it stops. A stopped fusion restarts from the 
+				level orientation.
+*/
+Module_Status StartFusion(uint16_t rateHz)
+{
+	Module_Status status = H0BR4_OK;
+	uint32_t period = 0;
+	uint8_t held = 0, previous = 0;
+	
+	if (rateHz == 0 || rateHz > FUSION_MAX_RATE_HZ || FusionTaskHandle == NULL)
+		return H0BR4_ERR_WrongParams;
+	if (powerMode == MEMS_POWER_DUTY_CYCLED)
+		return H0BR4_ERR_BUSY;
+	
+	period = 1000 / rateHz;
+	
+	if ((status = MATCH_GYRO_ODR(period, &held)) != H0BR4_OK || (status = MATCH_ACC_ODR(period, &held)) != H0BR4_OK || 
+			(status = MATCH_MAG_ODR(period, &held)) != H0BR4_OK) {
+		ReleaseOdr(held);
+		return status;
+	}
+	
+	// The ODRs of the previous rate are given back once the new ones are held
+	taskENTER_CRITICAL();
+	previous = fusionOdrHeld;
+	fusionOdrHeld = held;
+	taskEXIT_CRITICAL();
+	ReleaseOdr(previous);
+	
+	fusionPeriodMs = period;
+	
+	if (!fusionRunning) {
+		taskENTER_CRITICAL();
+		fusionQ[0] = Q29_ONE;
+		fusionQ[1] = fusionQ[2] = fusionQ[3] = 0;
+		memset(fusionIntegral, 0, sizeof(fusionIntegral));
+		taskEXIT_CRITICAL();
+		
+		fusionRunning = true;
+		xTaskNotifyGive(FusionTaskHandle);
+	}
+	
+	return status;
+}
+
+void StopFusion(void)
+{
+	uint8_t held = 0;
+	
+	fusionRunning = false;
+	
+	taskENTER_CRITICAL();
+	held = fusionOdrHeld;
+	fusionOdrHeld = 0;
+	taskEXIT_CRITICAL();
+	ReleaseOdr(held);
+}
+
+/* --- Fusion rate in Hz, 0 when stopped. 
+*/
+uint16_t GetFusionRate(void)
+{
+	return fusionRunning ? (1000 / fusionPeriodMs) : 0;
+}
+
+/* Orientation streams start the fusion, or raise its rate, so each period gets a new orientation */
+static Module_Status MatchFusionToPeriod(uint32_t period)
+{
+	uint32_t requiredHz = 0;
+	
+	if (period < MIN_MEMS_PERIOD_MS)
+		return H0BR4_ERR_WrongParams;
+	if (fusionRunning && fusionPeriodMs <= period)
+		return H0BR4_OK;
+	
+	requiredHz = (1000 + period - 1) / period;
+	return StartFusion((requiredHz > FUSION_MAX_RATE_HZ) ? FUSION_MAX_RATE_HZ : requiredHz);
+}
+
+Module_Status StreamQuaternionToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToPort(port, module, period, timeout, SampleQuaternionToPort, &quatStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamQuaternionToCLI(uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToCLI(period, timeout, SampleQuaternionToString, &quatStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamQuaternionToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToBuf(buffer, NULL, 4, period, timeout, SampleQuaternionToBuf, &quatStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamQuaternionToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToBuf(NULL, ring, 4, period, timeout, SampleQuaternionToBuf, &quatStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamEulerToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToPort(port, module, period, timeout, SampleEulerToPort, &eulerStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamEulerToCLI(uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToCLI(period, timeout, SampleEulerToString, &eulerStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamEulerToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToBuf(buffer, NULL, 3, period, timeout, SampleEulerToBuf, &eulerStreamInfo, MEMS_REPORT_NONE);
+}
+
+Module_Status StreamEulerToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if ((status = MatchFusionToPeriod(period)) != H0BR4_OK)
+		return status;
+	return StreamMemsToBuf(NULL, ring, 3, period, timeout, SampleEulerToBuf, &eulerStreamInfo, MEMS_REPORT_NONE);
+}
+
+/* --- Set up an empty sample ring on data, which holds capacity * (1 + values) floats. Not while a 
+				stream or a reader uses it.
+*/
+Module_Status InitMemsSampleRing(MemsSampleRing_t *ring, float *data, uint16_t capacity, uint8_t values)
+{
+	return MemsRingInit(ring, data, capacity, values) ? H0BR4_OK : H0BR4_ERR_WrongParams;
+}
+
+/* --- Records ready to read. Safe from either side: a concurrent stream can only add to it
+*/
+uint16_t GetMemsSampleRingCount(const MemsSampleRing_t *ring)
+{
+	return MemsRingCount(ring);
+}
+
+/* --- Oldest record of a sample ring, left in it. Consumer side. H0BR4_ERR_BUSY when empty
+*/
+Module_Status PeekMemsSampleRing(const MemsSampleRing_t *ring, uint32_t *timeUs, float *values)
+{
+	if (ring == NULL || ring->data == NULL)
+		return H0BR4_ERR_WrongParams;
+	return MemsRingPeek(ring, timeUs, values) ? H0BR4_OK : H0BR4_ERR_BUSY;
+}
+
+/* --- Take the oldest record of a sample ring. Consumer side. H0BR4_ERR_BUSY when empty
+*/
+Module_Status ReadMemsSampleRing(MemsSampleRing_t *ring, uint32_t *timeUs, float *values)
+{
+	if (ring == NULL || ring->data == NULL)
+		return H0BR4_ERR_WrongParams;
+	return MemsRingPop(ring, timeUs, values) ? H0BR4_OK : H0BR4_ERR_BUSY;
+}
+
+#if H0BR4_ENABLE_SLOTS
+/* --- Start a stream in a free slot. The request is queued to the stream scheduler task, which serves 
+				it with the other slots: the caller returns at once. Sensor ODR, fusion rate, bandwidth and 
+				change-triggered reporting are those of the single stream APIs, which send one sample when 
+				the timeout is shorter than the period. index gets the slot (may be NULL). H0BR4_ERR_BUSY 
+				when all slots are taken. A slot with a ring stores float records in it, as the StreamXToRing 
+				APIs do but without blocking the caller: the ring has the values of the sensor, 1 for 
+				heading and steps (the count as uint32_t bits), and port, module and format are ignored.
+*/
+Module_Status StartMemsStreamSlot(const MemsStreamSlot_t *slot, uint8_t *index)
+{
+	const MemsStreamInfo_t *info = NULL;
+	Module_Status status = H0BR4_OK;
+	uint32_t outBytes = 0;
+	uint8_t port = 0, i = 0, held = 0;
+	
+	if (slot == NULL || slot->sensor > MEMS_STREAM_STEPS || slot->format > MEMS_STREAM_FORMAT_TEXT || 
+			slot->period < MIN_MEMS_PERIOD_MS)
+		return H0BR4_ERR_WrongParams;
+	if (slot->ring != NULL && (slot->ring->data == NULL || slot->ring->values != sensorSources[slot->sensor].count))
+		return H0BR4_ERR_WrongParams;
+	if (slot->ring == NULL && slot->format == MEMS_STREAM_FORMAT_Q16 && sensorSources[slot->sensor].q16Scale == 0)
+		return H0BR4_ERR_WrongParams;
+	if (slot->ring == NULL && slot->port != 0 && slot->format == MEMS_STREAM_FORMAT_TEXT && slot->module != myID)
+		return H0BR4_ERR_WrongParams;
+	if (slot->ring == NULL && slot->port == PcPort && slot->format != MEMS_STREAM_FORMAT_TEXT) // Check if CLI is not enabled at that port!
+		return H0BR4_ERR_BUSY;
+	
+	// Text lines are checked at their usual length, rings at the sensor rate only
+	info = sensorSources[slot->sensor].info ? sensorSources[slot->sensor].info : AccChannelStreamInfo();
+	port = slot->port ? slot->port : PcPort;
+	if (slot->ring != NULL)
+		outBytes = 0;
+	else if (slot->port == 0 || slot->format == MEMS_STREAM_FORMAT_TEXT)
+		outBytes = TEXT_SAMPLE_BYTES;
+	else
+		outBytes = MEMS_TIMESTAMP_BYTES + info->portBytes + ((slot->module != myID) ? 1 + BOS_MSG_OVERHEAD : 0);
+	if ((status = CheckStreamPeriod(slot->period, StreamMinPeriodUs(info, port, outBytes))) != H0BR4_OK)
+		return status;
+	
+	// The slot holds the raised ODRs until it ends
+	switch (slot->sensor)
+	{
+		case MEMS_STREAM_GYRO: status = MATCH_GYRO_ODR(slot->period, &held); break;
+		case MEMS_STREAM_ACC: status = MatchAccChannelOdr(slot->period, &held); break;
+		case MEMS_STREAM_MAG: status = MATCH_MAG_ODR(slot->period, &held); break;
+		case MEMS_STREAM_HEADING:
+			if ((status = MATCH_ACC_ODR(slot->period, &held)) == H0BR4_OK)
+				status = MATCH_MAG_ODR(slot->period, &held);
+			break;
+		case MEMS_STREAM_QUAT:
+		case MEMS_STREAM_EULER: status = MatchFusionToPeriod(slot->period); break;
+		default: break;
+	}
+	if (status != H0BR4_OK) {
+		ReleaseOdr(held);
+		return status;
+	}
+	
+	taskENTER_CRITICAL();
+	for (i = 0; i < H0BR4_STREAM_SLOTS && (streamSlots[i].active || streamSlots[i].reserved); i++);
+	if (i < H0BR4_STREAM_SLOTS) {
+		streamSlots[i].config = *slot;
+		if (slot->period > slot->timeout)
+			streamSlots[i].config.timeout = slot->period;
+		streamSlots[i].odrHeld = held;
+		streamSlots[i].reserved = true;
+	}
+	taskEXIT_CRITICAL();
+	
+	if (i == H0BR4_STREAM_SLOTS) {
+		ReleaseOdr(held);
+		return H0BR4_ERR_BUSY;
+	}
+	
+	// Requests of slots stopped before the scheduler saw them may still fill the queue
+	if (xQueueSend(slotRequestQueue, &i, 0) != pdPASS) {
+		taskENTER_CRITICAL();
+		streamSlots[i].reserved = false;
+		taskEXIT_CRITICAL();
+		ReleaseSlotOdr(&streamSlots[i]);
+		return H0BR4_ERR_BUSY;
+	}
+	
+	if (index != NULL)
+		*index = i;
+	return H0BR4_OK;
+}
+
+/* --- Stop a stream slot, or all of them for H0BR4_STREAM_SLOTS or more
+*/
+Module_Status StopMemsStreamSlot(uint8_t index)
+{
+	uint8_t i = 0;
+	
+	taskENTER_CRITICAL();
+	for (i = 0; i < H0BR4_STREAM_SLOTS; i++) {
+		if ((index == i || index >= H0BR4_STREAM_SLOTS) && (streamSlots[i].active || streamSlots[i].reserved)) {
+			streamSlots[i].active = false;
+			streamSlots[i].reserved = false;
+			streamSlots[i].status = H0BR4_ERR_TERMINATED;
+		}
+	}
+	taskEXIT_CRITICAL();
+	
+	for (i = 0; i < H0BR4_STREAM_SLOTS; i++)
+		ReleaseSlotOdr(&streamSlots[i]);
+	
+	return H0BR4_OK;
+}
+#endif
+
+/* --- Timing counters of a stream: a slot, H0BR4_STREAM_TIMING_API + n for the stream APIs and CLI 
+				streams of the task in timing->task, or H0BR4_STREAM_TIMING_JOB for statistics and spectrum 
+				streams handed off to a port. They restart with each stream and are kept after it ends. With 
+				more calling tasks than entries, a new stream takes the entry claimed longest ago.
+*/
+Module_Status GetMemsStreamTiming(uint8_t stream, MemsStreamTiming_t *timing)
+{
+	MemsStreamTimingAcc_t acc;
+	
+	if (stream >= TABLE_SIZE(streamTiming) || timing == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	taskENTER_CRITICAL();
+	acc = streamTiming[stream];
+	timing->task = (stream >= H0BR4_STREAM_TIMING_API && stream < H0BR4_STREAM_TIMING_JOB) ? 
+								 streamTimingTask[stream - H0BR4_STREAM_TIMING_API] : NULL;
+	taskEXIT_CRITICAL();
+	
+	timing->samples = acc.samples;
+	timing->missed = acc.missed;
+	timing->jitterMinUs = acc.jitterMinUs;
+	timing->jitterMaxUs = acc.jitterMaxUs;
+	timing->jitterMeanUs = acc.samples ? (int32_t)(acc.jitterSumUs / (int32_t)acc.samples) : 0;
+	return H0BR4_OK;
+}
+
+#if H0BR4_ENABLE_SLOTS
+/* --- Request of a stream slot. Returns H0BR4_OK while it runs, H0BR4_ERR_TERMINATED once stopped or 
+				timed out, or the sensor or port error that ended it. A slot never used is terminated.
+*/
+Module_Status GetMemsStreamSlot(uint8_t index, MemsStreamSlot_t *slot)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if (index >= H0BR4_STREAM_SLOTS || slot == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	taskENTER_CRITICAL();
+	*slot = streamSlots[index].config;
+	status = (streamSlots[index].active || streamSlots[index].reserved) ? H0BR4_OK : streamSlots[index].status;
+	taskEXIT_CRITICAL();
+	
+	return status;
+}
+#endif
+
+/* --- Stop the stream running in the caller task, if any, and all stream slots
+*/
+void stopStreamMems(void)
+{
+	stopStream = true;
+#if H0BR4_ENABLE_SLOTS
+	StopMemsStreamSlot(H0BR4_STREAM_SLOTS);
+#endif
+}
+
+/* --- Highest sustainable rate in Hz computed for the last stream request rejected with 
+				H0BR4_ERR_BANDWIDTH.
+*/
+uint32_t GetMemsStreamMaxRate(void)
+{
+	return streamMaxRateHz;
+}
+
+Module_Status SetMemsAcquisitionMode(MemsAcqMode_t mode)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if (mode > MEMS_ACQ_FIFO)
+		return H0BR4_ERR_WrongParams;
+	// Interrupt-driven modes need the sensors running
+	if (mode != MEMS_ACQ_POLLING && powerMode == MEMS_POWER_DUTY_CYCLED)
+		return H0BR4_ERR_BUSY;
+	
+	// Wait for the acquisition task to finish its current read and keep it off the sensors 
+	// while re-routing the interrupt lines
+	if (!MemsLock(pdMS_TO_TICKS(MEMS_LOCK_TIMEOUT_MS)))
+		return H0BR4_ERR_BUSY;
+	acqMode = MEMS_ACQ_POLLING;
+	
+	if ((status = LSM6DS3RouteInterrupts(mode)) == H0BR4_OK && 
+			(status = LSM6DS3SetupFifo(mode == MEMS_ACQ_FIFO)) == H0BR4_OK) {
+		// The magnetometer has no FIFO: it uses its data-ready line in both interrupt modes
+		status = LSM303MagRouteDRDY(mode != MEMS_ACQ_POLLING);
+	}
+	
+	if (status == H0BR4_OK) {
+		memset(&memsCache, 0, sizeof(memsCache));
+		memset(&memsOutput, 0, sizeof(memsOutput));
+		acqMode = mode;
+	}
+	MemsUnlock();
+	
+	// First read releases any data-ready line latched before routing
+	if (status == H0BR4_OK && mode != MEMS_ACQ_POLLING && MemsAcqTaskHandle != NULL)
+		xTaskNotify(MemsAcqTaskHandle, MEMS_EVT_ALL, eSetBits);
+	
+	return status;
+}
+
+/* --- Set the MEMS I2C bus speed in kHz: 100 (Standard), 400 (Fast) or 1000 (Fast-mode Plus).
+				Both sensors must answer WHO_AM_I at the new speed, otherwise the previous speed 
+				(or Standard mode as a last resort) is restored and H0BR4_ERR_IO is returned.
+				A working speed is stored in EEPROM and restored at startup.
+*/
+Module_Status SetMemsI2CSpeed(uint16_t speedKHz)
+{
+	uint16_t previous = MX_I2C2_GetSpeed();
+	uint8_t i = 0;
+	
+	for (i = 0; i < TABLE_SIZE(memsI2CSpeedKHz) && memsI2CSpeedKHz[i] != speedKHz; i++);
+	if (i == TABLE_SIZE(memsI2CSpeedKHz))
+		return H0BR4_ERR_WrongParams;
+	
+	if (MX_I2C2_SetSpeed(speedKHz) == HAL_OK && MemsCheckWhoAmI() == H0BR4_OK)
+		return SaveMemsSettings(MEMS_SETTING_I2C_SPEED, (uint16_t)i << MEMS_SETTING_I2C_SPEED_POS);
+	
+	if (MX_I2C2_SetSpeed(previous) == HAL_OK && MemsCheckWhoAmI() == H0BR4_OK)
+		return H0BR4_ERR_IO;
+	
+	MX_I2C2_SetSpeed(MEMS_I2C_DEFAULT_KHZ);
+	return H0BR4_ERR_IO;
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t GetMemsI2CSpeed(void)
+{
+	return MX_I2C2_GetSpeed();
+}
+
+/*-----------------------------------------------------------*/
+
+/* --- CPU time in us of one LSM6DS3 temperature, gyro and accelerometer read (14 bytes) at the 
+				current bus speed: blocking HAL transfer against the interrupt-driven transport.
+*/
+Module_Status BenchmarkMemsI2C(uint32_t *blockingUs, uint32_t *asyncUs)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	
+	if (blockingUs == NULL || asyncUs == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	status = MX_I2C2_Benchmark(LSM6DS3_ACC_GYRO_I2C_ADDRESS_HIGH, LSM6DS3_ACC_GYRO_OUT_TEMP_L, LSM6DS3_IMU_OUT_LEN, 
+														 blockingUs, asyncUs);
+	if (status == HAL_BUSY)
+		return H0BR4_ERR_BUSY;
+	return (status == HAL_OK) ? H0BR4_OK : H0BR4_ERR_LSM6DS3;
+}
+
+/*-----------------------------------------------------------*/
+
+/* --- Set gyro ODR (13, 26, 52, 104, 208, 416, 833 or 1660 Hz) and full scale (125, 245, 500, 
+				1000 or 2000 dps). The setting is applied, then stored in EEPROM.
+*/
+Module_Status SetGyroConfig(uint16_t odrHz, uint16_t fullScaleDPS)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t odr = 0, fs = 0;
+	
+	if (!FindOdr(gyroOdrTable, TABLE_SIZE(gyroOdrTable), odrHz, &odr) || 
+			!FindFullScale(gyroFsTable, TABLE_SIZE(gyroFsTable), fullScaleDPS, &fs))
+		return H0BR4_ERR_WrongParams;
+	
+	gyroOdrIdx = odrBaseIdx[MEMS_ODR_GYRO] = odr;
+	gyroFsIdx = fs;
+	
+	// Cached samples were scaled for the previous full scale
+	taskENTER_CRITICAL();
+	memsCache.gyroCount = memsOutput.gyroCount = 0;
+	taskEXIT_CRITICAL();
+	
+	if ((status = LSM6DS3ApplyGyroConfig()) != H0BR4_OK)
+		return status;
+	
+	return SaveMemsConfig();
+}
+
+/* --- Set accelerometer ODR (13 to 6660 Hz), full scale (2, 4, 8 or 16 g) and anti-aliasing 
+				bandwidth (50, 100, 200 or 400 Hz). The setting is applied, then stored in EEPROM.
+*/
+Module_Status SetAccConfig(uint16_t odrHz, uint8_t fullScaleG, uint16_t bandwidthHz)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t odr = 0, fs = 0, bw = 0;
+	
+	if (!FindOdr(accOdrTable, TABLE_SIZE(accOdrTable), odrHz, &odr) || 
+			!FindFullScale(accFsTable, TABLE_SIZE(accFsTable), fullScaleG, &fs) || 
+			!FindOdr(accBwTable, TABLE_SIZE(accBwTable), bandwidthHz, &bw))
+		return H0BR4_ERR_WrongParams;
+	
+	accOdrIdx = odrBaseIdx[MEMS_ODR_ACC] = odr;
+	accFsIdx = fs;
+	accBwIdx = bw;
+	
+	taskENTER_CRITICAL();
+	memsCache.accCount = memsOutput.accCount = 0;
+	taskEXIT_CRITICAL();
+	
+	if ((status = LSM6DS3ApplyAccConfig()) != H0BR4_OK)
+		return status;
+	
+	return SaveMemsConfig();
+}
+
+/* --- Set magnetometer ODR (10, 20, 50 or 100 Hz). Full scale is fixed at 50 gauss. 
+				The setting is applied, then stored in EEPROM.
+*/
+Module_Status SetMagConfig(uint8_t odrHz)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t odr = 0;
+	
+	if (!FindOdr(magOdrTable, TABLE_SIZE(magOdrTable), odrHz, &odr))
+		return H0BR4_ERR_WrongParams;
+	
+	magOdrIdx = odrBaseIdx[MEMS_ODR_MAG] = odr;
+	
+	if ((status = LSM303ApplyMagConfig()) != H0BR4_OK)
+		return status;
+	
+	return SaveMemsConfig();
+}
+
+void GetGyroConfig(uint16_t *odrHz, uint16_t *fullScaleDPS)
+{
+	*odrHz = gyroOdrTable[gyroOdrIdx].hz;
+	*fullScaleDPS = gyroFsTable[gyroFsIdx].range;
+}
+
+void GetAccConfig(uint16_t *odrHz, uint8_t *fullScaleG, uint16_t *bandwidthHz)
+{
+	*odrHz = accOdrTable[accOdrIdx].hz;
+	*fullScaleG = accFsTable[accFsIdx].range;
+	*bandwidthHz = accBwTable[accBwIdx].hz;
+}
+
+/* --- Set the LSM303AGR accelerometer operating mode (power down, low power 8-bit, normal 10-bit or high 
+				resolution 12-bit), ODR (1, 10, 25, 50, 100, 200 or 400 Hz) and full scale (2, 4, 8 or 16 g). 
+				The setting is applied, then stored in EEPROM.
+*/
+Module_Status SetLsm303AccConfig(Lsm303AccMode_t mode, uint16_t odrHz, uint8_t fullScaleG)
+{
+	Module_Status status = H0BR4_OK;
+	uint8_t odr = 0, fs = 0;
+	
+	if (mode > LSM303_ACC_HIGH_RES || !FindOdr(acc2OdrTable, TABLE_SIZE(acc2OdrTable), odrHz, &odr) || 
+			!FindFullScale(acc2FsTable, TABLE_SIZE(acc2FsTable), fullScaleG, &fs))
+		return H0BR4_ERR_WrongParams;
+	
+	// The selected channel cannot be powered down
+	if (mode == LSM303_ACC_POWER_DOWN && accChannel == MEMS_ACC_LSM303AGR)
+		return H0BR4_ERR_WrongParams;
+	
+	acc2Mode = mode;
+	acc2OdrIdx = odrBaseIdx[MEMS_ODR_ACC2] = odr;
+	acc2FsIdx = fs;
+	
+	if ((status = LSM303ApplyAccConfig()) != H0BR4_OK)
+		return status;
+	
+	return SaveMemsConfig();
+}
+
+void GetLsm303AccConfig(Lsm303AccMode_t *mode, uint16_t *odrHz, uint8_t *fullScaleG)
+{
+	*mode = acc2Mode;
+	*odrHz = acc2OdrTable[acc2OdrIdx].hz;
+	*fullScaleG = acc2FsTable[acc2FsIdx].range;
+}
+
+/* --- Select the accelerometer read by the Acc APIs and streams. The LSM303AGR accelerometer 
+				must be enabled with SetLsm303AccConfig first. Stored in EEPROM.
+*/
+Module_Status SetAccChannel(MemsAccChannel_t channel)
+{
+	if (channel > MEMS_ACC_LSM303AGR)
+		return H0BR4_ERR_WrongParams;
+	if (channel == MEMS_ACC_LSM303AGR && acc2Mode == LSM303_ACC_POWER_DOWN)
+		return H0BR4_ERR_WrongParams;
+	
+	accChannel = channel;
+	return SaveMemsConfig();
+}
+
+MemsAccChannel_t GetAccChannel(void)
+{
+	return accChannel;
+}
+
+/* --- Redundant accelerometer cross-check. While both accelerometers are running, each Acc sample 
+				also reads the other one and counts a mismatch when an axis differs by more than toleranceMG. 
+				The two sensors sample at different instants, so the tolerance must cover the expected motion. 
+				0 disables the check. Stored in EEPROM and the mismatch count is reset.
+*/
+Module_Status SetAccCrossCheck(uint16_t toleranceMG)
+{
+	accCrossCheckMG = toleranceMG;
+	accMismatches = 0;
+	
+	return SaveMemsConfig();
+}
+
+void GetAccCrossCheck(uint16_t *toleranceMG, uint32_t *mismatches)
+{
+	*toleranceMG = accCrossCheckMG;
+	*mismatches = accMismatches;
+}
+
+/* --- Set the magnetic declination added to the compass heading, -180 to 180 degrees, east positive. 
+				Stored in EEPROM with a resolution of 0.1 degree.
+*/
+Module_Status SetMagDeclination(float degrees)
+{
+	int16_t deciDegrees = 0;
+	
+	if (degrees < -180 || degrees > 180)
+		return H0BR4_ERR_WrongParams;
+	
+	deciDegrees = (int16_t)((degrees < 0) ? (degrees * 10 - 0.5f) : (degrees * 10 + 0.5f));
+	if (deciDegrees == magDeclination)
+		return H0BR4_OK;
+	
+	magDeclination = deciDegrees;
+	if (EE_WriteVariable(_EE_MEMS_MAG_DECLINATION, (uint16_t)deciDegrees) != 0)
+		return H0BR4_ERR_IO;
+	
+	return H0BR4_OK;
+}
+
+float GetMagDeclination(void)
+{
+	return (float)magDeclination / 10;
+}
+
+void GetMagConfig(uint8_t *odrHz)
+{
+	*odrHz = magOdrTable[magOdrIdx].hz;
+}
+
+/*-----------------------------------------------------------*/
+
+/* --- Configure the LSM6DS3 FIFO acquisition mode.
+				watermark: data sets (3-axis samples of any sensor) that trigger a burst drain.
+				gyroDecimation, accDecimation: 0 (sensor not in FIFO), 1, 2, 3, 4, 8, 16 or 32 
+				relative to the FIFO ODR, which is the configured ODR of the faster sensor in the FIFO.
+*/
+Module_Status SetMemsFifoConfig(uint16_t watermark, uint8_t gyroDecimation, uint8_t accDecimation)
+{
+	uint8_t code = 0;
+	
+	if (watermark == 0 || watermark > H0BR4_FIFO_MAX_SAMPLES)
+		return H0BR4_ERR_WrongParams;
+	if (!FifoDecimationCode(gyroDecimation, &code) || !FifoDecimationCode(accDecimation, &code))
+		return H0BR4_ERR_WrongParams;
+	if (gyroDecimation == 0 && accDecimation == 0)
+		return H0BR4_ERR_WrongParams;
+	
+	fifoWatermark = watermark;
+	fifoGyroDecimation = gyroDecimation;
+	fifoAccDecimation = accDecimation;
+	
+	// Apply now if the FIFO is already running
+	if (acqMode == MEMS_ACQ_FIFO)
+		return SetMemsAcquisitionMode(MEMS_ACQ_FIFO);
+	
+	return H0BR4_OK;
+}
+
+/* --- Copy the last drained FIFO burst. Compare batch->sequence to detect new bursts.
+*/
+Module_Status GetMemsFifoBatch(MemsFifoBatch_t *batch)
+{
+	if (batch == NULL)
+		return H0BR4_ERR_WrongParams;
+	if (acqMode != MEMS_ACQ_FIFO)
+		return H0BR4_ERR_BUSY;
+	
+	vTaskSuspendAll();
+	batch->numGyro = fifoBatch.numGyro;
+	batch->numAcc = fifoBatch.numAcc;
+	batch->sequence = fifoBatch.sequence;
+	memcpy(batch->gyro, fifoBatch.gyro, fifoBatch.numGyro * sizeof(fifoBatch.gyro[0]));
+	memcpy(batch->acc, fifoBatch.acc, fifoBatch.numAcc * sizeof(fifoBatch.acc[0]));
+	xTaskResumeAll();
+	
+	return H0BR4_OK;
+}
+
+MemsAcqMode_t GetMemsAcquisitionMode(void)
+{
+	return acqMode;
+}
+
+/* --- Select continuous or duty-cycled sensor power. In duty-cycled mode the LSM6DS3 gyro and 
+				accelerometer are powered down and the LSM303AGR magnetometer idles between samples. Each 
+				sample wakes only the sensors it reads, waits for their turn-on time, then powers them down 
+				again; concurrent samplers share one power-up. Needs polling acquisition, the fusion stopped, no 
+				motion events and the pedometer off. Gyro bias learning pauses. Stored in EEPROM.
+*/
+Module_Status SetMemsPowerMode(MemsPowerMode_t mode)
+{
+	Module_Status status = H0BR4_OK;
+	
+	if (mode > MEMS_POWER_DUTY_CYCLED)
+		return H0BR4_ERR_WrongParams;
+	if (mode == MEMS_POWER_DUTY_CYCLED && (acqMode != MEMS_ACQ_POLLING || fusionRunning || motionEvents || pedoEnabled))
+		return H0BR4_ERR_BUSY;
+	
+	powerMode = mode;
+	// The timestamp counter may not run while powered down: continue the timeline from the MCU time
+	memsTimeSynced = false;
+	
+	// Re-applying the configuration powers the LSM6DS3 sensors up or down
+	if ((status = LSM6DS3ApplyGyroConfig()) != H0BR4_OK)
+		return status;
+	if ((status = LSM6DS3ApplyAccConfig()) != H0BR4_OK)
+		return status;
+	if ((status = (mode == MEMS_POWER_DUTY_CYCLED) ? LSM303MagDisable() : LSM303MagEnable()) != H0BR4_OK)
+		return status;
+	
+	return SaveMemsSettings(MEMS_SETTING_DUTY_CYCLED, (mode == MEMS_POWER_DUTY_CYCLED) ? MEMS_SETTING_DUTY_CYCLED : 0);
+}
+
+MemsPowerMode_t GetMemsPowerMode(void)
+{
+	return powerMode;
+}
+
+/* --- Current time on the sensor timeline in us since MCU reset, from the LSM6DS3 timestamp counter 
+				(25 us resolution) extended to 64 bits. Sample records carry its lower 32 bits.
+*/
+Module_Status SampleMemsTime(uint64_t *timeUs)
+{
+	if (timeUs == NULL)
+		return H0BR4_ERR_WrongParams;
+	
+	return LSM6DS3SampleTime(timeUs);
+}
+
+/* --- Map a HAL_GetTick() time on the sensor timeline, from the last LSM6DS3 timestamp read. 
+				Places samples of sensors without a timestamp, such as the magnetometer, within 1 ms.
+*/
+uint64_t MemsTickToTimeUs(uint32_t tick)
+{
+	uint64_t timeUs = 0;
+	
+	taskENTER_CRITICAL();
+	timeUs = memsTimeUs + (int64_t)(int32_t)(tick - memsTimeTick) * 1000;
+	taskEXIT_CRITICAL();
+	
+	return timeUs;
+}
+
+/* --- Sensor time in us of the last sample read by the calling task. Sample APIs that return 
+				bare values can be followed by this call to time them.
+*/
+uint32_t GetMemsSampleTime(void)
+{
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+	uint32_t timeUs = 0;
+	uint8_t i = 0;
+	
+	taskENTER_CRITICAL();
+	for (i = 0; i < MEMS_SAMPLE_TIME_SLOTS && sampleTimes[i].task != NULL; i++) {
+		if (sampleTimes[i].task == task) {
+			timeUs = sampleTimes[i].timeUs;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+	
+	return timeUs;
+}
+
+/* --- Filter a channel at its input rate and keep one output every decimation samples. param is the 
+				cutoff in Hz (clamped to 0.45 of the input rate) or the moving average length. Filters run 
+				on samples read by the acquisition task at the sensor rate: polled samples have no steady 
+				rate, so a filter other than none is refused with H0BR4_ERR_BUSY in polling acquisition. 
+				Select drdy or fifo first. Stored in EEPROM; stored filters pause while polling.
+*/
+Module_Status SetMemsFilter(MemsFilterChannel_t channel, MemsFilterType_t type, uint16_t param, uint8_t decimation)
+{
+	if (channel > MEMS_FILTER_MAG || !MemsFilterValid(type, param, decimation))
+		return H0BR4_ERR_WrongParams;
+	if (acqMode == MEMS_ACQ_POLLING && (type != MEMS_FILTER_NONE || decimation > 1))
+		return H0BR4_ERR_BUSY;
+	
+	// The acquisition task picks the new settings up on its next sample
+	taskENTER_CRITICAL();
+	filterConfig[channel].type = type;
+	filterConfig[channel].param = (type == MEMS_FILTER_NONE) ? 0 : param;
+	filterConfig[channel].decimation = decimation;
+	memsFilters[channel].redesign = true;
+	taskEXIT_CRITICAL();
+	
+	return SaveMemsFilterConfig();
+}
+
+void GetMemsFilter(MemsFilterChannel_t channel, MemsFilterType_t *type, uint16_t *param, uint8_t *decimation)
+{
+	if (channel > MEMS_FILTER_MAG)
+		channel = MEMS_FILTER_GYRO;
+	
+	*type = filterConfig[channel].type;
+	*param = filterConfig[channel].param;
+	*decimation = filterConfig[channel].decimation;
+}
+
+/* --- Report gyro, acc, mag or temp streams on change instead of every period, on port, CLI and 
+				buffer. A NULL config sends every sample again. Stored in EEPROM. Q16 streams are not affected.
+*/
+Module_Status SetMemsReport(MemsReportChannel_t channel, const MemsReportConfig_t *config)
+{
+	if (channel >= MEMS_REPORT_NONE || (config != NULL && !MemsReportValid(channel, config)))
+		return H0BR4_ERR_WrongParams;
+	
+	// Running streams keep the settings they started with
+	taskENTER_CRITICAL();
+	reportEnabled[channel] = (config != NULL);
+	if (config != NULL)
+		reportConfig[channel] = *config;
+	taskEXIT_CRITICAL();
+	
+	return SaveMemsReportConfig(channel);
+}
+
+/* Returns true when the channel reports on change
+*/
+bool GetMemsReport(MemsReportChannel_t channel, MemsReportConfig_t *config)
+{
+	if (channel >= MEMS_REPORT_NONE)
+		return false;
+	
+	*config = reportConfig[channel];
+	return reportEnabled[channel];
+}
+
+/* -----------------------------------------------------------------------
+	|															Commands																 	|
+   ----------------------------------------------------------------------- 
+*/
+
+static portBASE_TYPE SampleSensorCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	const char *const gyroCmdName = "gyro";
+	const char *const accCmdName = "acc";
+	const char *const magCmdName = "mag";
+	const char *const tempCmdName = "temp";
+	const char *const imuCmdName = "imu";
+	const char *const quatCmdName = "quat";
+	const char *const eulerCmdName = "euler";
+	const char *const headingCmdName = "heading";
+	const char *const stepsCmdName = "steps";
+	
+	const char *pSensName = NULL;
+	portBASE_TYPE sensNameLen = 0;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	pSensName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &sensNameLen);
+	
+	if (pSensName == NULL) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+		return pdFALSE;
+	}
+	
+	do {
+		if (!strncmp(pSensName, gyroCmdName, strlen(gyroCmdName))) {
+			if (SampleGyroDPSToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, accCmdName, strlen(accCmdName))) {
+			if (SampleAccGToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+		
+		} else if (!strncmp(pSensName, magCmdName, strlen(magCmdName))) {
+			if (SampleMagMGaussToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, tempCmdName, strlen(tempCmdName))) {
+			if (SampleTempCToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, imuCmdName, strlen(imuCmdName))) {
+			if (SampleImuToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, quatCmdName, strlen(quatCmdName))) {
+			if (SampleQuaternionToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, eulerCmdName, strlen(eulerCmdName))) {
+			if (SampleEulerToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, headingCmdName, strlen(headingCmdName))) {
+			if (SampleHeadingToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, stepsCmdName, strlen(stepsCmdName))) {
+			if (SampleStepCountToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
+				break;
+			
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+		
+		PrependSampleTime((char *)pcWriteBuffer, xWriteBufferLen);
+		return pdFALSE;
+	} while (0);
+	
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
+	return pdFALSE;
+}
+
+// Port Mode => false and CLI Mode => true
+static bool StreamCommandParser(const int8_t *pcCommandString, const char **ppSensName, portBASE_TYPE *pSensNameLen, 
+														bool *pPortOrCLI, uint32_t *pPeriod, uint32_t *pTimeout, uint8_t *pPort, uint8_t *pModule)
+{
+	const char *pPeriodMSStr = NULL;
+	const char *pTimeoutMSStr = NULL;
+	
+	portBASE_TYPE periodStrLen = 0;
+	portBASE_TYPE timeoutStrLen = 0;
+	
+	const char *pPortStr = NULL;
+	const char *pModStr = NULL;
+	
+	portBASE_TYPE portStrLen = 0;
+	portBASE_TYPE modStrLen = 0;
+	
+	*ppSensName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, pSensNameLen);
+	pPeriodMSStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &periodStrLen);
+	pTimeoutMSStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 3, &timeoutStrLen);
+	
+	// At least 3 Parameters are required!
+	if ((*ppSensName == NULL) || (pPeriodMSStr == NULL) || (pTimeoutMSStr == NULL))
+		return false;
+	
+	// TODO: Check if Period and Timeout are integers or not!
+	*pPeriod = atoi(pPeriodMSStr);
+	*pTimeout = atoi(pTimeoutMSStr);
+	*pPortOrCLI = true;
+	
+	pPortStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 4, &portStrLen);
+	pModStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 5, &modStrLen);
+	
+	if ((pModStr == NULL) && (pPortStr == NULL))
+		return true;
+	if ((pModStr == NULL) || (pPortStr == NULL))	// If user has provided 4 Arguments.
+		return false;
+	
+	*pPort = atoi(pPortStr);
+	*pModule = atoi(pModStr);
+	*pPortOrCLI = false;
+	
+	return true;
+}
+
+#if H0BR4_ENABLE_STATS
+/* stream [gyro]/[acc]/[mag] stats (window samples) (window ms) (time in ms) [port] [module]
+*/
+static portBASE_TYPE StreamStatsCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	// In MemsFilterChannel_t order
+	const char *const channelNames[] = { "gyro", "acc", "mag" };
+	
+	const char *pParamStr[7] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+	portBASE_TYPE paramStrLen = 0;
+	Module_Status status = H0BR4_OK;
+	uint32_t windowMs = 0, timeout = 0;
+	uint16_t windowSamples = 0;
+	uint8_t channel = 0, i = 0;
+	
+	for (i = 0; i < 7; i++)
+		pParamStr[i] = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, i + 1, &paramStrLen);
+	
+	for (channel = 0; channel < TABLE_SIZE(channelNames) && strncmp(pParamStr[0], channelNames[channel], strlen(channelNames[channel])); channel++);
+	
+	// Port and module come together
+	if (channel == TABLE_SIZE(channelNames) || pParamStr[2] == NULL || pParamStr[3] == NULL || pParamStr[4] == NULL || 
+			((pParamStr[5] == NULL) != (pParamStr[6] == NULL))) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+		return pdFALSE;
+	}
+	
+	windowSamples = (atoi(pParamStr[2]) > UINT16_MAX) ? UINT16_MAX : atoi(pParamStr[2]);
+	windowMs = atoi(pParamStr[3]);
+	timeout = atoi(pParamStr[4]);
+	
+	if (pParamStr[5] == NULL)
+		status = StreamMemsStatsToCLI((MemsFilterChannel_t)channel, windowSamples, windowMs, timeout);
+	else {
+		// Streams to a port are handed off: the CLI is free meanwhile
+		MemsStreamJob_t job = { .kind = MEMS_JOB_STATS, .port = atoi(pParamStr[5]), .module = atoi(pParamStr[6]), .channel = channel, 
+														.samples = windowSamples, .period = windowMs, .timeout = timeout };
+		
+		status = StartStreamJob(&job);
+	}
+	
+	if (status == H0BR4_OK || status == H0BR4_ERR_TERMINATED) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "\r\n");
+	} else if (status == H0BR4_ERR_WrongParams) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+	} else if (status == H0BR4_ERR_BANDWIDTH) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Window too short. Highest sustainable rate: %lu Hz\r\n", 
+						 (unsigned long)GetMemsStreamMaxRate());
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
+	}
+	return pdFALSE;
+}
+#endif
+
+#if H0BR4_ENABLE_FFT
+/* stream accfft [x]/[y]/[z] (size) (sample Hz) [rect]/[hann] (period in ms) (time in ms) [port] [module]
+*/
+static portBASE_TYPE StreamSpectrumCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	// In MemsFftWindow_t order
+	const char *const windowNames[] = { "rect", "hann" };
+	const char *const axisNames = "xyz";
+	
+	const char *pParamStr[8] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+	portBASE_TYPE paramStrLen = 0;
+	Module_Status status = H0BR4_OK;
+	uint32_t period = 0, timeout = 0;
+	uint16_t size = 0, sampleHz = 0;
+	uint8_t axis = 0, window = 0, i = 0;
+	
+	for (i = 0; i < 8; i++)
+		pParamStr[i] = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, i + 2, &paramStrLen);
+	
+	for (i = 0; i < 6 && pParamStr[i] != NULL; i++);
+	
+	// Port and module come together
+	if (i < 6 || ((pParamStr[6] == NULL) != (pParamStr[7] == NULL))) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+		return pdFALSE;
+	}
+	
+	for (axis = 0; axis < 3 && pParamStr[0][0] != axisNames[axis]; axis++);
+	for (window = 0; window < TABLE_SIZE(windowNames) && strncmp(pParamStr[3], windowNames[window], strlen(windowNames[window])); window++);
+	
+	size = (atoi(pParamStr[1]) > UINT16_MAX) ? 0 : atoi(pParamStr[1]);
+	sampleHz = (atoi(pParamStr[2]) > UINT16_MAX) ? 0 : atoi(pParamStr[2]);
+	period = atoi(pParamStr[4]);
+	timeout = atoi(pParamStr[5]);
+	
+	if (pParamStr[6] == NULL)
+		status = StreamAccSpectrumToCLI(axis, size, sampleHz, (MemsFftWindow_t)window, period, timeout);
+	else {
+		// Streams to a port are handed off: the CLI is free meanwhile
+		MemsStreamJob_t job = { .kind = MEMS_JOB_SPECTRUM, .port = atoi(pParamStr[6]), .module = atoi(pParamStr[7]), .channel = axis, 
+														.samples = size, .sampleHz = sampleHz, .window = (MemsFftWindow_t)window, .period = period, .timeout = timeout };
+		
+		status = StartStreamJob(&job);
+	}
+	
+	if (status == H0BR4_OK || status == H0BR4_ERR_TERMINATED) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "\r\n");
+	} else if (status == H0BR4_ERR_WrongParams) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+	} else if (status == H0BR4_ERR_BANDWIDTH) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Period too short. Highest sustainable rate: %lu Hz\r\n", 
+						 (unsigned long)GetMemsStreamMaxRate());
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
+	}
+	return pdFALSE;
+}
+#endif
+
+static portBASE_TYPE StreamSensorCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	const char *const gyroCmdName = "gyro";
+	const char *const accCmdName = "acc";
+	const char *const magCmdName = "mag";
+	const char *const tempCmdName = "temp";
+	const char *const quatCmdName = "quat";
+	const char *const eulerCmdName = "euler";
+	const char *const headingCmdName = "heading";
+	const char *const stepsCmdName = "steps";
+	// In MemsStreamSensor_t order
+	const char *const sensorNames[] = { "gyro", "acc", "mag", "temp", "quat", "euler", "heading", "steps" };
+	
+#if H0BR4_ENABLE_SLOTS
+	MemsStreamSlot_t slot;
+	uint8_t index = 0;
+#endif
+	uint8_t sensor = 0;
+	uint32_t period = 0;
+	uint32_t timeout = 0;
+	uint8_t port = 0;
+	uint8_t module = 0;
+	
+	bool portOrCLI = true; // Port Mode => false and CLI Mode => true
+	Module_Status status = H0BR4_OK;
+	
+	const char *pSensName = NULL;
+	portBASE_TYPE sensNameLen = 0;
+#if H0BR4_ENABLE_STATS
+	const char *pModeStr = NULL;
+	portBASE_TYPE modeStrLen = 0;
+#endif
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+#if H0BR4_ENABLE_FFT
+	// The spectrum is not an acc stream: check it before the "acc" prefix matches
+	pSensName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &sensNameLen);
+	if (pSensName != NULL && !strncmp(pSensName, "accfft", 6))
+		return StreamSpectrumCommand(pcWriteBuffer, xWriteBufferLen, pcCommandString);
+#endif
+	
+#if H0BR4_ENABLE_STATS
+	// Window statistics take the place of the period
+	pModeStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &modeStrLen);
+	if (pModeStr != NULL && !strncmp(pModeStr, "stats", 5))
+		return StreamStatsCommand(pcWriteBuffer, xWriteBufferLen, pcCommandString);
+#endif
+	
+	if (!StreamCommandParser(pcCommandString, &pSensName, &sensNameLen, &portOrCLI, &period, &timeout, &port, &module)) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+		return pdFALSE;
+	}
+	
+	do {
+		// Streams to a port run in a stream slot: the CLI is free meanwhile. CLI streams are shown here
+		if (!portOrCLI) {
+			for (sensor = 0; sensor < TABLE_SIZE(sensorNames) && strncmp(pSensName, sensorNames[sensor], strlen(sensorNames[sensor])); sensor++);
+			if (sensor == TABLE_SIZE(sensorNames)) {
+				snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+				return pdFALSE;
+			}
+			
+#if H0BR4_ENABLE_SLOTS
+			slot.sensor = (MemsStreamSensor_t)sensor;
+			slot.format = MEMS_STREAM_FORMAT_FLOAT;
+			slot.port = port;
+			slot.module = module;
+			slot.period = period;
+			slot.timeout = timeout;
+			slot.ring = NULL;
+			if ((status = StartMemsStreamSlot(&slot, &index)) != H0BR4_OK)
+				break;
+			
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Streaming in slot %u\r\n", index);
+#else
+			// Without stream slots the CLI waits for the stream to end
+			if ((status = StartMessageStream((MemsStreamSensor_t)sensor, port, module, period, timeout)) != H0BR4_OK)
+				break;
+			
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "\r\n");
+#endif
+			return pdFALSE;
+		}
+		
+		if (!strncmp(pSensName, gyroCmdName, strlen(gyroCmdName))) {
+			if ((status = StreamGyroDPSToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, accCmdName, strlen(accCmdName))) {
+			if ((status = StreamAccGToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, magCmdName, strlen(magCmdName))) {
+			if ((status = StreamMagMGaussToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, tempCmdName, strlen(tempCmdName))) {
+			if ((status = StreamTempCToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, quatCmdName, strlen(quatCmdName))) {
+			if ((status = StreamQuaternionToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, eulerCmdName, strlen(eulerCmdName))) {
+			if ((status = StreamEulerToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, headingCmdName, strlen(headingCmdName))) {
+			if ((status = StreamHeadingToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else if (!strncmp(pSensName, stepsCmdName, strlen(stepsCmdName))) {
+			if ((status = StreamStepCountToCLI(period, timeout)) != H0BR4_OK)
+				break;
+			
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+		}
+	
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "\r\n");
+		return pdFALSE;
+	} while (0);
+	
+	if (status == H0BR4_ERR_BANDWIDTH) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Period too short. Highest sustainable rate: %lu Hz\r\n", 
+						 (unsigned long)GetMemsStreamMaxRate());
+		return pdFALSE;
+	}
+	
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
+	return pdFALSE;
+}
+
+static portBASE_TYPE StopStreamCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	// Make sure we return something
+	pcWriteBuffer[0] = '\0';
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Stopping Streaming MEMS...\r\n");
+	
+	stopStreamMems();
+	return pdFALSE;
+}
+
+static portBASE_TYPE AcquisitionCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	const char *const pollingCmdName = "polling";
+	const char *const dutyCmdName = "duty";
+	const char *const drdyCmdName = "drdy";
+	const char *const fifoCmdName = "fifo";
+	
+	const char *pModeName = NULL;
+	portBASE_TYPE modeNameLen = 0;
+	MemsAcqMode_t mode = MEMS_ACQ_POLLING;
+	MemsPowerMode_t power = MEMS_POWER_CONTINUOUS;
+	Module_Status status = H0BR4_OK;
+	
+	const char *pParamStr = NULL;
+	portBASE_TYPE paramStrLen = 0;
+	uint16_t watermark = 0;
+	uint8_t gyroDecimation = 0, accDecimation = 0;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	pModeName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &modeNameLen);
+	
+	if (pModeName == NULL) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+		return pdFALSE;
+	}
+	
+	if (!strncmp(pModeName, pollingCmdName, strlen(pollingCmdName))) {
+		mode = MEMS_ACQ_POLLING;
+	} else if (!strncmp(pModeName, dutyCmdName, strlen(dutyCmdName))) {
+		mode = MEMS_ACQ_POLLING;
+		power = MEMS_POWER_DUTY_CYCLED;
+	} else if (!strncmp(pModeName, drdyCmdName, strlen(drdyCmdName))) {
+		mode = MEMS_ACQ_DRDY;
+	} else if (!strncmp(pModeName, fifoCmdName, strlen(fifoCmdName))) {
+		mode = MEMS_ACQ_FIFO;
+		
+		// Optional FIFO configuration: all three parameters or none
+		if ((pParamStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &paramStrLen)) != NULL) {
+			watermark = atoi(pParamStr);
+			if ((pParamStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 3, &paramStrLen)) != NULL)
+				gyroDecimation = atoi(pParamStr);
+			if ((pParamStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 4, &paramStrLen)) == NULL) {
+				snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+				return pdFALSE;
+			}
+			accDecimation = atoi(pParamStr);
+			
+			if (SetMemsFifoConfig(watermark, gyroDecimation, accDecimation) != H0BR4_OK) {
+				snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+				return pdFALSE;
+			}
+		}
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+		return pdFALSE;
+	}
+	
+	// Sensors run before leaving polling and are powered down only once polling
+	if (power == MEMS_POWER_DUTY_CYCLED) {
+		if ((status = SetMemsAcquisitionMode(mode)) == H0BR4_OK)
+			status = SetMemsPowerMode(power);
+	} else {
+		if ((status = SetMemsPowerMode(power)) == H0BR4_OK)
+			status = SetMemsAcquisitionMode(mode);
+	}
+	
+	if (status != H0BR4_OK)
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+	else if (mode == MEMS_ACQ_POLLING && MemsFiltersSet())
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "MEMS acquisition mode: %.*s, filters paused\r\n", (int)modeNameLen, pModeName);
+	else
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "MEMS acquisition mode: %.*s\r\n", (int)modeNameLen, pModeName);
+	
+	return pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static portBASE_TYPE I2CSpeedCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	const char *pSpeedStr = NULL;
+	portBASE_TYPE speedStrLen = 0;
+	Module_Status status = H0BR4_OK;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	pSpeedStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &speedStrLen);
+	
+	if (pSpeedStr != NULL && !strncmp(pSpeedStr, "bench", speedStrLen)) {
+		uint32_t blockingUs = 0, asyncUs = 0;
+		
+		if (BenchmarkMemsI2C(&blockingUs, &asyncUs) != H0BR4_OK)
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
+		else
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "IMU read at %u kHz | CPU blocking: %lu us, interrupt-driven: %lu us\r\n", 
+							 GetMemsI2CSpeed(), (unsigned long)blockingUs, (unsigned long)asyncUs);
+		return pdFALSE;
+	}
+	
+	if (pSpeedStr != NULL) {
+		status = SetMemsI2CSpeed(atoi(pSpeedStr));
+		
+		if (status == H0BR4_ERR_WrongParams) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+		if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Sensors not responding. MEMS I2C speed: %u kHz\r\n", 
+							 GetMemsI2CSpeed());
+			return pdFALSE;
+		}
+	}
+	
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "MEMS I2C speed: %u kHz\r\n", GetMemsI2CSpeed());
+	return pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static portBASE_TYPE MemsConfigCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	const char *const gyroCmdName = "gyro";
+	const char *const accCmdName = "acc";
+	const char *const magCmdName = "mag";
+	const char *const declinationCmdName = "declination";
+	const char *const acc2CmdName = "acc2";
+	const char *const accChannelCmdName = "accchannel";
+	const char *const acc2ModeNames[] = { "off", "lp", "normal", "hr" };
+	
+	const char *pSensName = NULL;
+	portBASE_TYPE sensNameLen = 0;
+	const char *pParamStr[3] = { NULL, NULL, NULL };
+	portBASE_TYPE paramStrLen = 0;
+	Module_Status status = H0BR4_ERR_WrongParams;
+	
+	uint16_t gyroOdr = 0, gyroFs = 0, accOdr = 0, accBw = 0, acc2Odr = 0, tolerance = 0;
+	uint8_t accFs = 0, magOdr = 0, acc2Fs = 0, i = 0;
+	Lsm303AccMode_t mode = LSM303_ACC_POWER_DOWN;
+	uint32_t mismatches = 0;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	pSensName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &sensNameLen);
+	
+	for (i = 0; i < 3; i++)
+		pParamStr[i] = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, i + 2, &paramStrLen);
+	
+	if (pSensName != NULL) {
+		if (!strncmp(pSensName, gyroCmdName, strlen(gyroCmdName)) && pParamStr[1] != NULL) {
+			status = SetGyroConfig(atoi(pParamStr[0]), atoi(pParamStr[1]));
+		} else if (!strncmp(pSensName, acc2CmdName, strlen(acc2CmdName)) && pParamStr[2] != NULL) {
+			// Checked before acc, which is a prefix of it
+			for (i = 0; i < TABLE_SIZE(acc2ModeNames) && strncmp(pParamStr[0], acc2ModeNames[i], strlen(acc2ModeNames[i])); i++);
+			if (i < TABLE_SIZE(acc2ModeNames))
+				status = SetLsm303AccConfig((Lsm303AccMode_t)i, atoi(pParamStr[1]), atoi(pParamStr[2]));
+		} else if (!strncmp(pSensName, accChannelCmdName, strlen(accChannelCmdName)) && pParamStr[0] != NULL) {
+			if (!strncmp(pParamStr[0], "lsm6ds3", 7))
+				status = SetAccChannel(MEMS_ACC_LSM6DS3);
+			else if (!strncmp(pParamStr[0], "lsm303", 6))
+				status = SetAccChannel(MEMS_ACC_LSM303AGR);
+			if (status == H0BR4_OK && pParamStr[1] != NULL)
+				status = SetAccCrossCheck(atoi(pParamStr[1]));
+		} else if (!strncmp(pSensName, accCmdName, strlen(accCmdName)) && pParamStr[2] != NULL) {
+			status = SetAccConfig(atoi(pParamStr[0]), atoi(pParamStr[1]), atoi(pParamStr[2]));
+		} else if (!strncmp(pSensName, magCmdName, strlen(magCmdName)) && pParamStr[0] != NULL) {
+			status = SetMagConfig(atoi(pParamStr[0]));
+		} else if (!strncmp(pSensName, declinationCmdName, strlen(declinationCmdName)) && pParamStr[0] != NULL) {
+			status = SetMagDeclination(atof(pParamStr[0]));
+		}
+		
+		if (status == H0BR4_ERR_WrongParams) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		} else if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
+		}
+	}
+	
+	GetGyroConfig(&gyroOdr, &gyroFs);
+	GetAccConfig(&accOdr, &accFs, &accBw);
+	GetMagConfig(&magOdr);
+	GetLsm303AccConfig(&mode, &acc2Odr, &acc2Fs);
+	GetAccCrossCheck(&tolerance, &mismatches);
+	
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Gyro | ODR: %u Hz, FS: %u dps\r\nAcc | ODR: %u Hz, FS: %u g, BW: %u Hz\r\n\
+Mag | ODR: %u Hz, FS: 50 gauss, Declination: %.1f deg\r\nAcc2 | Mode: %s, ODR: %u Hz, FS: %u g\r\n\
+Acc channel: %s, Cross-check: %u mg, Mismatches: %lu\r\n", gyroOdr, gyroFs, accOdr, accFs, accBw, magOdr, GetMagDeclination(), 
+					 acc2ModeNames[mode], acc2Odr, acc2Fs, (GetAccChannel() == MEMS_ACC_LSM303AGR) ? "lsm303" : "lsm6ds3", tolerance, 
+					 (unsigned long)mismatches);
+	return pdFALSE;
 }
 
-Module_Status StreamMagMGaussToBuffer(float *buffer, uint32_t period, uint32_t timeout)
-{
-	return StreamMemsToBuf(buffer, sizeof(*buffer) * 3, period, timeout, SampleMagMGaussToBuf);
-}
+/*-----------------------------------------------------------*/
 
-Module_Status StreamTempCToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout)
+#if H0BR4_ENABLE_CONVBENCH
+static portBASE_TYPE ConvBenchCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	return StreamMemsToPort(port, module, period, timeout, SampleTempCToPort);
+	uint32_t floatCycles = 0, fixedCycles = 0;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	BenchmarkMemsConversion(&floatCycles, &fixedCycles);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Gyro conversion cycles | float: %lu, Q16.16: %lu\r\n", 
+					 (unsigned long)floatCycles, (unsigned long)fixedCycles);
+	return pdFALSE;
 }
+#endif
 
-Module_Status StreamTempCToCLI(uint32_t period, uint32_t timeout)
+/*-----------------------------------------------------------*/
+
+static portBASE_TYPE FusionCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	return StreamMemsToCLI(period, timeout, SampleTempCToString);
+	const char *const startCmdName = "start";
+	const char *const stopCmdName = "stop";
+	
+	const char *pActionName = NULL;
+	portBASE_TYPE actionNameLen = 0;
+	const char *pRateStr = NULL;
+	portBASE_TYPE rateStrLen = 0;
+	uint16_t rateHz = FUSION_DEFAULT_RATE_HZ;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	pActionName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &actionNameLen);
+	
+	if (pActionName != NULL) {
+		if (!strncmp(pActionName, startCmdName, strlen(startCmdName))) {
+			if ((pRateStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &rateStrLen)) != NULL)
+				rateHz = atoi(pRateStr);
+			
+			if (StartFusion(rateHz) != H0BR4_OK) {
+				snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+				return pdFALSE;
+			}
+		} else if (!strncmp(pActionName, stopCmdName, strlen(stopCmdName))) {
+			StopFusion();
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+	}
+	
+	if (GetFusionRate())
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Fusion: running at %u Hz\r\n", GetFusionRate());
+	else
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Fusion: stopped\r\n");
+	return pdFALSE;
 }
 
-Module_Status StreamTempCToBuffer(float *buffer, uint32_t period, uint32_t timeout)
+/*-----------------------------------------------------------*/
+
+static portBASE_TYPE MagCalCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	return StreamMemsToBuf(buffer, sizeof(*buffer), period, timeout, SampleTempCelsius);
+	const char *const startCmdName = "start";
+	const char *const clearCmdName = "clear";
+	
+	const char *pActionName = NULL;
+	portBASE_TYPE actionNameLen = 0;
+	const char *pTimeStr = NULL;
+	portBASE_TYPE timeStrLen = 0;
+	uint32_t seconds = 30;
+	Module_Status status = H0BR4_OK;
+	MagCalibration_t cal;
+	MemsStreamJob_t job = { .kind = MEMS_JOB_MAG_CAL };
+	int len = 0;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	pActionName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &actionNameLen);
+	
+	if (pActionName != NULL) {
+		if (!strncmp(pActionName, startCmdName, strlen(startCmdName))) {
+			if ((pTimeStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &timeStrLen)) != NULL)
+				seconds = atoi(pTimeStr);
+			
+			// Collected on the stream job task: the CLI is free meanwhile
+			job.period = seconds * 1000;
+			if (seconds > UINT32_MAX / 1000)
+				status = H0BR4_ERR_WrongParams;
+			else if ((status = StartStreamJob(&job)) == H0BR4_OK) {
+				snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Rotate the module in all directions for %lu s\r\n", 
+								 (unsigned long)seconds);
+				return pdFALSE;
+			}
+		} else if (!strncmp(pActionName, clearCmdName, strlen(clearCmdName))) {
+			status = ClearMagCalibration();
+		} else {
+			status = H0BR4_ERR_WrongParams;
+		}
+		
+		if (status == H0BR4_ERR_WrongParams) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		} else if (status == H0BR4_ERR_BUSY) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Busy: a stream job or calibration is running\r\n");
+			return pdFALSE;
+		} else if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
+		}
+	}
+	
+	if (magCalStatus == H0BR4_ERR_BUSY) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Mag calibration | collecting\r\n");
+		return pdFALSE;
+	} else if (magCalStatus == H0BR4_ERR_MAG) {
+		// The previous calibration stays in use
+		len = snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Last calibration failed: rotate the module in all directions\r\n");
+	}
+	
+	if (GetMagCalibration(&cal) != H0BR4_OK) {
+		snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Mag calibration | none\r\n");
+		return pdFALSE;
+	}
+	
+	snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Mag calibration | Offset(LSB) X: %d, Y: %d, Z: %d\r\n\
+Soft iron | XX: %.3f, YY: %.3f, ZZ: %.3f, XY: %.3f, XZ: %.3f, YZ: %.3f\r\n", cal.offset[0], cal.offset[1], cal.offset[2], 
+					 cal.softIron[0] / 16384.0f, cal.softIron[1] / 16384.0f, cal.softIron[2] / 16384.0f, 
+					 cal.softIron[3] / 16384.0f, cal.softIron[4] / 16384.0f, cal.softIron[5] / 16384.0f);
+	return pdFALSE;
 }
 
-void stopStreamMems(void)
+/*-----------------------------------------------------------*/
+
+static portBASE_TYPE GyroBiasCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	stopStream = true;
+	const char *const onCmdName = "on";
+	const char *const offCmdName = "off";
+	const char *const clearCmdName = "clear";
+	
+	const char *pActionName = NULL;
+	portBASE_TYPE actionNameLen = 0;
+	float x = 0, y = 0, z = 0;
+	Module_Status status = H0BR4_OK;
+	
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
+	
+	pActionName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &actionNameLen);
+	
+	if (pActionName != NULL) {
+		if (!strncmp(pActionName, onCmdName, strlen(onCmdName))) {
+			status = SetGyroBiasAuto(true);
+		} else if (!strncmp(pActionName, offCmdName, strlen(offCmdName))) {
+			status = SetGyroBiasAuto(false);
+		} else if (!strncmp(pActionName, clearCmdName, strlen(clearCmdName))) {
+			status = ClearGyroBias();
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+		
+		if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
+		}
+	}
+	
+	GetGyroBias(&x, &y, &z);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Gyro bias(DPS) | X: %.3f, Y: %.3f, Z: %.3f, learning %s\r\n", 
+					 x, y, z, GetGyroBiasAuto() ? "on" : "off");
+	return pdFALSE;
 }
 
-/* -----------------------------------------------------------------------
-	|															Commands																 	|
-   ----------------------------------------------------------------------- 
-*/
+/*-----------------------------------------------------------*/
 
-static portBASE_TYPE SampleSensorCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+static portBASE_TYPE MotionCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	const char *const gyroCmdName = "gyro";
-	const char *const accCmdName = "acc";
-	const char *const magCmdName = "mag";
-	const char *const tempCmdName = "temp";
+	const char *const onCmdName = "on";
+	const char *const offCmdName = "off";
+	const char *const lineCmdName = "line";
+	const char *const thresholdsCmdName = "thresholds";
+	const char *const reportCmdName = "report";
+	// In MEMS_MOTION_* bit order
+	const char *const eventNames[] = { "wakeup", "freefall", "tap", "doubletap", "6d", "tilt", "sigmotion", "step" };
 	
-	const char *pSensName = NULL;
-	portBASE_TYPE sensNameLen = 0;
+	const char *pActionName = NULL;
+	portBASE_TYPE actionNameLen = 0;
+	const char *pParamStr[3] = { NULL, NULL, NULL };
+	portBASE_TYPE paramStrLen = 0;
+	Module_Status status = H0BR4_ERR_WrongParams;
+	uint16_t wakeUp = 0, freeFall = 0, tap = 0;
+	uint8_t events = 0, line = 0, last = 0, i = 0;
+	uint32_t count = 0;
 	
 	// Make sure we return something
 	*pcWriteBuffer = '\0';
 	
-	pSensName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &sensNameLen);
+	pActionName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &actionNameLen);
 	
-	if (pSensName == NULL) {
-		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
-		return pdFALSE;
-	}
+	for (i = 0; i < 3; i++)
+		pParamStr[i] = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, i + 2, &paramStrLen);
 	
-	do {
-		if (!strncmp(pSensName, gyroCmdName, strlen(gyroCmdName))) {
-			if (SampleGyroDPSToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
-				break;
-			
-		} else if (!strncmp(pSensName, accCmdName, strlen(accCmdName))) {
-			if (SampleAccGToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
-				break;
+	GetMotionEvents(&events, &line);
+	
+	if (pActionName != NULL) {
+		if ((!strncmp(pActionName, onCmdName, strlen(onCmdName)) || !strncmp(pActionName, offCmdName, strlen(offCmdName))) && 
+				pParamStr[0] != NULL) {
+			for (i = 0; i < TABLE_SIZE(eventNames) && strncmp(pParamStr[0], eventNames[i], strlen(eventNames[i])); i++);
+			if (i < TABLE_SIZE(eventNames)) {
+				if (!strncmp(pActionName, onCmdName, strlen(onCmdName)))
+					events |= (1U << i);
+				else
+					events &= ~(1U << i);
+				status = SetMotionEvents(events, line);
+			}
+		} else if (!strncmp(pActionName, lineCmdName, strlen(lineCmdName)) && pParamStr[0] != NULL) {
+			status = SetMotionEvents(events, atoi(pParamStr[0]));
+		} else if (!strncmp(pActionName, thresholdsCmdName, strlen(thresholdsCmdName)) && pParamStr[2] != NULL) {
+			status = SetMotionThresholds(atoi(pParamStr[0]), atoi(pParamStr[1]), atoi(pParamStr[2]));
+		} else if (!strncmp(pActionName, reportCmdName, strlen(reportCmdName)) && pParamStr[1] != NULL) {
+			status = SetMotionEventReport(atoi(pParamStr[0]), atoi(pParamStr[1]));
+		}
 		
-		} else if (!strncmp(pSensName, magCmdName, strlen(magCmdName))) {
-			if (SampleMagMGaussToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
-				break;
-			
-		} else if (!strncmp(pSensName, tempCmdName, strlen(tempCmdName))) {
-			if (SampleTempCToString((char *)pcWriteBuffer, xWriteBufferLen) != H0BR4_OK)
-				break;
-			
-		} else {
+		if (status == H0BR4_ERR_WrongParams) {
 			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		} else if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
 		}
+	}
 	
-		return pdFALSE;
-	} while (0);
+	GetMotionEvents(&events, &line);
+	GetMotionThresholds(&wakeUp, &freeFall, &tap);
+	count = GetMotionEventCount(&last);
 	
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion events: 0x%02X on IMU_INT%u, last 0x%02X, count %lu\r\n\
+Thresholds | Wake-up: %u mg, Free-fall: %u mg, Tap: %u mg\r\n", events, line, last, (unsigned long)count, wakeUp, freeFall, tap);
 	return pdFALSE;
 }
 
-// Port Mode => false and CLI Mode => true
-static bool StreamCommandParser(const int8_t *pcCommandString, const char **ppSensName, portBASE_TYPE *pSensNameLen, 
-														bool *pPortOrCLI, uint32_t *pPeriod, uint32_t *pTimeout, uint8_t *pPort, uint8_t *pModule)
+static portBASE_TYPE PedometerCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	const char *pPeriodMSStr = NULL;
-	const char *pTimeoutMSStr = NULL;
-	
-	portBASE_TYPE periodStrLen = 0;
-	portBASE_TYPE timeoutStrLen = 0;
-	
-	const char *pPortStr = NULL;
-	const char *pModStr = NULL;
+	const char *const onCmdName = "on";
+	const char *const offCmdName = "off";
+	const char *const resetCmdName = "reset";
 	
-	portBASE_TYPE portStrLen = 0;
-	portBASE_TYPE modStrLen = 0;
+	const char *pActionName = NULL;
+	portBASE_TYPE actionNameLen = 0;
+	const char *pDebounceStr = NULL;
+	portBASE_TYPE debounceStrLen = 0;
+	Module_Status status = H0BR4_ERR_WrongParams;
+	bool enabled = false;
+	uint8_t debounce = 0;
+	uint32_t steps = 0;
 	
-	*ppSensName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, pSensNameLen);
-	pPeriodMSStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &periodStrLen);
-	pTimeoutMSStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 3, &timeoutStrLen);
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
 	
-	// At least 3 Parameters are required!
-	if ((*ppSensName == NULL) || (pPeriodMSStr == NULL) || (pTimeoutMSStr == NULL))
-		return false;
+	pActionName = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &actionNameLen);
+	pDebounceStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &debounceStrLen);
 	
-	// TODO: Check if Period and Timeout are integers or not!
-	*pPeriod = atoi(pPeriodMSStr);
-	*pTimeout = atoi(pTimeoutMSStr);
-	*pPortOrCLI = true;
+	GetPedometer(&enabled, &debounce);
+	if (pDebounceStr != NULL)
+		debounce = atoi(pDebounceStr);
 	
-	pPortStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 4, &portStrLen);
-	pModStr = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 5, &modStrLen);
+	if (pActionName != NULL) {
+		if (!strncmp(pActionName, onCmdName, strlen(onCmdName))) {
+			status = SetPedometer(true, debounce);
+		} else if (!strncmp(pActionName, offCmdName, strlen(offCmdName))) {
+			status = SetPedometer(false, debounce);
+		} else if (!strncmp(pActionName, resetCmdName, strlen(resetCmdName))) {
+			status = ResetStepCount();
+		}
+		
+		if (status == H0BR4_ERR_WrongParams) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		} else if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
+		}
+	}
 	
-	if ((pModStr == NULL) && (pPortStr == NULL))
-		return true;
-	if ((pModStr == NULL) || (pPortStr == NULL))	// If user has provided 4 Arguments.
-		return false;
+	GetPedometer(&enabled, &debounce);
+	if (!enabled) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Pedometer: off, debounce %u steps\r\n", debounce);
+		return pdFALSE;
+	}
 	
-	*pPort = atoi(pPortStr);
-	*pModule = atoi(pModStr);
-	*pPortOrCLI = false;
+	if (SampleStepCount(&steps) != H0BR4_OK) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
+		return pdFALSE;
+	}
 	
-	return true;
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Pedometer: on, debounce %u steps, %lu steps\r\n", debounce, (unsigned long)steps);
+	return pdFALSE;
 }
 
-static portBASE_TYPE StreamSensorCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+static portBASE_TYPE FilterCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	const char *const gyroCmdName = "gyro";
-	const char *const accCmdName = "acc";
-	const char *const magCmdName = "mag";
-	const char *const tempCmdName = "temp";
+	// In MemsFilterChannel_t and MemsFilterType_t order
+	const char *const channelNames[] = { "gyro", "acc", "mag" };
+	const char *const typeNames[] = { "none", "avg", "lp1", "hp1", "lp2", "hp2", "fir" };
 	
-	uint32_t period = 0;
-	uint32_t timeout = 0;
-	uint8_t port = 0;
-	uint8_t module = 0;
+	const char *pParamStr[4] = { NULL, NULL, NULL, NULL };
+	portBASE_TYPE paramStrLen = 0;
+	Module_Status status = H0BR4_OK;
+	MemsFilterType_t type = MEMS_FILTER_NONE;
+	uint16_t param = 0;
+	uint8_t decimation = 1, channel = 0, i = 0;
+	int len = 0;
 	
-	bool portOrCLI = true; // Port Mode => false and CLI Mode => true
+	// Make sure we return something
+	*pcWriteBuffer = '\0';
 	
-	const char *pSensName = NULL;
-	portBASE_TYPE sensNameLen = 0;
+	for (i = 0; i < 4; i++)
+		pParamStr[i] = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, i + 1, &paramStrLen);
+	
+	if (pParamStr[0] != NULL) {
+		for (channel = 0; channel < TABLE_SIZE(channelNames) && strncmp(pParamStr[0], channelNames[channel], strlen(channelNames[channel])); channel++);
+		for (i = 0; pParamStr[1] != NULL && i < TABLE_SIZE(typeNames) && strncmp(pParamStr[1], typeNames[i], strlen(typeNames[i])); i++);
+		
+		if (channel == TABLE_SIZE(channelNames) || pParamStr[1] == NULL || i == TABLE_SIZE(typeNames)) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+		
+		type = (MemsFilterType_t)i;
+		if (pParamStr[2] != NULL)
+			param = atoi(pParamStr[2]);
+		if (pParamStr[3] != NULL)
+			decimation = atoi(pParamStr[3]);
+		
+		if ((status = SetMemsFilter((MemsFilterChannel_t)channel, type, param, decimation)) == H0BR4_ERR_WrongParams) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		} else if (status == H0BR4_ERR_BUSY) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Filters need drdy or fifo acquisition: select one first\r\n");
+			return pdFALSE;
+		} else if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
+		}
+	}
+	
+	for (channel = 0; channel < TABLE_SIZE(channelNames) && len < (int)xWriteBufferLen; channel++) {
+		GetMemsFilter((MemsFilterChannel_t)channel, &type, &param, &decimation);
+		len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "%s | %s %u, decimation %u (%u Hz in)\r\n", 
+										channelNames[channel], typeNames[type], param, decimation, MemsFilterInputHz((MemsFilterChannel_t)channel));
+	}
+	
+	if (GetMemsAcquisitionMode() == MEMS_ACQ_POLLING && len < (int)xWriteBufferLen)
+		snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Paused in polling acquisition\r\n");
+	
+	return pdFALSE;
+}
+
+static portBASE_TYPE ReportCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	// In MemsReportChannel_t order
+	const char *const channelNames[] = { "gyro", "acc", "mag", "temp" };
+	
+	const char *pParamStr[5] = { NULL, NULL, NULL, NULL, NULL };
+	portBASE_TYPE paramStrLen = 0;
+	Module_Status status = H0BR4_OK;
+	MemsReportConfig_t config;
+	uint8_t channel = 0, i = 0;
+	int len = 0;
 	
 	// Make sure we return something
 	*pcWriteBuffer = '\0';
 	
-	if (!StreamCommandParser(pcCommandString, &pSensName, &sensNameLen, &portOrCLI, &period, &timeout, &port, &module)) {
-		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
-		return pdFALSE;
-	}
+	for (i = 0; i < 5; i++)
+		pParamStr[i] = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, i + 1, &paramStrLen);
 	
-	do {
-		if (!strncmp(pSensName, gyroCmdName, strlen(gyroCmdName))) {
-			if (portOrCLI) {
-				if (StreamGyroDPSToCLI(period, timeout) != H0BR4_OK)
-					break;
-			} else {
-				if (StreamGyroDPSToPort(port, module, period, timeout) != H0BR4_OK)
-					break;
-			}
-			
-		} else if (!strncmp(pSensName, accCmdName, strlen(accCmdName))) {
-			if (portOrCLI) {
-				if (StreamAccGToCLI(period, timeout) != H0BR4_OK)
-					break;
-			} else {
-				if (StreamAccGToPort(port, module, period, timeout) != H0BR4_OK)
-					break;
-			}
-			
-		} else if (!strncmp(pSensName, magCmdName, strlen(magCmdName))) {
-			if (portOrCLI) {
-				if (StreamMagMGaussToCLI(period, timeout) != H0BR4_OK)
-					break;
-			} else {
-				if (StreamMagMGaussToPort(port, module, period, timeout) != H0BR4_OK)
-					break;
-			}
-			
-		} else if (!strncmp(pSensName, tempCmdName, strlen(tempCmdName))) {
-			if (portOrCLI) {
-				if (StreamTempCToCLI(period, timeout) != H0BR4_OK)
-					break;
-			} else {
-				if (StreamTempCToPort(port, module, period, timeout) != H0BR4_OK)
-					break;
-			}
-			
+	if (pParamStr[0] != NULL) {
+		for (channel = 0; channel < TABLE_SIZE(channelNames) && strncmp(pParamStr[0], channelNames[channel], strlen(channelNames[channel])); channel++);
+		
+		if (channel == TABLE_SIZE(channelNames) || pParamStr[1] == NULL) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+		
+		if (!strncmp(pParamStr[1], "off", 3)) {
+			status = SetMemsReport((MemsReportChannel_t)channel, NULL);
 		} else {
+			// One deadband for all axes, or X,Y,Z
+			memset(&config, 0, sizeof(config));
+			if (sscanf(pParamStr[1], "%f,%f,%f", &config.deadband[0], &config.deadband[1], &config.deadband[2]) == 1)
+				config.deadband[1] = config.deadband[2] = config.deadband[0];
+			if (pParamStr[2] != NULL)
+				config.hysteresis = (atoi(pParamStr[2]) > UINT8_MAX) ? UINT8_MAX : atoi(pParamStr[2]);
+			if (pParamStr[3] != NULL)
+				config.minIntervalMs = atoi(pParamStr[3]);
+			if (pParamStr[4] != NULL)
+				config.maxIntervalMs = atoi(pParamStr[4]);
+			status = SetMemsReport((MemsReportChannel_t)channel, &config);
+		}
+		
+		if (status == H0BR4_ERR_WrongParams) {
 			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		} else if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
 		}
+	}
 	
-		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "\r\n");
-		return pdFALSE;
-	} while (0);
+	for (channel = 0; channel < TABLE_SIZE(channelNames) && len < (int)xWriteBufferLen; channel++) {
+		if (!GetMemsReport((MemsReportChannel_t)channel, &config)) {
+			len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "%s | every sample\r\n", channelNames[channel]);
+			continue;
+		}
+		len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "%s | deadband %.3f, %.3f, %.3f, hysteresis %u%%, %u to %u ms\r\n", 
+										channelNames[channel], config.deadband[0], config.deadband[1], config.deadband[2], config.hysteresis, 
+										config.minIntervalMs, config.maxIntervalMs);
+	}
 	
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error reading Sensor\r\n");
 	return pdFALSE;
 }
 
-static portBASE_TYPE StopStreamCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+#if H0BR4_ENABLE_SLOTS
+static portBASE_TYPE SlotCommand(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
+	// In MemsStreamSensor_t and MemsStreamFormat_t order
+	const char *const sensorNames[] = { "gyro", "acc", "mag", "temp", "quat", "euler", "heading", "steps" };
+	const char *const formatNames[] = { "float", "q16", "text" };
+	
+	const char *pParamStr[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+	portBASE_TYPE paramStrLen = 0;
+	Module_Status status = H0BR4_OK;
+	MemsStreamSlot_t slot;
+	MemsStreamTiming_t timing;
+	uint8_t sensor = 0, format = 0, index = 0, i = 0;
+	int len = 0;
+	
 	// Make sure we return something
-	pcWriteBuffer[0] = '\0';
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Stopping Streaming MEMS...\r\n");
+	*pcWriteBuffer = '\0';
+	
+	for (i = 0; i < 6; i++)
+		pParamStr[i] = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, i + 1, &paramStrLen);
+	
+	if (pParamStr[0] != NULL && !strncmp(pParamStr[0], "stop", 4)) {
+		if (pParamStr[1] == NULL) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+		StopMemsStreamSlot(strncmp(pParamStr[1], "all", 3) ? atoi(pParamStr[1]) : H0BR4_STREAM_SLOTS);
+		
+	} else if (pParamStr[0] != NULL && !strncmp(pParamStr[0], "timing", 6)) {
+		for (index = 0; index <= H0BR4_STREAM_TIMING_JOB && len < (int)xWriteBufferLen; index++) {
+			GetMemsStreamTiming(index, &timing);
+			if (index < H0BR4_STREAM_SLOTS)
+				len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Slot %u", index);
+			else if (index < H0BR4_STREAM_TIMING_JOB && timing.task == NULL)
+				continue;
+			else if (index < H0BR4_STREAM_TIMING_JOB)
+				len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Task %u", index - H0BR4_STREAM_TIMING_API);
+			else
+				len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Jobs");
+			if (len < (int)xWriteBufferLen)
+				len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, " | %lu samples, %lu missed, jitter %ld to %ld us, mean %ld us\r\n", 
+												(unsigned long)timing.samples, (unsigned long)timing.missed, (long)timing.jitterMinUs, 
+												(long)timing.jitterMaxUs, (long)timing.jitterMeanUs);
+		}
+		return pdFALSE;
+		
+	} else if (pParamStr[0] != NULL) {
+		for (sensor = 0; sensor < TABLE_SIZE(sensorNames) && strncmp(pParamStr[0], sensorNames[sensor], strlen(sensorNames[sensor])); sensor++);
+		
+		// Port and module come together. Binary by default on a port
+		format = MEMS_STREAM_FORMAT_FLOAT;
+		if (pParamStr[5] != NULL)
+			for (format = 0; format < TABLE_SIZE(formatNames) && strncmp(pParamStr[5], formatNames[format], strlen(formatNames[format])); format++);
+		if (sensor == TABLE_SIZE(sensorNames) || format == TABLE_SIZE(formatNames) || pParamStr[1] == NULL || pParamStr[2] == NULL || 
+				((pParamStr[3] == NULL) != (pParamStr[4] == NULL))) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		}
+		
+		slot.sensor = (MemsStreamSensor_t)sensor;
+		slot.format = (MemsStreamFormat_t)format;
+		slot.period = atoi(pParamStr[1]);
+		slot.timeout = atoi(pParamStr[2]);
+		slot.port = (pParamStr[3] != NULL) ? atoi(pParamStr[3]) : 0;
+		slot.module = (pParamStr[4] != NULL) ? atoi(pParamStr[4]) : myID;
+		slot.ring = NULL;
+		
+		if ((status = StartMemsStreamSlot(&slot, &index)) == H0BR4_ERR_WrongParams) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid Arguments\r\n");
+			return pdFALSE;
+		} else if (status == H0BR4_ERR_BUSY) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "No free slot\r\n");
+			return pdFALSE;
+		} else if (status == H0BR4_ERR_BANDWIDTH) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Period too short. Highest sustainable rate: %lu Hz\r\n", 
+							 (unsigned long)GetMemsStreamMaxRate());
+			return pdFALSE;
+		} else if (status != H0BR4_OK) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Error configuring Sensor\r\n");
+			return pdFALSE;
+		}
+	}
+	
+	for (index = 0; index < H0BR4_STREAM_SLOTS && len < (int)xWriteBufferLen; index++) {
+		if (GetMemsStreamSlot(index, &slot) != H0BR4_OK) {
+			len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Slot %u | off\r\n", index);
+			continue;
+		}
+		if (slot.ring != NULL) {
+			len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Slot %u | %s every %lu ms to a ring, %lu dropped\r\n", 
+											index, sensorNames[slot.sensor], (unsigned long)slot.period, (unsigned long)slot.ring->dropped);
+			continue;
+		}
+		if (slot.port == 0) {
+			len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Slot %u | %s every %lu ms to the CLI\r\n", 
+											index, sensorNames[slot.sensor], (unsigned long)slot.period);
+			continue;
+		}
+		len += snprintf((char *)pcWriteBuffer + len, xWriteBufferLen - len, "Slot %u | %s every %lu ms to P%u of module %u as %s\r\n", 
+										index, sensorNames[slot.sensor], (unsigned long)slot.period, slot.port, slot.module, formatNames[slot.format]);
+	}
 	
-	stopStreamMems();
 	return pdFALSE;
 }
+#endif
 
 /************************ (C) COPYRIGHT HEXABITZ *****END OF FILE****/
@@ -18,6 +18,7 @@
 #include "H0BR4_i2c.h"
 #include "H0BR4_gpio.h"	
 #include "H0BR4_dma.h"		
+#include "H0BR4_ring.h"
 	
 /* Exported definitions -------------------------------------------------------*/
 
@@ -43,6 +44,23 @@
 #define _Usart5 1
 #define _Usart6	1
 
+/* Optional features. Define one as 0 (here or in the project C defines) to leave it out of the image 
+	 with its APIs, messages and CLI commands. Without stream slots, streams requested by message or to a 
+	 port from the CLI run in the requesting task until they end. The FFT of H0BR4_dsp.c needs no switch: 
+	 the linker removes it once unreferenced (one ELF section per function). */
+#ifndef H0BR4_ENABLE_FFT
+#define H0BR4_ENABLE_FFT				1			// Acc vibration spectrum
+#endif
+#ifndef H0BR4_ENABLE_STATS
+#define H0BR4_ENABLE_STATS			1			// Window statistics streams
+#endif
+#ifndef H0BR4_ENABLE_SLOTS
+#define H0BR4_ENABLE_SLOTS			1			// Stream slots and their scheduler task
+#endif
+#ifndef H0BR4_ENABLE_CONVBENCH
+#define H0BR4_ENABLE_CONVBENCH	1			// Raw conversion benchmark
+#endif
+
 /* Port-UART mapping */
 #define P1uart &huart4	
 #define P2uart &huart2
@@ -129,8 +147,285 @@ typedef enum
 	H0BR4_ERR_IO,
 	H0BR4_ERR_TERMINATED,
 	H0BR4_ERR_WrongParams,
+	H0BR4_ERR_BANDWIDTH,
+	H0BR4_ERR_FUSION,
 	H0BR4_ERROR = 25} Module_Status;
 
+/* MEMS acquisition modes */
+typedef enum
+{
+	MEMS_ACQ_POLLING = 0,			// Sensors are read on demand by the caller
+	MEMS_ACQ_DRDY,						// Sensors are read by the acquisition task on each data-ready interrupt
+	MEMS_ACQ_FIFO,						// LSM6DS3 FIFO is drained in bursts on its threshold interrupt
+} MemsAcqMode_t;
+
+/* LSM6DS3 embedded motion events (mask bits) */
+#define MEMS_MOTION_WAKE_UP				0x01
+#define MEMS_MOTION_FREE_FALL			0x02
+#define MEMS_MOTION_SINGLE_TAP		0x04
+#define MEMS_MOTION_DOUBLE_TAP		0x08
+#define MEMS_MOTION_6D						0x10		// Orientation change
+#define MEMS_MOTION_TILT					0x20
+#define MEMS_MOTION_SIGNIFICANT		0x40		// Significant motion
+#define MEMS_MOTION_STEP					0x80		// Step detected by the pedometer
+#define MEMS_MOTION_ALL						0xFF
+
+/* MEMS power modes */
+typedef enum
+{
+	MEMS_POWER_CONTINUOUS = 0,		// Sensors run at their configured ODR
+	MEMS_POWER_DUTY_CYCLED,				// Sensors are powered down between samples (polling acquisition only)
+} MemsPowerMode_t;
+
+/* On-device filters, run at the input rate on samples read by the acquisition task (drdy and fifo modes) */
+typedef enum
+{
+	MEMS_FILTER_NONE = 0,
+	MEMS_FILTER_MOVING_AVG,				// Length 2 to H0BR4_FILTER_MAX_LEN samples
+	MEMS_FILTER_IIR1_LOWPASS,			// First order, cutoff in Hz
+	MEMS_FILTER_IIR1_HIGHPASS,
+	MEMS_FILTER_IIR2_LOWPASS,			// Second order Butterworth, cutoff in Hz
+	MEMS_FILTER_IIR2_HIGHPASS,
+	MEMS_FILTER_FIR_LOWPASS,			// H0BR4_FILTER_MAX_LEN - 1 taps, Hamming windowed, cutoff in Hz
+} MemsFilterType_t;
+
+typedef enum
+{
+	MEMS_FILTER_GYRO = 0,
+	MEMS_FILTER_ACC,
+	MEMS_FILTER_MAG,
+} MemsFilterChannel_t;
+
+#define H0BR4_FILTER_MAX_LEN				16
+#define H0BR4_FILTER_MAX_DECIMATION	64
+
+/* Streams with change-triggered reporting, in the order of the first MemsStreamSensor_t */
+typedef enum
+{
+	MEMS_REPORT_GYRO = 0,
+	MEMS_REPORT_ACC,
+	MEMS_REPORT_MAG,
+	MEMS_REPORT_TEMP,
+	MEMS_REPORT_NONE,							// Every sample is sent
+} MemsReportChannel_t;
+
+/* A sample is reported when an axis moved by its deadband since the last report, no sooner than 
+		minIntervalMs after it, and at least every maxIntervalMs as a heartbeat */
+typedef struct
+{
+	float deadband[3];						// Stream units (dps, g, mGauss, Celsius on X). 0 ignores an axis
+	uint8_t hysteresis;						// Percent of the deadband dropped while the value keeps changing
+	uint16_t minIntervalMs;
+	uint16_t maxIntervalMs;				// 0: no heartbeat
+} MemsReportConfig_t;
+
+#define H0BR4_REPORT_MAX_HYSTERESIS	90
+
+/* Statistics of one axis over a window, in stream units (dps, g or mGauss) */
+typedef struct
+{
+	float min;
+	float max;
+	float mean;
+	float rms;
+	float variance;
+	float peakToPeak;
+} MemsAxisStats_t;
+
+#define H0BR4_STATS_MAX_SAMPLES		0xFFFF		// Longer windows are closed early
+
+/* Vibration spectrum of one LSM6DS3 accelerometer axis */
+#define H0BR4_FFT_MAX_SIZE				512			// Samples of one capture
+#define H0BR4_FFT_PEAKS						5
+#define H0BR4_FFT_BANDS						8
+
+typedef enum
+{
+	MEMS_FFT_WINDOW_RECT = 0,
+	MEMS_FFT_WINDOW_HANN,
+} MemsFftWindow_t;
+
+typedef struct
+{
+	float hz;
+	float amplitude;			// mg
+} MemsFftPeak_t;
+
+typedef struct
+{
+	uint16_t size;
+	uint16_t sampleHz;
+	float binHz;
+	float binScale;				// mg per count in bins
+	uint16_t bins[H0BR4_FFT_MAX_SIZE / 2];			// Amplitude at k * binHz, size / 2 used
+	MemsFftPeak_t peaks[H0BR4_FFT_PEAKS];			// Largest first, hz is 0 when unused
+	float bandEnergy[H0BR4_FFT_BANDS];				// Mean square in mg^2 of equal bands up to Nyquist
+} MemsSpectrum_t;
+
+/* Records of StreamAccSpectrumToPort, after the sample time and record kind */
+#define H0BR4_FFT_RECORD_INFO			0				// Size, sample Hz (2 bytes each), bin Hz, bin scale
+#define H0BR4_FFT_RECORD_BINS			1				// First bin (2 bytes), then up to H0BR4_FFT_BINS_PER_RECORD bins (2 bytes each)
+#define H0BR4_FFT_RECORD_PEAK			2				// Rank, Hz, amplitude in mg
+#define H0BR4_FFT_RECORD_BAND			3				// Band, low Hz, high Hz, mean square in mg^2
+#define H0BR4_FFT_BINS_PER_RECORD	16
+
+/* Stream slots: concurrent streams served by the stream scheduler task */
+#define H0BR4_STREAM_SLOTS				4
+
+typedef enum
+{
+	MEMS_STREAM_GYRO = 0,					// dps
+	MEMS_STREAM_ACC,							// g
+	MEMS_STREAM_MAG,							// mGauss
+	MEMS_STREAM_TEMP,							// Celsius
+	MEMS_STREAM_QUAT,
+	MEMS_STREAM_EULER,						// Degrees
+	MEMS_STREAM_HEADING,					// Degrees
+	MEMS_STREAM_STEPS,
+} MemsStreamSensor_t;
+
+typedef enum
+{
+	MEMS_STREAM_FORMAT_FLOAT = 0,	// Same records as the ToPort APIs
+	MEMS_STREAM_FORMAT_Q16,				// Q16.16 records as the Q16 ToPort APIs (mag in Gauss). Not for quat and steps
+	MEMS_STREAM_FORMAT_TEXT,			// Same lines as the CLI streams, own module only
+} MemsStreamFormat_t;
+
+typedef struct
+{
+	MemsStreamSensor_t sensor;
+	MemsStreamFormat_t format;
+	uint8_t port;									// 0: the CLI, as text
+	uint8_t module;
+	uint32_t period;							// ms
+	uint32_t timeout;							// ms, 0xFFFFFFFF: until stopped
+	MemsSampleRing_t *ring;				// Not NULL: float records to this ring instead of a port or the CLI
+} MemsStreamSlot_t;
+
+/* Timing counters of a stream. Streams run on absolute deadlines: a deadline passed by a full period 
+		is skipped and counted as missed, a later one is sampled at once and counted as jitter. Stream APIs 
+		and CLI streams are counted per calling task, in H0BR4_STREAM_TIMING_CALLERS entries. */
+#define H0BR4_STREAM_TIMING_CALLERS	3
+#define H0BR4_STREAM_TIMING_API		H0BR4_STREAM_SLOTS				// First entry of the calling tasks
+#define H0BR4_STREAM_TIMING_JOB		(H0BR4_STREAM_SLOTS + H0BR4_STREAM_TIMING_CALLERS)	// Statistics and spectrum streams to a port
+
+typedef struct
+{
+	TaskHandle_t task;						// Calling task of an API entry, NULL for slots and jobs or when unused
+	uint32_t samples;
+	uint32_t missed;							// Deadlines skipped
+	int32_t jitterMinUs;					// Earliest sample against its deadline, negative when early
+	int32_t jitterMaxUs;					// Latest sample against its deadline
+	int32_t jitterMeanUs;
+} MemsStreamTiming_t;
+
+#define H0BR4_FIFO_MAX_SAMPLES		64			// 3-axis samples drained from the LSM6DS3 FIFO in one burst
+
+/* One LSM6DS3 FIFO burst demultiplexed per sensor (raw LSB) */
+typedef struct
+{
+	int16_t gyro[H0BR4_FIFO_MAX_SAMPLES][3];
+	int16_t acc[H0BR4_FIFO_MAX_SAMPLES][3];
+	uint16_t numGyro;
+	uint16_t numAcc;
+	uint32_t sequence;				// Incremented on each drained burst
+	uint32_t timestamp;				// Sensor time in us of the burst: sets are one decimated FIFO period apart
+} MemsFifoBatch_t;
+
+/* LSM6DS3 temperature, gyro and accelerometer from the same output cycle (raw LSB) */
+typedef struct
+{
+	int16_t temp;
+	int16_t gyro[3];
+	int16_t acc[3];
+	uint32_t timestamp;				// Sensor time in us
+} ImuRawSample_t;
+
+/* LSM6DS3 temperature, gyro and accelerometer from the same output cycle */
+typedef struct
+{
+	float temp;								// Celsius
+	float gyro[3];						// DPS
+	float acc[3];							// G
+	uint32_t timestamp;				// Sensor time in us
+} ImuSample_t;
+
+/* LSM303AGR accelerometer operating modes */
+typedef enum
+{
+	LSM303_ACC_POWER_DOWN = 0,
+	LSM303_ACC_LOW_POWER,			// 8-bit
+	LSM303_ACC_NORMAL,				// 10-bit
+	LSM303_ACC_HIGH_RES,			// 12-bit
+} Lsm303AccMode_t;
+
+/* Accelerometer behind the Acc APIs */
+typedef enum
+{
+	MEMS_ACC_LSM6DS3 = 0,
+	MEMS_ACC_LSM303AGR,				// Low-power channel, usable while the LSM6DS3 is powered down
+} MemsAccChannel_t;
+
+/* Magnetometer hard and soft-iron calibration: calibrated = softIron * (raw - offset) */
+typedef struct
+{
+	int16_t offset[3];				// Hard-iron offset in LSB
+	int16_t softIron[6];			// Symmetric matrix in Q2.14: XX, YY, ZZ, XY, XZ, YZ
+} MagCalibration_t;
+
+/* Signed fixed-point value with 16 integer and 16 fractional bits */
+typedef int32_t q16_16_t;
+
+#define Q16_16_ONE								(1L << 16)
+
+/* Module message codes */
+#define CODE_H0BR4_GET_IMU						1920
+#define CODE_H0BR4_SET_GYRO_CONFIG		1921
+#define CODE_H0BR4_SET_ACC_CONFIG			1922
+#define CODE_H0BR4_SET_MAG_CONFIG			1923
+#define CODE_H0BR4_STREAM_QUATERNION	1924
+#define CODE_H0BR4_STREAM_EULER				1925
+#define CODE_H0BR4_SET_FUSION					1926
+#define CODE_H0BR4_STREAM_HEADING			1927
+#define CODE_H0BR4_SET_DECLINATION		1928
+#define CODE_H0BR4_CALIBRATE_MAG			1929
+#define CODE_H0BR4_SET_GYRO_BIAS_AUTO	1930
+#define CODE_H0BR4_SET_ACC2_CONFIG		1931
+#define CODE_H0BR4_SET_ACC_CHANNEL		1932
+#define CODE_H0BR4_SET_POWER_MODE			1933
+#define CODE_H0BR4_SET_MOTION_EVENTS	1934
+#define CODE_H0BR4_SET_MOTION_THRESHOLDS	1935
+#define CODE_H0BR4_MOTION_EVENT				1936		// Sent: event mask, 6D orientation, tap source
+#define CODE_H0BR4_GET_STEPS					1937
+#define CODE_H0BR4_STREAM_STEPS				1938
+#define CODE_H0BR4_SET_PEDOMETER			1939
+#define CODE_H0BR4_RESET_STEPS				1940
+#define CODE_H0BR4_SET_FILTER					1941		// Channel, type, parameter (2 bytes), decimation
+#define CODE_H0BR4_SET_REPORT					1942		// Channel, enable, deadband X, Y, Z (2 bytes each), hysteresis, min and max interval (2 bytes each)
+#define CODE_H0BR4_STREAM_STATS				1943		// Channel, window samples (2 bytes), window ms (4 bytes), timeout (4 bytes)
+#define CODE_H0BR4_STREAM_ACC_FFT			1944		// Axis, size, sample Hz (2 bytes each), window, period, timeout (4 bytes each)
+#define CODE_H0BR4_START_SLOT					1945		// Sensor, format, port, module, period, timeout (4 bytes each)
+#define CODE_H0BR4_STOP_SLOT					1946		// Slot, H0BR4_STREAM_SLOTS or more: all
+
+/* Module EEPROM Variables */
+// Module Addressing Space 500 - 599
+#define _EE_MEMS_GYRO_CONFIG					500			// Bits 8-9: MEMS I2C bus speed, bit 10: gyro bias learning, bit 11: duty cycling
+#define _EE_MEMS_ACC_CONFIG						501
+#define _EE_MEMS_MAG_CONFIG						502
+#define _EE_MEMS_MAG_DECLINATION			503
+#define _EE_MEMS_MAG_CAL_OFFSET				504			// 3 words: X, Y, Z
+#define _EE_MEMS_MAG_CAL_SOFT_IRON		507			// 6 words: XX, YY, ZZ, XY, XZ, YZ
+#define _EE_MEMS_MAG_CAL_VALID				513
+#define _EE_MEMS_GYRO_BIAS_TABLE			514			// 48 words: X, Y, Z bias in mdps for 16 bins of 5 Celsius from -10 Celsius
+#define _EE_MEMS_ACC2_CONFIG					562
+#define _EE_MEMS_ACC_CROSS_CHECK			563
+#define _EE_MEMS_MOTION_CONFIG				564
+#define _EE_MEMS_MOTION_THRESHOLDS		565			// 3 words: wake-up, free-fall and tap in mg
+#define _EE_MEMS_MOTION_REPORT				568
+#define _EE_MEMS_PEDOMETER						569
+#define _EE_MEMS_FILTER								570			// 6 words: configuration and parameter of gyro, acc and mag
+#define _EE_MEMS_REPORT								576			// 24 words: configuration, deadband X, Y, Z, min and max interval of gyro, acc, mag and temp
+
 /* Indicator LED */
 #define _IND_LED_PORT		GPIOA
 #define _IND_LED_PIN		GPIO_PIN_11
@@ -152,6 +447,9 @@ extern void MX_USART4_UART_Init(void);
 extern void MX_USART5_UART_Init(void);
 extern void MX_USART6_UART_Init(void);
 
+/* MEMS interrupt lines, called from EXTI4_15_IRQHandler */
+extern void MEMS_EXTI_Callback(uint16_t GPIO_Pin);
+
 	
 /* -----------------------------------------------------------------------
 	|																APIs	 																 	|
@@ -189,7 +487,46 @@ Module_Status SampleTempFahrenheit(float *temp);
 Module_Status SampleTempCToPort(uint8_t port, uint8_t module);
 Module_Status SampleTempCToString(char *cstring, size_t maxLen);
 
-
+Module_Status SampleImu(ImuSample_t *sample);
+Module_Status SampleImuRaw(ImuRawSample_t *sample);
+Module_Status SampleImuToString(char *cstring, size_t maxLen);
+
+/* Q16.16 APIs for integer consumers: on the module (Sample) and on other modules (ToPort). The CLI and 
+	 buffer APIs stay float: text is formatted from float and buffer records are float words. */
+Module_Status SampleGyroDPSQ16(q16_16_t *x, q16_16_t *y, q16_16_t *z);
+Module_Status SampleAccGQ16(q16_16_t *x, q16_16_t *y, q16_16_t *z);
+Module_Status SampleMagGaussQ16(q16_16_t *x, q16_16_t *y, q16_16_t *z);
+Module_Status SampleTempCQ16(q16_16_t *temp);
+Module_Status SampleGyroDPSQ16ToPort(uint8_t port, uint8_t module);
+Module_Status SampleAccGQ16ToPort(uint8_t port, uint8_t module);
+Module_Status SampleMagGaussQ16ToPort(uint8_t port, uint8_t module);
+Module_Status SampleTempCQ16ToPort(uint8_t port, uint8_t module);
+#if H0BR4_ENABLE_CONVBENCH
+Module_Status BenchmarkMemsConversion(uint32_t *floatCycles, uint32_t *fixedCycles);
+#endif
+
+Module_Status SampleQuaternion(float *w, float *x, float *y, float *z);
+Module_Status SampleQuaternionToBuf(float *buffer);
+Module_Status SampleQuaternionToString(char *cstring, size_t maxLen);
+Module_Status SampleQuaternionToPort(uint8_t port, uint8_t module);
+Module_Status SampleEuler(float *roll, float *pitch, float *yaw);
+Module_Status SampleEulerToBuf(float *buffer);
+Module_Status SampleEulerToString(char *cstring, size_t maxLen);
+Module_Status SampleEulerToPort(uint8_t port, uint8_t module);
+Module_Status SampleHeadingQ16(q16_16_t *heading);
+Module_Status SampleHeading(float *heading);
+Module_Status SampleHeadingToString(char *cstring, size_t maxLen);
+Module_Status SampleHeadingToPort(uint8_t port, uint8_t module);
+Module_Status SampleStepCount(uint32_t *steps);
+Module_Status SampleStepCountToString(char *cstring, size_t maxLen);
+Module_Status SampleStepCountToPort(uint8_t port, uint8_t module);
+
+Module_Status SampleMemsTime(uint64_t *timeUs);
+uint64_t MemsTickToTimeUs(uint32_t tick);
+uint32_t GetMemsSampleTime(void);
+
+/* Port streams send one record per sample: the sample time in us (uint32), then the values, MSB first.
+	 Buffer streams store the sample time as a uint32_t in the first word of each record (read it with memcpy). */
 Module_Status StreamGyroDPSToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
 Module_Status StreamGyroDPSToCLI(uint32_t period, uint32_t timeout);
 Module_Status StreamGyroDPSToBuffer(float *buffer, uint32_t period, uint32_t timeout);
@@ -206,7 +543,112 @@ Module_Status StreamTempCToPort(uint8_t port, uint8_t module, uint32_t period, u
 Module_Status StreamTempCToCLI(uint32_t period, uint32_t timeout);
 Module_Status StreamTempCToBuffer(float *buffer, uint32_t period, uint32_t timeout);
 
+Module_Status StreamGyroDPSQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+Module_Status StreamAccGQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+Module_Status StreamMagGaussQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+Module_Status StreamTempCQ16ToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+
+Module_Status StreamQuaternionToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+Module_Status StreamQuaternionToCLI(uint32_t period, uint32_t timeout);
+Module_Status StreamQuaternionToBuffer(float *buffer, uint32_t period, uint32_t timeout);
+
+Module_Status StreamEulerToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+Module_Status StreamEulerToCLI(uint32_t period, uint32_t timeout);
+Module_Status StreamEulerToBuffer(float *buffer, uint32_t period, uint32_t timeout);
+
+Module_Status StreamHeadingToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+Module_Status StreamHeadingToCLI(uint32_t period, uint32_t timeout);
+
+/* Ring buffer streams: gyro, acc, mag and Euler rings hold 3 values, temp 1 and quaternion 4. Samples 
+	 arriving on a full ring are dropped and counted, never written over unread records. The StreamXToRing 
+	 APIs produce in the calling task until the timeout: to fill a ring in the background and only drain 
+	 it in UserTask, start a stream slot with the ring instead. */
+Module_Status InitMemsSampleRing(MemsSampleRing_t *ring, float *data, uint16_t capacity, uint8_t values);
+uint16_t GetMemsSampleRingCount(const MemsSampleRing_t *ring);
+Module_Status PeekMemsSampleRing(const MemsSampleRing_t *ring, uint32_t *timeUs, float *values);
+Module_Status ReadMemsSampleRing(MemsSampleRing_t *ring, uint32_t *timeUs, float *values);
+Module_Status StreamGyroDPSToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout);
+Module_Status StreamAccGToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout);
+Module_Status StreamMagMGaussToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout);
+Module_Status StreamTempCToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout);
+Module_Status StreamQuaternionToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout);
+Module_Status StreamEulerToRing(MemsSampleRing_t *ring, uint32_t period, uint32_t timeout);
+
+Module_Status StreamStepCountToPort(uint8_t port, uint8_t module, uint32_t period, uint32_t timeout);
+Module_Status StreamStepCountToCLI(uint32_t period, uint32_t timeout);
+#if H0BR4_ENABLE_STATS
+Module_Status StreamMemsStatsToPort(MemsFilterChannel_t channel, uint8_t port, uint8_t module, uint16_t windowSamples, 
+																		uint32_t windowMs, uint32_t timeout);
+Module_Status StreamMemsStatsToCLI(MemsFilterChannel_t channel, uint16_t windowSamples, uint32_t windowMs, uint32_t timeout);
+#endif
+
+#if H0BR4_ENABLE_FFT
+Module_Status SampleAccSpectrum(uint8_t axis, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, MemsSpectrum_t *spectrum);
+Module_Status StreamAccSpectrumToPort(uint8_t port, uint8_t module, uint8_t axis, uint16_t size, uint16_t sampleHz, 
+																			MemsFftWindow_t window, uint32_t period, uint32_t timeout);
+Module_Status StreamAccSpectrumToCLI(uint8_t axis, uint16_t size, uint16_t sampleHz, MemsFftWindow_t window, uint32_t period, 
+																		 uint32_t timeout);
+#endif
+
+#if H0BR4_ENABLE_SLOTS
+Module_Status StartMemsStreamSlot(const MemsStreamSlot_t *slot, uint8_t *index);
+Module_Status StopMemsStreamSlot(uint8_t index);
+Module_Status GetMemsStreamSlot(uint8_t index, MemsStreamSlot_t *slot);
+#endif
+Module_Status GetMemsStreamTiming(uint8_t stream, MemsStreamTiming_t *timing);
+
 void stopStreamMems(void);
+uint32_t GetMemsStreamMaxRate(void);
+
+Module_Status SetMemsAcquisitionMode(MemsAcqMode_t mode);
+MemsAcqMode_t GetMemsAcquisitionMode(void);
+Module_Status SetMemsPowerMode(MemsPowerMode_t mode);
+MemsPowerMode_t GetMemsPowerMode(void);
+Module_Status SetMemsFilter(MemsFilterChannel_t channel, MemsFilterType_t type, uint16_t param, uint8_t decimation);
+void GetMemsFilter(MemsFilterChannel_t channel, MemsFilterType_t *type, uint16_t *param, uint8_t *decimation);
+Module_Status SetMemsReport(MemsReportChannel_t channel, const MemsReportConfig_t *config);
+bool GetMemsReport(MemsReportChannel_t channel, MemsReportConfig_t *config);
+Module_Status SetMemsFifoConfig(uint16_t watermark, uint8_t gyroDecimation, uint8_t accDecimation);
+Module_Status GetMemsFifoBatch(MemsFifoBatch_t *batch);
+Module_Status SetMemsI2CSpeed(uint16_t speedKHz);
+uint16_t GetMemsI2CSpeed(void);
+Module_Status BenchmarkMemsI2C(uint32_t *blockingUs, uint32_t *asyncUs);
+
+Module_Status SetGyroConfig(uint16_t odrHz, uint16_t fullScaleDPS);
+Module_Status SetAccConfig(uint16_t odrHz, uint8_t fullScaleG, uint16_t bandwidthHz);
+Module_Status SetMagConfig(uint8_t odrHz);
+void GetGyroConfig(uint16_t *odrHz, uint16_t *fullScaleDPS);
+void GetAccConfig(uint16_t *odrHz, uint8_t *fullScaleG, uint16_t *bandwidthHz);
+void GetMagConfig(uint8_t *odrHz);
+Module_Status SetLsm303AccConfig(Lsm303AccMode_t mode, uint16_t odrHz, uint8_t fullScaleG);
+void GetLsm303AccConfig(Lsm303AccMode_t *mode, uint16_t *odrHz, uint8_t *fullScaleG);
+Module_Status SetAccChannel(MemsAccChannel_t channel);
+MemsAccChannel_t GetAccChannel(void);
+Module_Status SetAccCrossCheck(uint16_t toleranceMG);
+void GetAccCrossCheck(uint16_t *toleranceMG, uint32_t *mismatches);
+Module_Status SetMagDeclination(float degrees);
+float GetMagDeclination(void);
+Module_Status CalibrateMag(uint32_t durationMs);
+Module_Status SetMagCalibration(const MagCalibration_t *cal);
+Module_Status GetMagCalibration(MagCalibration_t *cal);
+Module_Status ClearMagCalibration(void);
+Module_Status SetGyroBiasAuto(bool enable);
+bool GetGyroBiasAuto(void);
+void GetGyroBias(float *x, float *y, float *z);
+Module_Status ClearGyroBias(void);
+Module_Status SetMotionEvents(uint8_t events, uint8_t line);
+void GetMotionEvents(uint8_t *events, uint8_t *line);
+Module_Status SetMotionThresholds(uint16_t wakeUpMG, uint16_t freeFallMG, uint16_t tapMG);
+void GetMotionThresholds(uint16_t *wakeUpMG, uint16_t *freeFallMG, uint16_t *tapMG);
+Module_Status SetMotionEventReport(uint8_t module, uint8_t port);
+uint32_t GetMotionEventCount(uint8_t *lastEvents);
+Module_Status SetPedometer(bool enable, uint8_t debounceSteps);
+void GetPedometer(bool *enabled, uint8_t *debounceSteps);
+Module_Status ResetStepCount(void);
+
+Module_Status StartFusion(uint16_t rateHz);
+void StopFusion(void);
+uint16_t GetFusionRate(void);
 
 
 /* -----------------------------------------------------------------------
@@ -0,0 +1,149 @@
+/*
+    BitzOS (BOS) V0.2.1 - Copyright (C) 2017-2020 Hexabitz
+    All rights reserved
+
+    File Name     : H0BR4_dsp.c
+    Description   : Fixed-point DSP helpers of module H0BR4.
+										Integer square root and Q15 FFT of the vibration spectrum.
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "H0BR4_dsp.h"
+
+#define FFT_STAGE_HEADROOM				13573		// 32767 / (1 + sqrt(2)): largest stage input a butterfly cannot overflow
+
+/* Private variables ---------------------------------------------------------*/
+
+/* sin(2 pi i / FFT_TABLE_SIZE) in Q15 over a quarter turn */
+static const int16_t fftSinTable[FFT_TABLE_SIZE / 4 + 1] =
+{
+	0, 402, 804, 1206, 1608, 2009, 2411, 2811, 3212, 3612, 4011, 4410,
+	4808, 5205, 5602, 5998, 6393, 6787, 7180, 7571, 7962, 8351, 8740, 9127,
+	9512, 9896, 10279, 10660, 11039, 11417, 11793, 12167, 12540, 12910, 13279, 13646,
+	14010, 14373, 14733, 15091, 15447, 15800, 16151, 16500, 16846, 17190, 17531, 17869,
+	18205, 18538, 18868, 19195, 19520, 19841, 20160, 20475, 20788, 21097, 21403, 21706,
+	22006, 22302, 22595, 22884, 23170, 23453, 23732, 24008, 24279, 24548, 24812, 25073,
+	25330, 25583, 25833, 26078, 26320, 26557, 26791, 27020, 27246, 27467, 27684, 27897,
+	28106, 28311, 28511, 28707, 28899, 29086, 29269, 29448, 29622, 29792, 29957, 30118,
+	30274, 30425, 30572, 30715, 30853, 30986, 31114, 31238, 31357, 31471, 31581, 31686,
+	31786, 31881, 31972, 32058, 32138, 32214, 32286, 32352, 32413, 32470, 32522, 32568,
+	32610, 32647, 32679, 32706, 32729, 32746, 32758, 32766, 32767
+};
+
+
+/* -----------------------------------------------------------------------
+	|																APIs	 																 	|
+   -----------------------------------------------------------------------
+*/
+
+/* Integer square root, one result bit per iteration
+*/
+uint32_t ISqrt64(uint64_t x)
+{
+	uint64_t root = 0, bit = 1ULL << 62;
+	
+	while (bit > x)
+		bit >>= 2;
+	
+	while (bit) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)root;
+}
+
+/* Sine and cosine of 2 pi i / FFT_TABLE_SIZE in Q15
+*/
+void FftSinCos(uint16_t i, int16_t *s, int16_t *c)
+{
+	uint16_t r = i % (FFT_TABLE_SIZE / 4);
+	
+	switch ((i / (FFT_TABLE_SIZE / 4)) & 3)
+	{
+		case 0: *s = fftSinTable[r]; *c = fftSinTable[FFT_TABLE_SIZE / 4 - r]; break;
+		case 1: *s = fftSinTable[FFT_TABLE_SIZE / 4 - r]; *c = -fftSinTable[r]; break;
+		case 2: *s = -fftSinTable[r]; *c = -fftSinTable[FFT_TABLE_SIZE / 4 - r]; break;
+		default: *s = -fftSinTable[FFT_TABLE_SIZE / 4 - r]; *c = fftSinTable[r]; break;
+	}
+}
+
+/* In-place radix-2 complex FFT of m interleaved Q15 values (real, imaginary). Stages are halved only 
+		when they could overflow: returns the number of halvings, the block exponent of the result.
+*/
+uint8_t FftComplexQ15(int16_t *z, uint16_t m)
+{
+	uint16_t i = 0, j = 0, k = 0, len = 0, half = 0, step = 0;
+	int32_t tr = 0, ti = 0, peak = 0;
+	int16_t s = 0, c = 0, t = 0;
+	uint8_t exponent = 0;
+	
+	// Bit-reversed order
+	for (i = 1, j = 0; i < m; i++) {
+		for (k = m >> 1; j & k; k >>= 1)
+			j ^= k;
+		j |= k;
+		if (i < j) {
+			t = z[2*i]; z[2*i] = z[2*j]; z[2*j] = t;
+			t = z[2*i + 1]; z[2*i + 1] = z[2*j + 1]; z[2*j + 1] = t;
+		}
+	}
+	
+	for (len = 2; len <= m; len <<= 1) {
+		// A butterfly output is at most (1 + sqrt(2)) times its largest input
+		for (i = 0, peak = 0; i < 2*m; i++) {
+			if (z[i] > peak)
+				peak = z[i];
+			else if (-z[i] > peak)
+				peak = -z[i];
+		}
+		if (peak > FFT_STAGE_HEADROOM) {
+			for (i = 0; i < 2*m; i++)
+				z[i] >>= 1;
+			exponent++;
+		}
+		
+		half = len / 2;
+		step = FFT_TABLE_SIZE / len;
+		for (j = 0; j < half; j++) {
+			FftSinCos(j * step, &s, &c);
+			for (i = j; i < m; i += len) {
+				k = i + half;
+				tr = ((int32_t)c * z[2*k] + (int32_t)s * z[2*k + 1] + 0x4000) >> 15;
+				ti = ((int32_t)c * z[2*k + 1] - (int32_t)s * z[2*k] + 0x4000) >> 15;
+				z[2*k] = z[2*i] - tr;
+				z[2*k + 1] = z[2*i + 1] - ti;
+				z[2*i] += tr;
+				z[2*i + 1] += ti;
+			}
+		}
+	}
+	
+	return exponent;
+}
+
+/* Twice the magnitude of bin k of a 2m-point real FFT, from the m-point complex FFT z of its even 
+		(real) and odd (imaginary) samples
+*/
+uint32_t FftRealBin(const int16_t *z, uint16_t m, uint16_t k)
+{
+	uint16_t mk = (m - k) % m;
+	int32_t er = (int32_t)z[2*k] + z[2*mk];						// Twice the even-sample spectrum
+	int32_t ei = (int32_t)z[2*k + 1] - z[2*mk + 1];
+	int32_t or = (int32_t)z[2*k + 1] + z[2*mk + 1];		// Twice the odd-sample spectrum
+	int32_t oi = (int32_t)z[2*mk] - z[2*k];
+	int64_t xr = 0, xi = 0;
+	int16_t s = 0, c = 0;
+	
+	FftSinCos(k * (FFT_TABLE_SIZE / (2*m)), &s, &c);
+	xr = er + (((int64_t)c * or + (int64_t)s * oi + 0x4000) >> 15);
+	xi = ei + (((int64_t)c * oi - (int64_t)s * or + 0x4000) >> 15);
+	
+	return ISqrt64((uint64_t)(xr * xr + xi * xi));
+}
+
+/************************ (C) COPYRIGHT HEXABITZ *****END OF FILE****/
@@ -0,0 +1,37 @@
+/*
+    BitzOS (BOS) V0.2.1 - Copyright (C) 2017-2020 Hexabitz
+    All rights reserved
+
+    File Name     : H0BR4_dsp.h
+    Description   : Header file for the H0BR4 fixed-point DSP helpers.
+										Integer square root and Q15 FFT. No HAL or RTOS dependency: also built
+										on the host by Tests/Makefile.
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef H0BR4_DSP_H
+#define H0BR4_DSP_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported definitions -------------------------------------------------------*/
+
+#define FFT_TABLE_SIZE						512			// Full turn of the sine table: FFT sizes up to 512
+#define FFT_Q15_ONE								32768
+
+
+/* -----------------------------------------------------------------------
+	|																APIs	 																 	|
+   -----------------------------------------------------------------------
+*/
+
+extern uint32_t ISqrt64(uint64_t x);
+extern void FftSinCos(uint16_t i, int16_t *s, int16_t *c);
+extern uint8_t FftComplexQ15(int16_t *z, uint16_t m);
+extern uint32_t FftRealBin(const int16_t *z, uint16_t m, uint16_t k);
+
+
+#endif /* H0BR4_DSP_H */
+
+/************************ (C) COPYRIGHT HEXABITZ *****END OF FILE****/
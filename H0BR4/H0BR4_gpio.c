@@ -73,7 +73,6 @@ void IND_LED_Init(void)
 
 void MEMS_GPIO_Init(void)
 {
-// TODO: Enable INT pins and their interrupts.
   GPIO_InitTypeDef GPIO_InitStruct;
 
   /**I2C2 GPIO Configuration
@@ -97,6 +96,31 @@ void MEMS_GPIO_Init(void)
   /* I2C2 interrupt Init */
   HAL_NVIC_SetPriority(I2C2_IRQn, 1, 0);
   HAL_NVIC_EnableIRQ(I2C2_IRQn);
+
+  /**MEMS interrupt lines (data-ready). Sensors keep them low until routed.
+  PB12     ------> IMU_INT1 (LSM6DS3 accelerometer)
+  PA6      ------> IMU_INT2 (LSM6DS3 gyroscope)
+  PA7      ------> MAG_INT (LSM303AGR magnetometer)
+  */
+  IMU_INT1_GPIO_CLK();
+  IMU_INT2_GPIO_CLK();
+  MAG_INT_GPIO_CLK();
+
+  GPIO_InitStruct.Pin = IMU_INT1_PIN;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+  GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+  GPIO_InitStruct.Speed = GPIO_SPEED_HIGH;
+  HAL_GPIO_Init(IMU_INT1_PORT, &GPIO_InitStruct);
+
+  GPIO_InitStruct.Pin = IMU_INT2_PIN;
+  HAL_GPIO_Init(IMU_INT2_PORT, &GPIO_InitStruct);
+
+  GPIO_InitStruct.Pin = MAG_INT_PIN;
+  HAL_GPIO_Init(MAG_INT_PORT, &GPIO_InitStruct);
+
+  /* EXTI interrupt Init - all three lines share EXTI4_15 */
+  HAL_NVIC_SetPriority(EXTI4_15_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(EXTI4_15_IRQn);
 }
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
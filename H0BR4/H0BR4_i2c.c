@@ -47,11 +47,52 @@
 
 I2C_HandleTypeDef hi2c2;
 
+/* MEMS transport */
+#define MEMS_I2C_TIMEOUT		100		// ms
+#define MEMS_I2C_BENCH_MAX	32		// Bytes of a benchmark read
+
+/* TIMINGR field limits */
+#define I2C_PRESC_MAX				15
+#define I2C_SCLL_MAX				255
+#define I2C_SCLH_MAX				255
+#define I2C_SDADEL_MAX			15
+#define I2C_SCLDEL_MAX			15
+
+#define I2C_AF_MIN_NS				50		// Analog filter delay, minimum
+#define I2C_DNF							0			// Digital filter, disabled in MX_I2C2_Configure
+
+/* Bus timings (ns) per I2C specification (UM10204): SCL low and high minimums, data setup minimum 
+	and the maximum rise and fall times the clock must tolerate */
+typedef struct
+{
+	uint16_t speedKHz;
+	uint16_t tLow;
+	uint16_t tHigh;
+	uint16_t tSuDat;
+	uint16_t tr;
+	uint16_t tf;
+} I2C_BusTiming_t;
+
+static const I2C_BusTiming_t busTimings[] =
+{
+	{ 100,  4700, 4000, 250, 1000, 300 },			// Standard mode
+	{ 400,  1300,  600, 100,  300, 300 },			// Fast mode
+	{ 1000,  500,  260,  50,  120, 120 },			// Fast mode Plus
+};
+
+static uint16_t busSpeedKHz = MEMS_I2C_DEFAULT_KHZ;
+
+SemaphoreHandle_t I2C2MutexHandle = NULL;
+SemaphoreHandle_t I2C2CpltSemaphoreHandle = NULL;
+volatile uint32_t I2C2IsrCycles = 0;			// CPU cycles spent in I2C2_IRQHandler
+
 /*----------------------------------------------------------------------------*/
 /* Configure I2C                                                             */
 /*----------------------------------------------------------------------------*/
 
 static void MX_I2C2_Init(void);
+static bool MEMS_I2C_Timing(uint32_t i2cClockHz, uint16_t speedKHz, uint32_t *timing);
+static HAL_StatusTypeDef MX_I2C2_Configure(uint16_t speedKHz, uint32_t timing);
 
 /** I2C Configuration
 */
@@ -65,6 +106,10 @@ void MX_I2C_Init(void)
   __GPIOF_CLK_ENABLE();   // for HSE and Boot0
 
   MX_I2C2_Init();
+	
+	/* Interrupt-driven MEMS transport */
+	I2C2MutexHandle = xSemaphoreCreateMutex();
+	I2C2CpltSemaphoreHandle = xSemaphoreCreateBinary();
 }
 
 //-- Configure indicator LED
@@ -72,8 +117,9 @@ static void MX_I2C2_Init(void)
 {
 
   hi2c2.Instance = I2C2;
-  /* hi2c2.Init.Timing = 0x2010091A; */ /* fast mode: 400 KHz */
-  hi2c2.Init.Timing = 0x20303E5D; /* Standard mode: 100 KHz */
+  /* Timing computed from PCLK1, the fixed value is kept for an unsupported clock */
+  if (!MEMS_I2C_Timing(HAL_RCC_GetPCLK1Freq(), MEMS_I2C_DEFAULT_KHZ, &hi2c2.Init.Timing))
+    hi2c2.Init.Timing = 0x20303E5D; /* Standard mode: 100 KHz */
   hi2c2.Init.OwnAddress1 = 0;
   hi2c2.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
   hi2c2.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
@@ -90,10 +136,281 @@ static void MX_I2C2_Init(void)
   HAL_I2CEx_ConfigDigitalFilter(&hi2c2, 0);
 }
 
+/*----------------------------------------------------------------------------*/
+/* I2C bus speed                                                             */
+/*----------------------------------------------------------------------------*/
+
+/* I2C kernel clock cycles covering ns nanoseconds, rounded up
+*/
+static uint32_t I2C_NsToCycles(uint32_t ns, uint32_t clkKHz)
+{
+	return (ns * clkKHz + 999999) / 1000000;
+}
+
+/* Prescaled ticks covering the given kernel clock cycles, rounded up
+*/
+static uint32_t I2C_CyclesToTicks(uint32_t cycles, uint32_t presc)
+{
+	return (cycles + presc) / (presc + 1);
+}
+
+/* Compute TIMINGR for speedKHz from the I2C kernel clock (RM0091 I2C timings section). Every 
+	field is rounded up to its specification minimum including the rise and fall times:
+		tSCLDEL >= tr + tSU;DAT
+		tSDADEL >= tf - tAF(min) - (DNF + 3) x tI2CCLK
+	The hold time is the minimum, well inside tVD;DAT(max) for the sensor bus capacitance.
+	The smallest prescaler that fits all fields gives the finest resolution.
+*/
+static bool MEMS_I2C_Timing(uint32_t i2cClockHz, uint16_t speedKHz, uint32_t *timing)
+{
+	const I2C_BusTiming_t *bus = NULL;
+	uint32_t clkKHz = i2cClockHz / 1000;
+	uint32_t presc = 0, scll = 0, sclh = 0, sdadel = 0, scldel = 0, tLow = 0, holdCycles = 0, filterCycles = 0;
+	uint8_t i = 0;
+	
+	for (i = 0; i < sizeof(busTimings) / sizeof(busTimings[0]); i++) {
+		if (busTimings[i].speedKHz == speedKHz)
+			bus = &busTimings[i];
+	}
+	if (bus == NULL || clkKHz == 0)
+		return false;
+	
+	/* Stretch SCL low so the period, edges included, does not exceed the nominal bus frequency */
+	tLow = 1000000UL / speedKHz - bus->tHigh - bus->tr - bus->tf;
+	if (tLow < bus->tLow)
+		tLow = bus->tLow;
+	
+	/* The analog filter delays SDA by at least tAF(min): rounded down, it never overstates the hold */
+	filterCycles = (I2C_AF_MIN_NS * clkKHz) / 1000000 + I2C_DNF + 3;
+	holdCycles = I2C_NsToCycles(bus->tf, clkKHz);
+	holdCycles = holdCycles > filterCycles ? holdCycles - filterCycles : 0;
+	
+	for (presc = 0; presc <= I2C_PRESC_MAX; presc++)
+	{
+		scll = I2C_CyclesToTicks(I2C_NsToCycles(tLow, clkKHz), presc);										// tSCLL = (SCLL + 1) x tPRESC
+		sclh = I2C_CyclesToTicks(I2C_NsToCycles(bus->tHigh, clkKHz), presc);							// tSCLH = (SCLH + 1) x tPRESC
+		sdadel = I2C_CyclesToTicks(holdCycles, presc);																		// tSDADEL = SDADEL x tPRESC
+		scldel = I2C_CyclesToTicks(I2C_NsToCycles(bus->tr + bus->tSuDat, clkKHz), presc);	// tSCLDEL = (SCLDEL + 1) x tPRESC
+		
+		scll = scll ? scll - 1 : 0;
+		sclh = sclh ? sclh - 1 : 0;
+		scldel = scldel ? scldel - 1 : 0;
+		
+		if (scll <= I2C_SCLL_MAX && sclh <= I2C_SCLH_MAX && sdadel <= I2C_SDADEL_MAX && scldel <= I2C_SCLDEL_MAX)
+		{
+			*timing = (presc << 28) | (scldel << 20) | (sdadel << 16) | (sclh << 8) | scll;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Re-initialize I2C2 at speedKHz (100, 400 or 1000). Waits for any transfer in progress.
+*/
+HAL_StatusTypeDef MX_I2C2_SetSpeed(uint16_t speedKHz)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	uint32_t timing = 0;
+	bool locked = false;
+	
+#if !defined(I2C_FASTMODEPLUS_I2C2)
+	/* Fm+ drive on the I2C2 pads is not available on this device */
+	if (speedKHz > 400)
+		return HAL_ERROR;
+#endif
+	
+	if (!MEMS_I2C_Timing(HAL_RCC_GetPCLK1Freq(), speedKHz, &timing))
+		return HAL_ERROR;
+	
+	/* A task suspended the scheduler, possibly in the middle of a transfer */
+	if (xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED)
+		return HAL_BUSY;
+	
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING && I2C2MutexHandle != NULL) {
+		if (xSemaphoreTake(I2C2MutexHandle, pdMS_TO_TICKS(MEMS_I2C_TIMEOUT)) != pdTRUE)
+			return HAL_BUSY;
+		locked = true;
+	}
+	
+	status = MX_I2C2_Configure(speedKHz, timing);
+	if (status == HAL_OK)
+		busSpeedKHz = speedKHz;
+	
+	if (locked)
+		xSemaphoreGive(I2C2MutexHandle);
+	
+	return status;
+}
+
+/* Re-initialize I2C2 with the given timing: also the recovery of a stuck bus. The caller holds 
+	I2C2MutexHandle once the scheduler runs.
+*/
+static HAL_StatusTypeDef MX_I2C2_Configure(uint16_t speedKHz, uint32_t timing)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	
+	HAL_I2C_DeInit(&hi2c2);
+	
+#if defined(I2C_FASTMODEPLUS_I2C2)
+	__HAL_RCC_SYSCFG_CLK_ENABLE();
+	if (speedKHz > 400)
+		HAL_I2CEx_EnableFastModePlus(I2C_FASTMODEPLUS_I2C2);
+	else
+		HAL_I2CEx_DisableFastModePlus(I2C_FASTMODEPLUS_I2C2);
+#endif
+	
+	hi2c2.Init.Timing = timing;
+	status = HAL_I2C_Init(&hi2c2);
+	
+	if (status == HAL_OK)
+		status = HAL_I2CEx_ConfigAnalogFilter(&hi2c2, I2C_ANALOGFILTER_ENABLE);
+	if (status == HAL_OK)
+		status = HAL_I2CEx_ConfigDigitalFilter(&hi2c2, 0);
+	
+	return status;
+}
+
+/*-----------------------------------------------------------*/
+
+uint16_t MX_I2C2_GetSpeed(void)
+{
+	return busSpeedKHz;
+}
+
+/*----------------------------------------------------------------------------*/
+/* MEMS transport                                                             */
+/*----------------------------------------------------------------------------*/
+
+/* Transfers are interrupt-driven once the scheduler runs: the calling task blocks on 
+	I2C2CpltSemaphoreHandle (given from the I2C callbacks in H0BR4_it.c) instead of polling 
+	the peripheral flags, so other tasks run while bytes are on the wire. */
+
+static HAL_StatusTypeDef MEMS_I2C_Transfer(I2C_HandleTypeDef *hi2c, uint16_t DevAddr, uint8_t RegAddr, 
+																					 uint8_t *pBuffer, uint16_t nBytes, bool read)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	
+	/* Blocking transfer before the scheduler starts (module and sensor initialization) */
+	if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED || I2C2MutexHandle == NULL) {
+		if (read)
+			return HAL_I2C_Mem_Read(hi2c, DevAddr, RegAddr, sizeof(RegAddr), pBuffer, nBytes, MEMS_I2C_TIMEOUT);
+		else
+			return HAL_I2C_Mem_Write(hi2c, DevAddr, RegAddr, sizeof(RegAddr), pBuffer, nBytes, MEMS_I2C_TIMEOUT);
+	}
+	
+	/* The mutex cannot be taken with the scheduler suspended, and the task it suspended may be in the 
+		middle of a transfer: refuse rather than drive the bus under it */
+	if (xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED)
+		return HAL_BUSY;
+	
+	/* One transfer at a time: sensors are sampled from several tasks */
+	if (xSemaphoreTake(I2C2MutexHandle, pdMS_TO_TICKS(MEMS_I2C_TIMEOUT)) != pdTRUE)
+		return HAL_BUSY;
+	
+	/* Drop a completion left over from a timed-out transfer */
+	xSemaphoreTake(I2C2CpltSemaphoreHandle, 0);
+	
+	if (read)
+		status = HAL_I2C_Mem_Read_IT(hi2c, DevAddr, RegAddr, sizeof(RegAddr), pBuffer, nBytes);
+	else
+		status = HAL_I2C_Mem_Write_IT(hi2c, DevAddr, RegAddr, sizeof(RegAddr), pBuffer, nBytes);
+	
+	if (status == HAL_OK) {
+		if (xSemaphoreTake(I2C2CpltSemaphoreHandle, pdMS_TO_TICKS(MEMS_I2C_TIMEOUT)) != pdTRUE) {
+			/* Bus stuck: reset the peripheral at the current speed, still holding the mutex, so the 
+				next transfer starts clean */
+			MX_I2C2_Configure(busSpeedKHz, hi2c->Init.Timing);
+			status = HAL_TIMEOUT;
+		} else if (HAL_I2C_GetError(hi2c) != HAL_I2C_ERROR_NONE) {
+			status = HAL_ERROR;
+		}
+	}
+	
+	xSemaphoreGive(I2C2MutexHandle);
+	
+	return status;
+}
+
+/*-----------------------------------------------------------*/
+
+/* CPU cycles on the RTOS tick and the SysTick count within it
+*/
+static uint32_t MEMS_I2C_Cycles(void)
+{
+	uint32_t reload = (SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1;
+	uint32_t count = 0;
+	TickType_t tick = 0;
+	
+	taskENTER_CRITICAL();
+	tick = xTaskGetTickCount();
+	count = SysTick->VAL;
+	/* Reload not yet counted by the tick interrupt */
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+		tick++;
+		count = SysTick->VAL;
+	}
+	taskEXIT_CRITICAL();
+	
+	return tick * reload + (reload - 1 - count);
+}
+
+/* CPU time in us of one nBytes register read, on the blocking path (the task polls the flags for the 
+	whole transfer) and on the interrupt-driven path (the task before it blocks and after it wakes, plus 
+	the I2C2 interrupts in between). Other interrupts during the blocking read are counted too.
+*/
+HAL_StatusTypeDef MX_I2C2_Benchmark(uint16_t DevAddr, uint8_t RegAddr, uint16_t nBytes, uint32_t *blockingUs, 
+																		uint32_t *asyncUs)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	uint8_t buffer[MEMS_I2C_BENCH_MAX];
+	uint32_t cyclesPerUs = ((SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1) / (1000 * portTICK_PERIOD_MS);
+	uint32_t start = 0, isrStart = 0, task = 0;
+	
+	if (nBytes == 0 || nBytes > MEMS_I2C_BENCH_MAX || cyclesPerUs == 0)
+		return HAL_ERROR;
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING || I2C2MutexHandle == NULL)
+		return HAL_BUSY;
+	if (xSemaphoreTake(I2C2MutexHandle, pdMS_TO_TICKS(MEMS_I2C_TIMEOUT)) != pdTRUE)
+		return HAL_BUSY;
+	
+	start = MEMS_I2C_Cycles();
+	status = HAL_I2C_Mem_Read(&hi2c2, DevAddr, RegAddr, sizeof(RegAddr), buffer, nBytes, MEMS_I2C_TIMEOUT);
+	*blockingUs = (MEMS_I2C_Cycles() - start) / cyclesPerUs;
+	
+	if (status == HAL_OK) {
+		xSemaphoreTake(I2C2CpltSemaphoreHandle, 0);
+		isrStart = I2C2IsrCycles;
+		
+		start = MEMS_I2C_Cycles();
+		status = HAL_I2C_Mem_Read_IT(&hi2c2, DevAddr, RegAddr, sizeof(RegAddr), buffer, nBytes);
+		task = MEMS_I2C_Cycles() - start;
+		
+		if (status == HAL_OK && xSemaphoreTake(I2C2CpltSemaphoreHandle, pdMS_TO_TICKS(MEMS_I2C_TIMEOUT)) != pdTRUE) {
+			MX_I2C2_Configure(busSpeedKHz, hi2c2.Init.Timing);
+			status = HAL_TIMEOUT;
+		}
+		
+		start = MEMS_I2C_Cycles();
+		if (status == HAL_OK && HAL_I2C_GetError(&hi2c2) != HAL_I2C_ERROR_NONE)
+			status = HAL_ERROR;
+		task += MEMS_I2C_Cycles() - start;
+		
+		*asyncUs = (task + (I2C2IsrCycles - isrStart)) / cyclesPerUs;
+	}
+	
+	xSemaphoreGive(I2C2MutexHandle);
+	
+	return status;
+}
+
+/*-----------------------------------------------------------*/
+
 uint8_t LSM6DS3_I2C_Write(void *handle, uint8_t WriteAddr, uint8_t *pBuffer, uint16_t nBytesToWrite)
 {
-	if (HAL_I2C_Mem_Write(handle, LSM6DS3_ACC_GYRO_I2C_ADDRESS_HIGH, WriteAddr, sizeof(WriteAddr), 
-																							pBuffer, nBytesToWrite, 100) != HAL_OK) {
+	if (MEMS_I2C_Transfer(handle, LSM6DS3_ACC_GYRO_I2C_ADDRESS_HIGH, WriteAddr, pBuffer, nBytesToWrite, false) != HAL_OK) {
 		return 1;
 	}
 	return 0;
@@ -101,17 +418,15 @@ uint8_t LSM6DS3_I2C_Write(void *handle, uint8_t WriteAddr, uint8_t *pBuffer, uin
 
 uint8_t LSM6DS3_I2C_Read(void *handle, uint8_t ReadAddr, uint8_t *pBuffer, uint16_t nBytesToRead)
 {
-	if (HAL_I2C_Mem_Read(handle, LSM6DS3_ACC_GYRO_I2C_ADDRESS_HIGH, ReadAddr, sizeof(ReadAddr), 
-		pBuffer, nBytesToRead, 100) != HAL_OK) {
-			return 1;
+	if (MEMS_I2C_Transfer(handle, LSM6DS3_ACC_GYRO_I2C_ADDRESS_HIGH, ReadAddr, pBuffer, nBytesToRead, true) != HAL_OK) {
+		return 1;
 	}
 	return 0;
 }
 
 uint8_t LSM303AGR_ACC_I2C_Write(void *handle, uint8_t WriteAddr, uint8_t *pBuffer, uint16_t nBytesToWrite)
 {
-	if (HAL_I2C_Mem_Write(handle, LSM303AGR_ACC_I2C_ADDRESS, WriteAddr, sizeof(WriteAddr), 
-																							pBuffer, nBytesToWrite, 100) != HAL_OK) {
+	if (MEMS_I2C_Transfer(handle, LSM303AGR_ACC_I2C_ADDRESS, WriteAddr, pBuffer, nBytesToWrite, false) != HAL_OK) {
 		return 1;
 	}
 	return 0;
@@ -119,17 +434,15 @@ uint8_t LSM303AGR_ACC_I2C_Write(void *handle, uint8_t WriteAddr, uint8_t *pBuffe
 
 uint8_t LSM303AGR_ACC_I2C_Read(void *handle, uint8_t ReadAddr, uint8_t *pBuffer, uint16_t nBytesToRead)
 {
-	if (HAL_I2C_Mem_Read(handle, LSM303AGR_ACC_I2C_ADDRESS, ReadAddr, sizeof(ReadAddr), 
-		pBuffer, nBytesToRead, 100) != HAL_OK) {
-			return 1;
+	if (MEMS_I2C_Transfer(handle, LSM303AGR_ACC_I2C_ADDRESS, ReadAddr, pBuffer, nBytesToRead, true) != HAL_OK) {
+		return 1;
 	}
 	return 0;
 }
 
 uint8_t LSM303AGR_MAG_I2C_Write(void *handle, uint8_t WriteAddr, uint8_t *pBuffer, uint16_t nBytesToWrite)
 {
-	if (HAL_I2C_Mem_Write(handle, LSM303AGR_MAG_I2C_ADDRESS, WriteAddr, sizeof(WriteAddr), 
-																							pBuffer, nBytesToWrite, 100) != HAL_OK) {
+	if (MEMS_I2C_Transfer(handle, LSM303AGR_MAG_I2C_ADDRESS, WriteAddr, pBuffer, nBytesToWrite, false) != HAL_OK) {
 		return 1;
 	}
 	return 0;
@@ -137,9 +450,8 @@ uint8_t LSM303AGR_MAG_I2C_Write(void *handle, uint8_t WriteAddr, uint8_t *pBuffe
 
 uint8_t LSM303AGR_MAG_I2C_Read(void *handle, uint8_t ReadAddr, uint8_t *pBuffer, uint16_t nBytesToRead)
 {
-	if (HAL_I2C_Mem_Read(handle, LSM303AGR_MAG_I2C_ADDRESS, ReadAddr, sizeof(ReadAddr), 
-		pBuffer, nBytesToRead, 100) != HAL_OK) {
-			return 1;
+	if (MEMS_I2C_Transfer(handle, LSM303AGR_MAG_I2C_ADDRESS, ReadAddr, pBuffer, nBytesToRead, true) != HAL_OK) {
+		return 1;
 	}
 	return 0;
 }
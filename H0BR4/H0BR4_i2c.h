@@ -47,11 +47,20 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f0xx_hal.h"
 
+#define MEMS_I2C_DEFAULT_KHZ		100
+
 extern I2C_HandleTypeDef hi2c2;
+extern SemaphoreHandle_t I2C2MutexHandle;
+extern SemaphoreHandle_t I2C2CpltSemaphoreHandle;
+extern volatile uint32_t I2C2IsrCycles;
 
 
 extern void MX_I2C_Init(void);
 extern void MX_I2C2_Init(void);
+extern HAL_StatusTypeDef MX_I2C2_SetSpeed(uint16_t speedKHz);
+extern uint16_t MX_I2C2_GetSpeed(void);
+extern HAL_StatusTypeDef MX_I2C2_Benchmark(uint16_t DevAddr, uint8_t RegAddr, uint16_t nBytes, uint32_t *blockingUs, 
+																					 uint32_t *asyncUs);
 
 #ifdef __cplusplus
 }
@@ -204,6 +204,79 @@ void DMA1_Ch4_7_DMA2_Ch3_5_IRQHandler(void)
 
 /*-----------------------------------------------------------*/
 
+/**
+* @brief This function handles EXTI line 4 to 15 interrupts (MEMS data-ready lines).
+*/
+void EXTI4_15_IRQHandler(void)
+{
+	/* The MEMS lines are served here rather than through HAL_GPIO_EXTI_Callback, which is left to BOS */
+	if (__HAL_GPIO_EXTI_GET_IT(IMU_INT1_PIN) != RESET) {
+		__HAL_GPIO_EXTI_CLEAR_IT(IMU_INT1_PIN);
+		MEMS_EXTI_Callback(IMU_INT1_PIN);
+	}
+	if (__HAL_GPIO_EXTI_GET_IT(IMU_INT2_PIN) != RESET) {
+		__HAL_GPIO_EXTI_CLEAR_IT(IMU_INT2_PIN);
+		MEMS_EXTI_Callback(IMU_INT2_PIN);
+	}
+	if (__HAL_GPIO_EXTI_GET_IT(MAG_INT_PIN) != RESET) {
+		__HAL_GPIO_EXTI_CLEAR_IT(MAG_INT_PIN);
+		MEMS_EXTI_Callback(MAG_INT_PIN);
+	}
+}
+
+/*-----------------------------------------------------------*/
+
+/**
+* @brief This function handles I2C2 event and error interrupts (MEMS transport).
+*/
+void I2C2_IRQHandler(void)
+{
+	uint32_t start = SysTick->VAL, end = 0;
+	
+	if (hi2c2.Instance->ISR & (I2C_FLAG_BERR | I2C_FLAG_ARLO | I2C_FLAG_OVR)) {
+		HAL_I2C_ER_IRQHandler(&hi2c2);
+	} else {
+		HAL_I2C_EV_IRQHandler(&hi2c2);
+	}
+	
+	/* SysTick counts down: CPU time of this interrupt for MX_I2C2_Benchmark */
+	end = SysTick->VAL;
+	I2C2IsrCycles += (start >= end) ? start - end : start + (SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1 - end;
+}
+
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+	
+	xSemaphoreGiveFromISR(I2C2CpltSemaphoreHandle, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+	
+	xSemaphoreGiveFromISR(I2C2CpltSemaphoreHandle, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+	
+	/* The waiting task checks the handle error code */
+	xSemaphoreGiveFromISR(I2C2CpltSemaphoreHandle, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/*-----------------------------------------------------------*/
+
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
 	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
@@ -0,0 +1,127 @@
+/*
+    BitzOS (BOS) V0.2.1 - Copyright (C) 2017-2020 Hexabitz
+    All rights reserved
+
+    File Name     : H0BR4_ring.c
+    Description   : Sample ring of module H0BR4.
+										Timed sample records passed from a stream to a reader task without a lock.
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "H0BR4_ring.h"
+
+/* Orders the record and the index that hands it over. Host builds define their own */
+#ifndef MEMS_RING_BARRIER
+#include "stm32f0xx.h"
+#define MEMS_RING_BARRIER()				__DMB()
+#endif
+
+/* Private functions ---------------------------------------------------------*/
+
+/* Ring index of the record at position pos in [0, 2 * capacity). Positions run over twice the 
+		capacity so a full ring is told from an empty one without a spare record.
+*/
+static uint16_t MemsRingIndex(const MemsSampleRing_t *ring, uint16_t pos)
+{
+	return (pos < ring->capacity) ? pos : pos - ring->capacity;
+}
+
+static uint16_t MemsRingNext(const MemsSampleRing_t *ring, uint16_t pos)
+{
+	return (pos + 1 < 2 * ring->capacity) ? pos + 1 : 0;
+}
+
+static float *MemsRingRecord(const MemsSampleRing_t *ring, uint16_t pos)
+{
+	return ring->data + (uint32_t)MemsRingIndex(ring, pos) * (1 + ring->values);
+}
+
+
+/* -----------------------------------------------------------------------
+	|																APIs	 																 	|
+   -----------------------------------------------------------------------
+*/
+
+/* Empty ring on data, which holds capacity * (1 + values) floats. false on wrong parameters
+*/
+bool MemsRingInit(MemsSampleRing_t *ring, float *data, uint16_t capacity, uint8_t values)
+{
+	if (ring == NULL || data == NULL || capacity == 0 || capacity > H0BR4_RING_MAX_RECORDS || values == 0 || 
+			values > H0BR4_RING_MAX_VALUES)
+		return false;
+	
+	memset(ring, 0, sizeof(*ring));
+	ring->data = data;
+	ring->capacity = capacity;
+	ring->values = values;
+	return true;
+}
+
+/* Records ready to read. Safe from either side: the other side can only add to it or take from it
+*/
+uint16_t MemsRingCount(const MemsSampleRing_t *ring)
+{
+	uint16_t head = ring->head, tail = ring->tail;
+	
+	return (head >= tail) ? head - tail : head + 2 * ring->capacity - tail;
+}
+
+/* Store a record on the producer side. A full ring drops it: the consumer owns the records up to head
+*/
+void MemsRingPush(MemsSampleRing_t *ring, uint32_t timeUs, const float *values)
+{
+	uint16_t head = ring->head;
+	float *record = NULL;
+	
+	if (MemsRingCount(ring) >= ring->capacity) {
+		if (!ring->dropping)
+			ring->overflows++;
+		ring->dropping = true;
+		ring->dropped++;
+		return;
+	}
+	
+	ring->dropping = false;
+	record = MemsRingRecord(ring, head);
+	memcpy(record, &timeUs, sizeof(timeUs));
+	memcpy(record + 1, values, ring->values * sizeof(float));
+	// The record is complete before the consumer can see it
+	MEMS_RING_BARRIER();
+	ring->head = MemsRingNext(ring, head);
+	ring->written++;
+}
+
+/* Copy out the oldest record, left in the ring. Consumer side. false when empty
+*/
+bool MemsRingPeek(const MemsSampleRing_t *ring, uint32_t *timeUs, float *values)
+{
+	const float *record = NULL;
+	
+	if (MemsRingCount(ring) == 0)
+		return false;
+	
+	// Head was read before the record: the producer completed it first
+	MEMS_RING_BARRIER();
+	record = MemsRingRecord(ring, ring->tail);
+	if (timeUs != NULL)
+		memcpy(timeUs, record, sizeof(*timeUs));
+	if (values != NULL)
+		memcpy(values, record + 1, ring->values * sizeof(float));
+	return true;
+}
+
+/* Take the oldest record. Consumer side. false when empty
+*/
+bool MemsRingPop(MemsSampleRing_t *ring, uint32_t *timeUs, float *values)
+{
+	if (!MemsRingPeek(ring, timeUs, values))
+		return false;
+	
+	// The record is copied out before the producer may reuse it
+	MEMS_RING_BARRIER();
+	ring->tail = MemsRingNext(ring, ring->tail);
+	return true;
+}
+
+/************************ (C) COPYRIGHT HEXABITZ *****END OF FILE****/
@@ -0,0 +1,56 @@
+/*
+    BitzOS (BOS) V0.2.1 - Copyright (C) 2017-2020 Hexabitz
+    All rights reserved
+
+    File Name     : H0BR4_ring.h
+    Description   : Header file for the H0BR4 sample ring.
+										Lock-free ring of timed sample records, one producer and one consumer.
+										No HAL or RTOS dependency: also built on the host by Tests/Makefile.
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef H0BR4_RING_H
+#define H0BR4_RING_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported definitions -------------------------------------------------------*/
+
+/* Sample ring of the ring buffer streams and stream slots: one producer, the stream, and one consumer, 
+		the reader, in any tasks and without a lock. Records are laid out as in the buffer streams: the 
+		sample time in us as a uint32_t, then the values. Set up with InitMemsSampleRing, then only use 
+		the ring APIs. */
+#define H0BR4_RING_MAX_RECORDS		32767
+#define H0BR4_RING_MAX_VALUES			4
+
+typedef struct
+{
+	float *data;									// capacity * (1 + values) words
+	uint16_t capacity;						// Records
+	uint8_t values;								// Values per record
+	volatile uint16_t head;				// Written by the producer only, in [0, 2 * capacity)
+	volatile uint16_t tail;				// Written by the consumer only, in [0, 2 * capacity)
+	volatile uint32_t written;		// Records stored
+	volatile uint32_t dropped;		// Samples lost: the ring was full
+	volatile uint32_t overflows;	// Times the ring filled up and started dropping
+	bool dropping;								// Producer state
+} MemsSampleRing_t;
+
+
+/* -----------------------------------------------------------------------
+	|																APIs	 																 	|
+   -----------------------------------------------------------------------
+*/
+
+extern bool MemsRingInit(MemsSampleRing_t *ring, float *data, uint16_t capacity, uint8_t values);
+extern uint16_t MemsRingCount(const MemsSampleRing_t *ring);
+extern void MemsRingPush(MemsSampleRing_t *ring, uint32_t timeUs, const float *values);
+extern bool MemsRingPeek(const MemsSampleRing_t *ring, uint32_t *timeUs, float *values);
+extern bool MemsRingPop(MemsSampleRing_t *ring, uint32_t *timeUs, float *values);
+
+
+#endif /* H0BR4_RING_H */
+
+/************************ (C) COPYRIGHT HEXABITZ *****END OF FILE****/
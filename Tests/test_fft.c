@@ -0,0 +1,111 @@
+/*
+    BitzOS (BOS) V0.2.1 - Copyright (C) 2017-2020 Hexabitz
+    All rights reserved
+
+    File Name     : test_fft.c
+    Description   : Host test of the H0BR4 Q15 FFT against a double-precision DFT.
+										Sines and impulses of 64 to 512 points: every bin must match the DFT
+										magnitude once the block exponent is applied, and sines must peak at
+										their own bin.
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "H0BR4_dsp.h"
+
+#define TEST_MAX_SIZE							FFT_TABLE_SIZE
+#define TEST_PI										3.14159265358979323846
+#define TEST_TOLERANCE						0.001		// Of the largest bin: Q15 rounding over log2(size) stages
+
+static int failures = 0;
+
+/* Twice the DFT magnitude of bin k of size real samples, the quantity FftRealBin returns
+*/
+static double DftBin(const int16_t *x, uint16_t size, uint16_t k)
+{
+	double re = 0, im = 0;
+	uint16_t n = 0;
+
+	for (n = 0; n < size; n++) {
+		re += x[n] * cos(2 * TEST_PI * k * n / size);
+		im -= x[n] * sin(2 * TEST_PI * k * n / size);
+	}
+	return 2 * sqrt(re * re + im * im);
+}
+
+/* Transform x in place and compare each bin below Nyquist with the DFT of a copy. peakBin is the bin
+		that must be the largest, or -1 for a flat spectrum
+*/
+static void CheckSpectrum(const char *name, int16_t *x, uint16_t size, int peakBin)
+{
+	int16_t input[TEST_MAX_SIZE];
+	double expected[TEST_MAX_SIZE / 2], got = 0, largest = 0, error = 0, worst = 0;
+	uint16_t m = size / 2, k = 0, top = 0;
+	uint32_t bin = 0, topBin = 0;
+	uint8_t exponent = 0;
+
+	for (k = 0; k < size; k++)
+		input[k] = x[k];
+	for (k = 0; k < m; k++) {
+		expected[k] = DftBin(input, size, k);
+		if (expected[k] > largest)
+			largest = expected[k];
+	}
+
+	exponent = FftComplexQ15(x, m);
+
+	for (k = 0; k < m; k++) {
+		bin = FftRealBin(x, m, k);
+		if (bin > topBin) {
+			topBin = bin;
+			top = k;
+		}
+		got = ldexp(bin, exponent);
+		error = fabs(got - expected[k]) / largest;
+		if (error > worst)
+			worst = error;
+	}
+
+	if (worst > TEST_TOLERANCE || (peakBin >= 0 && top != peakBin)) {
+		printf("FAIL %-16s %3u points: worst bin error %.4f, peak at bin %u\n", name, size, worst, top);
+		failures++;
+	} else {
+		printf("ok   %-16s %3u points: worst bin error %.4f, exponent %u\n", name, size, worst, exponent);
+	}
+}
+
+int main(void)
+{
+	int16_t x[TEST_MAX_SIZE];
+	uint16_t size = 0, n = 0, bin = 0;
+
+	for (size = 64; size <= TEST_MAX_SIZE; size <<= 1) {
+		// Full-scale and small sines, on a bin and on the bin next to Nyquist
+		for (n = 0; n < size; n++)
+			x[n] = (int16_t)lround(32000 * sin(2 * TEST_PI * 5 * n / size));
+		CheckSpectrum("sine full scale", x, size, 5);
+
+		bin = size / 2 - 1;
+		for (n = 0; n < size; n++)
+			x[n] = (int16_t)lround(300 * cos(2 * TEST_PI * bin * n / size));
+		CheckSpectrum("sine small", x, size, bin);
+
+		// Impulses: flat magnitude, and the phase ramp of a delayed one
+		for (n = 0; n < size; n++)
+			x[n] = 0;
+		x[0] = 20000;
+		CheckSpectrum("impulse", x, size, -1);
+
+		for (n = 0; n < size; n++)
+			x[n] = 0;
+		x[3] = -20000;
+		CheckSpectrum("impulse delayed", x, size, -1);
+	}
+
+	printf("%s\n", failures ? "FFT test FAILED" : "FFT test passed");
+	return failures ? 1 : 0;
+}
+
+/************************ (C) COPYRIGHT HEXABITZ *****END OF FILE****/
@@ -0,0 +1,121 @@
+/*
+    BitzOS (BOS) V0.2.1 - Copyright (C) 2017-2020 Hexabitz
+    All rights reserved
+
+    File Name     : test_ring.c
+    Description   : Host test of the H0BR4 sample ring.
+										Wraps the positions around twice the capacity, checks full and empty
+										detection and the dropped and overflow counters.
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include "H0BR4_ring.h"
+
+#define TEST_CAPACITY							5
+#define TEST_VALUES								3
+
+static int failures = 0;
+
+static void Check(int ok, const char *what)
+{
+	if (!ok) {
+		printf("FAIL %s\n", what);
+		failures++;
+	}
+}
+
+/* Store record n: time n, values n + 0.25, n + 0.5, n + 0.75
+*/
+static void Push(MemsSampleRing_t *ring, uint32_t n)
+{
+	float values[TEST_VALUES] = { n + 0.25f, n + 0.5f, n + 0.75f };
+
+	MemsRingPush(ring, n, values);
+}
+
+/* Take the oldest record and check it is record n
+*/
+static void Pop(MemsSampleRing_t *ring, uint32_t n)
+{
+	float values[TEST_VALUES];
+	uint32_t timeUs = 0;
+
+	if (!MemsRingPop(ring, &timeUs, values)) {
+		Check(0, "record missing");
+		return;
+	}
+	Check(timeUs == n && values[0] == n + 0.25f && values[1] == n + 0.5f && values[2] == n + 0.75f, "record out of order");
+}
+
+int main(void)
+{
+	MemsSampleRing_t ring;
+	float data[TEST_CAPACITY * (1 + TEST_VALUES)];
+	float values[TEST_VALUES];
+	uint32_t next = 0, expected = 0, timeUs = 0;
+	uint16_t i = 0, round = 0;
+
+	Check(!MemsRingInit(&ring, data, 0, TEST_VALUES), "zero capacity accepted");
+	Check(!MemsRingInit(&ring, data, TEST_CAPACITY, H0BR4_RING_MAX_VALUES + 1), "too many values accepted");
+	Check(MemsRingInit(&ring, data, TEST_CAPACITY, TEST_VALUES), "init failed");
+
+	// Empty
+	Check(MemsRingCount(&ring) == 0, "new ring not empty");
+	Check(!MemsRingPeek(&ring, &timeUs, values) && !MemsRingPop(&ring, &timeUs, values), "read from an empty ring");
+
+	// Single records through more than twice the capacity: head and tail wrap at 2 * capacity
+	for (i = 0; i < 3 * TEST_CAPACITY; i++) {
+		Push(&ring, next++);
+		Check(MemsRingCount(&ring) == 1, "count of one record");
+		Check(MemsRingPeek(&ring, &timeUs, NULL) && timeUs == expected, "peek");
+		Pop(&ring, expected++);
+		Check(MemsRingCount(&ring) == 0, "ring not empty after the read");
+		Check(ring.head < 2 * TEST_CAPACITY && ring.tail < 2 * TEST_CAPACITY, "position out of range");
+	}
+
+	// Fill up from every start position: full is told from empty without a spare record
+	for (round = 0; round < 2 * TEST_CAPACITY; round++) {
+		for (i = 0; i < TEST_CAPACITY; i++)
+			Push(&ring, next++);
+		Check(MemsRingCount(&ring) == TEST_CAPACITY, "full ring count");
+		Check(ring.head == ring.tail || ring.head == ring.tail + TEST_CAPACITY || ring.tail == ring.head + TEST_CAPACITY, 
+					"full positions");
+		for (i = 0; i < TEST_CAPACITY; i++)
+			Pop(&ring, expected++);
+		Check(MemsRingCount(&ring) == 0 && ring.head == ring.tail, "empty after draining");
+
+		// Shift the start position by one
+		Push(&ring, next++);
+		Pop(&ring, expected++);
+	}
+	Check(ring.written == next && ring.dropped == 0 && ring.overflows == 0, "counters without overflow");
+
+	// Overflow: samples on a full ring are dropped, never written over unread records
+	for (i = 0; i < TEST_CAPACITY + 3; i++)
+		Push(&ring, next++);
+	Check(MemsRingCount(&ring) == TEST_CAPACITY, "count after overflow");
+	Check(ring.dropped == 3 && ring.overflows == 1, "counters of one overflow");
+	for (i = 0; i < TEST_CAPACITY; i++)
+		Pop(&ring, expected++);
+	expected += 3;
+
+	// Each run of drops is one overflow: a record stored in between ends the run
+	for (i = 0; i < TEST_CAPACITY + 2; i++)
+		Push(&ring, next++);
+	Pop(&ring, expected++);
+	Push(&ring, next++);
+	Push(&ring, next++);
+	Check(ring.dropped == 3 + 2 + 1 && ring.overflows == 3, "counters of three overflows");
+	for (i = 0; i < TEST_CAPACITY - 1; i++)
+		Pop(&ring, expected++);
+	expected += 2;
+	Pop(&ring, expected++);
+	Check(MemsRingCount(&ring) == 0, "empty at the end");
+
+	printf("%s\n", failures ? "Ring test FAILED" : "Ring test passed");
+	return failures ? 1 : 0;
+}
+
+/************************ (C) COPYRIGHT HEXABITZ *****END OF FILE****/